@@ -66,16 +66,19 @@ DEVICE_CAPABILITIES_FORMAT_RAW       = 0
 DEVICE_CAPABILITIES_FORMAT_MP3       = 1
 DEVICE_CAPABILITIES_FORMAT_WAV       = 2
 DEVICE_CAPABILITIES_FORMAT_AAC       = 3
+DEVICE_CAPABILITIES_FORMAT_ADPCM     = 4
 DEVICE_CAPABILITIES_BITDEPTH_8       = 0
 DEVICE_CAPABILITIES_BITDEPTH_16      = 1
 DEVICE_CAPABILITIES_BITDEPTH_24      = 2
 DEVICE_CAPABILITIES_BITDEPTH_32      = 3
+DEVICE_CAPABILITIES_BITDEPTH_4       = 4
 DEVICE_CAPABILITIES_BITRATE_16000    = 0
 DEVICE_CAPABILITIES_BITRATE_32000    = 1
 DEVICE_CAPABILITIES_BITRATE_44100    = 2
 DEVICE_CAPABILITIES_BITRATE_48000    = 3
 DEVICE_CAPABILITIES_BITRATE_96000    = 4
 DEVICE_CAPABILITIES_BITRATE_8000     = 5
+DEVICE_CAPABILITIES_BITRATE_24000    = 6
 DEVICE_CAPABILITIES_CHANNEL_1        = 0
 DEVICE_CAPABILITIES_CHANNEL_2        = 1
 CONF_AUDIO_SEND_FORMAT               = DEVICE_CAPABILITIES_FORMAT_RAW
@@ -87,6 +90,44 @@ CONF_AUDIO_RECV_BITDEPTH             = DEVICE_CAPABILITIES_BITDEPTH_16
 CONF_AUDIO_RECV_BITRATE              = DEVICE_CAPABILITIES_BITRATE_16000
 CONF_AUDIO_RECV_CHANNEL              = DEVICE_CAPABILITIES_CHANNEL_1
 
+############################################################################################
+# Codec negotiation (requires support on the RPI Alexa Gateway)
+############################################################################################
+DEVICE_CODECS_MAGIC                  = 0x4E535641 # "AVSN"
+DEVICE_CODEC_PCM16                   = (1<<0)
+DEVICE_CODEC_ULAW                    = (1<<1)
+DEVICE_CODEC_ADPCM                   = (1<<2)
+CONF_AUDIO_NEGOTIATE                 = False
+CONF_AUDIO_SEND_CODECS               = DEVICE_CODEC_PCM16 | DEVICE_CODEC_ULAW | DEVICE_CODEC_ADPCM
+CONF_AUDIO_RECV_CODECS               = DEVICE_CODEC_PCM16 | DEVICE_CODEC_ULAW | DEVICE_CODEC_ADPCM
+
+############################################################################################
+# Framed protocol (requires support on the RPI Alexa Gateway)
+# Display cards are then received as frames instead of on the renderer port
+############################################################################################
+DEVICE_PROTOCOL_MAGIC                = 0x46535641 # "AVSF"
+DEVICE_PROTOCOL_VERSION_LENGTH       = 1
+DEVICE_PROTOCOL_VERSION_FRAMED       = 2
+DEVICE_FRAME_AUDIO                   = 0
+DEVICE_FRAME_CONTROL                 = 1
+DEVICE_FRAME_DISPLAYCARD             = 2
+DEVICE_FRAME_VOLUME                  = 3
+DEVICE_FRAME_HEARTBEAT               = 4
+DEVICE_FRAME_FLAG_END                = (1<<0)
+DEVICE_FRAME_FLAG_RESUME             = (1<<1)
+DEVICE_CONTROL_CANCEL                = 1
+DEVICE_FRAME_FORMAT                  = 'BBBBHHII'
+DEVICE_FRAME_SIZE                    = 16
+CONF_PROTOCOL_FRAMED                 = False
+
+############################################################################################
+# Streamed requests of protocol version 1 (requires support on the RPI Alexa Gateway)
+# Like avs_record_and_send_request, 0xFFFFFFFF is sent in place of the request size,
+# then each chunk is preceded by its 4-byte length and a 4-byte 0 length ends the request
+############################################################################################
+DEVICE_REQUEST_SIZE_STREAMED         = 0xFFFFFFFF
+CONF_REQUEST_STREAMED                = False
+
 ############################################################################################
 # Display cards
 ############################################################################################
@@ -113,6 +154,16 @@ g_deviceid = CONF_DEVICE_ID_DEFAULT
 g_socket = None
 g_quit = False
 g_connected = False
+g_sendcodec = DEVICE_CODEC_PCM16
+g_recvcodec = DEVICE_CODEC_PCM16
+g_protocol = DEVICE_PROTOCOL_VERSION_LENGTH
+g_sendstream = 0
+g_sendsequence = 0
+g_recvsequence = 0
+g_recvgaps = 0
+g_resumefile = None
+g_resumestream = 0
+g_resumeoffset = 0
 
 
 
@@ -129,6 +180,30 @@ def avs_set_capabilities(format, depth, rate, channel):
     cap |= (channel & DEVICE_CAPABILITIES_MASK_CHANNEL)  << DEVICE_CAPABILITIES_OFFSET_CHANNEL
     return (cap & 0xFFFF)
 
+############################################################################################
+# avs_get_codec
+############################################################################################
+def avs_get_codec(cap):
+    format = (cap >> DEVICE_CAPABILITIES_OFFSET_FORMAT) & DEVICE_CAPABILITIES_MASK_FORMAT
+    depth = (cap >> DEVICE_CAPABILITIES_OFFSET_BITDEPTH) & DEVICE_CAPABILITIES_MASK_BITDEPTH
+    if format == DEVICE_CAPABILITIES_FORMAT_ADPCM and depth == DEVICE_CAPABILITIES_BITDEPTH_4:
+        return DEVICE_CODEC_ADPCM
+    elif format == DEVICE_CAPABILITIES_FORMAT_RAW and depth == DEVICE_CAPABILITIES_BITDEPTH_8:
+        return DEVICE_CODEC_ULAW
+    elif format == DEVICE_CAPABILITIES_FORMAT_RAW and depth == DEVICE_CAPABILITIES_BITDEPTH_16:
+        return DEVICE_CODEC_PCM16
+    return 0
+
+############################################################################################
+# avs_decode
+############################################################################################
+def avs_decode(data, state):
+    if g_recvcodec == DEVICE_CODEC_ADPCM:
+        return audioop.adpcm2lin(data, 2, state)
+    elif g_recvcodec == DEVICE_CODEC_ULAW:
+        return (audioop.ulaw2lin(data, 2), state)
+    return (data, state)
+
 ############################################################################################
 # avs_connect
 ############################################################################################
@@ -137,6 +212,13 @@ def avs_connect():
     global g_socket
     global g_serveraddr
     global g_serverport
+    global g_sendcodec
+    global g_recvcodec
+    global g_protocol
+    global g_sendsequence
+    global g_recvsequence
+    global g_resumestream
+    global g_resumeoffset
 
     g_socket = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
     try:
@@ -161,6 +243,43 @@ def avs_connect():
         # Send device info
         g_socket.sendall(buf)
 
+        # Send the supported codecs and receive the codecs selected by the gateway
+        if CONF_AUDIO_NEGOTIATE:
+            buf = struct.pack('IHH', DEVICE_CODECS_MAGIC, CONF_AUDIO_SEND_CODECS, CONF_AUDIO_RECV_CODECS)
+            g_socket.sendall(buf)
+            timeval = struct.pack('ll', CONF_TIMEOUT_RECV, 0)
+            g_socket.setsockopt(socket.SOL_SOCKET, socket.SO_RCVTIMEO, timeval)
+            buf = g_socket.recv(8, socket.MSG_WAITALL)
+            deviceid, sendCap, recvCap = struct.unpack('IHH', buf)
+            if not (avs_get_codec(sendCap) & CONF_AUDIO_SEND_CODECS) or not (avs_get_codec(recvCap) & CONF_AUDIO_RECV_CODECS):
+                print("codec negotiation failed {:04x} {:04x}".format(sendCap, recvCap))
+                g_socket.close()
+                return 0
+
+        g_sendcodec = avs_get_codec(sendCap)
+        g_recvcodec = avs_get_codec(recvCap)
+
+        # Send the protocol version and the interrupted upload
+        # and receive the protocol selected by the gateway and the bytes of the upload it has
+        g_protocol = DEVICE_PROTOCOL_VERSION_LENGTH
+        if CONF_PROTOCOL_FRAMED:
+            buf = struct.pack('IHHI', DEVICE_PROTOCOL_MAGIC, DEVICE_PROTOCOL_VERSION_FRAMED, g_resumestream, 0)
+            g_socket.sendall(buf)
+            timeval = struct.pack('ll', CONF_TIMEOUT_RECV, 0)
+            g_socket.setsockopt(socket.SOL_SOCKET, socket.SO_RCVTIMEO, timeval)
+            buf = g_socket.recv(12, socket.MSG_WAITALL)
+            magic, version, stream, offset = struct.unpack('IHHI', buf)
+            if magic != DEVICE_PROTOCOL_MAGIC or version < DEVICE_PROTOCOL_VERSION_LENGTH or version > DEVICE_PROTOCOL_VERSION_FRAMED:
+                print("protocol negotiation failed {:08x} {}".format(magic, version))
+                g_socket.close()
+                return 0
+            g_protocol = version
+            g_sendsequence = 0
+            g_recvsequence = 0
+            if version < DEVICE_PROTOCOL_VERSION_FRAMED or stream != g_resumestream:
+                g_resumestream = 0
+            g_resumeoffset = offset
+
     except:
         g_socket.close()
         return 0
@@ -175,12 +294,27 @@ def avs_disconnect():
     global g_socket
     g_socket.close()
 
+############################################################################################
+# avs_send_frame
+############################################################################################
+def avs_send_frame(type, flags, subtype, stream, offset, payload):
+
+    global g_socket
+    global g_sendsequence
+
+    buf = struct.pack(DEVICE_FRAME_FORMAT, type, flags, subtype, 0, stream, g_sendsequence & 0xFFFF, offset, len(payload))
+    g_sendsequence += 1
+    g_socket.sendall(buf + payload)
+
 ############################################################################################
 # avs_send_audio
 ############################################################################################
-def avs_send_audio(file_name):
+def avs_send_audio(file_name, offset=0):
 
     global g_socket
+    global g_sendstream
+    global g_resumefile
+    global g_resumestream
     
     # Get file size
     file_size = 0
@@ -193,31 +327,80 @@ def avs_send_audio(file_name):
     file_bytes = file.read(file_size)
     file.close()
 
-    # Compress file bytes from 16-bit to 8-bit
-    if CONF_AUDIO_SEND_BITDEPTH == DEVICE_CAPABILITIES_BITDEPTH_8:
+    # Compress file bytes from 16-bit to 8-bit or 4-bit
+    # A resumed upload is compressed from the offset with a reset IMA-ADPCM state
+    if g_sendcodec == DEVICE_CODEC_ADPCM:
+        file_bytes = file_bytes[offset<<2:]
+        file_bytes = bytes(offset) + audioop.lin2adpcm(file_bytes[:len(file_bytes) & ~3], 2, None)[0]
+    elif g_sendcodec == DEVICE_CODEC_ULAW:
         file_bytes = audioop.lin2ulaw(file_bytes, 2)
     file_size = len(file_bytes)
 
     # Send size of Alexa request
     timeval = struct.pack('ll', CONF_TIMEOUT_SEND, 0)
     g_socket.setsockopt(socket.SOL_SOCKET, socket.SO_SNDTIMEO, timeval)
-    val = struct.pack('i', file_size)
-    g_socket.sendall(val)
+    if g_protocol < DEVICE_PROTOCOL_VERSION_FRAMED:
+        if CONF_REQUEST_STREAMED:
+            val = struct.pack('I', DEVICE_REQUEST_SIZE_STREAMED)
+        else:
+            val = struct.pack('i', file_size)
+        g_socket.sendall(val)
+    elif offset == 0:
+        g_resumestream = 0
+        g_sendstream = (g_sendstream + 1) & 0xFFFF or 1
 
     # Send Alexa request
     # send in chunks instead of sending all to simulate RS485 slowness
     # g_socket.sendall(bytes(file_bytes))
-    sent_data = 0
+    sent_data = offset
     send_size = CONF_CHUNK_SIZE
     file_bytes = bytes(file_bytes)
     #print("{}".format(file_size))
     while sent_data < file_size:
         if file_size - sent_data < send_size:
             send_size = file_size - sent_data
-        g_socket.sendall(file_bytes[sent_data:sent_data+send_size])
+        if g_protocol < DEVICE_PROTOCOL_VERSION_FRAMED:
+            if CONF_REQUEST_STREAMED:
+                g_socket.sendall(struct.pack('I', send_size) + file_bytes[sent_data:sent_data+send_size])
+            else:
+                g_socket.sendall(file_bytes[sent_data:sent_data+send_size])
+        else:
+            flags = 0
+            if sent_data + send_size == file_size:
+                flags |= DEVICE_FRAME_FLAG_END
+            if offset and sent_data == offset:
+                flags |= DEVICE_FRAME_FLAG_RESUME
+            try:
+                avs_send_frame(DEVICE_FRAME_AUDIO, flags, 0, g_sendstream, sent_data, file_bytes[sent_data:sent_data+send_size])
+            except:
+                # resume from here after the next avs_connect
+                g_resumefile = file_name
+                g_resumestream = g_sendstream
+                raise
         sent_data += send_size
         #print("{} {}".format(send_size, sent_data))
 
+    # End of streamed request
+    if g_protocol < DEVICE_PROTOCOL_VERSION_FRAMED and CONF_REQUEST_STREAMED:
+        g_socket.sendall(struct.pack('I', 0))
+
+############################################################################################
+# avs_resume_audio
+############################################################################################
+def avs_resume_audio():
+
+    global g_sendstream
+    global g_resumestream
+
+    if g_resumestream == 0 or g_protocol < DEVICE_PROTOCOL_VERSION_FRAMED:
+        return False
+
+    print("\n[COMMANDER] Resuming Alexa query [{}] from {}...".format(g_resumefile, g_resumeoffset))
+    g_sendstream = g_resumestream
+    g_resumestream = 0
+    avs_send_audio(g_resumefile, g_resumeoffset)
+    return True
+
 ############################################################################################
 # avs_recv_audio
 ############################################################################################
@@ -225,6 +408,10 @@ def avs_recv_audio(queue_data):
 
     global g_socket
     global g_quit
+
+    if g_protocol >= DEVICE_PROTOCOL_VERSION_FRAMED:
+        avs_recv_frames(queue_data)
+        return
     
     try:
         val = g_socket.recv(4)
@@ -235,6 +422,7 @@ def avs_recv_audio(queue_data):
             file_size_recv = struct.unpack('I', val[:])[0]
             recv_size = CONF_CHUNK_SIZE
             recved_size = 0
+            state = None
             #print("streaming {} bytes".format(file_size_recv))
 
             while g_quit is False:
@@ -258,7 +446,8 @@ def avs_recv_audio(queue_data):
                     if recved_size == file_size_recv:
                         break
 
-                    # queue the data
+                    # queue the decompressed data
+                    data, state = avs_decode(data, state)
                     queue_data.put(data)
                     # print("queue_data.put {}".format(len_data))
 
@@ -275,6 +464,74 @@ def avs_recv_audio(queue_data):
 
     return
 
+############################################################################################
+# avs_recv_frames
+# Receives the frames of the framed protocol until the end of a response
+############################################################################################
+def avs_recv_frames(queue_data):
+
+    global g_socket
+    global g_quit
+    global g_recvsequence
+    global g_recvgaps
+
+    state = None
+    displaycard = bytes()
+    while g_quit is False:
+        try:
+            val = g_socket.recv(DEVICE_FRAME_SIZE, socket.MSG_WAITALL)
+            if len(val) < DEVICE_FRAME_SIZE:
+                print("recv error")
+                g_quit = True
+                break
+            type, flags, subtype, reserved, stream, sequence, offset, length = struct.unpack(DEVICE_FRAME_FORMAT, val)
+            data = bytes()
+            if length:
+                data = g_socket.recv(length, socket.MSG_WAITALL)
+                if len(data) < length:
+                    print("Error: recv failed! not data")
+                    g_quit = True
+                    break
+        except (socket.timeout, BlockingIOError):
+            continue
+        except:
+            print("avs_recv_frames exception")
+            g_quit = True
+            break
+
+        # count the frames lost
+        if sequence != g_recvsequence:
+            print("\n[STREAMER] Sequence {} expected {}".format(sequence, g_recvsequence))
+            g_recvgaps += (sequence - g_recvsequence) & 0xFFFF
+        g_recvsequence = (sequence + 1) & 0xFFFF
+
+        if type == DEVICE_FRAME_AUDIO:
+            # queue the decompressed data
+            if offset == 0 or (flags & DEVICE_FRAME_FLAG_RESUME):
+                state = None
+            if len(data):
+                data, state = avs_decode(data, state)
+                queue_data.put(data)
+            if flags & DEVICE_FRAME_FLAG_END:
+                break
+        elif type == DEVICE_FRAME_CONTROL:
+            if subtype == DEVICE_CONTROL_CANCEL:
+                print("\n[STREAMER] Response {} cancelled".format(stream))
+                break
+        elif type == DEVICE_FRAME_DISPLAYCARD:
+            # print the display card once complete
+            if offset == 0:
+                displaycard = bytes()
+            displaycard += data
+            if flags & DEVICE_FRAME_FLAG_END:
+                print('\n[STREAMER] Display card {}:{}'.format(len(displaycard), subtype))
+                g_renderer.printDataType(subtype)
+                g_renderer.printJSON(displaycard, subtype)
+        elif type == DEVICE_FRAME_VOLUME:
+            print("\n[STREAMER] Volume {}%".format(offset))
+
+    return
+
 ############################################################################################
 # avs_play_audio
 ############################################################################################
@@ -289,9 +546,7 @@ def avs_play_audio(queue_data, stream):
         return False
     #print("queue_data.get {}".format(len(data)))
 
-    # Decompress and play data
-    if CONF_AUDIO_RECV_BITDEPTH == DEVICE_CAPABILITIES_BITDEPTH_8:
-        data = audioop.ulaw2lin(data, 2)
+    # Play data
     stream.write(data)
 
     queue_data.task_done()
@@ -318,6 +573,8 @@ def avs_recv_and_play_audio():
         bitrate = 48000
     elif (CONF_AUDIO_RECV_BITRATE == DEVICE_CAPABILITIES_BITRATE_8000):
         bitrate = 8000
+    elif (CONF_AUDIO_RECV_BITRATE == DEVICE_CAPABILITIES_BITRATE_24000):
+        bitrate = 24000
 
     # Get the channel based on configuration
     channel = 0
@@ -338,6 +595,7 @@ def avs_recv_and_play_audio():
             file_size_recv = struct.unpack('I', val[:])[0]
             recv_size = CONF_CHUNK_SIZE
             recved_size = 0
+            state = None
             #print("streaming {} bytes".format(file_size_recv))
 
             while g_quit is False:
@@ -361,8 +619,7 @@ def avs_recv_and_play_audio():
                         break
 
                     # play recvd data
-                    if CONF_AUDIO_RECV_BITDEPTH == DEVICE_CAPABILITIES_BITDEPTH_8:
-                        data = audioop.ulaw2lin(data, 2)
+                    data, state = avs_decode(data, state)
                     stream.write(data)
 
                     # compute bytes to recv
@@ -406,6 +663,8 @@ class thread_player(threading.Thread):
             bitrate = 48000
         elif (CONF_AUDIO_RECV_BITRATE == DEVICE_CAPABILITIES_BITRATE_8000):
             bitrate = 8000
+        elif (CONF_AUDIO_RECV_BITRATE == DEVICE_CAPABILITIES_BITRATE_24000):
+            bitrate = 24000
 
         # Get the channel based on configuration
         channel = 0
@@ -470,6 +729,12 @@ class thread_streamer(threading.Thread):
             usage()
             g_connected = True
 
+            # Send the rest of the query interrupted by the disconnection
+            try:
+                avs_resume_audio()
+            except:
+                print("\n[STREAMER] avs_resume_audio exception!")
+
         while g_quit is False:
             try: 
                 avs_recv_audio(self.queue_data)
@@ -530,6 +795,10 @@ class thread_renderer(threading.Thread):
         while not g_connected:
             sleep(1)
 
+        # Display cards are received by the streamer with the framed protocol
+        if g_protocol >= DEVICE_PROTOCOL_VERSION_FRAMED:
+            return
+
         if g_quit is False:
             try:
                 socket_handle = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
@@ -809,6 +1078,10 @@ class thread_renderer(threading.Thread):
             print(len(json_payload))
 
 
+# Display cards of the framed protocol are printed with the renderer methods
+g_renderer = thread_renderer()
+
+
 ############################################################################################
 # Usage
 ############################################################################################
@@ -126,6 +126,8 @@
 #define configUSE_PREEMPTION                        0
 #elif (COMMUNICATION_IO==2) // WiFi
 #define configUSE_PREEMPTION                        1
+#elif (COMMUNICATION_IO==3) // RS485
+#define configUSE_PREEMPTION                        1
 #endif
 #define configUSE_IDLE_HOOK                         0
 #define configUSE_TICK_HOOK                         0
@@ -142,6 +144,8 @@
 #define configUSE_TIMERS                            0
 #elif (COMMUNICATION_IO==2) // WiFi
 #define configUSE_TIMERS                            1
+#elif (COMMUNICATION_IO==3) // RS485
+#define configUSE_TIMERS                            0
 #endif
 #define configQUEUE_REGISTRY_SIZE                   0U
 #define configCHECK_FOR_STACK_OVERFLOW              0       //0, 1, or 2
@@ -206,7 +210,7 @@
 #define INCLUDE_xEventGroupSetBitFromISR            0
 #define INCLUDE_xTimerPendFunctionCall              0
 #define INCLUDE_xTaskGetSchedulerState              0
-#define INCLUDE_xTaskGetCurrentTaskHandle           0
+#define INCLUDE_xTaskGetCurrentTaskHandle           1
 #define INCLUDE_vTaskCleanUpResources               0
 
 /* Trace. */
@@ -21,10 +21,14 @@
 ///////////////////////////////////////////////////////////////////////////////////
 #if (COMMUNICATION_IO==1) || (COMMUNICATION_IO==2)
 #define AVS_CONFIG_SERVER_ADDR          PP_HTONL(LWIP_MAKEU32(192, 168, 100, 12))
+#elif (COMMUNICATION_IO==3) // RS485
+// The serial bridge of the gateway connects to the server for the device
+// 0 selects the server given to the bridge, else ((a<<24)|(b<<16)|(c<<8)|d)
+#define AVS_CONFIG_SERVER_ADDR          (0)
+#endif // COMMUNICATION_IO
 #if AVS_CONFIG_DIFFERENT_ACCOUNT
 #define AVS_CONFIG_SERVER_PORT          (11234 + AVS_CONFIG_DEVICE_ID)
 #endif // AVS_CONFIG_DIFFERENT_ACCOUNT
-#endif // (COMMUNICATION_IO==1) || (COMMUNICATION_IO==2)
 
 
 ///////////////////////////////////////////////////////////////////////////////////
@@ -41,8 +45,9 @@
 #define AVS_CONFIG_WIFI_PASSWORD        "MahirapTandaan"
 #define AVS_CONFIG_WIFI_SECURITY        eWiFiSecurityWPA2
 #elif (COMMUNICATION_IO==3) // RS485
-// TODO
-#endif // (COMMUNICATION_IO==2) // WiFi
+#define AVS_CONFIG_RS485_BAUD           (2000000)
+#define AVS_CONFIG_RS485_ADDRESS        AVS_CONFIG_DEVICE_ID  // polled by the bridge, [1, 127]
+#endif // COMMUNICATION_IO
 
 
 
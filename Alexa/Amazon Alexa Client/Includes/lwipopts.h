@@ -162,6 +162,7 @@
 #define LWIP_PROVIDE_ERRNO         0
 #define LWIP_SO_SNDTIMEO           1
 #define LWIP_SO_RCVTIMEO           1
+#define LWIP_SO_LINGER             1
 #define LWIP_SO_RCVBUF             0
 
 #define LWIP_TCPIP_CORE_LOCKING    0
@@ -65,7 +65,6 @@
 #include "net.h"
 #include "wifi.h"
 #elif (COMMUNICATION_IO==3) // RS485
-// TODO RS485
 #endif // COMMUNICATION_IO
 
 
@@ -84,6 +83,8 @@
 ///////////////////////////////////////////////////////////////////////////////////
 /* Configurables */
 #define USE_RECVPLAY_RESPONSE           1
+#define USE_RECVPLAY_THREADED           1 // Requires USE_MULTITHREADED_RECVPLAY in avs.c
+#define USE_RECORDSEND_REQUEST          0 // Requires gateway support for AVS_REQUEST_SIZE_STREAMED
 #define BUTTON_GPIO                     (31)
 ///////////////////////////////////////////////////////////////////////////////////
 
@@ -136,10 +137,14 @@ static inline void wifi_setup(void)
     gpio_function(55, pad_uart1_cts); /* UART1 CTS MM900EVxA CN3 pin 11 */
     interrupt_enable_globally();
 }
-#elif (COMMUNICATION_IO==3) // WiFi
+#elif (COMMUNICATION_IO==3) // RS485
 static inline void rs485_setup(void)
 {
-    // TODO RS485
+    sys_enable(sys_device_uart1);
+    gpio_function(52, pad_uart1_txd); /* UART1 TXD to the transceiver DI */
+    gpio_function(53, pad_uart1_rxd); /* UART1 RXD to the transceiver RO */
+    gpio_function(56, pad_uart1_dtr); /* UART1 DTR to the transceiver DE and /RE */
+    interrupt_enable_globally();
 }
 #endif // COMMUNICATION_IO
 
@@ -214,7 +219,7 @@ static inline void display_communication_info()
     DEBUG_PRINTF( "GW=%s\r\n", ucGateway );
     DEBUG_PRINTF( "MA=%s\r\n", ucMask );
 #elif (COMMUNICATION_IO==3)   // RS485
-    // TODO RS485
+    DEBUG_PRINTF( "RS485=%d baud, address %d\r\n", AVS_CONFIG_RS485_BAUD, AVS_CONFIG_RS485_ADDRESS );
 #endif
 }
 
@@ -271,7 +276,7 @@ static inline void initialize_communication()
         vTaskDelay(pdMS_TO_TICKS(5000));
     }
 #elif (COMMUNICATION_IO==3)   // RS485
-    // TODO RS485
+    // The link is opened by avs_init and connected through the serial bridge of the gateway
 #endif // COMMUNICATION_IO
     display_communication_info();
 }
@@ -303,10 +308,19 @@ static char g_cSendCommand = SEND_COMMAND_RESET;
 static char g_cRecordVoice = 0;
 static char g_cQuit = 0;
 static char g_cVolumeIncrease = 0;
+#if AVS_CONFIG_TRACE
+static char g_cDumpTrace = 0;
+#endif
 
+// Keeps the microphone and the speaker from running at the same time, and lets a new query
+// interrupt the response being played. The send and the receive of libavs can overlap
+// (comm_wrapper socket event task) but this application does not use it; test/host avs_bench does.
 static SemaphoreHandle_t g_xMutexRecordPlay;
 static char cbRecordVoice(void);
 static char cbSendTriggered(void);
+#if AVS_CONFIG_TRACE
+static void cbDumpTrace(const void* pvData, unsigned int ulSize);
+#endif
 
 enum {
     REQUEST_RECORD,
@@ -367,6 +381,9 @@ static void usage(void)
     DEBUG_PRINTF("  Press '+' to increase volume.\r\n");
     DEBUG_PRINTF("  Press '-' to decrease volume.\r\n");
     DEBUG_PRINTF("  Press 'q' to quit and restart.\r\n");
+#if AVS_CONFIG_TRACE
+    DEBUG_PRINTF("  Press 'e' to dump the event trace.\r\n");
+#endif
     DEBUG_PRINTF("\r\n");
 }
 
@@ -450,6 +467,13 @@ void vIsrAlexaButton(void)
                     g_cQuit = 1;
                     break;
                 }
+#if AVS_CONFIG_TRACE
+                case 'E':
+                case 'e': { // event trace
+                    g_cDumpTrace = 1;
+                    break;
+                }
+#endif
                 default: {
                     break;
                 }
@@ -523,7 +547,6 @@ loop:
 #elif (COMMUNICATION_IO==2)   // WiFi
         // TODO WiFi
 #elif (COMMUNICATION_IO==3)   // RS485
-        // TODO RS485
 #endif // COMMUNICATION_IO
 
         // Handle quit command and disconnection
@@ -547,8 +570,13 @@ loop:
         if (!avs_isconnected()) {
             lRet = 0;
             do {
+#if (COMMUNICATION_IO==3)   // RS485
+                DEBUG_PRINTF("\r\nConnecting to Alexa provider... RS485 bridge:%d [id:0x%08x]\r\n",
+                    avs_get_server_port(), avs_get_device_id());
+#else
                 DEBUG_PRINTF("\r\nConnecting to Alexa provider... %s:%d [id:0x%08x]\r\n",
                     ipaddr_ntoa(avs_get_server_addr()), avs_get_server_port(), avs_get_device_id());
+#endif
                 if (!avs_connect()) {
                     if (avs_err()) {
                         goto loop;
@@ -564,6 +592,14 @@ loop:
 
             DEBUG_PRINTF("\r\nConnected to Alexa provider!\r\n");
             usage();
+
+            // Send the rest of the query interrupted by the disconnection
+            xSemaphoreTake(g_xMutexRecordPlay, pdMS_TO_TICKS(portMAX_DELAY));
+            lRet = avs_resume_request();
+            xSemaphoreGive(g_xMutexRecordPlay);
+            if (lRet >= 0) {
+                DEBUG_PRINTF("\r\nResuming Alexa query...%s\r\n", lRet ? "OK" : "FAILED!");
+            }
         }
 
         // Set volume
@@ -573,6 +609,15 @@ loop:
             DEBUG_PRINTF("\r\nSetting volume [%d%%]...OK\r\n", avs_get_volume());
         }
 
+#if AVS_CONFIG_TRACE
+        // Dump the event trace as binary between the logs; test/host/avs_trace decodes the capture
+        if (g_cDumpTrace) {
+            g_cDumpTrace = 0;
+            lRet = avs_trace_dump(cbDumpTrace);
+            DEBUG_PRINTF("\r\nDumped %d events\r\n", lRet);
+        }
+#endif
+
         // No command is set
         if (g_cSendCommand == SEND_COMMAND_RESET) {
             vTaskDelay(pdMS_TO_TICKS(500));
@@ -583,12 +628,17 @@ loop:
             if (g_cRecordVoice) {
                 xSemaphoreTake(g_xMutexRecordPlay, pdMS_TO_TICKS(portMAX_DELAY));
 
+#if USE_RECORDSEND_REQUEST
+                DEBUG_PRINTF("\r\nRecording and sending Alexa query [%s]...", g_pcREQUEST[(int)g_cSendCommand]);
+                lRet = avs_record_and_send_request(cbRecordVoice);
+#else // USE_RECORDSEND_REQUEST
                 DEBUG_PRINTF("\r\nRecording Alexa query [%s]...\r\n", g_pcREQUEST[(int)g_cSendCommand]);
                 avs_record_request(g_pcREQUESTfile[(int)g_cSendCommand], cbRecordVoice);
                 DEBUG_PRINTF("\r\nRecorded Alexa query [%s]...OK\r\n", g_pcREQUEST[(int)g_cSendCommand]);
 
                 DEBUG_PRINTF("\r\nSending Alexa query [%s]...", g_pcREQUEST[(int)g_cSendCommand]);
                 lRet = avs_send_request(g_pcREQUESTfile[(int)g_cSendCommand]);
+#endif // USE_RECORDSEND_REQUEST
                 if (!lRet) {
                     DEBUG_PRINTF("FAILED!\r\n");
                 }
@@ -638,7 +688,6 @@ void vTaskAlexaStreamer(void *pvParameters)
         }
 #elif (COMMUNICATION_IO==2)   // WiFi
 #elif (COMMUNICATION_IO==3)   // RS485
-        // TODO RS485
 #endif // COMMUNICATION_IO
 
         if (!avs_isconnected()) {
@@ -650,7 +699,11 @@ void vTaskAlexaStreamer(void *pvParameters)
             if (g_cSendCommand == SEND_COMMAND_RESET) {
 #if USE_RECVPLAY_RESPONSE
                 xSemaphoreTake(g_xMutexRecordPlay, pdMS_TO_TICKS(portMAX_DELAY));
+#if USE_RECVPLAY_THREADED
+                lRet = avs_recv_and_play_response_threaded(cbSendTriggered);
+#else // USE_RECVPLAY_THREADED
                 lRet = avs_recv_and_play_response(cbSendTriggered);
+#endif // USE_RECVPLAY_THREADED
                 if (!lRet) {
                     xSemaphoreGive(g_xMutexRecordPlay);
                     break;
@@ -691,3 +744,10 @@ char cbSendTriggered(void)
 }
 
 
+
+#if AVS_CONFIG_TRACE
+void cbDumpTrace(const void* pvData, unsigned int ulSize)
+{
+    uart_writen(UART0, (uint8_t*)pvData, ulSize);
+}
+#endif
@@ -2,6 +2,11 @@
 #define AVS_H
 
 
+// Length sent in place of the request size by avs_record_and_send_request.
+// It is followed by [4-byte length][payload] frames and a 4-byte 0 length ends the request.
+#define AVS_REQUEST_SIZE_STREAMED  (0xFFFFFFFF)
+
+
 int  avs_init(void);
 void avs_free(void);
 
@@ -9,9 +14,10 @@ int  avs_connect(void);
 void avs_disconnect(void);
 int avs_isconnected(void);
 
-// - Read 2KB from microphone
-// - Convert 2KB stereo to 1KB mono
-// - Save 1KB to SD card
+// - Read 2KB mono from microphone ring (filled by I2S interrupt)
+// - Save 2KB to SD card
+// With AVS_CONFIG_VAD, the silence before the preroll of the speech is skipped and recording stops
+// at the end of speech; if speech is never detected, the whole recording is saved
 int  avs_record_request(const char* pcFileName, char (*fxnCallbackRecord)(void));
 
 // - Read 4KB from SD card
@@ -19,6 +25,17 @@ int  avs_record_request(const char* pcFileName, char (*fxnCallbackRecord)(void))
 // - Send 2KB to RPI
 int  avs_send_request  (const char* pcFileName);
 
+// With AVS_CONFIG_PROTOCOL_FRAMED, sends the rest of the avs_send_request upload
+// interrupted by a disconnection; call after avs_connect. Returns -1 if there is none.
+int  avs_resume_request(void);
+
+// - Read 1KB mono from microphone ring (filled by I2S interrupt)
+// - Convert 1KB 16-bit to 512 bytes 8-bit
+// - Send 512 bytes to RPI while still recording
+// With AVS_CONFIG_VAD, recording stops at the end of speech; the leading silence already sent
+// cannot be taken back so only the trailing silence is skipped
+int  avs_record_and_send_request(char (*fxnCallbackRecord)(void));
+
 // - Recv 2KB from RPI
 // - Convert 8-bit to 16-bit
 // - Save 4KB to SD card
@@ -34,14 +51,12 @@ int  avs_play_response (const char* pcFileName);
 // - Play 2KB on speaker
 int  avs_recv_and_play_response(char (*fxnCallbackExit)(void));
 
-// - Recv 2KB from RPI
-// - Convert 8-bit to 16-bit (1KB)
-// - Save 4KB to SD card
+// - Recv 1KB from RPI into the jitter buffer
 // - thread
-//   Read 4KB from SD card
-//   For each 1KB, convert from mono (1KB) to stereo (2KB)
+//   Wait for the prebuffer watermark
+//   Convert 8-bit mono (512) from the jitter buffer to 16-bit stereo (2KB)
 //   Play 2KB on speaker
-int  avs_recv_and_play_response_threaded(const char* pcFileName);
+int  avs_recv_and_play_response_threaded(char (*fxnCallbackExit)(void));
 
 
 unsigned int avs_get_device_id(void);
@@ -53,5 +68,25 @@ int  avs_err(void);
 void avs_set_volume(int rate);
 int  avs_get_volume(void);
 
+unsigned int avs_get_jitter_underruns(void);
+unsigned int avs_get_jitter_overruns(void);
+unsigned int avs_get_jitter_watermark(void);
+
+// Speech start and end in milliseconds from the start of the last recording (AVS_CONFIG_VAD)
+unsigned int avs_get_speech_start(void);
+unsigned int avs_get_speech_end(void);
+
+// Frames of the responses lost (AVS_CONFIG_PROTOCOL_FRAMED)
+unsigned int avs_get_sequence_gaps(void);
+
+// Display cards received between the audio of the responses (AVS_CONFIG_PROTOCOL_FRAMED)
+// Called for each chunk of a card; bEnd is set on the last chunk.
+void avs_set_displaycard_callback(void (*fxnCallbackDisplayCard)(int lType, unsigned int ulOffset, const char* pcData, unsigned int ulSize, char bEnd));
+
+// Timestamped events of the request and response stages (AVS_CONFIG_TRACE)
+// Writes the events recorded since the last dump as binary (test/host/avs_trace decodes it)
+// and empties the event ring. Returns the events written.
+unsigned int avs_trace_dump(void (*fxnWrite)(const void* pvData, unsigned int ulSize));
+
 
 #endif // AVS_H
@@ -17,6 +17,26 @@
 #define AVS_CONFIG_DIFFERENT_ACCOUNT    0
 #endif
 
+#if (COMMUNICATION_IO==3) // RS485
+#ifndef AVS_CONFIG_RS485_BAUD
+#define AVS_CONFIG_RS485_BAUD           (2000000)
+#endif
+#ifndef AVS_CONFIG_RS485_ADDRESS
+#define AVS_CONFIG_RS485_ADDRESS        AVS_CONFIG_DEVICE_ID
+#endif
+#if (AVS_CONFIG_RS485_ADDRESS < 1) || (AVS_CONFIG_RS485_ADDRESS > 127)
+#error "AVS_CONFIG_RS485_ADDRESS must be in the range of [1, 127]"
+#endif
+#endif // (COMMUNICATION_IO==3) // RS485
+
+#if (COMMUNICATION_IO==2) // WiFi
+// Streams over the ESP32 in passthrough (AT+CIPMODE=1) rather than AT+CIPSEND and +IPD.
+// Passthrough needs AT+CIPMUX=0, so WIFI_On leaves a single link for the AVS client
+#ifndef AVS_CONFIG_WIFI_PASSTHROUGH
+#define AVS_CONFIG_WIFI_PASSTHROUGH     1
+#endif
+#endif // (COMMUNICATION_IO==2) // WiFi
+
 #ifndef AVS_CONFIG_SAMPLING_RATE
 #define AVS_CONFIG_SAMPLING_RATE        SAMPLING_RATE_16KHZ
 #endif
@@ -29,6 +49,62 @@
 #define AVS_CONFIG_SDCARD_BUFFER_SIZE   (4096)
 #endif
 
+#ifndef AVS_CONFIG_SDCARD_CACHE_SIZE
+#define AVS_CONFIG_SDCARD_CACHE_SIZE    (4096) // Multiple of 512; recording file write cache, 0 to write through
+#endif
+
+#ifndef AVS_CONFIG_MIC_BUFFER_SIZE
+#define AVS_CONFIG_MIC_BUFFER_SIZE      (8192) // Power of 2; 256ms of 16-bit mono at 16KHz
+#endif
+
+#ifndef AVS_CONFIG_STREAM_FRAME_SIZE
+#define AVS_CONFIG_STREAM_FRAME_SIZE    (1024) // 16-bit mono bytes per streamed frame; 32ms at 16KHz
+#endif
+
+#ifndef AVS_CONFIG_JITTER_BUFFER_SIZE
+#define AVS_CONFIG_JITTER_BUFFER_SIZE   (8192) // Power of 2; 512ms of 8-bit mono at 16KHz
+#endif
+
+#ifndef AVS_CONFIG_JITTER_PREBUFFER_SIZE
+#define AVS_CONFIG_JITTER_PREBUFFER_SIZE (3200) // Initial watermark; 200ms of 8-bit mono at 16KHz
+#endif
+
+#ifndef AVS_CONFIG_VOLUME_DEFAULT
+#define AVS_CONFIG_VOLUME_DEFAULT       (80)   // Speaker volume in percent set by avs_connect
+#endif
+
+#ifndef AVS_CONFIG_VOLUME_STEP
+#define AVS_CONFIG_VOLUME_STEP          (20)   // Codec volume granularity in percent; finer steps use the software gain
+#endif
+
+#ifndef AVS_CONFIG_VOLUME_TONE
+#define AVS_CONFIG_VOLUME_TONE          1      // Mix a short tone into the response when the volume changes
+#endif
+
+#ifndef AVS_CONFIG_VAD
+#define AVS_CONFIG_VAD                  1      // Stop recording at the end of speech and trim the silence around it
+#endif
+
+#ifndef AVS_CONFIG_VAD_FRAME_SIZE
+#define AVS_CONFIG_VAD_FRAME_SIZE       (512)  // 16-bit mono bytes per VAD frame; 16ms at 16KHz
+#endif
+
+#ifndef AVS_CONFIG_VAD_ONSET_MS
+#define AVS_CONFIG_VAD_ONSET_MS         (48)   // Speech needed before recording starts
+#endif
+
+#ifndef AVS_CONFIG_VAD_HANGOVER_MS
+#define AVS_CONFIG_VAD_HANGOVER_MS      (700)  // Silence needed before recording stops, and kept after speech
+#endif
+
+#ifndef AVS_CONFIG_TRACE
+#define AVS_CONFIG_TRACE                0      // Record timestamped events of the request and response stages (avs_trace_dump)
+#endif
+
+#ifndef AVS_CONFIG_TRACE_EVENTS
+#define AVS_CONFIG_TRACE_EVENTS         (1024) // Power of 2; 8 bytes per event
+#endif
+
 #ifndef AVS_CONFIG_RX_TIMEOUT
 #define AVS_CONFIG_RX_TIMEOUT           (10)
 #endif
@@ -76,4 +152,29 @@
 #endif
 
 
+// Codec negotiation requires support on the RPI Alexa Gateway.
+// When enabled, the AVS_CONFIG_AUDIO_SEND/RECV settings above are the preferred codecs
+// and the gateway selects among the codecs below (DEVICE_CODEC_xxx).
+#ifndef AVS_CONFIG_AUDIO_NEGOTIATE
+#define AVS_CONFIG_AUDIO_NEGOTIATE      0
+#endif
+
+#ifndef AVS_CONFIG_AUDIO_SEND_CODECS
+#define AVS_CONFIG_AUDIO_SEND_CODECS    (DEVICE_CODEC_PCM16 | DEVICE_CODEC_ULAW | DEVICE_CODEC_ADPCM)
+#endif
+
+#ifndef AVS_CONFIG_AUDIO_RECV_CODECS
+#define AVS_CONFIG_AUDIO_RECV_CODECS    (DEVICE_CODEC_PCM16 | DEVICE_CODEC_ULAW | DEVICE_CODEC_ADPCM)
+#endif
+
+
+// Framed protocol (DEVICE_PROTOCOL_VERSION_FRAMED) requires support on the RPI Alexa Gateway.
+// When enabled, responses carry volume, display card and control frames between the audio,
+// and an upload of avs_send_request interrupted by a disconnection is resumed
+// by avs_resume_request after the next avs_connect.
+#ifndef AVS_CONFIG_PROTOCOL_FRAMED
+#define AVS_CONFIG_PROTOCOL_FRAMED      0
+#endif
+
+
 #endif // AVS_CONFIG_DEFAULTS_H
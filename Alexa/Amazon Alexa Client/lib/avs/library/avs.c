@@ -44,6 +44,7 @@
  * ============================================================================
  */
 
+#include <string.h>
 #include "ft900.h"
 #include "tinyprintf.h"               // tinyprintf 3rd-party library
 #include "FreeRTOS.h"                 // FreeRTOS 3rd-party library
@@ -53,9 +54,11 @@
 #include "avs/avs.h"                  // AVS library
 #include "avs_config.h"               // AVS configuration
 #include "utils/audio.h"              // Audio utility
+#include "utils/audio_stream.h"       // Audio streaming utility
 #include "utils/sdcard.h"             // SD card utility
 #include "utils/comm_wrapper.h"       // Communication wrapper
 #include "utils/device_information.h" // Device information
+#include "utils/trace.h"              // Event trace utility
 
 
 
@@ -70,33 +73,72 @@
 
 #define USE_DO_DIR 0
 #define USE_STEREO_TO_MONO_AVERAGE 0 // Using discard instead of average is better audio quality.
-#define USE_MULTITHREADED_RECVPLAY 0
+#define USE_MULTITHREADED_RECVPLAY 1
 #if (COMMUNICATION_IO==1)   // Ethernet
-#define USE_SENDRECV_MUTEX 1
+#define USE_SENDRECV_MUTEX 0 // the socket event task of comm_wrapper lets the send and the receive overlap
+#define USE_ZEROCOPY_SEND 1 // avs_send_request encodes into buffers referenced by lwIP until acknowledged
 #elif (COMMUNICATION_IO==2)   // WiFi
 #define USE_SENDRECV_MUTEX 0
+#define USE_ZEROCOPY_SEND 0
+#elif (COMMUNICATION_IO==3)   // RS485
+#define USE_SENDRECV_MUTEX 0
+#define USE_ZEROCOPY_SEND 0 // comm_send copies into the window of the link
+#elif (COMMUNICATION_IO==4)   // Host
+#define USE_SENDRECV_MUTEX 0
+#define USE_ZEROCOPY_SEND 0 // send copies into the socket buffer of the kernel
 #endif
 #define USE_RECORDPLAY_MUTEX 0
 
+#if (AVS_CONFIG_STREAM_FRAME_SIZE + 4 > AVS_CONFIG_AUDIO_BUFFER_SIZE)
+#error "AVS_CONFIG_STREAM_FRAME_SIZE must leave room for the 4-byte frame length in AVS_CONFIG_AUDIO_BUFFER_SIZE"
+#endif
+#if AVS_CONFIG_PROTOCOL_FRAMED && (AVS_CONFIG_STREAM_FRAME_SIZE + 16 > AVS_CONFIG_AUDIO_BUFFER_SIZE)
+#error "AVS_CONFIG_STREAM_FRAME_SIZE must leave room for the 16-byte TDeviceFrame in AVS_CONFIG_AUDIO_BUFFER_SIZE"
+#endif
+
+#if USE_ZEROCOPY_SEND
+// avs_send_request splits the SD card buffer into slots of the size of the copying path's chunk,
+// sent in place. While one slot is in flight, the next one is read ahead from the SD card.
+// A slot is reused once the gateway acknowledged it; the 16-bit PCM is staged in the audio buffer.
+#define AVS_ZEROCOPY_SLOTS      2
+#define AVS_ZEROCOPY_SLOT_SIZE  (AVS_CONFIG_SDCARD_BUFFER_SIZE / AVS_ZEROCOPY_SLOTS)
+#endif
+
 
 #if USE_MULTITHREADED_RECVPLAY
+// Jitter buffer between the receiver (avs_recv_and_play_response_threaded) and vPlayerTask.
+// The receiver (or the socket event task for the request the receiver waits for)
+// is the only writer of m_ulHead and the player the only writer of m_ulTail.
+// Both indexes run freely and are masked with AVS_CONFIG_JITTER_BUFFER_SIZE-1.
 typedef struct _ThreadPlayerContext {
 
     TaskHandle_t m_xTask;
-    SemaphoreHandle_t m_xMutexFile;
-    SemaphoreHandle_t m_xMutexRun;
-    FIL m_fHandle;
-    uint32_t m_ulWriteSize;
-    uint32_t m_ulReadSize;
-    uint32_t m_ulRecvSize;
+    volatile TaskHandle_t m_xReceiver;
+    char* m_pcBuffer;
+    volatile uint32_t m_ulHead;
+    volatile uint32_t m_ulTail;
+    volatile uint8_t m_ucActive;   // set by receiver when a response starts, cleared by player when done
+    volatile uint8_t m_ucFinished; // receiver has received the whole response
+    volatile uint8_t m_ucFlush;    // receiver discards the rest of the response; player stops
+    uint32_t m_ulWatermark;        // bytes buffered before playback (re)starts
+    uint32_t m_ulUnderruns;        // player found the buffer empty before the end of the response
+    uint32_t m_ulOverruns;         // times the receiver found the buffer full
 
 } ThreadPlayerContext;
 
 static ThreadPlayerContext g_hContext;
 static void vPlayerTask(void *pvParameters);
+static void avs_recv_publish(TCommRequest* pRequest, int lBytes, int lStatus);
 #endif
 
+// Volume changes are applied by a single task: vPlayerTask with USE_MULTITHREADED_RECVPLAY, else the caller.
+// The other tasks only post the volume they request.
 static int g_lVolumePercent = 0;
+static int g_lVolumeCodec = -1;             // coarse volume programmed in the codec; unknown until set
+static volatile int g_lVolumeRequest = -1;  // volume posted and not applied yet
+#if (AVS_CONFIG_VOLUME_DEFAULT % AVS_CONFIG_VOLUME_STEP)
+#error "AVS_CONFIG_VOLUME_DEFAULT must be a multiple of AVS_CONFIG_VOLUME_STEP so that the software gain stays at unity"
+#endif
 static char* g_pcAudioBuffer  = NULL;
 static char* g_pcSDCardBuffer = NULL;
 #if USE_SENDRECV_MUTEX
@@ -106,6 +148,53 @@ static SemaphoreHandle_t m_xMutexSendRecv = NULL;
 static SemaphoreHandle_t m_xMutexRecordPlay = NULL;
 #endif
 
+// Codecs in use, selected in avs_connect (DEVICE_CODEC_xxx)
+static uint16_t g_uwSendCodec = DEVICE_CODEC_ULAW;
+static uint16_t g_uwRecvCodec = DEVICE_CODEC_ULAW;
+static TAudioAdpcmState g_tSendAdpcm;
+static TAudioAdpcmState g_tRecvAdpcm;
+
+// Resampling between the I2S sampling rate and the gateway rates (1 if equal)
+static uint8_t g_ucSendRatio = 1;
+static uint8_t g_ucRecvRatio = 1;
+static TAudioResampler g_tSendResampler;
+static TAudioResampler g_tRecvResampler;
+static char* g_pcResampleBuffer = NULL;
+
+// Response being received, set by avs_recv_header
+static uint32_t g_ulRecvRemaining = 0; // bytes of the current audio segment not yet received
+static char g_bRecvEnd = 1;            // the current audio segment is the last one of the response
+
+#if AVS_CONFIG_PROTOCOL_FRAMED
+// Protocol selected in avs_connect (DEVICE_PROTOCOL_VERSION_xxx)
+// Streams are numbered from 1; 0 means no stream.
+static uint16_t g_uwProtocol = DEVICE_PROTOCOL_VERSION_LENGTH;
+static uint16_t g_uwSendStream = 0;
+static uint16_t g_uwSendSequence = 0;
+static uint16_t g_uwRecvStream = 0;
+static uint16_t g_uwRecvSequence = 0;
+static uint32_t g_ulRecvGaps = 0;
+
+// Upload of avs_send_request interrupted by a disconnection
+static uint16_t g_uwResumeStream = 0;
+static uint32_t g_ulResumeOffset = 0;
+static char g_acResumeFile[16] = {0};
+
+static void (*g_fxnCallbackDisplayCard)(int lType, unsigned int ulOffset, const char* pcData, unsigned int ulSize, char bEnd) = NULL;
+#endif // AVS_CONFIG_PROTOCOL_FRAMED
+
+#if AVS_CONFIG_VAD
+// Voice activity detection of the recording
+// Frames before speech starts are kept in a preroll ring so that the onset is not clipped.
+// The preroll ring uses the SD card buffer which is not used while recording.
+static TAudioVad g_tVad;
+static uint32_t g_ulPrerollHead = 0;
+static uint32_t g_ulPrerollTail = 0;
+#if (AVS_CONFIG_VAD_FRAME_SIZE > AVS_CONFIG_AUDIO_BUFFER_SIZE) || (AVS_CONFIG_VAD_FRAME_SIZE > AVS_CONFIG_STREAM_FRAME_SIZE)
+#error "AVS_CONFIG_VAD_FRAME_SIZE must not exceed AVS_CONFIG_AUDIO_BUFFER_SIZE and AVS_CONFIG_STREAM_FRAME_SIZE"
+#endif
+#endif // AVS_CONFIG_VAD
+
 
 
 #ifdef DEBUG
@@ -131,12 +220,182 @@ static const char* getConfigSamplingRateStr()
 }
 #endif // DEBUG
 
+static uint32_t getConfigSamplingRate()
+{
+    if (AVS_CONFIG_SAMPLING_RATE == SAMPLING_RATE_44100HZ) {
+        return 44100;
+    }
+    else if (AVS_CONFIG_SAMPLING_RATE == SAMPLING_RATE_48KHZ) {
+        return 48000;
+    }
+    else if (AVS_CONFIG_SAMPLING_RATE == SAMPLING_RATE_32KHZ) {
+        return 32000;
+    }
+    else if (AVS_CONFIG_SAMPLING_RATE == SAMPLING_RATE_8KHZ) {
+        return 8000;
+    }
+    return 16000;
+}
+
+
+/////////////////////////////////////////////////////////////////////////////////////////////
+// Codec helpers
+// Audio is always 16-bit PCM mono on the device side;
+// the codec only applies to the bytes exchanged with the RPI Alexa Gateway.
+/////////////////////////////////////////////////////////////////////////////////////////////
+
+// Returns the codec described by the device capabilities, 0 if not supported.
+static uint16_t avs_get_codec(uint16_t uwCapabilities)
+{
+    uint16_t uwFormat = GET_DEVICE_CAPABILITIES_FORMAT(uwCapabilities);
+    uint16_t uwBitDepth = GET_DEVICE_CAPABILITIES_BITDEPTH(uwCapabilities);
+
+    if (uwFormat == DEVICE_CAPABILITIES_FORMAT_ADPCM && uwBitDepth == DEVICE_CAPABILITIES_BITDEPTH_4) {
+        return DEVICE_CODEC_ADPCM;
+    }
+    else if (uwFormat == DEVICE_CAPABILITIES_FORMAT_RAW && uwBitDepth == DEVICE_CAPABILITIES_BITDEPTH_8) {
+        return DEVICE_CODEC_ULAW;
+    }
+    else if (uwFormat == DEVICE_CAPABILITIES_FORMAT_RAW && uwBitDepth == DEVICE_CAPABILITIES_BITDEPTH_16) {
+        return DEVICE_CODEC_PCM16;
+    }
+    return 0;
+}
+
+// Returns the ratio of the I2S sampling rate to the rate in the device capabilities, 1 if not supported.
+static uint8_t avs_get_ratio(uint16_t uwCapabilities)
+{
+    uint32_t ulRate = 16000;
+
+    switch (GET_DEVICE_CAPABILITIES_BITRATE(uwCapabilities)) {
+        case DEVICE_CAPABILITIES_BITRATE_8000:  ulRate =  8000; break;
+        case DEVICE_CAPABILITIES_BITRATE_24000: ulRate = 24000; break;
+        case DEVICE_CAPABILITIES_BITRATE_32000: ulRate = 32000; break;
+        case DEVICE_CAPABILITIES_BITRATE_44100: ulRate = 44100; break;
+        case DEVICE_CAPABILITIES_BITRATE_48000: ulRate = 48000; break;
+        case DEVICE_CAPABILITIES_BITRATE_96000: ulRate = 96000; break;
+        default: break;
+    }
+
+    for (uint8_t ucRatio = 1; ucRatio <= 3; ucRatio++) {
+        if (ulRate * ucRatio == getConfigSamplingRate()) {
+            return ucRatio;
+        }
+    }
+    DEBUG_PRINTF("avs_get_ratio(): %d Hz not supported at %d Hz\r\n", (int)ulRate, (int)getConfigSamplingRate());
+    return 1;
+}
+
+// Returns the ratio of 16-bit PCM bytes to encoded bytes as a shift.
+static int avs_get_codec_shift(uint16_t uwCodec)
+{
+    if (uwCodec == DEVICE_CODEC_ADPCM) {
+        return 2;
+    }
+    else if (uwCodec == DEVICE_CODEC_ULAW) {
+        return 1;
+    }
+    return 0;
+}
+
+// Encodes 16-bit PCM, in-place if pcDst is pcSrc. Returns the encoded size.
+static uint32_t avs_encode(const char* pcSrc, uint32_t ulSize, char* pcDst)
+{
+    if (g_uwSendCodec == DEVICE_CODEC_ADPCM) {
+        audio_pcm16_to_adpcm(ulSize, pcSrc, pcDst, &g_tSendAdpcm);
+        return ulSize>>2;
+    }
+    else if (g_uwSendCodec == DEVICE_CODEC_ULAW) {
+        audio_pcm16_to_ulaw(ulSize, pcSrc, pcDst);
+        return ulSize>>1;
+    }
+    if (pcDst != pcSrc) {
+        memcpy(pcDst, pcSrc, ulSize);
+    }
+    return ulSize;
+}
+
+// Decodes to 16-bit PCM mono. Returns the decoded size.
+static uint32_t avs_decode(const char* pcSrc, uint32_t ulSize, char* pcDst)
+{
+    if (g_uwRecvCodec == DEVICE_CODEC_ADPCM) {
+        audio_adpcm_to_pcm16(ulSize, pcSrc, pcDst, &g_tRecvAdpcm);
+        return ulSize<<2;
+    }
+    else if (g_uwRecvCodec == DEVICE_CODEC_ULAW) {
+        audio_ulaw_to_pcm16(ulSize, pcSrc, pcDst);
+        return ulSize<<1;
+    }
+    memcpy(pcDst, pcSrc, ulSize);
+    return ulSize;
+}
+
+// Upsamples 16-bit PCM mono to the I2S sampling rate and expands to stereo. Returns the stereo size.
+static uint32_t avs_upsample_stereo(const char* pcSrc, uint32_t ulSize, char* pcDst)
+{
+    if (g_ucRecvRatio > 1) {
+        // Upsample to the upper half, then expand in-place through the mixing stage
+        uint32_t ulMonoSize = (ulSize & ~1) * g_ucRecvRatio;
+        audio_resample_up(pcDst + ulMonoSize, pcSrc, ulSize, &g_tRecvResampler);
+        audio_mono_to_stereo(pcDst, pcDst + ulMonoSize, ulMonoSize);
+        return ulMonoSize<<1;
+    }
+    audio_mono_to_stereo(pcDst, (char*)pcSrc, ulSize);
+    return ulSize<<1;
+}
+
+// Decodes to 16-bit PCM stereo for the speaker. Returns the decoded size.
+static uint32_t avs_decode_stereo(const char* pcSrc, uint32_t ulSize, char* pcDst)
+{
+    if (g_ucRecvRatio > 1) {
+        if (g_uwRecvCodec == DEVICE_CODEC_ADPCM || g_uwRecvCodec == DEVICE_CODEC_ULAW) {
+            ulSize = avs_decode(pcSrc, ulSize, g_pcResampleBuffer);
+            pcSrc = g_pcResampleBuffer;
+        }
+        return avs_upsample_stereo(pcSrc, ulSize, pcDst);
+    }
+    if (audio_mix_active() && (g_uwRecvCodec == DEVICE_CODEC_ADPCM || g_uwRecvCodec == DEVICE_CODEC_ULAW)) {
+        // Decode to mono in the upper half, then expand in-place through the mixing stage
+        uint32_t ulMonoSize = ulSize << avs_get_codec_shift(g_uwRecvCodec);
+        avs_decode(pcSrc, ulSize, pcDst + ulMonoSize);
+        audio_mono_to_stereo(pcDst, pcDst + ulMonoSize, ulMonoSize);
+        return ulMonoSize<<1;
+    }
+    if (g_uwRecvCodec == DEVICE_CODEC_ADPCM) {
+        audio_adpcm_to_pcm16_stereo(ulSize, pcSrc, pcDst, &g_tRecvAdpcm);
+        return ulSize<<3;
+    }
+    else if (g_uwRecvCodec == DEVICE_CODEC_ULAW) {
+        audio_ulaw_to_pcm16_stereo(ulSize, pcSrc, pcDst);
+        return ulSize<<2;
+    }
+    audio_mono_to_stereo(pcDst, (char*)pcSrc, ulSize);
+    return ulSize<<1;
+}
+
+// Returns the received bytes that fill one speaker buffer.
+static uint32_t avs_get_play_size(void)
+{
+    uint32_t ulSize = audio_player_buffer_size() >> (avs_get_codec_shift(g_uwRecvCodec) + 1);
+    return (ulSize / g_ucRecvRatio) & ~1;
+}
+
+// Downsamples 16-bit PCM mono in-place to the send rate. Returns the downsampled size.
+static uint32_t avs_downsample(char* pcData, uint32_t ulSize)
+{
+    if (g_ucSendRatio > 1) {
+        return audio_resample_down(pcData, pcData, ulSize, &g_tSendResampler);
+    }
+    return ulSize;
+}
+
 
 
 int avs_init(void)
 {
     // Initialize audio
-    audio_setup(NULL, AVS_CONFIG_SAMPLING_RATE);
+    // Speaker and microphone are driven by the I2S FIFO interrupts
+    audio_setup(audio_stream_isr, AVS_CONFIG_SAMPLING_RATE);
     DEBUG_PRINTF("Audio initialize.\r\n");
 
     // Initialize SD card
@@ -146,9 +405,39 @@ int avs_init(void)
     // Pre-allocate the buffers now for faster communication
     g_pcSDCardBuffer = pvPortMalloc(AVS_CONFIG_SDCARD_BUFFER_SIZE);
     g_pcAudioBuffer = pvPortMalloc(AVS_CONFIG_AUDIO_BUFFER_SIZE);
-    if (!g_pcAudioBuffer || !g_pcSDCardBuffer) {
-        DEBUG_PRINTF("avs_init(): pvPortMalloc failed %p %p\n",
-            g_pcAudioBuffer, g_pcSDCardBuffer);
+    g_pcResampleBuffer = pvPortMalloc(AVS_CONFIG_AUDIO_BUFFER_SIZE>>2);
+    if (!g_pcAudioBuffer || !g_pcSDCardBuffer || !g_pcResampleBuffer) {
+        DEBUG_PRINTF("avs_init(): pvPortMalloc failed %p %p %p\n",
+            g_pcAudioBuffer, g_pcSDCardBuffer, g_pcResampleBuffer);
+        return 0;
+    }
+    if (!audio_player_setup(AVS_CONFIG_AUDIO_BUFFER_SIZE)) {
+        DEBUG_PRINTF("avs_init(): audio_player_setup failed\n");
+        avs_free();
+        return 0;
+    }
+    if (!audio_recorder_setup(AVS_CONFIG_MIC_BUFFER_SIZE)) {
+        DEBUG_PRINTF("avs_init(): audio_recorder_setup failed\n");
+        avs_free();
+        return 0;
+    }
+#if AVS_CONFIG_SDCARD_CACHE_SIZE
+    if (!sdcard_cache_setup(AVS_CONFIG_SDCARD_CACHE_SIZE)) {
+        DEBUG_PRINTF("avs_init(): sdcard_cache_setup failed\n");
+        avs_free();
+        return 0;
+    }
+#endif
+#if AVS_CONFIG_TRACE
+    if (!trace_setup(AVS_CONFIG_TRACE_EVENTS)) {
+        DEBUG_PRINTF("avs_init(): trace_setup failed\n");
+        avs_free();
+        return 0;
+    }
+#endif
+    if (!comm_init()) {
+        DEBUG_PRINTF("avs_init(): comm_init failed\n");
+        avs_free();
         return 0;
     }
     DEBUG_PRINTF("Memory initialize.\r\n");
@@ -162,14 +451,13 @@ int avs_init(void)
 #endif
 
 #if USE_MULTITHREADED_RECVPLAY
-    g_hContext.m_xMutexFile = xSemaphoreCreateMutex();
-    g_hContext.m_xMutexRun = xSemaphoreCreateMutex();
-    if (!g_hContext.m_xMutexRun || !g_hContext.m_xMutexFile) {
-        DEBUG_PRINTF("avs_init(): xSemaphoreCreateMutex failed\n");
+    g_hContext.m_pcBuffer = pvPortMalloc(AVS_CONFIG_JITTER_BUFFER_SIZE);
+    if (!g_hContext.m_pcBuffer) {
+        DEBUG_PRINTF("avs_init(): pvPortMalloc failed\n");
         avs_free();
         return 0;
     }
-    xSemaphoreTake(g_hContext.m_xMutexRun, pdMS_TO_TICKS(portMAX_DELAY));
+    g_hContext.m_ulWatermark = AVS_CONFIG_JITTER_PREBUFFER_SIZE;
 
     // Initialize task
     g_hContext.m_xTask = NULL;
@@ -195,15 +483,21 @@ void avs_free(void)
         g_pcSDCardBuffer = NULL;
     }
 
-#if USE_MULTITHREADED_RECVPLAY
-    if (g_hContext.m_xMutexFile) {
-        vSemaphoreDelete(g_hContext.m_xMutexFile);
-        g_hContext.m_xMutexFile = NULL;
+    if (g_pcResampleBuffer) {
+        vPortFree(g_pcResampleBuffer);
+        g_pcResampleBuffer = NULL;
     }
 
-    if (g_hContext.m_xMutexRun) {
-        vSemaphoreDelete(g_hContext.m_xMutexRun);
-        g_hContext.m_xMutexRun = NULL;
+    audio_player_free();
+    audio_recorder_free();
+    sdcard_cache_free();
+    trace_free();
+    comm_free();
+
+#if USE_MULTITHREADED_RECVPLAY
+    if (g_hContext.m_pcBuffer) {
+        vPortFree(g_hContext.m_pcBuffer);
+        g_hContext.m_pcBuffer = NULL;
     }
 #endif
 
@@ -242,26 +536,316 @@ int avs_err(void)
     return comm_err();
 }
 
-void avs_set_volume(int rate)
+/////////////////////////////////////////////////////////////////////////////////////////////
+// Sets the coarse volume in the codec and the rest with the software gain of the speaker output.
+// Writing the codec blocks so it is skipped while playing and done at the end of the playback;
+// meanwhile the software gain follows the new volume as far as it can without boosting.
+// Called by the task owning the volume only.
+/////////////////////////////////////////////////////////////////////////////////////////////
+static void avs_update_volume(void)
 {
-    if ((g_lVolumePercent == 100 && rate>=0) ||
-        (g_lVolumePercent == 0 && rate<=0) ) {
+    int lCodec = (g_lVolumePercent + AVS_CONFIG_VOLUME_STEP - 1) / AVS_CONFIG_VOLUME_STEP * AVS_CONFIG_VOLUME_STEP;
+
+    if (lCodec > 100) {
+        lCodec = 100;
+    }
+    if (lCodec != g_lVolumeCodec && !audio_player_running()) {
+        audio_speaker_set_volume(lCodec);
+        g_lVolumeCodec = lCodec;
+    }
+    audio_mix_set_gain(audio_speaker_volume_to_gain(g_lVolumeCodec - g_lVolumePercent));
+}
+
+// Takes the volume posted, if any, and updates the codec and the software gain
+static void avs_apply_volume(void)
+{
+    int lRequest;
+
+    taskENTER_CRITICAL();
+    lRequest = g_lVolumeRequest;
+    if (lRequest >= 0) {
+        g_lVolumePercent = lRequest;
+        g_lVolumeRequest = -1;
+    }
+    taskEXIT_CRITICAL();
+
+    avs_update_volume();
+#if AVS_CONFIG_VOLUME_TONE
+    if (lRequest >= 0 && audio_player_running()) {
+        audio_mix_tone(1000, 80, getConfigSamplingRate());
+    }
+#endif
+}
+
+// Has the task owning the volume apply the volume posted and the codec volume deferred by a playback
+static void avs_notify_volume(void)
+{
+#if USE_MULTITHREADED_RECVPLAY
+    if (g_hContext.m_xTask) {
+        xTaskNotifyGive(g_hContext.m_xTask);
         return;
     }
-    audio_speaker_set_volume(g_lVolumePercent+rate);
-    g_lVolumePercent += rate;
+#endif
+    avs_apply_volume();
+}
+
+// Posts a volume in percent, or a change of the volume already posted if bRelative is set
+static void avs_post_volume(int lPercent, char bRelative)
+{
+    int lCurrent;
 
-    if (g_lVolumePercent < 0) {
-        g_lVolumePercent = 0;
+    taskENTER_CRITICAL();
+    lCurrent = (g_lVolumeRequest >= 0) ? g_lVolumeRequest : g_lVolumePercent;
+    if (bRelative) {
+        lPercent += lCurrent;
     }
-    else if (g_lVolumePercent > 100) {
-        g_lVolumePercent = 100;
+    if (lPercent < 0) {
+        lPercent = 0;
     }
+    else if (lPercent > 100) {
+        lPercent = 100;
+    }
+    if (lPercent != lCurrent) {
+        g_lVolumeRequest = lPercent;
+    }
+    taskEXIT_CRITICAL();
+
+    if (lPercent != lCurrent) {
+        avs_notify_volume();
+    }
+}
+
+void avs_set_volume(int rate)
+{
+    avs_post_volume(rate, 1);
 }
 
+// Volume posted, applied or not
 int avs_get_volume(void)
 {
-    return g_lVolumePercent;
+    int lRequest = g_lVolumeRequest;
+
+    return (lRequest >= 0) ? lRequest : g_lVolumePercent;
+}
+
+unsigned int avs_get_jitter_underruns(void)
+{
+#if USE_MULTITHREADED_RECVPLAY
+    return g_hContext.m_ulUnderruns;
+#else
+    return 0;
+#endif
+}
+
+unsigned int avs_get_jitter_overruns(void)
+{
+#if USE_MULTITHREADED_RECVPLAY
+    return g_hContext.m_ulOverruns;
+#else
+    return 0;
+#endif
+}
+
+unsigned int avs_get_jitter_watermark(void)
+{
+#if USE_MULTITHREADED_RECVPLAY
+    return g_hContext.m_ulWatermark;
+#else
+    return 0;
+#endif
+}
+
+unsigned int avs_get_sequence_gaps(void)
+{
+#if AVS_CONFIG_PROTOCOL_FRAMED
+    return g_ulRecvGaps;
+#else
+    return 0;
+#endif
+}
+
+void avs_set_displaycard_callback(void (*fxnCallbackDisplayCard)(int lType, unsigned int ulOffset, const char* pcData, unsigned int ulSize, char bEnd))
+{
+#if AVS_CONFIG_PROTOCOL_FRAMED
+    g_fxnCallbackDisplayCard = fxnCallbackDisplayCard;
+#else
+    (void)fxnCallbackDisplayCard;
+#endif
+}
+
+unsigned int avs_trace_dump(void (*fxnWrite)(const void* pvData, unsigned int ulSize))
+{
+#if AVS_CONFIG_TRACE
+    return trace_dump(fxnWrite);
+#else
+    (void)fxnWrite;
+    return 0;
+#endif
+}
+
+
+#if AVS_CONFIG_PROTOCOL_FRAMED
+/////////////////////////////////////////////////////////////////////////////////////////////
+// Helpers for the framed protocol
+/////////////////////////////////////////////////////////////////////////////////////////////
+
+// Receives exactly ulSize bytes. Returns ulSize, or the failed comm_recv result.
+static int avs_recv_all(char* pcBuffer, uint32_t ulSize)
+{
+    uint32_t ulReceived = 0;
+
+    while (ulReceived < ulSize) {
+        int iRet = comm_recv(pcBuffer + ulReceived, ulSize - ulReceived);
+        if (iRet <= 0) {
+            return iRet;
+        }
+        ulReceived += iRet;
+    }
+    return ulReceived;
+}
+
+// Fills the AUDIO frame in front of the payload of a request. Returns the frame size.
+static uint32_t avs_set_frame(char* pcFrame, uint8_t ucFlags, uint32_t ulOffset, uint32_t ulLength)
+{
+    TDeviceFrame* pFrame = (TDeviceFrame*)pcFrame;
+
+    pFrame->m_ucType = DEVICE_FRAME_AUDIO;
+    pFrame->m_ucFlags = ucFlags;
+    pFrame->m_ucSubtype = 0;
+    pFrame->m_ucReserved = 0;
+    pFrame->m_uwStream = g_uwSendStream;
+    pFrame->m_uwSequence = g_uwSendSequence++;
+    pFrame->m_ulOffset = ulOffset;
+    pFrame->m_ulLength = ulLength;
+    return sizeof(TDeviceFrame);
+}
+
+// Starts the stream of a new request
+static void avs_new_stream(void)
+{
+    g_uwResumeStream = 0;
+    if (++g_uwSendStream == 0) {
+        g_uwSendStream = 1;
+    }
+}
+
+// Receives frames until the next AUDIO frame of the response, handling the frames in between.
+// The first 4 bytes of a frame are received alone like the length of protocol 1
+// so that the WiFi wrapper waits for the next +IPD.
+static int avs_recv_frame(void)
+{
+    TDeviceFrame tFrame;
+    char acPayload[128];
+    int iRet = 0;
+
+    while (1) {
+        iRet = comm_recv((char*)&tFrame, sizeof(uint32_t));
+        if (iRet < 0 && g_bRecvEnd) {
+            // timedout
+            return -1;
+        }
+        if (iRet <= 0 ||
+            avs_recv_all((char*)&tFrame + iRet, sizeof(tFrame) - iRet) != (int)(sizeof(tFrame) - iRet)) {
+            DEBUG_PRINTF("avs_recv_frame(): recv failed! %d errno %d\r\n\r\n", iRet, comm_errno());
+            return 0;
+        }
+
+        // Count the frames lost
+        if (tFrame.m_uwSequence != g_uwRecvSequence) {
+            DEBUG_PRINTF("avs_recv_frame(): sequence %d expected %d\r\n", tFrame.m_uwSequence, g_uwRecvSequence);
+            g_ulRecvGaps += (uint16_t)(tFrame.m_uwSequence - g_uwRecvSequence);
+        }
+        g_uwRecvSequence = tFrame.m_uwSequence + 1;
+
+        switch (tFrame.m_ucType) {
+            case DEVICE_FRAME_AUDIO:
+                if (!g_bRecvEnd && tFrame.m_uwStream != g_uwRecvStream) {
+                    DEBUG_PRINTF("avs_recv_frame(): stream %d ended by stream %d\r\n", g_uwRecvStream, tFrame.m_uwStream);
+                }
+                g_uwRecvStream = tFrame.m_uwStream;
+                g_ulRecvRemaining = tFrame.m_ulLength;
+                g_bRecvEnd = (tFrame.m_ucFlags & DEVICE_FRAME_FLAG_END) != 0;
+                return 1;
+
+            case DEVICE_FRAME_CONTROL:
+                if (tFrame.m_ucSubtype == DEVICE_CONTROL_CANCEL &&
+                    !g_bRecvEnd && tFrame.m_uwStream == g_uwRecvStream) {
+                    // End the response with an empty segment
+                    DEBUG_PRINTF("avs_recv_frame(): stream %d cancelled\r\n", tFrame.m_uwStream);
+                    g_ulRecvRemaining = 0;
+                    g_bRecvEnd = 1;
+                    return 1;
+                }
+                break;
+
+            case DEVICE_FRAME_VOLUME:
+                avs_post_volume((int)tFrame.m_ulOffset, 0);
+                break;
+
+            case DEVICE_FRAME_HEARTBEAT:
+                if (g_bRecvEnd) {
+                    // No response yet
+                    return -1;
+                }
+                break;
+
+            default:
+                break;
+        }
+
+        // Pass the display cards to the callback and discard any other payload
+        comm_setsockopt(AVS_CONFIG_RX_TIMEOUT, 0);
+        uint32_t ulOffset = 0;
+        while (ulOffset < tFrame.m_ulLength) {
+            uint32_t ulSize = tFrame.m_ulLength - ulOffset;
+            if (ulSize > sizeof(acPayload)) {
+                ulSize = sizeof(acPayload);
+            }
+            if (avs_recv_all(acPayload, ulSize) != (int)ulSize) {
+                DEBUG_PRINTF("avs_recv_frame(): recv failed! %d errno %d\r\n\r\n", (int)ulSize, comm_errno());
+                return 0;
+            }
+            if (tFrame.m_ucType == DEVICE_FRAME_DISPLAYCARD && g_fxnCallbackDisplayCard) {
+                g_fxnCallbackDisplayCard(tFrame.m_ucSubtype, tFrame.m_ulOffset + ulOffset, acPayload, ulSize,
+                    (tFrame.m_ucFlags & DEVICE_FRAME_FLAG_END) && ulOffset + ulSize == tFrame.m_ulLength);
+            }
+            ulOffset += ulSize;
+        }
+    }
+}
+#endif // AVS_CONFIG_PROTOCOL_FRAMED
+
+/////////////////////////////////////////////////////////////////////////////////////////////
+// Receives the header of the next audio segment of the response
+// into g_ulRecvRemaining and g_bRecvEnd.
+// - Protocol 1: the 4-byte length of the whole response; a 0 length means no response yet
+// - Protocol 2: the next AUDIO frame; the response ends with the frame with DEVICE_FRAME_FLAG_END
+// Returns 1 on success, -1 when there is no response yet, 0 on error.
+/////////////////////////////////////////////////////////////////////////////////////////////
+static int avs_recv_header(void)
+{
+    uint32_t ulSize = 0;
+    int iRet = 0;
+
+#if AVS_CONFIG_PROTOCOL_FRAMED
+    if (g_uwProtocol >= DEVICE_PROTOCOL_VERSION_FRAMED) {
+        return avs_recv_frame();
+    }
+#endif
+
+    iRet = comm_recv((char*)&ulSize, sizeof(ulSize));
+    if (iRet < 0 || (iRet == sizeof(ulSize) && ulSize == 0)) {
+        // timedout
+        return -1;
+    }
+    else if (iRet != sizeof(ulSize)) {
+        DEBUG_PRINTF("avs_recv_header(): recv failed! %d %d errno %d\r\n\r\n", iRet, sizeof(ulSize), comm_errno());
+        return 0;
+    }
+
+    g_ulRecvRemaining = ulSize;
+    g_bRecvEnd = 1;
+    return 1;
 }
 
 
@@ -276,8 +860,7 @@ int avs_connect(void)
     }
 
     // Set the volume
-    audio_speaker_set_volume(80);
-    g_lVolumePercent = 80;
+    avs_post_volume(AVS_CONFIG_VOLUME_DEFAULT, 0);
     audio_mic_set_volume(100);
 
     // Set device info
@@ -305,6 +888,87 @@ int avs_connect(void)
         return 0;
     }
 
+#if AVS_CONFIG_AUDIO_NEGOTIATE
+    // Send the supported codecs
+    TDeviceCodecs tDeviceCodecs = {0};
+    tDeviceCodecs.m_ulMagic = DEVICE_CODECS_MAGIC;
+    tDeviceCodecs.m_uwSendCodecs = AVS_CONFIG_AUDIO_SEND_CODECS;
+    tDeviceCodecs.m_uwRecvCodecs = AVS_CONFIG_AUDIO_RECV_CODECS;
+    iRet = comm_send((char*)&tDeviceCodecs, sizeof(tDeviceCodecs));
+    if (iRet != sizeof(tDeviceCodecs)) {
+        DEBUG_PRINTF("avs_connect(): comm_send failed! %d %d\r\n\r\n", iRet, sizeof(tDeviceCodecs));
+        comm_disconnect();
+        return 0;
+    }
+
+    // Receive the codecs selected by the gateway
+    comm_setsockopt(AVS_CONFIG_RX_TIMEOUT, 0);
+    iRet = comm_recv((char*)&tDeviceInfo, sizeof(tDeviceInfo));
+    if (iRet != sizeof(tDeviceInfo) ||
+        !(avs_get_codec(tDeviceInfo.m_uwSendCapabilities) & AVS_CONFIG_AUDIO_SEND_CODECS) ||
+        !(avs_get_codec(tDeviceInfo.m_uwRecvCapabilities) & AVS_CONFIG_AUDIO_RECV_CODECS)) {
+        DEBUG_PRINTF("avs_connect(): negotiation failed! %d %04x %04x\r\n\r\n", iRet,
+            tDeviceInfo.m_uwSendCapabilities, tDeviceInfo.m_uwRecvCapabilities);
+        comm_disconnect();
+        return 0;
+    }
+    comm_setsockopt(AVS_CONFIG_TX_TIMEOUT, 1);
+#endif // AVS_CONFIG_AUDIO_NEGOTIATE
+
+#if AVS_CONFIG_PROTOCOL_FRAMED
+    // Send the protocol version and the interrupted upload, if any
+    TDeviceProtocol tDeviceProtocol = {0};
+    tDeviceProtocol.m_ulMagic = DEVICE_PROTOCOL_MAGIC;
+    tDeviceProtocol.m_uwVersion = DEVICE_PROTOCOL_VERSION_FRAMED;
+    tDeviceProtocol.m_uwStream = g_uwResumeStream;
+    iRet = comm_send((char*)&tDeviceProtocol, sizeof(tDeviceProtocol));
+    if (iRet != sizeof(tDeviceProtocol)) {
+        DEBUG_PRINTF("avs_connect(): comm_send failed! %d %d\r\n\r\n", iRet, sizeof(tDeviceProtocol));
+        comm_disconnect();
+        return 0;
+    }
+
+    // Receive the protocol selected by the gateway and the bytes of the upload it already has
+    comm_setsockopt(AVS_CONFIG_RX_TIMEOUT, 0);
+    iRet = avs_recv_all((char*)&tDeviceProtocol, sizeof(tDeviceProtocol));
+    if (iRet != sizeof(tDeviceProtocol) ||
+        tDeviceProtocol.m_ulMagic != DEVICE_PROTOCOL_MAGIC ||
+        tDeviceProtocol.m_uwVersion < DEVICE_PROTOCOL_VERSION_LENGTH ||
+        tDeviceProtocol.m_uwVersion > DEVICE_PROTOCOL_VERSION_FRAMED) {
+        DEBUG_PRINTF("avs_connect(): protocol negotiation failed! %d %d\r\n\r\n", iRet, tDeviceProtocol.m_uwVersion);
+        comm_disconnect();
+        return 0;
+    }
+    comm_setsockopt(AVS_CONFIG_TX_TIMEOUT, 1);
+
+    g_uwProtocol = tDeviceProtocol.m_uwVersion;
+    g_uwSendSequence = 0;
+    g_uwRecvSequence = 0;
+    g_uwRecvStream = 0;
+
+    // The gateway no longer has the interrupted upload or cannot resume it
+    if (!g_uwResumeStream ||
+        g_uwProtocol < DEVICE_PROTOCOL_VERSION_FRAMED ||
+        tDeviceProtocol.m_uwStream != g_uwResumeStream) {
+        g_uwResumeStream = 0;
+    }
+    g_ulResumeOffset = tDeviceProtocol.m_ulOffset;
+    DEBUG_PRINTF("avs_connect(): protocol %d resume stream %d offset %d\r\n",
+        g_uwProtocol, g_uwResumeStream, (int)g_ulResumeOffset);
+#endif // AVS_CONFIG_PROTOCOL_FRAMED
+    g_ulRecvRemaining = 0;
+    g_bRecvEnd = 1;
+
+    // Select the codecs; unsupported formats are passed through as is
+    g_uwSendCodec = avs_get_codec(tDeviceInfo.m_uwSendCapabilities);
+    g_uwRecvCodec = avs_get_codec(tDeviceInfo.m_uwRecvCapabilities);
+    DEBUG_PRINTF("avs_connect(): send codec %d recv codec %d\r\n", g_uwSendCodec, g_uwRecvCodec);
+
+    // Select the resampling ratios; unsupported rates are passed through as is
+    g_ucSendRatio = avs_get_ratio(tDeviceInfo.m_uwSendCapabilities);
+    g_ucRecvRatio = avs_get_ratio(tDeviceInfo.m_uwRecvCapabilities);
+    DEBUG_PRINTF("avs_connect(): send ratio %d recv ratio %d\r\n", g_ucSendRatio, g_ucRecvRatio);
+
     return 1;
 }
 
@@ -313,8 +977,7 @@ int avs_connect(void)
 /////////////////////////////////////////////////////////////////////////////////////////////
 void avs_disconnect(void)
 {
-    audio_speaker_set_volume(0);
-    g_lVolumePercent = 0;
+    avs_post_volume(0, 0);
     audio_mic_set_volume(0);
 
     comm_disconnect();
@@ -327,13 +990,163 @@ int avs_isconnected(void)
 
 
 
+unsigned int avs_get_speech_start(void)
+{
+#if AVS_CONFIG_VAD
+    return (uint64_t)g_tVad.m_ulSpeechStart * 1000 / getConfigSamplingRate();
+#else
+    return 0;
+#endif
+}
+
+unsigned int avs_get_speech_end(void)
+{
+#if AVS_CONFIG_VAD
+    return (uint64_t)g_tVad.m_ulSpeechEnd * 1000 / getConfigSamplingRate();
+#else
+    return 0;
+#endif
+}
+
+
+#if AVS_CONFIG_VAD
+/////////////////////////////////////////////////////////////////////////////////////////////
+// Helpers for avs_record_request and avs_record_and_send_request
+// - Before speech starts, read one VAD frame at a time into the preroll ring;
+//   once the ring is full, the oldest bytes it overwrites are returned
+// - Once speech starts, return the preroll ring then the microphone ring
+// - Once speech ends, return up to AVS_CONFIG_VAD_HANGOVER_MS after the last speech frame then nothing,
+//   so that the trailing silence is dropped
+// Nothing recorded before the end of speech is dropped: if speech is never detected, the whole recording
+// is returned. avs_record_request rewinds its file once speech starts to keep only the preroll before it.
+/////////////////////////////////////////////////////////////////////////////////////////////
+static void avs_vad_begin(void)
+{
+    uint32_t ulFrameMs = (AVS_CONFIG_VAD_FRAME_SIZE>>1) * 1000 / getConfigSamplingRate();
+
+    audio_vad_reset(&g_tVad, AVS_CONFIG_VAD_ONSET_MS / ulFrameMs, AVS_CONFIG_VAD_HANGOVER_MS / ulFrameMs);
+    g_ulPrerollHead = 0;
+    g_ulPrerollTail = 0;
+}
+
+static char avs_vad_started(void)
+{
+    return g_tVad.m_ucState != AUDIO_VAD_SILENCE;
+}
+
+static char avs_vad_ended(void)
+{
+    return g_tVad.m_ucState == AUDIO_VAD_ENDED;
+}
+
+// Swaps the frame in pcBuffer into the preroll ring; the bytes it overwrites are moved to the start of pcBuffer
+static uint32_t avs_vad_preroll(char* pcBuffer, uint32_t ulSize)
+{
+    char* pcPreroll = g_pcSDCardBuffer;
+    uint32_t ulOverwritten = 0;
+
+    for (uint32_t i = 0; i < ulSize; i++) {
+        char* pcSlot = pcPreroll + (g_ulPrerollHead++ % AVS_CONFIG_SDCARD_BUFFER_SIZE);
+        char cSample = pcBuffer[i];
+        if (g_ulPrerollHead - g_ulPrerollTail > AVS_CONFIG_SDCARD_BUFFER_SIZE) {
+            pcBuffer[ulOverwritten++] = *pcSlot;
+            g_ulPrerollTail++;
+        }
+        *pcSlot = cSample;
+    }
+    return ulOverwritten;
+}
+
+static uint32_t avs_vad_read(char* pcBuffer, uint32_t ulSize, char bRecording)
+{
+    char* pcPreroll = g_pcSDCardBuffer;
+    uint32_t ulRecordSize = 0;
+    uint32_t ulOffset = 0;
+    uint32_t ulFirst = 0;
+    uint32_t ulSample = 0;
+
+
+    // Wait for speech, keeping the latest frames
+    if (g_tVad.m_ucState == AUDIO_VAD_SILENCE && bRecording) {
+        ulRecordSize = audio_recorder_read(pcBuffer, AVS_CONFIG_VAD_FRAME_SIZE, 100);
+        if (!ulRecordSize) {
+            return 0;
+        }
+        audio_vad_process(&g_tVad, pcBuffer, ulRecordSize);
+        if (g_tVad.m_ucState != AUDIO_VAD_SILENCE) {
+            DEBUG_PRINTF(">> Speech started at %d ms\r\n", avs_get_speech_start());
+        }
+
+        // The preroll ring is returned from the next call
+        return avs_vad_preroll(pcBuffer, ulRecordSize);
+    }
+
+    // Return the preroll ring first
+    if (g_ulPrerollHead != g_ulPrerollTail) {
+        ulRecordSize = g_ulPrerollHead - g_ulPrerollTail;
+        if (ulRecordSize > ulSize) {
+            ulRecordSize = ulSize;
+        }
+        ulOffset = g_ulPrerollTail % AVS_CONFIG_SDCARD_BUFFER_SIZE;
+        ulFirst = AVS_CONFIG_SDCARD_BUFFER_SIZE - ulOffset;
+        if (ulFirst > ulRecordSize) {
+            ulFirst = ulRecordSize;
+        }
+        memcpy(pcBuffer, pcPreroll + ulOffset, ulFirst);
+        memcpy(pcBuffer + ulFirst, pcPreroll, ulRecordSize - ulFirst);
+        g_ulPrerollTail += ulRecordSize;
+        return ulRecordSize;
+    }
+
+    // Drop the trailing silence
+    if (g_tVad.m_ucState == AUDIO_VAD_ENDED) {
+        return 0;
+    }
+
+    // Sleep until the microphone ring has a full buffer
+    ulRecordSize = audio_recorder_read(pcBuffer, ulSize, 100);
+    ulSample = g_tVad.m_ulSamples;
+    for (ulOffset = 0; ulOffset < ulRecordSize; ulOffset += AVS_CONFIG_VAD_FRAME_SIZE) {
+        ulFirst = ulRecordSize - ulOffset;
+        if (ulFirst > AVS_CONFIG_VAD_FRAME_SIZE) {
+            ulFirst = AVS_CONFIG_VAD_FRAME_SIZE;
+        }
+        if (audio_vad_process(&g_tVad, pcBuffer + ulOffset, ulFirst) == AUDIO_VAD_ENDED) {
+            // Keep the hangover after the last speech frame, the rest of the buffer is silence
+            uint32_t ulEnd = g_tVad.m_ulSpeechEnd + AVS_CONFIG_VAD_HANGOVER_MS * getConfigSamplingRate() / 1000;
+            if (ulEnd < ulSample) {
+                ulEnd = ulSample;
+            }
+            if (((ulEnd - ulSample) << 1) < ulRecordSize) {
+                ulRecordSize = (ulEnd - ulSample) << 1;
+            }
+            DEBUG_PRINTF(">> Speech ended at %d ms\r\n", avs_get_speech_end());
+            TRACE_EVENT(TRACE_VAD_END, avs_get_speech_end());
+            break;
+        }
+    }
+    return ulRecordSize;
+}
+#endif // AVS_CONFIG_VAD
+
+
+// Stops the microphone of avs_record_request and avs_record_and_send_request
+static void avs_capture_end(uint32_t ulBytesRecorded)
+{
+    audio_recorder_end();
+    TRACE_EVENT(TRACE_CAPTURE_END, ulBytesRecorded);
+    TRACE_EVENT(TRACE_MIC_HIGH, audio_recorder_watermark());
+}
+
+
 /////////////////////////////////////////////////////////////////////////////////////////////
 // Record audio file from microphone and save to SD card given the complete file path
-// - Read 2KB from microphone
-// - Convert 2KB stereo to 1KB mono
-// - Save 1KB to SD card
+// - I2S interrupt reads the microphone FIFO, converts stereo to mono and fills the microphone ring
+// - Read 2KB from microphone ring
+// - Save 2KB to SD card through the write cache (4KB multi-sector writes to a preallocated file)
+// An SD card write stall is absorbed by the microphone ring instead of dropping samples.
 // Audio recorded: 16-bit PCM, 16KHZ, stereo (2-channels)
-// Audio saved:    16-bit PCM, 16KHZ, mono (1-channel)
+// Audio saved:    16-bit PCM, 16KHZ, mono (1-channel); downsampled to the send rate if lower
 /////////////////////////////////////////////////////////////////////////////////////////////
 int avs_record_request(const char* pcFileName, char (*fxnCallbackRecord)(void))
 {
@@ -341,14 +1154,16 @@ int avs_record_request(const char* pcFileName, char (*fxnCallbackRecord)(void))
     uint32_t ulRecordSize = 0;
     uint32_t ulBytesWritten = 0;
     char* pcMicrophone = g_pcAudioBuffer;
+    char bRecording = 1;
+#if AVS_CONFIG_VAD
+    char bSpeech = 0;
+#endif
+    int iRet = 1;
 
 
-    audio_mic_begin();
-
-    // Open file given complete file path in SD card
-    if (sdcard_open(&fHandle, pcFileName, 1, 0)) {
+    // Open file given complete file path in SD card, preallocated for the longest recording
+    if (sdcard_open_record(&fHandle, pcFileName, AVS_CONFIG_MAX_RECORD_SIZE + AVS_CONFIG_AUDIO_BUFFER_SIZE)) {
         DEBUG_PRINTF("avs_record_request(): sdcard_open failed!\r\n");
-        audio_mic_end();
         return 0;
     }
 
@@ -356,100 +1171,433 @@ int avs_record_request(const char* pcFileName, char (*fxnCallbackRecord)(void))
     xSemaphoreTake(m_xMutexRecordPlay, pdMS_TO_TICKS(portMAX_DELAY));
 #endif
 
+    audio_resample_reset(&g_tSendResampler, g_ucSendRatio);
+#if AVS_CONFIG_VAD
+    avs_vad_begin();
+#endif
+    audio_recorder_begin();
+    TRACE_EVENT(TRACE_CAPTURE_BEGIN, 0);
+
     // Record microphone input to SD card while callback function returns true
-    // Microphone input is 16-bit stereo
+    // Once the callback returns false, the samples still in the ring are saved
     do {
-        // Process transfer if the mic is full
-        if (audio_mic_ready()) {
+        if (bRecording && !((*fxnCallbackRecord)() && ulBytesWritten < AVS_CONFIG_MAX_RECORD_SIZE)) {
+            avs_capture_end(ulBytesWritten);
+            bRecording = 0;
+        }
+#if AVS_CONFIG_VAD
+        else if (bRecording && avs_vad_ended()) {
+            avs_capture_end(ulBytesWritten);
+            bRecording = 0;
+        }
+
+        // Skip the silence before and after speech
+        ulRecordSize = avs_vad_read(pcMicrophone, AVS_CONFIG_AUDIO_BUFFER_SIZE, bRecording);
+        if (!bSpeech && avs_vad_started()) {
+            // Keep the preroll only; what was saved and read so far is the silence before it
+            bSpeech = 1;
+            ulRecordSize = 0;
+            ulBytesWritten = 0;
+            if (FR_OK != sdcard_rewind(&fHandle)) {
+                DEBUG_PRINTF("avs_record_request(): sdcard_rewind failed!\r\n");
+                if (bRecording) {
+                    avs_capture_end(ulBytesWritten);
+                }
+                iRet = 0;
+                break;
+            }
+        }
+#else
+        // Sleep until the microphone ring has a full buffer
+        ulRecordSize = audio_recorder_read(pcMicrophone, AVS_CONFIG_AUDIO_BUFFER_SIZE, 100);
+#endif
+        if (!ulRecordSize) {
+            if (!bRecording) {
+                break;
+            }
+            continue;
+        }
 
-            ulRecordSize = AVS_CONFIG_AUDIO_BUFFER_SIZE;
+        // Convert to the send rate before saving
+        ulRecordSize = avs_downsample(pcMicrophone, ulRecordSize);
+
+        // write mic data to SD card
+        uint32_t ulWriteSize = 0;
+        uint32_t ulStart = TRACE_TIME();
+        sdcard_write(&fHandle, pcMicrophone, ulRecordSize, (UINT*)&ulWriteSize);
+        TRACE_DURATION(TRACE_SDCARD_WRITE, ulStart);
+        if (ulRecordSize != ulWriteSize) {
+            DEBUG_PRINTF("avs_record_request(): sdcard_write failed! %d %d\r\n\r\n",
+                (int)ulRecordSize, (int)ulWriteSize);
+            if (bRecording) {
+                avs_capture_end(ulBytesWritten);
+            }
+            iRet = 0;
+            break;
+        }
 
-            // copy data from microphone
-            audio_record((uint8_t*)pcMicrophone, ulRecordSize);
+        ulBytesWritten += ulWriteSize;
+        //DEBUG_PRINTF("avs_record_request ulBytesWritten %d\r\n", (int)ulWriteSize);
+    } while (1);
 
-            // convert stereo to mono in-place
-            audio_stereo_to_mono(pcMicrophone, pcMicrophone, ulRecordSize);
-            ulRecordSize = ulRecordSize >> 1;
+#if USE_RECORDPLAY_MUTEX
+    xSemaphoreGive(m_xMutexRecordPlay);
+#endif
 
-            // write mic data to SD card
-            uint32_t ulWriteSize = 0;
-            sdcard_write(&fHandle, pcMicrophone, ulRecordSize, (UINT*)&ulWriteSize);
-            if (ulRecordSize != ulWriteSize) {
-                DEBUG_PRINTF("avs_record_request(): sdcard_write failed! %d %d\r\n\r\n",
-                    (int)ulRecordSize, (int)ulWriteSize);
-                audio_mic_clear();
-                break;
+    // Close the file
+    sdcard_close(&fHandle);
+    DEBUG_PRINTF(">> %s %d bytes (16-bit, %s, mono) overruns %d dropped %d\r\n",
+        pcFileName, (int)ulBytesWritten, getConfigSamplingRateStr(),
+        (int)audio_recorder_overruns(), (int)audio_recorder_dropped());
+
+    return iRet;
+}
+
+
+#if USE_ZEROCOPY_SEND
+/////////////////////////////////////////////////////////////////////////////////////////////
+// Helper for avs_send_file
+// Reads and compresses up to ulSize encoded bytes into pcDst.
+// A compressed codec stages the 16-bit PCM in the audio buffer, one buffer at a time.
+// Returns the result of sdcard_read; *pulSize is the encoded size.
+/////////////////////////////////////////////////////////////////////////////////////////////
+static int avs_read_encode(FIL* pFile, char* pcDst, uint32_t ulSize, int lShift, uint32_t* pulSize)
+{
+    *pulSize = 0;
+
+    while (*pulSize < ulSize) {
+        char* pcRead = lShift ? g_pcAudioBuffer : pcDst + *pulSize;
+        uint32_t ulWanted = (ulSize - *pulSize) << lShift;
+        uint32_t ulReadSize = 0;
+        int iRet;
+
+        if (lShift && ulWanted > AVS_CONFIG_AUDIO_BUFFER_SIZE) {
+            ulWanted = AVS_CONFIG_AUDIO_BUFFER_SIZE;
+        }
+
+        uint32_t ulStart = TRACE_TIME();
+        iRet = sdcard_read(pFile, pcRead, ulWanted, (UINT*)&ulReadSize);
+        TRACE_DURATION(TRACE_SDCARD_READ, ulStart);
+        if (iRet != 0) {
+            return iRet;
+        }
+        if (!ulReadSize) {
+            break;
+        }
+
+        // Compress based on the negotiated codec
+        ulStart = TRACE_TIME();
+        *pulSize += avs_encode(pcRead, ulReadSize, pcDst + *pulSize);
+        TRACE_DURATION(TRACE_ENCODE, ulStart);
+
+        if (ulReadSize < ulWanted) {
+            break;
+        }
+    }
+
+    return 0;
+}
+#endif // USE_ZEROCOPY_SEND
+
+/////////////////////////////////////////////////////////////////////////////////////////////
+// Helper for avs_send_request and avs_resume_request
+// Sends the request from ulOffset (compressed bytes) to the end of the file.
+// With the framed protocol, each chunk is preceded by its AUDIO frame in the same buffer
+// and an upload interrupted by a send failure is remembered for avs_resume_request.
+// With USE_ZEROCOPY_SEND, each chunk is encoded into a slot of the SD card buffer
+// which lwIP sends without copying it; up to AVS_ZEROCOPY_SLOTS chunks are in flight.
+/////////////////////////////////////////////////////////////////////////////////////////////
+static int avs_send_file(const char* pcFileName, uint32_t ulOffset)
+{
+    FIL fHandle;
+    int iRet = 0;
+    int lShift = avs_get_codec_shift(g_uwSendCodec);
+    char* pcFrame = g_pcSDCardBuffer;
+    uint32_t ulHeaderSize = 0;
+#if USE_ZEROCOPY_SEND
+    TCommRequest atSlot[AVS_ZEROCOPY_SLOTS] = {{0}};
+    uint32_t ulSlots = 0;
+    uint32_t ulBufferSize = AVS_ZEROCOPY_SLOT_SIZE;
+    uint32_t ulBytesToProcess = 0;
+#else
+    uint32_t ulBufferSize = AVS_CONFIG_SDCARD_BUFFER_SIZE;
+#if (COMMUNICATION_IO==1)   // Ethernet
+    uint32_t ulBytesToProcess = AVS_CONFIG_SDCARD_BUFFER_SIZE>>1;
+#elif (COMMUNICATION_IO==2) // WiFi
+    uint32_t ulBytesToProcess = AVS_CONFIG_SDCARD_BUFFER_SIZE>>1; // comm_send returns once queued for AT+CIPSEND
+#elif (COMMUNICATION_IO==3) // RS485
+    uint32_t ulBytesToProcess = AVS_CONFIG_SDCARD_BUFFER_SIZE>>3;
+#elif (COMMUNICATION_IO==4) // Host
+    uint32_t ulBytesToProcess = AVS_CONFIG_SDCARD_BUFFER_SIZE>>1;
+#endif
+#endif // USE_ZEROCOPY_SEND
+    uint32_t ulBytesToTransfer = 0;
+    uint32_t ulBytesSent = ulOffset;
+
+
+#if USE_DO_DIR
+    DEBUG_PRINTF("\r\nChecking SD card directory...\r\n");
+    sdcard_dir("");
+#endif // USE_DO_DIR
+
+    DEBUG_PRINTF(">> openx\r\n");
+    // Open file given complete file path in SD card
+    if (sdcard_open(&fHandle, pcFileName, 0, 1)) {
+        DEBUG_PRINTF("avs_send_request(): sdcard_open failed!\r\n");
+        return 0;
+    }
+    DEBUG_PRINTF(">> open\r\n");
+
+    // Get file size
+    ulBytesToTransfer = sdcard_size(&fHandle);
+    if (!ulBytesToTransfer) {
+        DEBUG_PRINTF("avs_send_request(): sdcard_size failed!\r\n");
+        sdcard_close(&fHandle);
+        return 0;
+    }
+    DEBUG_PRINTF(">> %s %d bytes (16-bit)\r\n", pcFileName, (int)ulBytesToTransfer);
+    ulBytesToTransfer = ulBytesToTransfer >> lShift;
+    if (ulBytesSent > ulBytesToTransfer) {
+        ulBytesSent = ulBytesToTransfer;
+    }
+    sdcard_lseek(&fHandle, ulBytesSent << lShift);
+
+#if AVS_CONFIG_PROTOCOL_FRAMED
+    // Leave room for the frame in front of the payload
+    if (g_uwProtocol >= DEVICE_PROTOCOL_VERSION_FRAMED) {
+        ulHeaderSize = sizeof(TDeviceFrame);
+    }
+#endif
+    ulBufferSize -= ulHeaderSize;
+#if USE_ZEROCOPY_SEND
+    // A chunk fills a slot
+    ulBytesToProcess = ulBufferSize;
+#else
+    if ((ulBytesToProcess << lShift) > ulBufferSize) {
+        ulBytesToProcess = ulBufferSize >> lShift;
+    }
+#endif
+    audio_adpcm_reset(&g_tSendAdpcm);
+
+#if USE_SENDRECV_MUTEX
+    xSemaphoreTake(m_xMutexSendRecv, pdMS_TO_TICKS(portMAX_DELAY));
+#endif
+
+    // Set a timeout for the operation
+    comm_setsockopt(AVS_CONFIG_TX_TIMEOUT, 1);
+
+    // Negotiate the bytes to transfer
+    TRACE_EVENT(TRACE_SEND_BEGIN, ulBytesToTransfer - ulBytesSent);
+    if (!ulHeaderSize) {
+        iRet = comm_send((char*)&ulBytesToTransfer, sizeof(ulBytesToTransfer));
+        if (iRet != sizeof(ulBytesToTransfer)) {
+            DEBUG_PRINTF("avs_send_request(): send failed! %d %d\r\n\r\n", iRet, sizeof(ulBytesToTransfer));
+            iRet = 0;
+            goto err;
+        }
+    }
+
+
+    // Set a timeout for the operation
+    comm_setsockopt(AVS_CONFIG_TX_TIMEOUT, 1);
+
+    while (ulBytesSent != ulBytesToTransfer) {
+        // Compute the transfer size
+        if (ulBytesToTransfer-ulBytesSent < ulBytesToProcess) {
+            ulBytesToProcess = ulBytesToTransfer-ulBytesSent;
+        }
+
+        char* pcPayload = pcFrame + ulHeaderSize;
+#if USE_ZEROCOPY_SEND
+        // Wait for the next slot to be sent and acknowledged; its request completes on the acknowledgement
+        uint32_t ulSlot = ulSlots % AVS_ZEROCOPY_SLOTS;
+        if (ulSlots >= AVS_ZEROCOPY_SLOTS) {
+            if (comm_wait(&atSlot[ulSlot]) != COMM_STATUS_DONE) {
+                DEBUG_PRINTF("avs_send_request(): send failed! %d %d\r\n\r\n", atSlot[ulSlot].m_lSize, atSlot[ulSlot].m_lTransferred);
+                goto err_send;
+            }
+        }
+        pcPayload = g_pcSDCardBuffer + ulSlot * AVS_ZEROCOPY_SLOT_SIZE + ulHeaderSize;
+
+        // Read from SD card and compress into the slot
+        uint32_t ulReadSize = 0;
+        iRet = avs_read_encode(&fHandle, pcPayload, ulBytesToProcess, lShift, &ulReadSize);
+#else
+        char* pcRead = pcPayload;
+
+        // Read from SD card
+        uint32_t ulReadSize = 0;
+        uint32_t ulStart = TRACE_TIME();
+        iRet = sdcard_read(&fHandle, pcRead, ulBytesToProcess << lShift, (UINT*)&ulReadSize);
+        TRACE_DURATION(TRACE_SDCARD_READ, ulStart);
+#endif
+        if (iRet != 0) {
+            DEBUG_PRINTF(">> avs_send_request(): iRet = %d\r\n", iRet);
+            iRet = 0;
+            goto err;
+        }
+
+        if (ulReadSize) {
+#if !USE_ZEROCOPY_SEND
+            // Compress based on the negotiated codec
+            ulStart = TRACE_TIME();
+            ulReadSize = avs_encode(pcRead, ulReadSize, pcPayload);
+            TRACE_DURATION(TRACE_ENCODE, ulStart);
+#endif
+            uint32_t ulFrameSize = ulReadSize;
+
+#if AVS_CONFIG_PROTOCOL_FRAMED
+            if (ulHeaderSize) {
+                uint8_t ucFlags = 0;
+                if (ulBytesSent + ulReadSize == ulBytesToTransfer) {
+                    ucFlags |= DEVICE_FRAME_FLAG_END;
+                }
+                if (ulOffset && ulBytesSent == ulOffset) {
+                    ucFlags |= DEVICE_FRAME_FLAG_RESUME;
+                }
+                ulFrameSize += avs_set_frame(pcPayload - ulHeaderSize, ucFlags, ulBytesSent, ulReadSize);
             }
+#endif
 
-            // Clear interrupt flag
-            audio_mic_clear();
+            // Send the converted bytes
+#if USE_ZEROCOPY_SEND
+            // Queue the slot and continue with the next one while it is sent
+            atSlot[ulSlot].m_pcBuffer = pcPayload - ulHeaderSize;
+            atSlot[ulSlot].m_lSize = ulFrameSize;
+            atSlot[ulSlot].m_ucFlags = COMM_FLAG_NOCOPY;
+            if (!comm_submit_send(&atSlot[ulSlot])) {
+                DEBUG_PRINTF("avs_send_request(): comm_submit_send failed!\r\n\r\n");
+                goto err_send;
+            }
+            ulSlots++;
+#else
+            iRet = comm_send(pcPayload - ulHeaderSize, ulFrameSize);
+            if (iRet != ulFrameSize) {
+                DEBUG_PRINTF("avs_send_request(): send failed! %d %d\r\n\r\n", (int)ulFrameSize, iRet);
+                goto err_send;
+            }
+#endif
+            //DEBUG_PRINTF(">> Sent %d bytes\r\n", size_tx);
+
+            // Compute the total bytes sent
+            ulBytesSent += ulReadSize;
+        }
+        else {
+            DEBUG_PRINTF(">> avs_send_request(): sdcard_read is 0\r\n");
+        }
+    }
+    iRet = ulBytesSent;
+    goto err;
+
+
+err_send:
+#if AVS_CONFIG_PROTOCOL_FRAMED
+    // Resume from the offset reported by the gateway after the next avs_connect
+    if (ulHeaderSize && strlen(pcFileName) < sizeof(g_acResumeFile)) {
+        if (pcFileName != g_acResumeFile) {
+            strcpy(g_acResumeFile, pcFileName);
+        }
+        g_uwResumeStream = g_uwSendStream;
+    }
+#endif
+    iRet = 0;
 
-            ulBytesWritten += ulWriteSize;
-            //DEBUG_PRINTF("avs_record_request ulBytesWritten %d\r\n", (int)ulWriteSize);
+err:
+#if USE_ZEROCOPY_SEND
+    // Keep the slots until they are sent and acknowledged by the gateway.
+    // After a failure, abort the connection so that lwIP drops them.
+    if (ulSlots) {
+        for (uint32_t i = 0; i < AVS_ZEROCOPY_SLOTS && i < ulSlots; i++) {
+            if (comm_wait(&atSlot[i]) != COMM_STATUS_DONE) {
+                iRet = 0;
+            }
         }
-    } while ((*fxnCallbackRecord)() && ulBytesWritten < AVS_CONFIG_MAX_RECORD_SIZE);
-
-#if USE_RECORDPLAY_MUTEX
-    xSemaphoreGive(m_xMutexRecordPlay);
+        if (!iRet) {
+            comm_disconnect();
+        }
+    }
 #endif
 
     // Close the file
     sdcard_close(&fHandle);
-    DEBUG_PRINTF(">> %s %d bytes (16-bit, %s, mono)\r\n",
-        pcFileName, (int)ulBytesWritten, getConfigSamplingRateStr());
 
-    audio_mic_end();
+#if USE_SENDRECV_MUTEX
+    xSemaphoreGive(m_xMutexSendRecv);
+#endif
 
-    return 1;
+    if (iRet) {
+        TRACE_EVENT(TRACE_SEND_END, ulBytesSent);
+    }
+    DEBUG_PRINTF(">> Total bytes sent %d (compressed)\r\n", (int)ulBytesSent);
+    return iRet;
 }
 
-
 /////////////////////////////////////////////////////////////////////////////////////////////
 // Sends the voice request to the RPI Alexa Gateway provided the filename of the voice recording in the SD card.
 // - Read 4KB from SD card
 // - Convert 4KB 16-bit to 2KB 8-bit
 // - Send 2KB to RPI
-// Audio sent: 8-bit u-law, 16KHZ, mono (1-channel)
+// Audio sent: 8-bit u-law, 16KHZ, mono (1-channel); or the codec selected in avs_connect
 /////////////////////////////////////////////////////////////////////////////////////////////
 int avs_send_request(const char* pcFileName)
 {
-    FIL fHandle;
-    int iRet = 0;
-    char* pcSDCard = g_pcSDCardBuffer;
-#if (COMMUNICATION_IO==1)   // Ethernet
-    uint32_t ulBytesToProcess = AVS_CONFIG_SDCARD_BUFFER_SIZE>>1;
-#elif (COMMUNICATION_IO==2) // WiFi
-    uint32_t ulBytesToProcess = AVS_CONFIG_SDCARD_BUFFER_SIZE>>3;
+#if AVS_CONFIG_PROTOCOL_FRAMED
+    avs_new_stream();
 #endif
-    uint32_t ulBytesToTransfer = 0;
-    uint32_t ulBytesSent = 0;
+    return avs_send_file(pcFileName, 0);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////
+// Sends the rest of the request of avs_send_request interrupted by a disconnection,
+// from the bytes the gateway reported to have in avs_connect.
+// Returns -1 when there is no upload to resume.
+/////////////////////////////////////////////////////////////////////////////////////////////
+int avs_resume_request(void)
+{
+#if AVS_CONFIG_PROTOCOL_FRAMED
+    if (g_uwResumeStream && g_uwProtocol >= DEVICE_PROTOCOL_VERSION_FRAMED) {
+        DEBUG_PRINTF(">> Resuming stream %d from %d\r\n", g_uwResumeStream, (int)g_ulResumeOffset);
+        g_uwSendStream = g_uwResumeStream;
+        g_uwResumeStream = 0;
+        return avs_send_file(g_acResumeFile, g_ulResumeOffset);
+    }
+#endif
+    return -1;
+}
 
 
-#if USE_DO_DIR
-    DEBUG_PRINTF("\r\nChecking SD card directory...\r\n");
-    sdcard_dir("");
-#endif // USE_DO_DIR
+/////////////////////////////////////////////////////////////////////////////////////////////
+// Records the voice request from microphone and sends it to the RPI Alexa Gateway while recording,
+// bypassing the SD card.
+// - Read 1KB mono from microphone ring (filled by I2S interrupt)
+// - Convert 1KB 16-bit to 512 bytes 8-bit
+// - Send 4-byte length + 512 bytes to RPI
+// The request size is not known in advance so AVS_REQUEST_SIZE_STREAMED is sent in place of it,
+// then each frame is preceded by its 4-byte length and a 4-byte 0 length ends the request.
+// With the framed protocol, each frame is preceded by its AUDIO frame instead
+// and an empty AUDIO frame with DEVICE_FRAME_FLAG_END ends the request.
+// Audio sent: 8-bit u-law, 16KHZ, mono (1-channel); or the codec selected in avs_connect
+/////////////////////////////////////////////////////////////////////////////////////////////
+int avs_record_and_send_request(char (*fxnCallbackRecord)(void))
+{
+    int iRet = 0;
+    char* pcFrame = g_pcAudioBuffer;
+    uint32_t* pulFrameSize = (uint32_t*)g_pcAudioBuffer;
+    uint32_t ulHeaderSize = sizeof(uint32_t);
+    char* pcPayload = NULL;
+    uint32_t ulRecordSize = 0;
+    uint32_t ulBytesRecorded = 0;
+    uint32_t ulBytesSent = 0;
+    char bRecording = 1;
 
-    DEBUG_PRINTF(">> openx\r\n");
-    // Open file given complete file path in SD card
-    if (sdcard_open(&fHandle, pcFileName, 0, 1)) {
-        DEBUG_PRINTF("avs_send_request(): sdcard_open failed!\r\n");
-        return 0;
-    }
-    DEBUG_PRINTF(">> open\r\n");
 
-    // Get file size
-    ulBytesToTransfer = sdcard_size(&fHandle);
-    if (!ulBytesToTransfer) {
-        DEBUG_PRINTF("avs_send_request(): sdcard_size failed!\r\n");
-        sdcard_close(&fHandle);
-        return 0;
-    }
-    sdcard_lseek(&fHandle, 0);
-    DEBUG_PRINTF(">> %s %d bytes (16-bit)\r\n", pcFileName, (int)ulBytesToTransfer);
-    if (AVS_CONFIG_AUDIO_SEND_BITDEPTH == DEVICE_CAPABILITIES_BITDEPTH_8) {
-        ulBytesToTransfer = (ulBytesToTransfer >> 1);
+#if AVS_CONFIG_PROTOCOL_FRAMED
+    if (g_uwProtocol >= DEVICE_PROTOCOL_VERSION_FRAMED) {
+        ulHeaderSize = sizeof(TDeviceFrame);
+        avs_new_stream();
     }
+#endif
+    pcPayload = pcFrame + ulHeaderSize;
 
 #if USE_SENDRECV_MUTEX
     xSemaphoreTake(m_xMutexSendRecv, pdMS_TO_TICKS(portMAX_DELAY));
@@ -459,67 +1607,105 @@ int avs_send_request(const char* pcFileName)
     comm_setsockopt(AVS_CONFIG_TX_TIMEOUT, 1);
 
     // Negotiate the bytes to transfer
-    iRet = comm_send((char*)&ulBytesToTransfer, sizeof(ulBytesToTransfer));
-    if (iRet != sizeof(ulBytesToTransfer)) {
-        DEBUG_PRINTF("avs_send_request(): send failed! %d %d\r\n\r\n", iRet, sizeof(ulBytesToTransfer));
-        iRet = 0;
-        goto err;
+    TRACE_EVENT(TRACE_SEND_BEGIN, 0);
+    if (ulHeaderSize == sizeof(uint32_t)) {
+        *pulFrameSize = AVS_REQUEST_SIZE_STREAMED;
+        iRet = comm_send(pcFrame, sizeof(uint32_t));
+        if (iRet != sizeof(uint32_t)) {
+            DEBUG_PRINTF("avs_record_and_send_request(): send failed! %d %d\r\n\r\n", iRet, sizeof(uint32_t));
+#if USE_SENDRECV_MUTEX
+            xSemaphoreGive(m_xMutexSendRecv);
+#endif
+            return 0;
+        }
     }
 
+    audio_adpcm_reset(&g_tSendAdpcm);
+    audio_resample_reset(&g_tSendResampler, g_ucSendRatio);
+#if AVS_CONFIG_VAD
+    avs_vad_begin();
+#endif
+    audio_recorder_begin();
+    TRACE_EVENT(TRACE_CAPTURE_BEGIN, 0);
 
-    // Set a timeout for the operation
-    comm_setsockopt(AVS_CONFIG_TX_TIMEOUT, 1);
-
-    while (ulBytesSent != ulBytesToTransfer) {
-        // Compute the transfer size
-        if (ulBytesToTransfer-ulBytesSent < ulBytesToProcess) {
-            ulBytesToProcess = ulBytesToTransfer-ulBytesSent;
+    // Send microphone input while callback function returns true
+    // Once the callback returns false, the samples still in the ring are sent
+    do {
+        if (bRecording && !((*fxnCallbackRecord)() && ulBytesRecorded < AVS_CONFIG_MAX_RECORD_SIZE)) {
+            avs_capture_end(ulBytesRecorded);
+            bRecording = 0;
+        }
+#if AVS_CONFIG_VAD
+        else if (bRecording && avs_vad_ended()) {
+            avs_capture_end(ulBytesRecorded);
+            bRecording = 0;
         }
 
-        // Read from SD card
-        uint32_t ulReadSize = 0;
-        iRet = sdcard_read(&fHandle, pcSDCard, ulBytesToProcess<<1, (UINT*)&ulReadSize);
-        if (iRet != 0) {
-            DEBUG_PRINTF(">> avs_send_request(): iRet = %d\r\n", iRet);
+        // Skip the silence before and after speech
+        ulRecordSize = avs_vad_read(pcPayload, AVS_CONFIG_STREAM_FRAME_SIZE, bRecording);
+#else
+        // Sleep until the microphone ring has a full frame
+        ulRecordSize = audio_recorder_read(pcPayload, AVS_CONFIG_STREAM_FRAME_SIZE, 100);
+#endif
+        if (!ulRecordSize) {
+            if (!bRecording) {
+                break;
+            }
+            continue;
+        }
+        ulBytesRecorded += ulRecordSize;
+
+        // Convert to the send rate and compress in-place based on the negotiated codec
+        uint32_t ulStart = TRACE_TIME();
+        ulRecordSize = avs_downsample(pcPayload, ulRecordSize);
+        ulRecordSize = avs_encode(pcPayload, ulRecordSize, pcPayload);
+        TRACE_DURATION(TRACE_ENCODE, ulStart);
+
+        // Send the length or frame and the converted bytes together
+        *pulFrameSize = ulRecordSize;
+#if AVS_CONFIG_PROTOCOL_FRAMED
+        if (ulHeaderSize != sizeof(uint32_t)) {
+            avs_set_frame(pcFrame, 0, ulBytesSent, ulRecordSize);
+        }
+#endif
+        iRet = comm_send(pcFrame, ulHeaderSize + ulRecordSize);
+        if (iRet != ulHeaderSize + ulRecordSize) {
+            DEBUG_PRINTF("avs_record_and_send_request(): send failed! %d %d\r\n\r\n", (int)ulRecordSize, iRet);
+            if (bRecording) {
+                avs_capture_end(ulBytesRecorded);
+            }
             iRet = 0;
             goto err;
         }
 
-        if (ulReadSize) {
-            if (AVS_CONFIG_AUDIO_SEND_BITDEPTH == DEVICE_CAPABILITIES_BITDEPTH_8) {
-                // Convert in-place from 16-bit to 8-bit
-                audio_pcm16_to_ulaw(ulReadSize, pcSDCard, pcSDCard);
-                ulReadSize = ulReadSize>>1;
-            }
-
-            // Send the converted bytes
-            iRet = comm_send(pcSDCard, ulReadSize);
-            if (iRet <= 0) {
-                DEBUG_PRINTF("avs_send_request(): send failed! %d %d\r\n\r\n", (int)ulReadSize, iRet);
-                iRet = 0;
-                goto err;
-            }
-            //DEBUG_PRINTF(">> Sent %d bytes\r\n", size_tx);
+        // Compute the total bytes sent
+        ulBytesSent += ulRecordSize;
+    } while (1);
 
-            // Compute the total bytes sent
-            ulBytesSent += iRet;
-        }
-        else {
-            DEBUG_PRINTF(">> avs_send_request(): sdcard_read is 0\r\n");
-        }
+    // End of request
+    *pulFrameSize = 0;
+#if AVS_CONFIG_PROTOCOL_FRAMED
+    if (ulHeaderSize != sizeof(uint32_t)) {
+        avs_set_frame(pcFrame, DEVICE_FRAME_FLAG_END, ulBytesSent, 0);
+    }
+#endif
+    iRet = comm_send(pcFrame, ulHeaderSize);
+    if (iRet != ulHeaderSize) {
+        DEBUG_PRINTF("avs_record_and_send_request(): send failed! %d %d\r\n\r\n", iRet, (int)ulHeaderSize);
+        iRet = 0;
+        goto err;
     }
     iRet = ulBytesSent;
+    TRACE_EVENT(TRACE_SEND_END, ulBytesSent);
 
 
 err:
-    // Close the file
-    sdcard_close(&fHandle);
-
 #if USE_SENDRECV_MUTEX
     xSemaphoreGive(m_xMutexSendRecv);
 #endif
 
-    DEBUG_PRINTF(">> Total bytes sent %d (8-bit compressed)\r\n", (int)ulBytesSent);
+    DEBUG_PRINTF(">> Total bytes sent %d (compressed) overruns %d dropped %d\r\n",
+        (int)ulBytesSent, (int)audio_recorder_overruns(), (int)audio_recorder_dropped());
     return iRet;
 }
 
@@ -529,7 +1715,7 @@ err:
 // - Recv 2KB from RPI
 // - Convert 8-bit to 16-bit
 // - Save 4KB to SD card
-// Audio received: 8-bit u-law, 16KHZ, mono (1-channel)
+// Audio received: 8-bit u-law, 16KHZ, mono (1-channel); or the codec selected in avs_connect
 // Audio saved:   16-bit PCM, 16KHZ, mono (1-channel)
 /////////////////////////////////////////////////////////////////////////////////////////////
 int avs_recv_response(const char* pcFileName)
@@ -538,8 +1724,7 @@ int avs_recv_response(const char* pcFileName)
     int iRet = 0;
     char* pcSDCard = g_pcSDCardBuffer;
     char* pcRecv = g_pcAudioBuffer;
-    uint32_t ulBytesToProcess = AVS_CONFIG_SDCARD_BUFFER_SIZE >> 1;
-    uint32_t ulBytesToReceive = 0;
+    uint32_t ulBytesToProcess = AVS_CONFIG_SDCARD_BUFFER_SIZE >> avs_get_codec_shift(g_uwRecvCodec);
     uint32_t ulBytesReceived = 0;
     uint32_t ulWriteSize = 0;
 
@@ -555,17 +1740,18 @@ int avs_recv_response(const char* pcFileName)
     comm_setsockopt(AVS_CONFIG_RX_TIMEOUT, 0);
 
     // Negotiate the bytes to transfer
-    iRet = comm_recv((char*)&ulBytesToReceive, sizeof(ulBytesToReceive));
-    if (iRet < sizeof(ulBytesToReceive)) {
-        DEBUG_PRINTF("avs_recv_response(): recv failed! %d %d errno %d\r\n\r\n", iRet, sizeof(ulBytesToReceive), comm_errno());
+    iRet = avs_recv_header();
+    if (iRet <= 0) {
+        // timedout or failed
         sdcard_close(&fHandle);
-        return 0;
+        return iRet;
     }
-    else if (ulBytesToReceive == 0) {
-        // timedout
-        return -1;
+    TRACE_EVENT(TRACE_RESPONSE_BEGIN, g_ulRecvRemaining);
+    DEBUG_PRINTF(">> Total bytes to recv %d (compressed)\r\n", (int)g_ulRecvRemaining);
+    if (ulBytesToProcess > AVS_CONFIG_AUDIO_BUFFER_SIZE) {
+        ulBytesToProcess = AVS_CONFIG_AUDIO_BUFFER_SIZE;
     }
-    DEBUG_PRINTF(">> Total bytes to recv %d (8-bit compressed)\r\n", (int)ulBytesToReceive);
+    audio_adpcm_reset(&g_tRecvAdpcm);
 
 
     // Set a timeout for the operation
@@ -573,9 +1759,22 @@ int avs_recv_response(const char* pcFileName)
 
     // Receive the total bytes in segments of buffer size
     do {
+        // Receive the header of the next audio segment
+        if (!g_ulRecvRemaining) {
+            if (g_bRecvEnd) {
+                break;
+            }
+            if (avs_recv_header() <= 0) {
+                sdcard_close(&fHandle);
+                return 0;
+            }
+            continue;
+        }
+
         // Compute the transfer size
-        if (ulBytesToReceive-ulBytesReceived < ulBytesToProcess) {
-            ulBytesToProcess = ulBytesToReceive-ulBytesReceived;
+        uint32_t ulRecvSize = ulBytesToProcess;
+        if (g_ulRecvRemaining < ulRecvSize) {
+            ulRecvSize = g_ulRecvRemaining;
         }
 
 #if USE_SENDRECV_MUTEX
@@ -583,9 +1782,9 @@ int avs_recv_response(const char* pcFileName)
 #endif
 
         // Receive the bytes of transfer size
-        iRet = comm_recv(pcRecv, ulBytesToProcess);
+        iRet = comm_recv(pcRecv, ulRecvSize);
         if (iRet <= 0) {
-            DEBUG_PRINTF("avs_recv_response(): recv failed! %d %d errno %d\r\n\r\n", (int)ulBytesToProcess, iRet, comm_errno());
+            DEBUG_PRINTF("avs_recv_response(): recv failed! %d %d errno %d\r\n\r\n", (int)ulRecvSize, iRet, comm_errno());
             sdcard_close(&fHandle);
 #if USE_SENDRECV_MUTEX
             xSemaphoreGive(m_xMutexSendRecv);
@@ -601,19 +1800,23 @@ int avs_recv_response(const char* pcFileName)
 
         // Compute the total bytes received
         ulBytesReceived += iRet;
+        g_ulRecvRemaining -= iRet;
 
         // Compress bytes based on configuration settings
         char* pBuffer = pcRecv;
-        if (AVS_CONFIG_AUDIO_RECV_BITDEPTH == DEVICE_CAPABILITIES_BITDEPTH_8) {
-            // Convert 8-bit data to 16-bit data before saving
-            audio_ulaw_to_pcm16(iRet, pcRecv, pcSDCard);
-            iRet = iRet<<1;
+        uint32_t ulStart = TRACE_TIME();
+        if (g_uwRecvCodec == DEVICE_CODEC_ULAW || g_uwRecvCodec == DEVICE_CODEC_ADPCM) {
+            // Convert to 16-bit data before saving
+            iRet = avs_decode(pcRecv, iRet, pcSDCard);
             pBuffer = pcSDCard;
+            TRACE_DURATION(TRACE_DECODE, ulStart);
         }
 
         // Save to 16-bit decoded data to SD card
         ulWriteSize = 0;
+        ulStart = TRACE_TIME();
         sdcard_write(&fHandle, pBuffer, iRet, (UINT*)&ulWriteSize);
+        TRACE_DURATION(TRACE_SDCARD_WRITE, ulStart);
         if (iRet != ulWriteSize) {
             DEBUG_PRINTF("avs_recv_response(): sdcard_write failed! %d %d\r\n\r\n", iRet, (int)ulWriteSize);
             sdcard_close(&fHandle);
@@ -621,12 +1824,13 @@ int avs_recv_response(const char* pcFileName)
         }
         //DEBUG_PRINTF(">> Wrote %d bytes to SD card\r\n", ulWriteSize);
     }
-    while (ulBytesReceived < ulBytesToReceive);
+    while (g_ulRecvRemaining || !g_bRecvEnd);
+    TRACE_EVENT(TRACE_RESPONSE_END, ulBytesReceived);
 
 
     // Close the file
     sdcard_close(&fHandle);
-    DEBUG_PRINTF(">> %s %d bytes (16-bit)\r\n", pcFileName, (int)ulBytesReceived<<1);
+    DEBUG_PRINTF(">> %s %d bytes (16-bit)\r\n", pcFileName, (int)ulBytesReceived << avs_get_codec_shift(g_uwRecvCodec));
 
 #if USE_DO_DIR
     // f_read fails when sd_dir() is not called for some reason
@@ -642,8 +1846,8 @@ int avs_recv_response(const char* pcFileName)
 // Play audio file from SD card given the complete file path
 // - Read 4KB from SD card
 // - For each 1KB, convert from mono (1KB) to stereo (2KB)
-// - Play 2KB on speaker
-// Audio read:   16-bit PCM, 16KHZ, mono (1-channel)
+// - Queue 2KB to the speaker; the I2S interrupt plays it while the next 4KB is read
+// Audio read:   16-bit PCM, 16KHZ, mono (1-channel); upsampled from the recv rate if lower
 // Audio played: 16-bit PCM, 16KHZ, stereo (2-channels)
 /////////////////////////////////////////////////////////////////////////////////////////////
 int avs_play_response(const char* pcFileName)
@@ -652,18 +1856,16 @@ int avs_play_response(const char* pcFileName)
     uint32_t ulFileSize = 0;
     uint32_t ulFileOffset = 0;
     uint32_t ulReadSize = 0;
-    char* pcSpeaker = g_pcAudioBuffer;
+    char* pcSpeaker = NULL;
     char* pcSDCard = g_pcSDCardBuffer;
     uint32_t ulPlayed = 0;
     uint32_t ulTransferSize = AVS_CONFIG_AUDIO_BUFFER_SIZE<<1;
+    int iRet = 1;
 
 
-    audio_speaker_begin();
-
     // Open file given complete file path in SD card
     if (sdcard_open(&fHandle, pcFileName, 0, 1)) {
         DEBUG_PRINTF("avs_play_response(): sdcard_open failed!\r\n");
-        audio_speaker_end();
         return 0;
     }
 
@@ -672,43 +1874,56 @@ int avs_play_response(const char* pcFileName)
     if (!ulFileSize) {
         DEBUG_PRINTF("avs_play_response(): sdcard_size failed!\r\n");
         sdcard_close(&fHandle);
-        audio_speaker_end();
         return 0;
     }
     DEBUG_PRINTF(">> %s %d bytes (16-bit, %s, mono)\r\n",
         pcFileName, (int)ulFileSize, getConfigSamplingRateStr());
 
 
+    audio_resample_reset(&g_tRecvResampler, g_ucRecvRatio);
+    audio_player_begin();
+
     // This code maximizes FIFO sizes of SD CARD (4KB) and SPEAKER (2KB)
-    // As a result, transfers are efficient and audio quality is very good
+    // The speaker ping-pong buffers (2x2KB) cover the SD card read of the next 4KB
     do {
         // Read 4KB data from SD card to buffer
         ulReadSize = 0;
+        uint32_t ulStart = TRACE_TIME();
         sdcard_read(&fHandle, pcSDCard, ulTransferSize, (UINT*)&ulReadSize);
+        TRACE_DURATION(TRACE_SDCARD_READ, ulStart);
+        if (!ulReadSize) {
+            DEBUG_PRINTF("avs_play_response(): sdcard_read failed!\r\n");
+            iRet = 0;
+            break;
+        }
         ulFileOffset += ulReadSize;
 
         // Write 4KB in 1KB (MONO) chunks (==2KB for STEREO)
         ulPlayed = 0;
-        uint32_t ulPlaySize = 1024;
+        uint32_t ulPlaySize = ((audio_player_buffer_size()>>1) / g_ucRecvRatio) & ~1;
         do {
-            // Process transfer if the speaker FIFO is empty
-            if (audio_speaker_ready()) {
-                if (ulReadSize - ulPlayed < ulPlaySize) {
-                    ulPlaySize = ulReadSize - ulPlayed;
-                }
-
-                // Input is mono 1 channel; speaker requires stereo 2 channels
-                audio_mono_to_stereo(pcSpeaker, pcSDCard + ulPlayed, ulPlaySize);
-
-                // Play buffer to speaker
-                audio_play((uint8_t *)pcSpeaker, ulPlaySize<<1);
+            if (ulReadSize - ulPlayed < ulPlaySize) {
+                ulPlaySize = ulReadSize - ulPlayed;
+            }
 
-                // Clear interrupt flag
-                audio_speaker_clear();
+            // Sleep until the speaker releases a buffer
+            pcSpeaker = audio_player_buffer();
+            if (!pcSpeaker) {
+                DEBUG_PRINTF("avs_play_response(): audio_player_buffer failed!\r\n");
+                iRet = 0;
+                break;
+            }
 
-                // Increment offset
-                ulPlayed += ulPlaySize;
+            // Input is mono 1 channel; speaker requires stereo 2 channels
+            ulStart = TRACE_TIME();
+            audio_player_submit(avs_upsample_stereo(pcSDCard + ulPlayed, ulPlaySize, pcSpeaker));
+            TRACE_DURATION(TRACE_DECODE, ulStart);
+            if (ulFileOffset == ulReadSize && !ulPlayed) {
+                TRACE_EVENT(TRACE_PLAY_BEGIN, 0);
             }
+
+            // Increment offset
+            ulPlayed += ulPlaySize;
         }
         while (ulPlayed < ulReadSize);
 
@@ -717,16 +1932,20 @@ int avs_play_response(const char* pcFileName)
             ulTransferSize = ulFileSize - ulFileOffset;
         }
 
-    } while (ulFileOffset != ulFileSize);
+    } while (iRet && ulFileOffset != ulFileSize);
+
+    // Wait for the queued audio to be played
+    audio_player_end();
+    TRACE_EVENT(TRACE_PLAY_END, ulFileOffset);
 
+    // Apply the volume changed during the playback
+    avs_notify_volume();
 
     // Close the file
     sdcard_close(&fHandle);
 
-    audio_speaker_end();
-
-    DEBUG_PRINTF(">> Total bytes played %d\r\n", (int)ulFileSize);
-    return 1;
+    DEBUG_PRINTF(">> Total bytes played %d\r\n", (int)ulFileOffset);
+    return iRet;
 }
 
 
@@ -734,42 +1953,60 @@ int avs_play_response(const char* pcFileName)
 // Recv and play Alexa response without saving to SD card
 // - Recv 512 bytes from RPI
 // - Convert 8-bit mono (512) to 16-bit stereo (2KB)
-// - Play 2KB on speaker
+// - Queue 2KB to the speaker; the I2S interrupt plays it while the next 512 bytes are received
 /////////////////////////////////////////////////////////////////////////////////////////////
 int avs_recv_and_play_response(char (*fxnCallbackExit)(void))
 {
     int iRet = 0;
     char* pcRecv = g_pcSDCardBuffer;
-    char* pcSpeaker = g_pcAudioBuffer;
-    uint32_t ulBytesToProcess = AVS_CONFIG_AUDIO_BUFFER_SIZE>>2;
-    uint32_t ulBytesToReceive = 0;
+    char* pcSpeaker = NULL;
+    uint32_t ulBytesToProcess = avs_get_play_size();
     uint32_t ulBytesReceived = 0;
+    char bPlaying = 0;
 
 
     // Set a timeout for the operation
     comm_setsockopt(1, 0);
 
     // Negotiate the bytes to transfer
-    iRet = comm_recv((char*)&ulBytesToReceive, sizeof(ulBytesToReceive));
-    if (iRet < sizeof(ulBytesToReceive)) {
-        DEBUG_PRINTF("avs_recv_and_play_response(): recv failed! %d %d errno %d\r\n\r\n", iRet, sizeof(ulBytesToReceive), comm_errno());
-        return 0;
-    }
-    else if (ulBytesToReceive == 0) {
-        // timedout
-        return -1;
+    iRet = avs_recv_header();
+    if (iRet <= 0) {
+        // timedout or failed
+        return iRet;
     }
-    DEBUG_PRINTF(">> Total bytes to recv %d (8-bit compressed)\r\n", (int)ulBytesToReceive);
+    TRACE_EVENT(TRACE_RESPONSE_BEGIN, g_ulRecvRemaining);
+    DEBUG_PRINTF(">> Total bytes to recv %d (compressed)\r\n", (int)g_ulRecvRemaining);
 
 
 #if USE_RECORDPLAY_MUTEX
     xSemaphoreTake(m_xMutexRecordPlay, pdMS_TO_TICKS(portMAX_DELAY));
 #endif // USE_RECORDPLAY_MUTEX
 
-    audio_speaker_begin();
+    audio_adpcm_reset(&g_tRecvAdpcm);
+    audio_resample_reset(&g_tRecvResampler, g_ucRecvRatio);
+    audio_player_begin();
 
     // Receive the total bytes in segments of buffer size
     do {
+        // Receive the header of the next audio segment
+        if (!g_ulRecvRemaining) {
+            if (g_bRecvEnd) {
+                break;
+            }
+            comm_setsockopt(AVS_CONFIG_RX_TIMEOUT, 0);
+            if (avs_recv_header() <= 0) {
+                ulBytesReceived = 0;
+                break;
+            }
+            continue;
+        }
+
+        // Compute the transfer size
+        uint32_t ulRecvSize = ulBytesToProcess;
+        if (g_ulRecvRemaining < ulRecvSize) {
+            ulRecvSize = g_ulRecvRemaining;
+        }
+
         // When exit callback returns true,
         // we still receive outstanding data but we dont play it.
         // This enables us to process higher priority data
@@ -782,12 +2019,12 @@ int avs_recv_and_play_response(char (*fxnCallbackExit)(void))
 
         // Set a timeout for the operation
         comm_setsockopt(AVS_CONFIG_RX_TIMEOUT, 0);
-        DEBUG_PRINTF("recv = %d %d\r\n", ulBytesToProcess, ulBytesReceived);
+        DEBUG_PRINTF("recv = %d %d\r\n", ulRecvSize, ulBytesReceived);
 
         // Receive the bytes of transfer size
-        iRet = comm_recv(pcRecv, ulBytesToProcess);
+        iRet = comm_recv(pcRecv, ulRecvSize);
         if (iRet <= 0) {
-            DEBUG_PRINTF("avs_recv_and_play_response(): recv2 failed! %d %d errno %d\r\n\r\n", (int)ulBytesToProcess, iRet, comm_errno());
+            DEBUG_PRINTF("avs_recv_and_play_response(): recv2 failed! %d %d errno %d\r\n\r\n", (int)ulRecvSize, iRet, comm_errno());
 #if USE_SENDRECV_MUTEX
             xSemaphoreGive(m_xMutexSendRecv);
 #endif // USE_SENDRECV_MUTEX
@@ -804,44 +2041,42 @@ int avs_recv_and_play_response(char (*fxnCallbackExit)(void))
 
         // Compute the total bytes received
         ulBytesReceived += iRet;
+        g_ulRecvRemaining -= iRet;
 
         // When exit callback returns true,
         // we still receive outstanding data but we dont play it.
         if (!bExit) {
-            // Uncompress based on configuration setting
-            char* pBuffer = pcRecv;
-            if (AVS_CONFIG_AUDIO_RECV_BITDEPTH == DEVICE_CAPABILITIES_BITDEPTH_8) {
-                // Convert 8-bit mono data to 16-bit stereo data before playing
-                audio_ulaw_to_pcm16_stereo(iRet, pcRecv, pcSpeaker);
-                iRet = iRet<<2;
-                pBuffer = pcSpeaker;
+            // Sleep until the speaker releases a buffer
+            pcSpeaker = audio_player_buffer();
+            if (pcSpeaker) {
+                // Uncompress based on the negotiated codec
+                // Input is mono 1 channel; speaker requires 16-bit stereo 2 channels
+                uint32_t ulStart = TRACE_TIME();
+                iRet = avs_decode_stereo(pcRecv, iRet, pcSpeaker);
+                TRACE_DURATION(TRACE_DECODE, ulStart);
+
+                // Queue to speaker
+                audio_player_submit(iRet);
+                if (!bPlaying) {
+                    TRACE_EVENT(TRACE_PLAY_BEGIN, 0);
+                    bPlaying = 1;
+                }
             }
-            else if (AVS_CONFIG_AUDIO_RECV_BITDEPTH == DEVICE_CAPABILITIES_BITDEPTH_16) {
-                // Input is mono 1 channel; speaker requires stereo 2 channels
-                audio_mono_to_stereo(pcSpeaker, pcRecv, iRet);
-                iRet = iRet<<1;
-                pBuffer = pcSpeaker;
+            else {
+                DEBUG_PRINTF("avs_recv_and_play_response(): audio_player_buffer failed!\r\n");
             }
-
-            // Play on speaker
-            do {
-                if (audio_speaker_ready()) {
-                    audio_play((uint8_t *)pBuffer, iRet);
-                    audio_speaker_clear();
-                    break;
-                }
-            } while (1);
-        }
-
-        // Compute the transfer size
-        if (ulBytesToReceive-ulBytesReceived < ulBytesToProcess) {
-            ulBytesToProcess = ulBytesToReceive-ulBytesReceived;
         }
     }
-    while (ulBytesReceived < ulBytesToReceive);
+    while (g_ulRecvRemaining || !g_bRecvEnd);
     DEBUG_PRINTF(">> Recv  %d bytes\r\n", ulBytesReceived);
+    TRACE_EVENT(TRACE_RESPONSE_END, ulBytesReceived);
 
-    audio_speaker_end();
+    // Wait for the queued audio to be played
+    audio_player_end();
+    TRACE_EVENT(TRACE_PLAY_END, 0);
+
+    // Apply the volume changed during the playback
+    avs_notify_volume();
 
 #if USE_RECORDPLAY_MUTEX
     xSemaphoreGive(m_xMutexRecordPlay);
@@ -853,231 +2088,312 @@ int avs_recv_and_play_response(char (*fxnCallbackExit)(void))
 
 #if USE_MULTITHREADED_RECVPLAY
 /////////////////////////////////////////////////////////////////////////////////////////////
-// Recv and play Alexa response in separate threads
-// - Recv 2KB from RPI
-// - Convert 8-bit to 16-bit (1KB)
-// - Save 4KB to SD card
+// Recv and play Alexa response in separate threads without saving to SD card
+// - Recv up to 1KB from RPI directly into the jitter buffer
+// - Player thread starts once the prebuffer watermark is reached
+// - Player thread converts 8-bit mono (512) to 16-bit stereo (2KB) and queues it to the speaker
+// The receiver sleeps when the jitter buffer is full; TCP flow control then throttles the RPI.
 /////////////////////////////////////////////////////////////////////////////////////////////
-int avs_recv_and_play_response_threaded(const char* pcFileName)
+int avs_recv_and_play_response_threaded(char (*fxnCallbackExit)(void))
 {
     int iRet = 0;
-    int iSignalled = 0;
-    char acSDCard[AVS_CONFIG_SDCARD_BUFFER_SIZE];
-    char acRecv[AVS_CONFIG_SDCARD_BUFFER_SIZE>>1];
-    uint32_t ulBytesToProcess = sizeof(acRecv);
+    char* pcDiscard = g_pcSDCardBuffer;
+    char* pcBuffer = g_hContext.m_pcBuffer;
+    uint32_t ulBytesToProcess = AVS_CONFIG_AUDIO_BUFFER_SIZE>>1;
     uint32_t ulBytesReceived = 0;
-
-
-    // Initialize structure
-    g_hContext.m_ulWriteSize = 0;
-    g_hContext.m_ulReadSize = 0;
-    g_hContext.m_ulRecvSize = 0;
-
-    // Open file given complete file path in SD card
-    if (sdcard_open(&g_hContext.m_fHandle, pcFileName, 1, 1)) {
-        DEBUG_PRINTF("avs_recv_and_play_response_threaded(): sd_open failed!\r\n");
-        return 0;
-    }
+    char bOverrun = 0;
 
 
     // Set a timeout for the operation
-    comm_setsockopt(AVS_CONFIG_RX_TIMEOUT, 0);
+    comm_setsockopt(1, 0);
 
     // Negotiate the bytes to transfer
-    iRet = comm_recv((char*)&g_hContext.m_ulRecvSize, sizeof(g_hContext.m_ulRecvSize));
-    if (iRet < sizeof(g_hContext.m_ulRecvSize)) {
-        DEBUG_PRINTF("avs_recv_and_play_response_threaded(): recv failed! %d %d\r\n\r\n", iRet, sizeof(g_hContext.m_ulRecvSize));
-        sdcard_close(&g_hContext.m_fHandle);
-        return 0;
+    iRet = avs_recv_header();
+    if (iRet <= 0) {
+        // timedout or failed
+        return iRet;
     }
-    DEBUG_PRINTF(">> Total bytes to recv %d (8-bit compressed)\r\n", (int)g_hContext.m_ulRecvSize);
+    TRACE_EVENT(TRACE_RESPONSE_BEGIN, g_ulRecvRemaining);
+    DEBUG_PRINTF(">> Total bytes to recv %d (compressed)\r\n", (int)g_ulRecvRemaining);
 
 
-    // Set a timeout for the operation
-    comm_setsockopt(AVS_CONFIG_RX_TIMEOUT, 0);
+#if USE_RECORDPLAY_MUTEX
+    xSemaphoreTake(m_xMutexRecordPlay, pdMS_TO_TICKS(portMAX_DELAY));
+#endif // USE_RECORDPLAY_MUTEX
+
+    // Start the player thread
+    TRACE_EVENT(TRACE_JITTER_PREBUFFER, g_hContext.m_ulWatermark);
+    g_hContext.m_ulHead = 0;
+    g_hContext.m_ulTail = 0;
+    g_hContext.m_ucFinished = 0;
+    g_hContext.m_ucFlush = 0;
+    g_hContext.m_xReceiver = xTaskGetCurrentTaskHandle();
+    ulTaskNotifyTake(pdTRUE, 0);
+    g_hContext.m_ucActive = 1;
+    xTaskNotifyGive(g_hContext.m_xTask);
 
     // Receive the total bytes in segments of buffer size
     do {
-        // Compute the transfer size
-        ulBytesToProcess = sizeof(acRecv);
-        if (g_hContext.m_ulRecvSize - ulBytesReceived < ulBytesToProcess) {
-            ulBytesToProcess = g_hContext.m_ulRecvSize - ulBytesReceived;
+        // When exit callback returns true,
+        // we still receive outstanding data but we dont play it.
+        if (!g_hContext.m_ucFlush && (*fxnCallbackExit)()) {
+            g_hContext.m_ucFlush = 1;
+            xTaskNotifyGive(g_hContext.m_xTask);
         }
 
-        // Save to 16-bit decoded data to SD card
-        // Take the semaphore
-        if (xSemaphoreTake(g_hContext.m_xMutexFile, pdMS_TO_TICKS(1000)) == pdTRUE) {
-
-            // Receive the bytes of transfer size
-            iRet = comm_recv(acRecv, ulBytesToProcess);
-            if (iRet <= 0) {
-                DEBUG_PRINTF("avs_recv_and_play_response_threaded(): recv failed! %d %d\r\n\r\n", (int)ulBytesToProcess, iRet);
-                if (ulBytesReceived) {
-                    xSemaphoreTake(g_hContext.m_xMutexRun, pdMS_TO_TICKS(portMAX_DELAY));
-                }
-                sdcard_close(&g_hContext.m_fHandle);
-                return 0;
+        // Receive the header of the next audio segment
+        if (!g_ulRecvRemaining) {
+            if (g_bRecvEnd) {
+                break;
             }
-            //tfp_printf(">> Recv  %d bytes %d\r\n", iRet, g_hContext.m_ulWriteSize);
-
-            // Uncompress based on configuration setting
-            char* pBuffer = acRecv;
-            if (AVS_CONFIG_AUDIO_RECV_BITDEPTH == DEVICE_CAPABILITIES_BITDEPTH_8) {
-                // Convert 8-bit data to 16-bit data before saving
-                audio_ulaw_to_pcm16(iRet, acRecv, acSDCard);
-                iRet = iRet<<1;
-                pBuffer = acSDCard;
+            comm_setsockopt(AVS_CONFIG_RX_TIMEOUT, 0);
+            if (avs_recv_header() <= 0) {
+                g_hContext.m_ucFlush = 1;
+                ulBytesReceived = 0;
+                break;
             }
+            continue;
+        }
+
+        // Compute the transfer size
+        uint32_t ulRecvSize = g_ulRecvRemaining;
+        if (ulRecvSize > ulBytesToProcess) {
+            ulRecvSize = ulBytesToProcess;
+        }
 
-            /* Get write position */
-            sdcard_lseek(&g_hContext.m_fHandle, g_hContext.m_ulWriteSize);
-            
-            /* Write data to specified position */
-            uint32_t ulWriteSize = 0;
-            sdcard_write(&g_hContext.m_fHandle, pBuffer, iRet, (UINT*)&ulWriteSize);
-            if (iRet != ulWriteSize) {
-                DEBUG_PRINTF("avs_recv_and_play_response_threaded(): sdcard_write failed! %d %d\r\n\r\n", iRet, (int)ulWriteSize);
-                xSemaphoreGive(g_hContext.m_xMutexFile);
-                if (ulBytesReceived) {
-                    xSemaphoreTake(g_hContext.m_xMutexRun, pdMS_TO_TICKS(portMAX_DELAY));
+        // Receive into the free contiguous span of the jitter buffer
+        char* pcRecv = pcDiscard;
+        if (!g_hContext.m_ucFlush) {
+            uint32_t ulHead = g_hContext.m_ulHead;
+            uint32_t ulOffset = ulHead & (AVS_CONFIG_JITTER_BUFFER_SIZE-1);
+            uint32_t ulFree = AVS_CONFIG_JITTER_BUFFER_SIZE - (ulHead - g_hContext.m_ulTail);
+            if (!ulFree) {
+                // The player stopped early: discard the rest of the response
+                if (!g_hContext.m_ucActive) {
+                    g_hContext.m_ucFlush = 1;
+                    continue;
                 }
-                sdcard_close(&g_hContext.m_fHandle);
-                return 0;
+                // Sleep until the player consumes
+                if (!bOverrun) {
+                    g_hContext.m_ulOverruns++;
+                    bOverrun = 1;
+                }
+                ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(100));
+                continue;
+            }
+            bOverrun = 0;
+            if (ulFree > AVS_CONFIG_JITTER_BUFFER_SIZE - ulOffset) {
+                ulFree = AVS_CONFIG_JITTER_BUFFER_SIZE - ulOffset;
             }
+            if (ulRecvSize > ulFree) {
+                ulRecvSize = ulFree;
+            }
+            pcRecv = pcBuffer + ulOffset;
+        }
+
+#if USE_SENDRECV_MUTEX
+        xSemaphoreTake(m_xMutexSendRecv, pdMS_TO_TICKS(portMAX_DELAY));
+#endif // USE_SENDRECV_MUTEX
 
-            g_hContext.m_ulWriteSize += ulWriteSize;
+        // Set a timeout for the operation
+        comm_setsockopt(AVS_CONFIG_RX_TIMEOUT, 0);
 
-            /* Release semaphone */
-            xSemaphoreGive(g_hContext.m_xMutexFile);
-            vTaskDelay(pdMS_TO_TICKS(1)); // Allow context switch
+        // Receive the bytes of transfer size
+        // The socket event task publishes them to the player thread as they arrive
+        TCommRequest tRequest = {0};
+        tRequest.m_pcBuffer = pcRecv;
+        tRequest.m_lSize = ulRecvSize;
+        if (pcRecv != pcDiscard) {
+            tRequest.m_fxnCallback = avs_recv_publish;
         }
-        else {
-            DEBUG_PRINTF("avs_recv_and_play_response_threaded(): xSemaphoreTake failed!\r\n\r\n");
+        iRet = comm_submit_recv(&tRequest) ? comm_wait(&tRequest) : COMM_STATUS_FAILED;
+        if (iRet != COMM_STATUS_DONE) {
+            DEBUG_PRINTF("avs_recv_and_play_response_threaded(): recv failed! %d %d errno %d\r\n\r\n", (int)ulRecvSize, iRet, comm_errno());
+#if USE_SENDRECV_MUTEX
+            xSemaphoreGive(m_xMutexSendRecv);
+#endif // USE_SENDRECV_MUTEX
+            g_hContext.m_ucFlush = 1;
+            ulBytesReceived = 0;
+            break;
         }
+        iRet = tRequest.m_lTransferred;
+
+#if USE_SENDRECV_MUTEX
+        xSemaphoreGive(m_xMutexSendRecv);
+#endif // USE_SENDRECV_MUTEX
 
         // Compute the total bytes received
         ulBytesReceived += iRet;
-
-        // Signal other thread to start
-        if (g_hContext.m_ulWriteSize>=4096 && !iSignalled) {
-            xSemaphoreGive(g_hContext.m_xMutexRun);
-            iSignalled = 1;
-        }
+        g_ulRecvRemaining -= iRet;
     }
-    while (ulBytesReceived < g_hContext.m_ulRecvSize);
-
-    DEBUG_PRINTF(">> %s %d bytes (16-bit)\r\n", pcFileName, (int)ulBytesReceived<<1);
-
- 
-    xSemaphoreTake(g_hContext.m_xMutexRun, pdMS_TO_TICKS(portMAX_DELAY));
-    // Wait for semaphore before closing it
-    while (g_hContext.m_ulReadSize != g_hContext.m_ulWriteSize) {
-        vTaskDelay( pdMS_TO_TICKS(1) );
+    while (g_ulRecvRemaining || !g_bRecvEnd);
+    DEBUG_PRINTF(">> Recv  %d bytes\r\n", (int)ulBytesReceived);
+    TRACE_EVENT(TRACE_RESPONSE_END, ulBytesReceived);
+
+    // Wait for the player thread to play the rest
+    g_hContext.m_ucFinished = 1;
+    xTaskNotifyGive(g_hContext.m_xTask);
+    while (g_hContext.m_ucActive) {
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(100));
     }
+    g_hContext.m_xReceiver = NULL;
 
-    // Close the file
-    sdcard_close(&g_hContext.m_fHandle);
+#if USE_RECORDPLAY_MUTEX
+    xSemaphoreGive(m_xMutexRecordPlay);
+#endif // USE_RECORDPLAY_MUTEX
 
-    return 1;
+    DEBUG_PRINTF(">> Jitter buffer underruns %d overruns %d watermark %d\r\n",
+        (int)g_hContext.m_ulUnderruns, (int)g_hContext.m_ulOverruns, (int)g_hContext.m_ulWatermark);
+    return ulBytesReceived;
 }
 
 /////////////////////////////////////////////////////////////////////////////////////////////
 // Helper for avs_recv_and_play_response_threaded
-// - Read 4KB from SD card
-// - For each 1KB, convert from mono (1KB) to stereo (2KB)
-// - Play 2KB on speaker
+// Called by the socket event task while the receiver waits for its request.
+/////////////////////////////////////////////////////////////////////////////////////////////
+static void avs_recv_publish(TCommRequest* pRequest, int lBytes, int lStatus)
+{
+    if (lBytes) {
+        g_hContext.m_ulHead += lBytes;
+        xTaskNotifyGive(g_hContext.m_xTask);
+    }
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////
+// Helper for avs_recv_and_play_response_threaded
+// - Wait until the prebuffer watermark is reached
+// - Convert 8-bit mono (512) from the jitter buffer to 16-bit stereo (2KB)
+// - Queue 2KB to the speaker
+// The watermark grows after an underrun and shrinks slowly after a response played cleanly.
 /////////////////////////////////////////////////////////////////////////////////////////////
 static void vPlayerTask(void *pvParameters)
 {
     ThreadPlayerContext* pContext = (ThreadPlayerContext*)pvParameters;
-    char* pcSDCard = g_pcSDCardBuffer;
-    char* pcSpeaker = g_pcAudioBuffer;
-    uint32_t ulTransferSize = 0;
-    uint32_t ulReadSize = 0;
+    const uint32_t ulMask = AVS_CONFIG_JITTER_BUFFER_SIZE-1;
+    const uint32_t ulWatermarkMin = AVS_CONFIG_JITTER_PREBUFFER_SIZE>>1;
+    const uint32_t ulWatermarkMax = AVS_CONFIG_JITTER_BUFFER_SIZE - (AVS_CONFIG_JITTER_BUFFER_SIZE>>2);
+    uint32_t ulPlaySize = 0;
 
 
     while (1) {
 
-        // wait for signal
-        xSemaphoreTake(pContext->m_xMutexRun, pdMS_TO_TICKS(portMAX_DELAY));
+        // wait for signal; apply the volume changes meanwhile
+        while (!pContext->m_ucActive) {
+            ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+            avs_apply_volume();
+        }
+
+        ulPlaySize = avs_get_play_size();
+        audio_adpcm_reset(&g_tRecvAdpcm);
+        audio_resample_reset(&g_tRecvResampler, g_ucRecvRatio);
+
+        uint32_t ulUnderruns = pContext->m_ulUnderruns;
+        char bBuffering = 1;
+        char bPlaying = 0;
+#if AVS_CONFIG_TRACE
+        uint32_t ulLow = AVS_CONFIG_JITTER_BUFFER_SIZE;
+#endif
+        audio_player_begin();
 
-        audio_speaker_begin();
+        while (!pContext->m_ucFlush) {
+            uint32_t ulTail = pContext->m_ulTail;
+            uint32_t ulAvailable = pContext->m_ulHead - ulTail;
 
-        while (1) {
+            if (g_lVolumeRequest >= 0) {
+                avs_apply_volume();
+            }
 
-            // Take the semaphore
-            if (xSemaphoreTake(pContext->m_xMutexFile, pdMS_TO_TICKS(1000)) == pdTRUE) {
+            if (g_uwRecvCodec != DEVICE_CODEC_ULAW && g_uwRecvCodec != DEVICE_CODEC_ADPCM) {
+                ulAvailable &= ~1;
+            }
 
-                // Check if new written bytes are available for reading
-                if (pContext->m_ulWriteSize == 0 ||
-                    (pContext->m_ulWriteSize - pContext->m_ulReadSize < 4096 &&
-                     pContext->m_ulWriteSize < (pContext->m_ulRecvSize << 1) ) ) {
-                    xSemaphoreGive(pContext->m_xMutexFile);
-                    vTaskDelay(pdMS_TO_TICKS(1)); // Allow context switch
+            // Prebuffer before (re)starting playback
+            if (bBuffering) {
+                if (ulAvailable < pContext->m_ulWatermark && !pContext->m_ucFinished) {
+                    ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(100));
                     continue;
                 }
+                bBuffering = 0;
+            }
+#if AVS_CONFIG_TRACE
+            if (ulAvailable < ulLow && !pContext->m_ucFinished) {
+                ulLow = ulAvailable;
+            }
+#endif
 
-                // Compute size to transfer
-                ulTransferSize = AVS_CONFIG_SDCARD_BUFFER_SIZE;
-                if (pContext->m_ulWriteSize - pContext->m_ulReadSize < ulTransferSize) {
-                    ulTransferSize = pContext->m_ulWriteSize - pContext->m_ulReadSize;
+            if (!ulAvailable) {
+                if (pContext->m_ucFinished) {
+                    break;
                 }
-
-                // Get read position
-                sdcard_lseek(&pContext->m_fHandle, pContext->m_ulReadSize);
-
-                // Read data from SD card to buffer
-                ulReadSize = 0;
-                sdcard_read(&pContext->m_fHandle, pcSDCard, ulTransferSize, (UINT*)&ulReadSize);
-                //tfp_printf(">> Read  %d bytes %d\r\n", (int)ulReadSize, (int)g_hContext.m_ulReadSize);
-
-                // Increment bytes read
-                pContext->m_ulReadSize += ulReadSize;
-
-                // Write 4KB in 1KB (MONO) chunks (==2KB for STEREO)
-                uint32_t ulPlayed = 0;
-                uint32_t ulPlaySize = 1024;
-                do {
-                    // Process transfer if the speaker FIFO is empty
-                    if (audio_speaker_ready()) {
-                        if (ulReadSize - ulPlayed < ulPlaySize) {
-                            ulPlaySize = ulReadSize - ulPlayed;
-                        }
-
-                        // Input is mono 1 channel; speaker requires stereo 2 channels
-                        audio_mono_to_stereo(pcSpeaker, pcSDCard + ulPlayed, ulPlaySize);
-
-                        // Play buffer to speaker
-                        audio_play((uint8_t *)pcSpeaker, ulPlaySize<<1);
-                        // Increment offset
-                        ulPlayed += ulPlaySize;
-
-                        audio_speaker_clear();
-                    }
+                // Underrun; buffer more next time
+                pContext->m_ulUnderruns++;
+                pContext->m_ulWatermark += AVS_CONFIG_JITTER_PREBUFFER_SIZE>>1;
+                if (pContext->m_ulWatermark > ulWatermarkMax) {
+                    pContext->m_ulWatermark = ulWatermarkMax;
                 }
-                while (ulPlayed < ulReadSize);
+                bBuffering = 1;
+                continue;
+            }
 
-                // Release semaphone
-                xSemaphoreGive(pContext->m_xMutexFile);
-                vTaskDelay(pdMS_TO_TICKS(1)); // Allow context switch
+            // Convert the contiguous span of the jitter buffer
+            uint32_t ulOffset = ulTail & ulMask;
+            uint32_t ulSize = AVS_CONFIG_JITTER_BUFFER_SIZE - ulOffset;
+            if (ulSize > ulAvailable) {
+                ulSize = ulAvailable;
+            }
+            if (ulSize > ulPlaySize) {
+                ulSize = ulPlaySize;
+            }
 
+            // Sleep until the speaker releases a buffer
+            char* pcSpeaker = audio_player_buffer();
+            if (!pcSpeaker) {
+                DEBUG_PRINTF("vPlayerTask(): audio_player_buffer failed!\r\n");
+                pContext->m_ucFlush = 1;
+                break;
+            }
 
-                // Check if all bytes are read
-                if ((pContext->m_ulRecvSize << 1) <= pContext->m_ulReadSize) {
-                    break;
-                }
+            // Convert mono data to 16-bit stereo data before playing
+            uint32_t ulStart = TRACE_TIME();
+            audio_player_submit(avs_decode_stereo(pContext->m_pcBuffer + ulOffset, ulSize, pcSpeaker));
+            TRACE_DURATION(TRACE_DECODE, ulStart);
+            if (!bPlaying) {
+                TRACE_EVENT(TRACE_PLAY_BEGIN, 0);
+                bPlaying = 1;
             }
-            else {
-                DEBUG_PRINTF("avs_recv_and_play_response_threaded(): xSemaphoreTake failed!\r\n\r\n");
+
+            // Release the span to the receiver
+            pContext->m_ulTail = ulTail + ulSize;
+            if (pContext->m_xReceiver) {
+                xTaskNotifyGive(pContext->m_xReceiver);
             }
         }
-        
-        // Release semaphone
-        xSemaphoreGive(pContext->m_xMutexRun);
 
-        audio_speaker_end();
+        // Wait for the queued audio to be played
+        audio_player_end();
+        TRACE_EVENT(TRACE_PLAY_END, 0);
+#if AVS_CONFIG_TRACE
+        if (bPlaying) {
+            TRACE_EVENT(TRACE_JITTER_LOW, ulLow);
+        }
+#endif
+
+        // Apply the volume changed during the playback
+        avs_apply_volume();
 
-        vTaskDelay( pdMS_TO_TICKS(1000) ); // Allow context switch
+        // Played cleanly; try a smaller prebuffer next time
+        if (ulUnderruns == pContext->m_ulUnderruns && !pContext->m_ucFlush) {
+            pContext->m_ulWatermark -= pContext->m_ulWatermark>>3;
+            if (pContext->m_ulWatermark < ulWatermarkMin) {
+                pContext->m_ulWatermark = ulWatermarkMin;
+            }
+        }
+
+        // Signal the receiver
+        pContext->m_ucActive = 0;
+        if (pContext->m_xReceiver) {
+            xTaskNotifyGive(pContext->m_xReceiver);
+        }
     }
 }
 #endif
@@ -326,16 +326,13 @@ void audio_setup(void (*audio_isr)(void), int sampling_rate)
     if (audio_isr) {
 
         /* Set up the ISR for the I2S device... */
+        /* FIFO interrupts are enabled by the stream owner when it starts the speaker or microphone */
+        i2s_disable_int(MASK_I2S_IE_FIFO_TX_EMPTY |
+                        MASK_I2S_IE_FIFO_TX_HALF_FULL |
+                        MASK_I2S_IE_FIFO_RX_FULL |
+                        MASK_I2S_IE_FIFO_RX_HALF_FULL);
         i2s_clear_int_flag(0xFFFF);
         interrupt_attach(interrupt_i2s, (uint8_t)interrupt_i2s, audio_isr);
-        i2s_enable_int(MASK_I2S_IE_FIFO_TX_EMPTY |
-                       MASK_I2S_IE_FIFO_TX_HALF_FULL);
-        i2s_enable_int(MASK_I2S_IE_FIFO_RX_FULL |
-                       MASK_I2S_IE_FIFO_RX_HALF_FULL);
-
-        /* Start streaming audio */
-        i2s_start_tx();
-        i2s_start_rx();
         interrupt_enable_globally();
     }
 }
@@ -367,6 +364,32 @@ int audio_get_volume(uint8_t addr1, uint8_t addr2)
     return percent;
 }
 
+// Q15 gain of lowering the speaker volume by 0..99 percent; 100 percent mutes
+// The headphone volume is 1dB per register step so 1 percent is 0.8dB.
+static const uint16_t audio_volume_gain[100] = {
+    32767, 29885, 27255, 24857, 22670, 20675, 18856, 17197, 15684, 14304,
+    13045, 11897, 10851,  9896,  9025,  8231,  7507,  6846,  6244,  5694,
+     5193,  4736,  4320,  3940,  3593,  3277,  2988,  2726,  2486,  2267,
+     2068,  1886,  1720,  1568,  1430,  1305,  1190,  1085,   990,   903,
+      823,   751,   685,   624,   569,   519,   474,   432,   394,   359,
+      328,   299,   273,   249,   227,   207,   189,   172,   157,   143,
+      130,   119,   109,    99,    90,    82,    75,    68,    62,    57,
+       52,    47,    43,    39,    36,    33,    30,    27,    25,    23,
+       21,    19,    17,    16,    14,    13,    12,    11,    10,     9,
+        8,     8,     7,     6,     6,     5,     5,     4,     4,     4,
+};
+
+int32_t audio_speaker_volume_to_gain(int percent)
+{
+    if (percent <= 0) {
+        return AUDIO_GAIN_UNITY;
+    }
+    else if (percent >= 100) {
+        return 0;
+    }
+    return audio_volume_gain[percent];
+}
+
 void audio_speaker_set_volume(int percent)
 {
     audio_set_volume(percent, 0x02<< 1, 0x03<< 1);
@@ -38,14 +38,71 @@ void audio_ulaw_to_pcm16(int lSrcLen, const char *pcSrc, char *pcDst);
 void audio_ulaw_to_pcm16_stereo(int lSrcLen, const char *pcSrc, char *pcDst);
 
 
+// Audio IMA-ADPCM 4-bit compression
+typedef struct _TAudioAdpcmState {
+    short m_sPredicted;
+    char  m_cIndex;
+} TAudioAdpcmState;
+void audio_adpcm_reset(TAudioAdpcmState *pState);
+void audio_pcm16_to_adpcm(int lSrcLen, const char *pcSrc, char *pcDst, TAudioAdpcmState *pState);
+void audio_adpcm_to_pcm16(int lSrcLen, const char *pcSrc, char *pcDst, TAudioAdpcmState *pState);
+void audio_adpcm_to_pcm16_stereo(int lSrcLen, const char *pcSrc, char *pcDst, TAudioAdpcmState *pState);
+
+
 // Audio mono/stereo conversion
+// audio_mono_to_stereo applies the mixing stage below
 void audio_mono_to_stereo(char* pDst, char* pSrc, uint32_t ulSize);
 void audio_stereo_to_mono(char* pDst, char* pSrc, uint32_t ulSize);
+void audio_stereo_to_mono_average(char* pDst, char* pSrc, uint32_t ulSize);
+
+
+// Audio 16-bit mono resampling by 2 or 3 (1 copies)
+#define AUDIO_RESAMPLE_TAPS_MAX (24)
+typedef struct _TAudioResampler {
+    short   m_sHistory[AUDIO_RESAMPLE_TAPS_MAX*2];
+    uint8_t m_ucFactor;
+    uint8_t m_ucPos;
+    uint8_t m_ucPhase;
+} TAudioResampler;
+void     audio_resample_reset(TAudioResampler *pState, int lFactor);
+uint32_t audio_resample_up(char *pDst, const char *pSrc, uint32_t ulSize, TAudioResampler *pState);
+uint32_t audio_resample_down(char *pDst, const char *pSrc, uint32_t ulSize, TAudioResampler *pState);
+
+
+// Mixing stage of the speaker output (Q15 gain with ramping, notification tone)
+#define AUDIO_GAIN_UNITY        (32768)
+void    audio_mix_set_gain(int32_t lGain);
+int32_t audio_mix_get_gain(void);
+void    audio_mix_tone(uint32_t ulFrequency, uint32_t ulDurationMs, uint32_t ulSamplingRate);
+int     audio_mix_active(void);
+
+
+// Voice activity detection on 16-bit mono frames
+#define AUDIO_VAD_SILENCE       0
+#define AUDIO_VAD_SPEECH        1
+#define AUDIO_VAD_ENDED         2
+typedef struct _TAudioVad {
+    uint32_t m_ulNoise;         // noise floor (mean absolute amplitude)
+    int32_t  m_lDC;             // DC offset of the microphone
+    short    m_sLast;           // last sample of the previous frame
+    uint32_t m_ulSamples;       // samples processed
+    uint32_t m_ulFrames;        // frames processed
+    uint32_t m_ulSpeechStart;   // sample where speech started
+    uint32_t m_ulSpeechEnd;     // sample where speech ended
+    uint16_t m_uwOnsetFrames;   // speech frames needed to start
+    uint16_t m_uwHangoverFrames;// non-speech frames needed to end
+    uint16_t m_uwOnset;
+    uint16_t m_uwHangover;
+    uint8_t  m_ucState;         // AUDIO_VAD_xxx
+} TAudioVad;
+void audio_vad_reset(TAudioVad *pVad, uint16_t uwOnsetFrames, uint16_t uwHangoverFrames);
+int  audio_vad_process(TAudioVad *pVad, const char *pcSamples, uint32_t ulSize);
 
 
 // Volume control
 void audio_speaker_set_volume(int percent);
 int  audio_speaker_get_volume(void);
+int32_t audio_speaker_volume_to_gain(int percent); // Q15 gain equal to lowering the speaker volume by percent
 void audio_mic_set_volume(int percent);
 int  audio_mic_get_volume(void);
 
@@ -45,15 +45,12 @@
  */
 
 #include "ft900.h"
+#include "audio.h"
 
 
 
 ////////////////////////////////////////////////////////////////////////////////////////
 
-#define	SIGN_BIT    (0x80)
-#define	QUANT_MASK  (0xf)
-#define	SEG_SHIFT   (4)
-#define	SEG_MASK    (0x70)
 #define BIAS        (0x84)
 #define CLIP        (8159)
 
@@ -61,88 +58,303 @@
 
 ////////////////////////////////////////////////////////////////////////////////////////
 
-static short seg_uend[8] = {0x3F, 0x7F, 0xFF, 0x1FF, 0x3FF, 0x7FF, 0xFFF, 0x1FFF};
+// u-law to 16-bit linear PCM for every u-law byte
+static const short ulaw_decode[256] = {
+    -32124, -31100, -30076, -29052, -28028, -27004, -25980, -24956,
+    -23932, -22908, -21884, -20860, -19836, -18812, -17788, -16764,
+    -15996, -15484, -14972, -14460, -13948, -13436, -12924, -12412,
+    -11900, -11388, -10876, -10364,  -9852,  -9340,  -8828,  -8316,
+     -7932,  -7676,  -7420,  -7164,  -6908,  -6652,  -6396,  -6140,
+     -5884,  -5628,  -5372,  -5116,  -4860,  -4604,  -4348,  -4092,
+     -3900,  -3772,  -3644,  -3516,  -3388,  -3260,  -3132,  -3004,
+     -2876,  -2748,  -2620,  -2492,  -2364,  -2236,  -2108,  -1980,
+     -1884,  -1820,  -1756,  -1692,  -1628,  -1564,  -1500,  -1436,
+     -1372,  -1308,  -1244,  -1180,  -1116,  -1052,   -988,   -924,
+      -876,   -844,   -812,   -780,   -748,   -716,   -684,   -652,
+      -620,   -588,   -556,   -524,   -492,   -460,   -428,   -396,
+      -372,   -356,   -340,   -324,   -308,   -292,   -276,   -260,
+      -244,   -228,   -212,   -196,   -180,   -164,   -148,   -132,
+      -120,   -112,   -104,    -96,    -88,    -80,    -72,    -64,
+       -56,    -48,    -40,    -32,    -24,    -16,     -8,      0,
+     32124,  31100,  30076,  29052,  28028,  27004,  25980,  24956,
+     23932,  22908,  21884,  20860,  19836,  18812,  17788,  16764,
+     15996,  15484,  14972,  14460,  13948,  13436,  12924,  12412,
+     11900,  11388,  10876,  10364,   9852,   9340,   8828,   8316,
+      7932,   7676,   7420,   7164,   6908,   6652,   6396,   6140,
+      5884,   5628,   5372,   5116,   4860,   4604,   4348,   4092,
+      3900,   3772,   3644,   3516,   3388,   3260,   3132,   3004,
+      2876,   2748,   2620,   2492,   2364,   2236,   2108,   1980,
+      1884,   1820,   1756,   1692,   1628,   1564,   1500,   1436,
+      1372,   1308,   1244,   1180,   1116,   1052,    988,    924,
+       876,    844,    812,    780,    748,    716,    684,    652,
+       620,    588,    556,    524,    492,    460,    428,    396,
+       372,    356,    340,    324,    308,    292,    276,    260,
+       244,    228,    212,    196,    180,    164,    148,    132,
+       120,    112,    104,     96,     88,     80,     72,     64,
+        56,     48,     40,     32,     24,     16,      8,      0,
+};
 
-static short search(
-   short val,
-   short *table,
-   short size)
-{
-   short i;
-
-   for (i = 0; i < size; i++) {
-      if (val <= *table++)
-	 return (i);
-   }
-   return (size);
-}
+// u-law segment of the biased 14-bit magnitude (33..8192), indexed by magnitude >> 6.
+// Segment boundaries are powers of 2 from 64 so this replaces the search over the segment ends.
+// Segment 8 only occurs for the clipped maximum.
+static const unsigned char ulaw_segment[129] = {
+    0, 1, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 4, 4, 4, 4,
+    5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5,
+    6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6,
+    6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6,
+    7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7,
+    7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7,
+    7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7,
+    7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7,
+    8,
+};
 
-unsigned char linear2ulaw(short pcm_val)
+static inline unsigned char ulaw_encode(int pcm_val)
 {
-   short mask;
-   short seg;
-   unsigned char uval;
+   int mask = 0xFF;
+   int seg;
 
    pcm_val = pcm_val >> 2;
    if (pcm_val < 0) {
       pcm_val = -pcm_val;
       mask = 0x7F;
-   } else {
-      mask = 0xFF;
    }
-   if ( pcm_val > CLIP ) pcm_val = CLIP;
+   if (pcm_val > CLIP) pcm_val = CLIP;
    pcm_val += (BIAS >> 2);
 
-   seg = search(pcm_val, seg_uend, 8);
+   seg = ulaw_segment[pcm_val >> 6];
    if (seg >= 8)
       return (unsigned char) (0x7F ^ mask);
-   else {
-      uval = (unsigned char) (seg << 4) | ((pcm_val >> (seg + 1)) & 0xF);
-      return (uval ^ mask);
-   }
+   return (unsigned char) (((seg << 4) | ((pcm_val >> (seg + 1)) & 0xF)) ^ mask);
+}
+
+// Both channels of a stereo frame for a u-law byte
+#define ULAW_STEREO(u) ((uint32_t)(unsigned short)ulaw_decode[(u)] * 0x00010001UL)
+
+unsigned char linear2ulaw(short pcm_val)
+{
+   return ulaw_encode(pcm_val);
 }
 
-short ulaw2linear(unsigned char	u_val)
+short ulaw2linear(unsigned char u_val)
 {
-   u_val = ~u_val;
-   short t = ((u_val & QUANT_MASK) << 3) + BIAS;
-   t <<= ((unsigned)u_val & SEG_MASK) >> SEG_SHIFT;
-   return ((u_val & SIGN_BIT) ? (BIAS - t) : (t - BIAS));
+   return ulaw_decode[u_val];
 }
 
 
 
 
 ////////////////////////////////////////////////////////////////////////////////////////
+// The loops below move 32-bit words; FT900 is little-endian.
+// Misaligned buffers are processed one sample at a time.
 
 void audio_pcm16_to_ulaw(int lSrcLen, const char *pcSrc, char *pcDst)
 {
     const unsigned short *s_samples = (const unsigned short *)pcSrc;
+    int lSamples = lSrcLen / 2;
+    int i = 0;
+
+    // 2 samples in, 2 bytes out per word; safe in-place since pcDst never passes pcSrc
+    if (!(((uintptr_t)pcSrc | ((uintptr_t)pcDst << 1)) & 3)) {
+        const uint32_t *s_words = (const uint32_t *)pcSrc;
+        unsigned short *d_pairs = (unsigned short *)pcDst;
+        for (; i + 2 <= lSamples; i += 2) {
+            uint32_t ulWord = *s_words++;
+            *d_pairs++ = ulaw_encode((short)ulWord) |
+                         (ulaw_encode((short)(ulWord >> 16)) << 8);
+        }
+    }
 
-    for (int i=0; i < lSrcLen / 2; i++) {
-    	pcDst[i] = linear2ulaw((short) s_samples[i]);
+    for (; i < lSamples; i++) {
+        pcDst[i] = ulaw_encode((short) s_samples[i]);
     }
 }
 
 void audio_ulaw_to_pcm16(int lSrcLen, const char *pcSrc, char *pcDst)
 {
-    unsigned char *s_samples = (unsigned char *) pcSrc;
+    const unsigned char *s_samples = (const unsigned char *) pcSrc;
     unsigned short *d_samples = (unsigned short *)pcDst;
+    int i = 0;
+
+    // 4 bytes in, 2 words out per word
+    if (!(((uintptr_t)pcSrc | (uintptr_t)pcDst) & 3)) {
+        const uint32_t *s_words = (const uint32_t *)pcSrc;
+        uint32_t *d_words = (uint32_t *)pcDst;
+        for (; i + 4 <= lSrcLen; i += 4) {
+            uint32_t ulWord = *s_words++;
+            d_words[0] = (unsigned short)ulaw_decode[ulWord & 0xFF] |
+                         ((uint32_t)(unsigned short)ulaw_decode[(ulWord >> 8) & 0xFF] << 16);
+            d_words[1] = (unsigned short)ulaw_decode[(ulWord >> 16) & 0xFF] |
+                         ((uint32_t)(unsigned short)ulaw_decode[ulWord >> 24] << 16);
+            d_words += 2;
+        }
+    }
 
-    for (int i=0; i < lSrcLen; i++) {
-        d_samples[i] = ulaw2linear(s_samples[i]);
+    for (; i < lSrcLen; i++) {
+        d_samples[i] = ulaw_decode[s_samples[i]];
     }
 }
 
 void audio_ulaw_to_pcm16_stereo(int lSrcLen, const char *pcSrc, char *pcDst)
 {
-    unsigned char *s_samples = (unsigned char *) pcSrc;
-    unsigned short *d_samples = (unsigned short *)pcDst;
+    const unsigned char *s_samples = (const unsigned char *) pcSrc;
+    int i = 0;
 
-    for (int i=0, j=0; i < lSrcLen; i++, j+=2) {
-        d_samples[j] = ulaw2linear(s_samples[i]);
+    // Decode and duplicate to both channels in one pass: 4 bytes in, 4 words out per word
+    if (!((uintptr_t)pcDst & 3)) {
+        uint32_t *d_frames = (uint32_t *)pcDst;
+
+        for (; i < lSrcLen && ((uintptr_t)&s_samples[i] & 3); i++) {
+            *d_frames++ = ULAW_STEREO(s_samples[i]);
+        }
+
+        const uint32_t *s_words = (const uint32_t *)&s_samples[i];
+        for (; i + 4 <= lSrcLen; i += 4) {
+            uint32_t ulWord = *s_words++;
+            d_frames[0] = ULAW_STEREO(ulWord & 0xFF);
+            d_frames[1] = ULAW_STEREO((ulWord >> 8) & 0xFF);
+            d_frames[2] = ULAW_STEREO((ulWord >> 16) & 0xFF);
+            d_frames[3] = ULAW_STEREO(ulWord >> 24);
+            d_frames += 4;
+        }
+
+        for (; i < lSrcLen; i++) {
+            *d_frames++ = ULAW_STEREO(s_samples[i]);
+        }
+        return;
+    }
+
+    unsigned short *d_samples = (unsigned short *)pcDst;
+    for (int j=i*2; i < lSrcLen; i++, j+=2) {
+        d_samples[j] = ulaw_decode[s_samples[i]];
         d_samples[j+1] = d_samples[j];
     }
 }
 
 
+
+////////////////////////////////////////////////////////////////////////////////////////
+// IMA-ADPCM (Intel/DVI), 4 bits per sample, first sample in the high nibble.
+// The predictor state runs across calls; reset it at the start of each transfer.
+
+static const short adpcm_step[89] = {
+    7, 8, 9, 10, 11, 12, 13, 14, 16, 17,
+    19, 21, 23, 25, 28, 31, 34, 37, 41, 45,
+    50, 55, 60, 66, 73, 80, 88, 97, 107, 118,
+    130, 143, 157, 173, 190, 209, 230, 253, 279, 307,
+    337, 371, 408, 449, 494, 544, 598, 658, 724, 796,
+    876, 963, 1060, 1166, 1282, 1411, 1552, 1707, 1878, 2066,
+    2272, 2499, 2749, 3024, 3327, 3660, 4026, 4428, 4871, 5358,
+    5894, 6484, 7132, 7845, 8630, 9493, 10442, 11487, 12635, 13899,
+    15289, 16818, 18500, 20350, 22385, 24623, 27086, 29794, 32767
+};
+
+static const signed char adpcm_index[16] = {
+    -1, -1, -1, -1, 2, 4, 6, 8,
+    -1, -1, -1, -1, 2, 4, 6, 8
+};
+
+static inline int adpcm_encode(int val, int *valpred, int *index)
+{
+   int step = adpcm_step[*index];
+   int diff = val - *valpred;
+   int delta = 0;
+   int vpdiff = step >> 3;
+
+   if (diff < 0) {
+      delta = 8;
+      diff = -diff;
+   }
+   if (diff >= step) { delta |= 4; diff -= step; vpdiff += step; }
+   step >>= 1;
+   if (diff >= step) { delta |= 2; diff -= step; vpdiff += step; }
+   step >>= 1;
+   if (diff >= step) { delta |= 1; vpdiff += step; }
+
+   *valpred += (delta & 8) ? -vpdiff : vpdiff;
+   if (*valpred > 32767) *valpred = 32767;
+   else if (*valpred < -32768) *valpred = -32768;
+
+   *index += adpcm_index[delta];
+   if (*index < 0) *index = 0;
+   else if (*index > 88) *index = 88;
+
+   return delta;
+}
+
+static inline short adpcm_decode(int delta, int *valpred, int *index)
+{
+   int step = adpcm_step[*index];
+   int vpdiff = step >> 3;
+
+   if (delta & 4) vpdiff += step;
+   if (delta & 2) vpdiff += step >> 1;
+   if (delta & 1) vpdiff += step >> 2;
+
+   *valpred += (delta & 8) ? -vpdiff : vpdiff;
+   if (*valpred > 32767) *valpred = 32767;
+   else if (*valpred < -32768) *valpred = -32768;
+
+   *index += adpcm_index[delta];
+   if (*index < 0) *index = 0;
+   else if (*index > 88) *index = 88;
+
+   return (short)*valpred;
+}
+
+void audio_adpcm_reset(TAudioAdpcmState *pState)
+{
+    pState->m_sPredicted = 0;
+    pState->m_cIndex = 0;
+}
+
+void audio_pcm16_to_adpcm(int lSrcLen, const char *pcSrc, char *pcDst, TAudioAdpcmState *pState)
+{
+    const short *s_samples = (const short *)pcSrc;
+    unsigned char *d_samples = (unsigned char *)pcDst;
+    int valpred = pState->m_sPredicted;
+    int index = pState->m_cIndex;
+
+    // 2 samples in, 1 byte out; safe in-place
+    for (int i=0; i < lSrcLen / 4; i++, s_samples+=2) {
+        int hi = adpcm_encode(s_samples[0], &valpred, &index);
+        int lo = adpcm_encode(s_samples[1], &valpred, &index);
+        d_samples[i] = (unsigned char)((hi << 4) | lo);
+    }
+
+    pState->m_sPredicted = (short)valpred;
+    pState->m_cIndex = (char)index;
+}
+
+void audio_adpcm_to_pcm16(int lSrcLen, const char *pcSrc, char *pcDst, TAudioAdpcmState *pState)
+{
+    const unsigned char *s_samples = (const unsigned char *)pcSrc;
+    short *d_samples = (short *)pcDst;
+    int valpred = pState->m_sPredicted;
+    int index = pState->m_cIndex;
+
+    for (int i=0; i < lSrcLen; i++, d_samples+=2) {
+        d_samples[0] = adpcm_decode(s_samples[i] >> 4, &valpred, &index);
+        d_samples[1] = adpcm_decode(s_samples[i] & 0xF, &valpred, &index);
+    }
+
+    pState->m_sPredicted = (short)valpred;
+    pState->m_cIndex = (char)index;
+}
+
+void audio_adpcm_to_pcm16_stereo(int lSrcLen, const char *pcSrc, char *pcDst, TAudioAdpcmState *pState)
+{
+    const unsigned char *s_samples = (const unsigned char *)pcSrc;
+    uint32_t *d_frames = (uint32_t *)pcDst;
+    int valpred = pState->m_sPredicted;
+    int index = pState->m_cIndex;
+
+    // Decode and duplicate to both channels in one pass: 1 byte in, 2 frames out
+    for (int i=0; i < lSrcLen; i++, d_frames+=2) {
+        d_frames[0] = (uint32_t)(unsigned short)adpcm_decode(s_samples[i] >> 4, &valpred, &index) * 0x00010001UL;
+        d_frames[1] = (uint32_t)(unsigned short)adpcm_decode(s_samples[i] & 0xF, &valpred, &index) * 0x00010001UL;
+    }
+
+    pState->m_sPredicted = (short)valpred;
+    pState->m_cIndex = (char)index;
+}
@@ -44,22 +44,313 @@
  * ============================================================================
  */
 
+#include <stdint.h>
+#include <string.h>
 #include "ft900.h"
+#include "audio.h"
 
 
 
+/////////////////////////////////////////////////////////////////////////////////////////////
+// Mixing stage of the speaker output, applied by audio_mono_to_stereo
+// - Q15 gain, ramped by at most AUDIO_GAIN_RAMP_STEP per sample so volume changes do not click
+// - Notification tone from a quarter-wave sine table, with a short attack and release
+// When the gain is unity and no tone is playing, samples are copied as is.
+/////////////////////////////////////////////////////////////////////////////////////////////
+
+#define AUDIO_GAIN_RAMP_STEP    (AUDIO_GAIN_UNITY >> 8) // full swing in 256 samples; 16ms at 16KHz
+#define AUDIO_TONE_LEVEL        (8192)                  // -12dBFS
+#define AUDIO_TONE_RAMP_SHIFT   (6)                     // attack and release of 64 samples
+
+// sin(i*pi/128) in Q15, i = 0..64
+static const short audio_sine[65] = {
+        0,   804,  1608,  2410,  3212,  4011,  4808,  5602,  6393,  7179,  7962,  8739,  9512,
+    10278, 11039, 11793, 12539, 13279, 14010, 14732, 15446, 16151, 16846, 17530, 18204, 18868,
+    19519, 20159, 20787, 21403, 22005, 22594, 23170, 23731, 24279, 24811, 25329, 25832, 26319,
+    26790, 27245, 27683, 28105, 28510, 28898, 29268, 29621, 29956, 30273, 30571, 30852, 31113,
+    31356, 31580, 31785, 31971, 32137, 32285, 32412, 32521, 32609, 32678, 32728, 32757, 32767,
+};
+
+static volatile int32_t g_lGainTarget = AUDIO_GAIN_UNITY;
+static int32_t g_lGain = AUDIO_GAIN_UNITY;
+static volatile uint32_t g_ulToneRemaining = 0;
+static uint32_t g_ulToneLength = 0;
+static uint32_t g_ulTonePhase = 0;
+static uint32_t g_ulToneStep = 0;
+
+
+static inline int32_t audio_sine_at(uint32_t ulPhase)
+{
+    uint32_t ulIndex = (ulPhase >> 24) & 0x3F;
+
+    switch (ulPhase >> 30) {
+        case 0:  return  audio_sine[ulIndex];
+        case 1:  return  audio_sine[64 - ulIndex];
+        case 2:  return -audio_sine[ulIndex];
+        default: return -audio_sine[64 - ulIndex];
+    }
+}
+
+void audio_mix_set_gain(int32_t lGain)
+{
+    if (lGain < 0) {
+        lGain = 0;
+    }
+    else if (lGain > AUDIO_GAIN_UNITY) {
+        lGain = AUDIO_GAIN_UNITY;
+    }
+    g_lGainTarget = lGain;
+}
+
+int32_t audio_mix_get_gain(void)
+{
+    return g_lGainTarget;
+}
+
+void audio_mix_tone(uint32_t ulFrequency, uint32_t ulDurationMs, uint32_t ulSamplingRate)
+{
+    g_ulToneRemaining = 0;
+    g_ulTonePhase = 0;
+    g_ulToneStep = (uint32_t)(((uint64_t)ulFrequency << 32) / ulSamplingRate);
+    g_ulToneLength = ulSamplingRate * ulDurationMs / 1000;
+    g_ulToneRemaining = g_ulToneLength;
+}
+
+int audio_mix_active(void)
+{
+    return (g_lGain != AUDIO_GAIN_UNITY || g_lGainTarget != AUDIO_GAIN_UNITY || g_ulToneRemaining);
+}
+
+// pSrc may be the upper half of pDst
 void audio_mono_to_stereo(char* pDst, char* pSrc, uint32_t ulSize)
 {
+    if (!audio_mix_active()) {
+        for (int i=0; i<ulSize; i+=2, pDst+=4, pSrc+=2) {
+            *((uint16_t*)&pDst[0]) = *((uint16_t*)&pSrc[0]);
+            *((uint16_t*)&pDst[2]) = *((uint16_t*)&pDst[0]);
+        }
+        return;
+    }
+
+    int32_t lGain = g_lGain;
+    int32_t lTarget = g_lGainTarget;
+    uint32_t ulTone = g_ulToneRemaining;
+    uint32_t ulPhase = g_ulTonePhase;
+
     for (int i=0; i<ulSize; i+=2, pDst+=4, pSrc+=2) {
-        *((uint16_t*)&pDst[0]) = *((uint16_t*)&pSrc[0]);
-        *((uint16_t*)&pDst[2]) = *((uint16_t*)&pDst[0]);
+        int32_t lSample = *((int16_t*)&pSrc[0]);
+
+        // Ramp the gain towards the target
+        if (lGain < lTarget) {
+            lGain += AUDIO_GAIN_RAMP_STEP;
+            if (lGain > lTarget) {
+                lGain = lTarget;
+            }
+        }
+        else if (lGain > lTarget) {
+            lGain -= AUDIO_GAIN_RAMP_STEP;
+            if (lGain < lTarget) {
+                lGain = lTarget;
+            }
+        }
+
+        // Mix the tone
+        if (ulTone) {
+            uint32_t ulEnvelope = g_ulToneLength - ulTone;
+            if (ulEnvelope > ulTone) {
+                ulEnvelope = ulTone;
+            }
+            if (ulEnvelope > (1 << AUDIO_TONE_RAMP_SHIFT)) {
+                ulEnvelope = (1 << AUDIO_TONE_RAMP_SHIFT);
+            }
+            lSample += ((audio_sine_at(ulPhase) * AUDIO_TONE_LEVEL >> 15) * (int32_t)ulEnvelope) >> AUDIO_TONE_RAMP_SHIFT;
+            ulPhase += g_ulToneStep;
+            ulTone--;
+        }
+
+        // Apply the gain and saturate
+        lSample = (lSample * lGain) >> 15;
+        if (lSample > 32767) {
+            lSample = 32767;
+        }
+        else if (lSample < -32768) {
+            lSample = -32768;
+        }
+
+        *((int16_t*)&pDst[0]) = (int16_t)lSample;
+        *((int16_t*)&pDst[2]) = (int16_t)lSample;
     }
+
+    g_lGain = lGain;
+    g_ulTonePhase = ulPhase;
+    g_ulToneRemaining = ulTone;
 }
 
+// Keeps the left channel; ulSize is the mono size
 void audio_stereo_to_mono(char* pDst, char* pSrc, uint32_t ulSize)
 {
-    for (int i=0; i<ulSize; i+=2, pDst+=2, pSrc+=4) {
+    int i = 0;
+
+    // 2 frames in, 2 samples out per word
+    if (!(((uintptr_t)pSrc | (uintptr_t)pDst) & 3)) {
+        const uint32_t* pulSrc = (const uint32_t*)pSrc;
+        uint32_t* pulDst = (uint32_t*)pDst;
+        for (; i+4<=ulSize; i+=4, pulSrc+=2) {
+            *pulDst++ = (pulSrc[0] & 0xFFFF) | (pulSrc[1] << 16);
+        }
+        pDst = (char*)pulDst;
+        pSrc = (char*)pulSrc;
+    }
+
+    for (; i<ulSize; i+=2, pDst+=2, pSrc+=4) {
         *((uint16_t*)&pDst[0]) = *((uint16_t*)&pSrc[0]);
     }
 }
 
+// Averages the left and right channels; ulSize is the mono size
+void audio_stereo_to_mono_average(char* pDst, char* pSrc, uint32_t ulSize)
+{
+    int i = 0;
+
+    // 2 frames in, 2 samples out per word
+    if (!(((uintptr_t)pSrc | (uintptr_t)pDst) & 3)) {
+        const uint32_t* pulSrc = (const uint32_t*)pSrc;
+        uint32_t* pulDst = (uint32_t*)pDst;
+        for (; i+4<=ulSize; i+=4, pulSrc+=2) {
+            uint32_t ulFrame0 = pulSrc[0];
+            uint32_t ulFrame1 = pulSrc[1];
+            int32_t lSample0 = ((int32_t)(int16_t)ulFrame0 + ((int32_t)ulFrame0 >> 16)) >> 1;
+            int32_t lSample1 = ((int32_t)(int16_t)ulFrame1 + ((int32_t)ulFrame1 >> 16)) >> 1;
+            *pulDst++ = (lSample0 & 0xFFFF) | ((uint32_t)lSample1 << 16);
+        }
+        pDst = (char*)pulDst;
+        pSrc = (char*)pulSrc;
+    }
+
+    for (; i<ulSize; i+=2, pDst+=2, pSrc+=4) {
+        *((int16_t*)&pDst[0]) = (*((int16_t*)&pSrc[0]) + *((int16_t*)&pSrc[2])) >> 1;
+    }
+}
+
+
+
+/////////////////////////////////////////////////////////////////////////////////////////////
+// Polyphase resampling of 16-bit mono by 2 or 3
+// - 8 taps per phase; Kaiser windowed sinc with the cutoff at 0.9 of the lower Nyquist
+// - Upsampling computes each output phase from the last 8 inputs
+// - Downsampling computes one output every 2 or 3 inputs from the last 16 or 24 inputs
+// The delay line is stored twice so that the taps are always contiguous.
+// Blocks of any size can be passed; downsampling can be done in-place.
+/////////////////////////////////////////////////////////////////////////////////////////////
+
+#define AUDIO_RESAMPLE_TAPS     (8)
+
+// Coefficients in Q15 of x[n], x[n-1], ... for each output phase
+static const short audio_resample_up2[2][AUDIO_RESAMPLE_TAPS] = {
+    {    -94,    940,  -3470,  10824,  26800,  -2473,    151,     90 },
+    {     90,    151,  -2473,  26800,  10824,  -3470,    940,    -94 },
+};
+static const short audio_resample_up3[3][AUDIO_RESAMPLE_TAPS] = {
+    {    -98,    880,  -2951,   7941,  28243,  -1130,   -347,    231 },
+    {   -116,   1022,  -4346,  19824,  19824,  -4346,   1022,   -116 },
+    {    231,   -347,  -1130,  28243,   7941,  -2951,    880,    -98 },
+};
+static const short audio_resample_down2[AUDIO_RESAMPLE_TAPS*2] = {
+       -47,     45,    470,     75,  -1735,  -1237,   5412,  13400,
+     13400,   5412,  -1237,  -1735,     75,    470,     45,    -47,
+};
+static const short audio_resample_down3[AUDIO_RESAMPLE_TAPS*3] = {
+       -33,    -39,     77,    293,    340,   -116,   -984,  -1447,
+      -377,   2648,   6602,   9418,   9418,   6602,   2648,   -377,
+     -1447,   -984,   -116,    340,    293,     77,    -39,    -33,
+};
+
+
+static inline int16_t audio_fir(const short* psCoef, const short* psHistory, int lTaps)
+{
+    int32_t lAcc = 1 << 14;
+
+    for (int k=0; k<lTaps; k++) {
+        lAcc += psCoef[k] * psHistory[k];
+    }
+    lAcc >>= 15;
+    if (lAcc > 32767) {
+        lAcc = 32767;
+    }
+    else if (lAcc < -32768) {
+        lAcc = -32768;
+    }
+    return (int16_t)lAcc;
+}
+
+void audio_resample_reset(TAudioResampler *pState, int lFactor)
+{
+    memset(pState, 0, sizeof(*pState));
+    pState->m_ucFactor = (lFactor == 2 || lFactor == 3) ? lFactor : 1;
+}
+
+uint32_t audio_resample_up(char *pDst, const char *pSrc, uint32_t ulSize, TAudioResampler *pState)
+{
+    const short* psSrc = (const short*)pSrc;
+    short* psDst = (short*)pDst;
+    short* psHistory = pState->m_sHistory;
+    uint32_t ulFactor = pState->m_ucFactor;
+    uint32_t ulPos = pState->m_ucPos;
+    uint32_t ulCount = ulSize >> 1;
+
+
+    if (ulFactor < 2) {
+        memmove(pDst, pSrc, ulSize);
+        return ulSize;
+    }
+
+    const short* psCoef = (ulFactor == 2) ? audio_resample_up2[0] : audio_resample_up3[0];
+    for (uint32_t i=0; i<ulCount; i++) {
+        ulPos = (ulPos ? ulPos : AUDIO_RESAMPLE_TAPS) - 1;
+        psHistory[ulPos] = psHistory[ulPos + AUDIO_RESAMPLE_TAPS] = psSrc[i];
+
+        psDst[0] = audio_fir(psCoef, psHistory + ulPos, AUDIO_RESAMPLE_TAPS);
+        psDst[1] = audio_fir(psCoef + AUDIO_RESAMPLE_TAPS, psHistory + ulPos, AUDIO_RESAMPLE_TAPS);
+        if (ulFactor == 3) {
+            psDst[2] = audio_fir(psCoef + AUDIO_RESAMPLE_TAPS*2, psHistory + ulPos, AUDIO_RESAMPLE_TAPS);
+        }
+        psDst += ulFactor;
+    }
+
+    pState->m_ucPos = ulPos;
+    return ulCount * ulFactor * 2;
+}
+
+uint32_t audio_resample_down(char *pDst, const char *pSrc, uint32_t ulSize, TAudioResampler *pState)
+{
+    const short* psSrc = (const short*)pSrc;
+    short* psDst = (short*)pDst;
+    short* psHistory = pState->m_sHistory;
+    uint32_t ulFactor = pState->m_ucFactor;
+    uint32_t ulPos = pState->m_ucPos;
+    uint32_t ulPhase = pState->m_ucPhase;
+    uint32_t ulCount = ulSize >> 1;
+
+
+    if (ulFactor < 2) {
+        memmove(pDst, pSrc, ulSize);
+        return ulSize;
+    }
+
+    const short* psCoef = (ulFactor == 2) ? audio_resample_down2 : audio_resample_down3;
+    uint32_t ulTaps = AUDIO_RESAMPLE_TAPS * ulFactor;
+    for (uint32_t i=0; i<ulCount; i++) {
+        ulPos = (ulPos ? ulPos : ulTaps) - 1;
+        psHistory[ulPos] = psHistory[ulPos + ulTaps] = psSrc[i];
+
+        if (++ulPhase == ulFactor) {
+            ulPhase = 0;
+            *psDst++ = audio_fir(psCoef, psHistory + ulPos, ulTaps);
+        }
+    }
+
+    pState->m_ucPos = ulPos;
+    pState->m_ucPhase = ulPhase;
+    return (char*)psDst - pDst;
+}
+
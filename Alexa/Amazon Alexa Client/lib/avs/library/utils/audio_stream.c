@@ -0,0 +1,562 @@
+/**
+  @file audio_stream.c
+  @brief
+  Interrupt-driven audio streaming
+
+ */
+/*
+ * ============================================================================
+ * History
+ * =======
+ * 2026-10-16 : Created v1
+ *
+ * Copyright (C) Bridgetek Pte Ltd
+ * ============================================================================
+ *
+ * This source code ("the Software") is provided by Bridgetek Pte Ltd
+ * ("Bridgetek") subject to the licence terms set out
+ * http://brtchip.com/BRTSourceCodeLicenseAgreement/ ("the Licence Terms").
+ * You must read the Licence Terms before downloading or using the Software.
+ * By installing or using the Software you agree to the Licence Terms. If you
+ * do not agree to the Licence Terms then do not download or use the Software.
+ *
+ * Without prejudice to the Licence Terms, here is a summary of some of the key
+ * terms of the Licence Terms (and in the event of any conflict between this
+ * summary and the Licence Terms then the text of the Licence Terms will
+ * prevail).
+ *
+ * The Software is provided "as is".
+ * There are no warranties (or similar) in relation to the quality of the
+ * Software. You use it at your own risk.
+ * The Software should not be used in, or for, any medical device, system or
+ * appliance. There are exclusions of Bridgetek liability for certain types of loss
+ * such as: special loss or damage; incidental loss or damage; indirect or
+ * consequential loss or damage; loss of income; loss of business; loss of
+ * profits; loss of revenue; loss of contracts; business interruption; loss of
+ * the use of money or anticipated savings; loss of information; loss of
+ * opportunity; loss of goodwill or reputation; and/or loss of, damage to or
+ * corruption of data.
+ * There is a monetary cap on Bridgetek's liability.
+ * The Software may have subsequently been amended by another user and then
+ * distributed by that other user ("Adapted Software").  If so that user may
+ * have additional licence terms that apply to those amendments. However, Bridgetek
+ * has no liability in relation to those amendments.
+ * ============================================================================
+ */
+
+#include <stdint.h>
+#include <string.h>
+#include <ft900.h>
+#include "tinyprintf.h"
+#include "FreeRTOS.h"
+#include "task.h"
+
+#include "audio.h"
+#include "audio_stream.h"
+
+
+
+//#define DEBUG
+#ifdef DEBUG
+#define DEBUG_PRINTF(...) do {tfp_printf(__VA_ARGS__);} while (0)
+#else
+#define DEBUG_PRINTF(...)
+#endif
+
+
+
+#define AUDIO_PLAYER_TIMEOUT_MS  1000
+#define AUDIO_PLAYER_INT_MASK    (MASK_I2S_IE_FIFO_TX_EMPTY | MASK_I2S_IE_FIFO_TX_HALF_FULL)
+#define AUDIO_PLAYER_PEND_MASK   (MASK_I2S_PEND_FIFO_TX_EMPTY | MASK_I2S_PEND_FIFO_TX_HALF_FULL)
+#define AUDIO_RECORDER_INT_MASK  (MASK_I2S_IE_FIFO_RX_FULL | MASK_I2S_IE_FIFO_RX_HALF_FULL)
+#define AUDIO_RECORDER_PEND_MASK (MASK_I2S_PEND_FIFO_RX_FULL | MASK_I2S_PEND_FIFO_RX_HALF_FULL | MASK_I2S_PEND_FIFO_RX_OVER)
+#define AUDIO_RECORDER_CHUNK     (256) // stereo bytes read from the FIFO at a time
+
+
+/////////////////////////////////////////////////////////////////////////////////////////////
+// Speaker ping-pong buffers
+// The task fills m_pcBuffer[m_ucTail] and submits it by setting m_ulSize[m_ucTail].
+// The ISR drains m_pcBuffer[m_ucHead] into the I2S FIFO and releases it by clearing m_ulSize[m_ucHead].
+// Each index has exactly one writer so no lock is needed between the task and the ISR.
+/////////////////////////////////////////////////////////////////////////////////////////////
+typedef struct _AudioPlayerContext {
+
+    char* m_pcBuffer[2];
+    volatile uint32_t m_ulSize[2];
+    uint32_t m_ulBufferSize;
+    uint32_t m_ulOffset;
+    uint8_t m_ucHead;
+    uint8_t m_ucTail;
+    volatile uint8_t m_ucRunning;
+    volatile uint8_t m_ucStarved;
+    volatile uint8_t m_ucDraining;
+    volatile TaskHandle_t m_xTask;
+    volatile uint32_t m_ulUnderruns;
+
+} AudioPlayerContext;
+
+static AudioPlayerContext g_hPlayer = {0};
+
+
+/////////////////////////////////////////////////////////////////////////////////////////////
+// Microphone ring buffer (16-bit mono)
+// The ISR is the only writer of m_ulHead and the task the only writer of m_ulTail.
+// Both indexes run freely and are masked with m_ulMask (ring size is a power of 2).
+/////////////////////////////////////////////////////////////////////////////////////////////
+typedef struct _AudioRecorderContext {
+
+    char* m_pcBuffer;
+    uint32_t m_ulMask;
+    volatile uint32_t m_ulHead;
+    volatile uint32_t m_ulTail;
+    volatile uint32_t m_ulWanted;
+    volatile uint8_t m_ucRunning;
+    volatile TaskHandle_t m_xTask;
+    volatile uint32_t m_ulOverruns;
+    volatile uint32_t m_ulDropped;
+    uint32_t m_ulWatermark;        // highest level found by the task since audio_recorder_begin
+
+} AudioRecorderContext;
+
+static AudioRecorderContext g_hRecorder = {0};
+
+
+
+/////////////////////////////////////////////////////////////////////////////////////////////
+// Copies up to ulSpace bytes of submitted buffers to the speaker FIFO.
+// Called from the ISR, or from the task while interrupts are disabled.
+// Returns 1 if a buffer was released back to the task.
+/////////////////////////////////////////////////////////////////////////////////////////////
+static int audio_player_fill(uint32_t ulSpace)
+{
+    int iReleased = 0;
+
+    while (ulSpace) {
+        uint32_t ulQueued = g_hPlayer.m_ulSize[g_hPlayer.m_ucHead];
+        if (!ulQueued) {
+            break;
+        }
+
+        uint32_t ulChunk = ulQueued - g_hPlayer.m_ulOffset;
+        if (ulChunk > ulSpace) {
+            ulChunk = ulSpace;
+        }
+        audio_play((uint8_t*)g_hPlayer.m_pcBuffer[g_hPlayer.m_ucHead] + g_hPlayer.m_ulOffset, ulChunk);
+        g_hPlayer.m_ulOffset += ulChunk;
+        ulSpace -= ulChunk;
+
+        if (g_hPlayer.m_ulOffset == ulQueued) {
+            g_hPlayer.m_ulOffset = 0;
+            g_hPlayer.m_ulSize[g_hPlayer.m_ucHead] = 0;
+            g_hPlayer.m_ucHead ^= 1;
+            iReleased = 1;
+        }
+    }
+
+    return iReleased;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////
+// Speaker half of the I2S interrupt.
+// - FIFO half empty: top up 1KB
+// - FIFO empty: top up 2KB, or stop the speaker interrupts if nothing is queued
+/////////////////////////////////////////////////////////////////////////////////////////////
+static int audio_player_isr(uint16_t uwStatus)
+{
+    uint32_t ulSpace = 0;
+    int iNotify = 0;
+
+    if (!g_hPlayer.m_ucRunning) {
+        return 0;
+    }
+
+    if (uwStatus & MASK_I2S_PEND_FIFO_TX_EMPTY) {
+        ulSpace = AUDIO_FIFO_SIZE;
+    }
+    else if (uwStatus & MASK_I2S_PEND_FIFO_TX_HALF_FULL) {
+        ulSpace = AUDIO_FIFO_SIZE >> 1;
+    }
+    else {
+        return 0;
+    }
+    i2s_clear_int_flag(AUDIO_PLAYER_PEND_MASK);
+
+    if (g_hPlayer.m_ulSize[g_hPlayer.m_ucHead]) {
+        iNotify = audio_player_fill(ulSpace);
+    }
+    else if (uwStatus & MASK_I2S_PEND_FIFO_TX_EMPTY) {
+        // Nothing left to play; stay quiet until the task submits again
+        i2s_disable_int(AUDIO_PLAYER_INT_MASK);
+        g_hPlayer.m_ucStarved = 1;
+        if (!g_hPlayer.m_ucDraining) {
+            g_hPlayer.m_ulUnderruns++;
+        }
+        iNotify = 1;
+    }
+
+    return iNotify;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////
+// Restarts the speaker after it has starved. The FIFO is empty at this point.
+// Interrupts are disabled so that the microphone half of the ISR cannot run meanwhile.
+/////////////////////////////////////////////////////////////////////////////////////////////
+static void audio_player_kick(void)
+{
+    taskENTER_CRITICAL();
+    g_hPlayer.m_ucStarved = 0;
+    audio_player_fill(AUDIO_FIFO_SIZE);
+    i2s_clear_int_flag(AUDIO_PLAYER_PEND_MASK);
+    i2s_enable_int(AUDIO_PLAYER_INT_MASK);
+    taskEXIT_CRITICAL();
+}
+
+
+
+/////////////////////////////////////////////////////////////////////////////////////////////
+// Microphone half of the I2S interrupt.
+// - FIFO half full: read 1KB stereo
+// - FIFO full or overflowed: read 2KB stereo and count the overrun
+// Samples are converted to mono while copied to the ring. Samples that do not fit are dropped.
+// Returns 1 if the task waiting for data should be woken.
+/////////////////////////////////////////////////////////////////////////////////////////////
+static int audio_recorder_isr(uint16_t uwStatus)
+{
+    static char acStereo[AUDIO_RECORDER_CHUNK];
+    uint32_t ulSize = 0;
+
+    if (!g_hRecorder.m_ucRunning) {
+        return 0;
+    }
+
+    if (uwStatus & (MASK_I2S_PEND_FIFO_RX_FULL | MASK_I2S_PEND_FIFO_RX_OVER)) {
+        ulSize = AUDIO_FIFO_SIZE;
+        if (uwStatus & MASK_I2S_PEND_FIFO_RX_OVER) {
+            g_hRecorder.m_ulOverruns++;
+        }
+    }
+    else if (uwStatus & MASK_I2S_PEND_FIFO_RX_HALF_FULL) {
+        ulSize = AUDIO_FIFO_SIZE >> 1;
+    }
+    else {
+        return 0;
+    }
+    i2s_clear_int_flag(AUDIO_RECORDER_PEND_MASK);
+
+    uint32_t ulHead = g_hRecorder.m_ulHead;
+    uint32_t ulFree = g_hRecorder.m_ulMask + 1 - (ulHead - g_hRecorder.m_ulTail);
+
+    for (; ulSize; ulSize -= AUDIO_RECORDER_CHUNK) {
+        audio_record((uint8_t*)acStereo, AUDIO_RECORDER_CHUNK);
+
+        if (ulFree < (AUDIO_RECORDER_CHUNK>>1)) {
+            g_hRecorder.m_ulDropped += AUDIO_RECORDER_CHUNK>>1;
+            continue;
+        }
+
+        // Ring size is a multiple of the chunk size so the chunk never wraps
+        audio_stereo_to_mono(g_hRecorder.m_pcBuffer + (ulHead & g_hRecorder.m_ulMask),
+            acStereo, AUDIO_RECORDER_CHUNK>>1);
+        ulHead += AUDIO_RECORDER_CHUNK>>1;
+        ulFree -= AUDIO_RECORDER_CHUNK>>1;
+    }
+    g_hRecorder.m_ulHead = ulHead;
+
+    return (ulHead - g_hRecorder.m_ulTail >= g_hRecorder.m_ulWanted);
+}
+
+
+
+/////////////////////////////////////////////////////////////////////////////////////////////
+// I2S interrupt handler; pass to audio_setup()
+// The FIFO flags are pending whether or not their interrupt is enabled, so only the enabled
+// ones are handled (the enable and pending bits are at the same positions).
+// The overflow flag is read along with the FIFO full interrupt.
+/////////////////////////////////////////////////////////////////////////////////////////////
+void audio_stream_isr(void)
+{
+    BaseType_t xHigherPriorityTaskWoken = pdFALSE;
+    uint16_t uwEnabled = I2S->I2S_IRQ_EN;
+    uint16_t uwStatus;
+
+    if (uwEnabled & MASK_I2S_IE_FIFO_RX_FULL) {
+        uwEnabled |= MASK_I2S_IE_FIFO_RX_OVER;
+    }
+    uwStatus = i2s_get_status() & uwEnabled;
+
+    if (audio_player_isr(uwStatus) && g_hPlayer.m_xTask) {
+        vTaskNotifyGiveFromISR(g_hPlayer.m_xTask, &xHigherPriorityTaskWoken);
+    }
+
+    if (audio_recorder_isr(uwStatus) && g_hRecorder.m_xTask) {
+        vTaskNotifyGiveFromISR(g_hRecorder.m_xTask, &xHigherPriorityTaskWoken);
+    }
+
+    if (xHigherPriorityTaskWoken) {
+        portYIELD_FROM_ISR();
+    }
+}
+
+
+
+/////////////////////////////////////////////////////////////////////////////////////////////
+// Allocates the speaker ping-pong buffers of ulBufferSize bytes each (16-bit stereo)
+/////////////////////////////////////////////////////////////////////////////////////////////
+int audio_player_setup(uint32_t ulBufferSize)
+{
+    g_hPlayer.m_pcBuffer[0] = pvPortMalloc(ulBufferSize);
+    g_hPlayer.m_pcBuffer[1] = pvPortMalloc(ulBufferSize);
+    if (!g_hPlayer.m_pcBuffer[0] || !g_hPlayer.m_pcBuffer[1]) {
+        DEBUG_PRINTF("audio_player_setup(): pvPortMalloc failed\r\n");
+        audio_player_free();
+        return 0;
+    }
+    g_hPlayer.m_ulBufferSize = ulBufferSize;
+
+    return 1;
+}
+
+void audio_player_free(void)
+{
+    for (int i=0; i<2; i++) {
+        if (g_hPlayer.m_pcBuffer[i]) {
+            vPortFree(g_hPlayer.m_pcBuffer[i]);
+            g_hPlayer.m_pcBuffer[i] = NULL;
+        }
+    }
+    g_hPlayer.m_ulBufferSize = 0;
+}
+
+uint32_t audio_player_buffer_size(void)
+{
+    return g_hPlayer.m_ulBufferSize;
+}
+
+uint32_t audio_player_underruns(void)
+{
+    return g_hPlayer.m_ulUnderruns;
+}
+
+int audio_player_running(void)
+{
+    return g_hPlayer.m_ucRunning;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////
+// Starts a playback session for the calling task
+/////////////////////////////////////////////////////////////////////////////////////////////
+void audio_player_begin(void)
+{
+    i2s_disable_int(AUDIO_PLAYER_INT_MASK);
+
+    g_hPlayer.m_ulSize[0] = 0;
+    g_hPlayer.m_ulSize[1] = 0;
+    g_hPlayer.m_ulOffset = 0;
+    g_hPlayer.m_ucHead = 0;
+    g_hPlayer.m_ucTail = 0;
+    g_hPlayer.m_ucStarved = 1;
+    g_hPlayer.m_ucDraining = 0;
+    g_hPlayer.m_ulUnderruns = 0;
+    g_hPlayer.m_xTask = xTaskGetCurrentTaskHandle();
+
+    // Discard stale notifications
+    ulTaskNotifyTake(pdTRUE, 0);
+
+    g_hPlayer.m_ucRunning = 1;
+    audio_speaker_begin();
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////
+// Returns the next free speaker buffer, sleeping until the ISR releases one.
+// Returns NULL if the speaker stopped consuming.
+/////////////////////////////////////////////////////////////////////////////////////////////
+char* audio_player_buffer(void)
+{
+    while (g_hPlayer.m_ulSize[g_hPlayer.m_ucTail]) {
+        if (!ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(AUDIO_PLAYER_TIMEOUT_MS))) {
+            DEBUG_PRINTF("audio_player_buffer(): timed out\r\n");
+            return NULL;
+        }
+    }
+
+    return g_hPlayer.m_pcBuffer[g_hPlayer.m_ucTail];
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////
+// Queues ulSize bytes of the buffer returned by audio_player_buffer().
+// Playback (re)starts once both buffers are queued so that the FIFO can be kept full.
+/////////////////////////////////////////////////////////////////////////////////////////////
+void audio_player_submit(uint32_t ulSize)
+{
+    if (!ulSize) {
+        return;
+    }
+
+    g_hPlayer.m_ulSize[g_hPlayer.m_ucTail] = ulSize;
+    g_hPlayer.m_ucTail ^= 1;
+
+    if (g_hPlayer.m_ucStarved && g_hPlayer.m_ulSize[g_hPlayer.m_ucTail]) {
+        audio_player_kick();
+    }
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////
+// Plays out the queued buffers and stops the speaker
+/////////////////////////////////////////////////////////////////////////////////////////////
+void audio_player_end(void)
+{
+    g_hPlayer.m_ucDraining = 1;
+
+    if (g_hPlayer.m_ucStarved && g_hPlayer.m_ulSize[g_hPlayer.m_ucHead]) {
+        audio_player_kick();
+    }
+
+    while (!g_hPlayer.m_ucStarved) {
+        if (!ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(AUDIO_PLAYER_TIMEOUT_MS))) {
+            DEBUG_PRINTF("audio_player_end(): timed out\r\n");
+            break;
+        }
+    }
+
+    i2s_disable_int(AUDIO_PLAYER_INT_MASK);
+    g_hPlayer.m_ucRunning = 0;
+    g_hPlayer.m_xTask = NULL;
+
+    audio_speaker_end();
+
+    DEBUG_PRINTF("audio_player_end(): underruns %d\r\n", (int)g_hPlayer.m_ulUnderruns);
+}
+
+
+
+/////////////////////////////////////////////////////////////////////////////////////////////
+// Allocates the microphone ring of ulBufferSize bytes (16-bit mono, power of 2)
+/////////////////////////////////////////////////////////////////////////////////////////////
+int audio_recorder_setup(uint32_t ulBufferSize)
+{
+    if ((ulBufferSize & (ulBufferSize - 1)) || ulBufferSize < AUDIO_FIFO_SIZE) {
+        DEBUG_PRINTF("audio_recorder_setup(): invalid size %d\r\n", (int)ulBufferSize);
+        return 0;
+    }
+
+    g_hRecorder.m_pcBuffer = pvPortMalloc(ulBufferSize);
+    if (!g_hRecorder.m_pcBuffer) {
+        DEBUG_PRINTF("audio_recorder_setup(): pvPortMalloc failed\r\n");
+        return 0;
+    }
+    g_hRecorder.m_ulMask = ulBufferSize - 1;
+
+    return 1;
+}
+
+void audio_recorder_free(void)
+{
+    if (g_hRecorder.m_pcBuffer) {
+        vPortFree(g_hRecorder.m_pcBuffer);
+        g_hRecorder.m_pcBuffer = NULL;
+    }
+    g_hRecorder.m_ulMask = 0;
+}
+
+uint32_t audio_recorder_overruns(void)
+{
+    return g_hRecorder.m_ulOverruns;
+}
+
+uint32_t audio_recorder_dropped(void)
+{
+    return g_hRecorder.m_ulDropped;
+}
+
+uint32_t audio_recorder_watermark(void)
+{
+    return g_hRecorder.m_ulWatermark;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////
+// Starts capturing microphone input to the ring; the calling task becomes the consumer
+/////////////////////////////////////////////////////////////////////////////////////////////
+void audio_recorder_begin(void)
+{
+    i2s_disable_int(AUDIO_RECORDER_INT_MASK);
+
+    g_hRecorder.m_ulHead = 0;
+    g_hRecorder.m_ulTail = 0;
+    g_hRecorder.m_ulWanted = 1;
+    g_hRecorder.m_ulOverruns = 0;
+    g_hRecorder.m_ulDropped = 0;
+    g_hRecorder.m_ulWatermark = 0;
+    g_hRecorder.m_xTask = xTaskGetCurrentTaskHandle();
+
+    // Discard stale notifications
+    ulTaskNotifyTake(pdTRUE, 0);
+
+    g_hRecorder.m_ucRunning = 1;
+    audio_mic_begin();
+    i2s_clear_int_flag(AUDIO_RECORDER_PEND_MASK);
+    i2s_enable_int(AUDIO_RECORDER_INT_MASK);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////
+// Stops capturing. Samples already in the ring can still be read.
+/////////////////////////////////////////////////////////////////////////////////////////////
+void audio_recorder_end(void)
+{
+    i2s_disable_int(AUDIO_RECORDER_INT_MASK);
+    g_hRecorder.m_ucRunning = 0;
+    audio_mic_end();
+    g_hRecorder.m_xTask = NULL;
+
+    DEBUG_PRINTF("audio_recorder_end(): overruns %d dropped %d\r\n",
+        (int)g_hRecorder.m_ulOverruns, (int)g_hRecorder.m_ulDropped);
+}
+
+uint32_t audio_recorder_available(void)
+{
+    return g_hRecorder.m_ulHead - g_hRecorder.m_ulTail;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////
+// Reads up to ulSize bytes of mono samples from the ring.
+// Sleeps until ulSize bytes are available, the timeout expires or capturing has stopped.
+// Returns the number of bytes read.
+/////////////////////////////////////////////////////////////////////////////////////////////
+uint32_t audio_recorder_read(char* pcBuffer, uint32_t ulSize, uint32_t ulTimeoutMs)
+{
+    uint32_t ulAvailable = audio_recorder_available();
+
+    if (ulAvailable < ulSize && g_hRecorder.m_ucRunning) {
+        g_hRecorder.m_ulWanted = ulSize;
+        TickType_t xStart = xTaskGetTickCount();
+        TickType_t xTimeout = pdMS_TO_TICKS(ulTimeoutMs);
+        do {
+            TickType_t xElapsed = xTaskGetTickCount() - xStart;
+            if (xElapsed >= xTimeout) {
+                break;
+            }
+            ulTaskNotifyTake(pdTRUE, xTimeout - xElapsed);
+            ulAvailable = audio_recorder_available();
+        } while (ulAvailable < ulSize && g_hRecorder.m_ucRunning);
+        g_hRecorder.m_ulWanted = 1;
+    }
+
+    if (ulAvailable > g_hRecorder.m_ulWatermark) {
+        g_hRecorder.m_ulWatermark = ulAvailable;
+    }
+    if (ulSize > ulAvailable) {
+        ulSize = ulAvailable;
+    }
+
+    // Copy out in at most 2 segments
+    uint32_t ulTail = g_hRecorder.m_ulTail;
+    uint32_t ulOffset = ulTail & g_hRecorder.m_ulMask;
+    uint32_t ulFirst = g_hRecorder.m_ulMask + 1 - ulOffset;
+    if (ulFirst > ulSize) {
+        ulFirst = ulSize;
+    }
+    memcpy(pcBuffer, g_hRecorder.m_pcBuffer + ulOffset, ulFirst);
+    memcpy(pcBuffer + ulFirst, g_hRecorder.m_pcBuffer, ulSize - ulFirst);
+    g_hRecorder.m_ulTail = ulTail + ulSize;
+
+    return ulSize;
+}
@@ -0,0 +1,37 @@
+#ifndef AUDIO_STREAM_H
+#define AUDIO_STREAM_H
+#include <stdint.h>
+
+
+// I2S interrupt handler to register with audio_setup()
+void audio_stream_isr(void);
+
+
+// Speaker APIs (interrupt-driven ping-pong buffers, 16-bit stereo)
+int      audio_player_setup(uint32_t ulBufferSize);
+void     audio_player_free(void);
+uint32_t audio_player_buffer_size(void);
+uint32_t audio_player_underruns(void);
+int      audio_player_running(void);
+
+void     audio_player_begin(void);
+char*    audio_player_buffer(void);
+void     audio_player_submit(uint32_t ulSize);
+void     audio_player_end(void);
+
+
+// Microphone APIs (interrupt-driven ring buffer, 16-bit mono)
+int      audio_recorder_setup(uint32_t ulBufferSize);
+void     audio_recorder_free(void);
+uint32_t audio_recorder_overruns(void);
+uint32_t audio_recorder_dropped(void);
+uint32_t audio_recorder_watermark(void);
+
+void     audio_recorder_begin(void);
+void     audio_recorder_end(void);
+uint32_t audio_recorder_available(void);
+uint32_t audio_recorder_read(char* pcBuffer, uint32_t ulSize, uint32_t ulTimeoutMs);
+
+
+
+#endif // AUDIO_STREAM_H
@@ -0,0 +1,181 @@
+/**
+  @file audio_vad.c
+  @brief
+  Voice activity detection
+
+ */
+/*
+ * ============================================================================
+ * History
+ * =======
+ * 2026-10-16 : Created v1
+ *
+ * Copyright (C) Bridgetek Pte Ltd
+ * ============================================================================
+ *
+ * This source code ("the Software") is provided by Bridgetek Pte Ltd
+ * ("Bridgetek") subject to the licence terms set out
+ * http://brtchip.com/BRTSourceCodeLicenseAgreement/ ("the Licence Terms").
+ * You must read the Licence Terms before downloading or using the Software.
+ * By installing or using the Software you agree to the Licence Terms. If you
+ * do not agree to the Licence Terms then do not download or use the Software.
+ *
+ * Without prejudice to the Licence Terms, here is a summary of some of the key
+ * terms of the Licence Terms (and in the event of any conflict between this
+ * summary and the Licence Terms then the text of the Licence Terms will
+ * prevail).
+ *
+ * The Software is provided "as is".
+ * There are no warranties (or similar) in relation to the quality of the
+ * Software. You use it at your own risk.
+ * The Software should not be used in, or for, any medical device, system or
+ * appliance. There are exclusions of Bridgetek liability for certain types of loss
+ * such as: special loss or damage; incidental loss or damage; indirect or
+ * consequential loss or damage; loss of income; loss of business; loss of
+ * profits; loss of revenue; loss of contracts; business interruption; loss of
+ * the use of money or anticipated savings; loss of information; loss of
+ * opportunity; loss of goodwill or reputation; and/or loss of, damage to or
+ * corruption of data.
+ * There is a monetary cap on Bridgetek's liability.
+ * The Software may have subsequently been amended by another user and then
+ * distributed by that other user ("Adapted Software").  If so that user may
+ * have additional licence terms that apply to those amendments. However, Bridgetek
+ * has no liability in relation to those amendments.
+ * ============================================================================
+ */
+
+#include <stdint.h>
+#include "ft900.h"
+
+#include "audio.h"
+
+
+
+/////////////////////////////////////////////////////////////////////////////////////////////
+// Energy and zero-crossing voice activity detector
+// Works on 16-bit mono frames in fixed point; a frame is whatever size is passed per call,
+// the onset and hangover are counted in frames.
+// - Energy is the mean absolute amplitude after removing the DC offset
+// - A frame is speech when its energy is well above the noise floor,
+//   or moderately above it with a high zero-crossing rate (fricatives such as 's' and 'f')
+// - The noise floor tracks the energy of non-speech frames
+/////////////////////////////////////////////////////////////////////////////////////////////
+
+#define AUDIO_VAD_RATIO_SPEECH     (48)   // energy > noise * 3.0 (Q4)
+#define AUDIO_VAD_RATIO_FRICATIVE  (24)   // energy > noise * 1.5 (Q4)
+#define AUDIO_VAD_ZCR_FRICATIVE    (77)   // crossings per sample > 0.3 (Q8)
+#define AUDIO_VAD_ENERGY_MIN       (64)   // ignore anything quieter than -54dBFS
+#define AUDIO_VAD_NOISE_MIN        (8)
+#define AUDIO_VAD_NOISE_INIT       (400)  // cap of the initial noise floor if speech starts right away
+
+
+
+void audio_vad_reset(TAudioVad *pVad, uint16_t uwOnsetFrames, uint16_t uwHangoverFrames)
+{
+    pVad->m_ulNoise = 0;
+    pVad->m_lDC = 0;
+    pVad->m_sLast = 0;
+    pVad->m_ulSamples = 0;
+    pVad->m_ulFrames = 0;
+    pVad->m_ulSpeechStart = 0;
+    pVad->m_ulSpeechEnd = 0;
+    pVad->m_uwOnsetFrames = uwOnsetFrames ? uwOnsetFrames : 1;
+    pVad->m_uwHangoverFrames = uwHangoverFrames ? uwHangoverFrames : 1;
+    pVad->m_uwOnset = 0;
+    pVad->m_uwHangover = 0;
+    pVad->m_ucState = AUDIO_VAD_SILENCE;
+}
+
+int audio_vad_process(TAudioVad *pVad, const char *pcSamples, uint32_t ulSize)
+{
+    const short *psSamples = (const short *)pcSamples;
+    uint32_t ulCount = ulSize >> 1;
+    uint32_t ulEnergy = 0;
+    uint32_t ulCrossings = 0;
+    int32_t lSum = 0;
+    int32_t lDC = pVad->m_lDC;
+    int32_t lLast = pVad->m_sLast - lDC;
+    char bSpeech = 0;
+
+
+    if (!ulCount || pVad->m_ucState == AUDIO_VAD_ENDED) {
+        return pVad->m_ucState;
+    }
+
+    for (uint32_t i = 0; i < ulCount; i++) {
+        int32_t lSample = psSamples[i];
+        lSum += lSample;
+        lSample -= lDC;
+        ulEnergy += (lSample < 0) ? -lSample : lSample;
+        ulCrossings += ((lSample ^ lLast) < 0);
+        lLast = lSample;
+    }
+    pVad->m_sLast = psSamples[ulCount - 1];
+    ulEnergy /= ulCount;
+    ulCrossings = (ulCrossings << 8) / ulCount;
+
+    // Track the DC offset of the microphone
+    if (!pVad->m_ulFrames) {
+        pVad->m_lDC = lSum / (int32_t)ulCount;
+        pVad->m_ulNoise = (ulEnergy < AUDIO_VAD_NOISE_INIT) ? ulEnergy : AUDIO_VAD_NOISE_INIT;
+    }
+    else {
+        pVad->m_lDC += (lSum / (int32_t)ulCount - lDC) >> 3;
+    }
+    if (pVad->m_ulNoise < AUDIO_VAD_NOISE_MIN) {
+        pVad->m_ulNoise = AUDIO_VAD_NOISE_MIN;
+    }
+
+    // Classify the frame
+    if (ulEnergy > AUDIO_VAD_ENERGY_MIN) {
+        if ((ulEnergy << 4) > pVad->m_ulNoise * AUDIO_VAD_RATIO_SPEECH) {
+            bSpeech = 1;
+        }
+        else if ((ulEnergy << 4) > pVad->m_ulNoise * AUDIO_VAD_RATIO_FRICATIVE &&
+            ulCrossings > AUDIO_VAD_ZCR_FRICATIVE) {
+            bSpeech = 1;
+        }
+    }
+
+    // Adapt the noise floor; quickly downwards, slowly upwards
+    // During speech it only creeps up (doubling in about 180 frames) so a louder background is eventually learned
+    if (ulEnergy < pVad->m_ulNoise) {
+        pVad->m_ulNoise -= (pVad->m_ulNoise - ulEnergy) >> 2;
+    }
+    else if (!bSpeech) {
+        pVad->m_ulNoise += (ulEnergy - pVad->m_ulNoise) >> 4;
+    }
+    else {
+        pVad->m_ulNoise += (pVad->m_ulNoise >> 8) + 1;
+    }
+
+    // Speech starts after consecutive speech frames and ends after consecutive non-speech frames
+    if (pVad->m_ucState == AUDIO_VAD_SILENCE) {
+        if (bSpeech) {
+            if (!pVad->m_uwOnset++) {
+                pVad->m_ulSpeechStart = pVad->m_ulSamples;
+            }
+            if (pVad->m_uwOnset >= pVad->m_uwOnsetFrames) {
+                pVad->m_ucState = AUDIO_VAD_SPEECH;
+                pVad->m_uwHangover = pVad->m_uwHangoverFrames;
+                pVad->m_ulSpeechEnd = pVad->m_ulSamples + ulCount;
+            }
+        }
+        else {
+            pVad->m_uwOnset = 0;
+        }
+    }
+    else {
+        if (bSpeech) {
+            pVad->m_uwHangover = pVad->m_uwHangoverFrames;
+            pVad->m_ulSpeechEnd = pVad->m_ulSamples + ulCount;
+        }
+        else if (!--pVad->m_uwHangover) {
+            pVad->m_ucState = AUDIO_VAD_ENDED;
+        }
+    }
+
+    pVad->m_ulSamples += ulCount;
+    pVad->m_ulFrames++;
+    return pVad->m_ucState;
+}
@@ -2,14 +2,23 @@
   @file comm.c
   @brief
   Communication wrapper module
-  Currently supports Ethernet connection only
-  Need to support MSTP RS435 connection for PanL
+  Supports Ethernet, WiFi (ESP32) and RS485 (serial bridge of the gateway) connections
+  and POSIX sockets for the host build of test/host
  */
 /*
  * ============================================================================
  * History
  * =======
  * 2019-04-02 : Created v1
+ * 2026-10-16 : Asynchronous requests processed by a socket event task
+ * 2026-10-16 : RS485 link to the serial bridge of the gateway
+ * 2026-10-16 : POSIX sockets for the host build
+ * 2026-10-16 : Durations of the requests recorded in the event trace
+ * 2026-10-16 : WiFi receives woken up by the AT parser instead of polled
+ * 2026-10-16 : WiFi receives of any size read from the link buffer, before the sends
+ * 2026-10-16 : WiFi sends queued to the AT transmit queue instead of one AT+CIPSEND each
+ * 2026-10-16 : WiFi passthrough (AVS_CONFIG_WIFI_PASSTHROUGH)
+ * 2026-10-16 : WiFi link taken from the sockets of wifi.c, shared with other tasks
  *
  * Copyright (C) Bridgetek Pte Ltd
  * ============================================================================
@@ -48,30 +57,106 @@
 #include <ft900.h>
 #include "avs_config.h"     // AVS configuration
 #include "comm_wrapper.h"
+#include "trace.h"
 
 #if (COMMUNICATION_IO==1)   // Ethernet
 #include "lwip/sockets.h"
+#include "lwip/api.h"
+#include "lwip/tcp.h"
+#include "lwip/priv/sockets_priv.h"
+#include "lwip/priv/tcpip_priv.h"
+#include "FreeRTOS.h"
+#include "task.h"
 #elif (COMMUNICATION_IO==2) // WiFi
+#include <string.h>
 #include "wifi.h"
 #include "at.h"
 #include "lwip/sockets.h"
 #include "FreeRTOS.h"
+#include "task.h"
 #elif (COMMUNICATION_IO==3) // RS485
-// TODO RS485
+#include "rs485.h"
+#include "FreeRTOS.h"
+#include "task.h"
+#elif (COMMUNICATION_IO==4) // Host
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include "FreeRTOS.h"
+#include "task.h"
 #endif
 
 
 
-#if (COMMUNICATION_IO==1) || (COMMUNICATION_IO==2)
+#if (COMMUNICATION_IO==1) || (COMMUNICATION_IO==2) || (COMMUNICATION_IO==3) || (COMMUNICATION_IO==4)
 static int   g_lSocket        = -1;
 static int   g_lErr           = 0;
-#endif // (COMMUNICATION_IO==1) || (COMMUNICATION_IO==2)
+#if (COMMUNICATION_IO==1) || (COMMUNICATION_IO==4)
+static int   g_lErrno         = 0;
+#endif
+
+// Socket event task
+// All socket operations run in this task so that the send of one task
+// and the receive of another task overlap on the same socket.
+// Requests are queued per direction and complete in submission order.
+#define COMM_TASK_NAME          "Comm"
+#define COMM_TASK_STACK_SIZE    (384)
+#if (COMMUNICATION_IO==3)   // RS485
+#define COMM_TASK_PRIORITY      (2)     // answers the polls of the bus master without waiting for a time slice
+#else
+#define COMM_TASK_PRIORITY      (1)
+#endif
+
+static TaskHandle_t g_xTask = NULL;
+static TCommRequest* g_pSendHead = NULL;
+static TCommRequest* g_pRecvHead = NULL;
+#if (COMMUNICATION_IO==1)   // Ethernet
+static TCommRequest* g_pAckHead = NULL;         // COMM_FLAG_NOCOPY sends waiting for their acknowledgement
+#endif
+static volatile TaskHandle_t g_xClosing = NULL;  // task waiting in comm_disconnect
+
+// Timeouts of the requests, set by comm_setsockopt
+static TickType_t g_xTimeoutTx = pdMS_TO_TICKS(AVS_CONFIG_TX_TIMEOUT*1000);
+static TickType_t g_xTimeoutRx = pdMS_TO_TICKS(AVS_CONFIG_RX_TIMEOUT*1000);
+
+static void comm_progress(TCommRequest* pRequest, int lBytes);
+static void comm_complete(TCommRequest** ppHead, int lStatus);
+static void comm_notify(TaskHandle_t xWaiter);
+static void comm_sleep(TickType_t xTicks);
+
+// Transport specific
+static void comm_close(void);
+static TickType_t comm_poll(void);
+#endif // (COMMUNICATION_IO==1) || (COMMUNICATION_IO==2) || (COMMUNICATION_IO==3) || (COMMUNICATION_IO==4)
 
 
 
 #if (COMMUNICATION_IO==1) // Ethernet
 
 
+// lwIP socket callback; also wakes up the socket event task
+static netconn_callback g_fxnSocketCallback = NULL;
+
+// lwIP sent callback of the connection; also wakes up the socket event task
+// for the COMM_FLAG_NOCOPY sends waiting for their acknowledgement
+static tcp_sent_fn g_fxnSentCallback = NULL;
+
+// Sequence number following the last byte sent with COMM_FLAG_NOCOPY
+static uint32_t g_ulNocopyMark = 0;
+static char g_bNocopy = 0;
+
+// Sequence numbers of the TCP connection, read in the tcpip thread
+typedef struct _TCommTcpSeq {
+    struct tcpip_api_call_data m_tCall;
+    struct netconn* m_pConn;
+    uint32_t m_ulLastAck;       // lastack
+    uint32_t m_ulLastByte;      // snd_lbb
+} TCommTcpSeq;
+
+
 int comm_get_server_port(void)
 {
     return AVS_CONFIG_SERVER_PORT;
@@ -89,10 +174,59 @@ int comm_err(void)
     return g_lErr;
 }
 
+static struct netconn* comm_get_netconn(void)
+{
+    struct lwip_sock* pSock = lwip_socket_dbg_get_socket(g_lSocket);
+
+    if (g_lSocket < 0 || !pSock) {
+        return NULL;
+    }
+    return pSock->conn;
+}
+
+static void comm_event_callback(struct netconn *pConn, enum netconn_evt eEvent, u16_t uwLen)
+{
+    g_fxnSocketCallback(pConn, eEvent, uwLen);
+    if (g_xTask) {
+        xTaskNotifyGive(g_xTask);
+    }
+}
+
+// Called by the tcpip thread for every acknowledgement, unlike NETCONN_EVT_SENDPLUS
+// which is only raised once the send buffer is below TCP_SNDLOWAT
+static err_t comm_sent_callback(void* pvArg, struct tcp_pcb* pPcb, u16_t uwLen)
+{
+    err_t err = g_fxnSentCallback ? g_fxnSentCallback(pvArg, pPcb, uwLen) : ERR_OK;
+
+    if (g_xTask) {
+        xTaskNotifyGive(g_xTask);
+    }
+    return err;
+}
+
+// The tcpip thread calls both callbacks so they are replaced there (tcpip_api_call)
+static err_t comm_hook_callbacks_fn(struct tcpip_api_call_data* pCall)
+{
+    struct netconn* pConn = ((TCommTcpSeq*)pCall)->m_pConn;
+    struct tcp_pcb* pPcb = pConn->pcb.tcp;
+
+    if (!pPcb) {
+        return ERR_CONN;
+    }
+    g_fxnSocketCallback = pConn->callback;
+    pConn->callback = comm_event_callback;
+    g_fxnSentCallback = pPcb->sent;
+    tcp_sent(pPcb, comm_sent_callback);
+    return ERR_OK;
+}
+
 int comm_connect(void)
 {
     int iRet = 0;
+    int lSocket = -1;
     struct sockaddr_in tServer = {0};
+    struct lwip_sock* pSock = NULL;
+    TCommTcpSeq tSeq;
 
 
     // Set server info
@@ -102,24 +236,48 @@ int comm_connect(void)
 
     // Create a TCP socket
     g_lErr = 0;
-    if ((g_lSocket = socket(AF_INET, SOCK_STREAM, 0)) < 0) {
+    if ((lSocket = socket(AF_INET, SOCK_STREAM, 0)) < 0) {
         g_lErr = 1;
         return 0;
     }
 
     // Connect to server
-    if ((iRet = connect(g_lSocket, (struct sockaddr *) &tServer, sizeof(tServer))) < 0) {
-        close(g_lSocket);
-        g_lSocket = -1;
+    if ((iRet = connect(lSocket, (struct sockaddr *) &tServer, sizeof(tServer))) < 0) {
+        close(lSocket);
         return 0;
     }
 
+    // The socket event task only uses non-blocking operations
+    // and is woken up by the socket events instead of select()
+    fcntl(lSocket, F_SETFL, O_NONBLOCK);
+    pSock = lwip_socket_dbg_get_socket(lSocket);
+    if (!pSock || !pSock->conn) {
+        close(lSocket);
+        return 0;
+    }
+    tSeq.m_pConn = pSock->conn;
+    if (tcpip_api_call(comm_hook_callbacks_fn, &tSeq.m_tCall) != ERR_OK) {
+        close(lSocket);
+        return 0;
+    }
+
+    g_bNocopy = 0;
+    g_lSocket = lSocket;
     return 1;
 }
 
-void comm_disconnect(void)
+static void comm_close(void)
 {
     if (g_lSocket >= 0) {
+#if LWIP_SO_LINGER
+        // Abort instead of lingering only if lwIP still references the buffers of COMM_FLAG_NOCOPY,
+        // since the submitter reuses them once its request failed
+        if (g_bNocopy && !comm_send_acked(g_ulNocopyMark)) {
+            struct linger tLinger = {1, 0};
+            setsockopt(g_lSocket, SOL_SOCKET, SO_LINGER, (const char*)&tLinger, sizeof(tLinger));
+        }
+#endif
+        g_bNocopy = 0;
         close(g_lSocket);
         shutdown(g_lSocket, SHUT_RDWR);
         g_lSocket = -1;
@@ -131,36 +289,167 @@ int comm_isconnected(void)
     return (g_lSocket>-1);
 }
 
-void comm_setsockopt(int lTimeoutSecs, int lIsSend)
+/////////////////////////////////////////////////////////////////////////////////////////////
+// Zero-copy send
+// send() copies the data into the TCP send buffer of lwIP.
+// COMM_FLAG_NOCOPY queues TCP segments referencing the buffer instead (NETCONN_NOCOPY)
+// and sets m_ulMark to the sequence number following its last byte.
+// Once all queued, the request waits in g_pAckHead and completes when the gateway acknowledged m_ulMark,
+// so the buffer can be reused once the request completed.
+// lastack and snd_lbb belong to the tcpip thread so they are read there (tcpip_api_call).
+/////////////////////////////////////////////////////////////////////////////////////////////
+static err_t comm_read_seq_fn(struct tcpip_api_call_data* pCall)
 {
-    struct timeval tTimeout = {lTimeoutSecs, 0};
-    if (lIsSend) {
-        setsockopt(g_lSocket, SOL_SOCKET, SO_SNDTIMEO, (const char*)&tTimeout, sizeof(tTimeout));
+    TCommTcpSeq* pSeq = (TCommTcpSeq*)pCall;
+    struct tcp_pcb* pPcb = pSeq->m_pConn->pcb.tcp;
+
+    // The pcb is freed by the tcpip thread once the connection is closed or aborted
+    if (!pPcb) {
+        return ERR_CONN;
     }
-    else {
-        setsockopt(g_lSocket, SOL_SOCKET, SO_RCVTIMEO, (const char*)&tTimeout, sizeof(tTimeout));
+    pSeq->m_ulLastAck = pPcb->lastack;
+    pSeq->m_ulLastByte = pPcb->snd_lbb;
+    return ERR_OK;
+}
+
+static err_t comm_read_seq(struct netconn* pConn, TCommTcpSeq* pSeq)
+{
+    pSeq->m_pConn = pConn;
+    return tcpip_api_call(comm_read_seq_fn, &pSeq->m_tCall);
+}
+
+static int comm_send_nocopy(TCommRequest* pRequest)
+{
+    struct netconn* pConn = comm_get_netconn();
+    TCommTcpSeq tSeq;
+    size_t ulWritten = 0;
+    err_t err;
+
+    if (!pConn) {
+        errno = ENOTCONN;
+        return -1;
     }
+
+    err = netconn_write_partly(pConn, pRequest->m_pcBuffer + pRequest->m_lTransferred,
+        pRequest->m_lSize - pRequest->m_lTransferred, NETCONN_NOCOPY | NETCONN_DONTBLOCK, &ulWritten);
+    if (ulWritten && comm_read_seq(pConn, &tSeq) == ERR_OK) {
+        pRequest->m_ulMark = tSeq.m_ulLastByte;
+        g_ulNocopyMark = tSeq.m_ulLastByte;
+        g_bNocopy = 1;
+    }
+    if (err != ERR_OK) {
+        errno = err_to_errno(err);
+        return -1;
+    }
+    return (int)ulWritten;
 }
 
-int comm_send(void *pvBuffer, int lSize)
+int comm_send_acked(uint32_t ulMark)
 {
-    return send(g_lSocket, pvBuffer, lSize, 0);
+    struct netconn* pConn = comm_get_netconn();
+    TCommTcpSeq tSeq;
+
+    // Without a connection, lwIP has freed the segments
+    if (!pConn || comm_read_seq(pConn, &tSeq) != ERR_OK) {
+        return 1;
+    }
+    return (int32_t)(tSeq.m_ulLastAck - ulMark) >= 0;
 }
 
-int comm_recv(void *pvBuffer, int lSize)
+// Moves the send head, all queued without copy, to the end of the sends waiting for their acknowledgement
+static void comm_wait_ack(void)
 {
-    return recv(g_lSocket, pvBuffer, lSize, 0);
+    TCommRequest* pRequest = g_pSendHead;
+    TCommRequest** ppTail = &g_pAckHead;
+
+    taskENTER_CRITICAL();
+    g_pSendHead = pRequest->m_pNext;
+    taskEXIT_CRITICAL();
+
+    pRequest->m_pNext = NULL;
+    while (*ppTail) {
+        ppTail = &(*ppTail)->m_pNext;
+    }
+    *ppTail = pRequest;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////
+// Progresses the queue heads with non-blocking operations until the socket would block.
+// The socket events then wake up the socket event task.
+/////////////////////////////////////////////////////////////////////////////////////////////
+static TickType_t comm_poll(void)
+{
+    TCommRequest* pRequest;
+    int lRet;
+
+    // Complete the zero-copy sends acknowledged, in submission order
+    while (g_pAckHead && comm_send_acked(g_pAckHead->m_ulMark)) {
+        comm_complete(&g_pAckHead, COMM_STATUS_DONE);
+    }
+
+    while ((pRequest = g_pRecvHead) != NULL) {
+        lRet = recv(g_lSocket, pRequest->m_pcBuffer + pRequest->m_lTransferred,
+            pRequest->m_lSize - pRequest->m_lTransferred, MSG_DONTWAIT);
+        if (lRet > 0) {
+            comm_progress(pRequest, lRet);
+            if (pRequest->m_lTransferred == pRequest->m_lSize || (pRequest->m_ucFlags & COMM_FLAG_PARTIAL)) {
+                comm_complete(&g_pRecvHead, COMM_STATUS_DONE);
+            }
+        }
+        else if (lRet < 0 && (errno == EWOULDBLOCK || errno == EAGAIN)) {
+            break;
+        }
+        else {
+            g_lErrno = lRet ? errno : 0;
+            comm_complete(&g_pRecvHead, lRet ? COMM_STATUS_FAILED : COMM_STATUS_CLOSED);
+        }
+    }
+
+    while ((pRequest = g_pSendHead) != NULL) {
+        if (pRequest->m_ucFlags & COMM_FLAG_NOCOPY) {
+            lRet = comm_send_nocopy(pRequest);
+        }
+        else {
+            lRet = send(g_lSocket, pRequest->m_pcBuffer + pRequest->m_lTransferred,
+                pRequest->m_lSize - pRequest->m_lTransferred, MSG_DONTWAIT);
+        }
+        if (lRet > 0) {
+            comm_progress(pRequest, lRet);
+            if (pRequest->m_lTransferred != pRequest->m_lSize) {
+                continue;
+            }
+            if (pRequest->m_ucFlags & COMM_FLAG_NOCOPY) {
+                comm_wait_ack();
+            }
+            else {
+                comm_complete(&g_pSendHead, COMM_STATUS_DONE);
+            }
+        }
+        else if (lRet == 0 || errno == EWOULDBLOCK || errno == EAGAIN) {
+            break;
+        }
+        else {
+            g_lErrno = errno;
+            comm_complete(&g_pSendHead, COMM_STATUS_FAILED);
+        }
+    }
+
+    return portMAX_DELAY;
 }
 
 int comm_errno(void)
 {
-    return errno;
+    return g_lErrno;
 }
 
 
 #elif (COMMUNICATION_IO==2) // WiFi
 
 
+// AT transmit timeout of the queued sends, applied when comm_setsockopt changes it
+static TickType_t g_xTimeoutCipsend = 0;
+
+
 int comm_get_server_port(void)
 {
     return AVS_CONFIG_SERVER_PORT;
@@ -180,27 +469,40 @@ int comm_err(void)
 
 int comm_connect(void)
 {
-    int8_t at_ret;
+    WIFISocket_t xSocket;
     char acIpAddress[16] = {0};
     ip_addr_t* pAddr = (ip_addr_t*)comm_get_server_addr();
 
 
     inet_ntop(AF_INET, pAddr, acIpAddress, sizeof(acIpAddress));
 
-    g_lSocket = 0;
-    at_ret = at_set_cipstart_tcp(g_lSocket, acIpAddress, AVS_CONFIG_SERVER_PORT, 0);
-    if (at_ret != AT_OK) {
-        g_lSocket = -1;
+    // Any free link of the module; the others stay connected for other tasks
+    xSocket = WIFI_SocketConnect(eWiFiSocketTCP, acIpAddress, AVS_CONFIG_SERVER_PORT);
+    if (xSocket == WIFI_SOCKET_INVALID) {
         return 0;
     }
 
+#if AVS_CONFIG_WIFI_PASSTHROUGH
+    // WIFI_On set AT+CIPMUX=0 for passthrough, so this is the only link.
+    // Stays in normal mode if the module does not take passthrough
+    at_lock();
+    if (at_set_cipmode(at_txmode_passthrough) == AT_OK) {
+        if (at_cipsend_start() != AT_OK) {
+            tfp_printf("at_cipsend_start failed!\r\n");
+            at_set_cipmode(at_txmode_normal);
+        }
+    }
+    at_unlock();
+#endif
+
+    g_lSocket = xSocket;
     return 1;
 }
 
-void comm_disconnect(void)
+static void comm_close(void)
 {
     if (g_lSocket >= 0) {
-        at_set_cipclose(g_lSocket);
+        WIFI_SocketClose(g_lSocket);
         g_lSocket = -1;
     }
 }
@@ -210,63 +512,222 @@ int comm_isconnected(void)
     return (g_lSocket>-1);
 }
 
-void comm_setsockopt(int lTimeoutSecs, int lIsSend)
+/////////////////////////////////////////////////////////////////////////////////////////////
+// Progresses the queue heads through the AT command interface.
+// A receive takes the +IPD data already in the buffer of the link without
+// waiting, whatever its size; the AT parser holds off the module while the
+// buffer is full. In passthrough, the link is checked once idle for a while
+// as the module does not report its loss. A send completes once its data is
+// in the transmit queue of the link, which at_send_progress sends by
+// pipelined AT+CIPSEND of up to 2048 bytes, or straight to the UART in
+// passthrough, so the sender prepares the next data meanwhile. The AT
+// parser wakes up the socket event task on the next data, link change or
+// response. The AT interface is locked meanwhile, as other tasks may use the
+// other links through the sockets of wifi.c.
+/////////////////////////////////////////////////////////////////////////////////////////////
+static TickType_t comm_poll(void)
 {
-    if (lIsSend) {
-        at_timeout_tx_comms(pdMS_TO_TICKS(lTimeoutSecs*1000));
+    TCommRequest* pRequest;
+    TickType_t xSleep = portMAX_DELAY;
+    int lWait = portMAX_DELAY;
+
+    at_lock();
+    while ((pRequest = g_pRecvHead) != NULL) {
+        //tfp_printf("at_recv lSize %d\r\n", pRequest->m_lSize);
+        uint16_t uwRecvLen = at_recv_nowait(g_lSocket, (uint16_t)(pRequest->m_lSize - pRequest->m_lTransferred),
+            (uint8_t*)pRequest->m_pcBuffer + pRequest->m_lTransferred);
+        //tfp_printf("at_recv lRet %d\r\n", uwRecvLen);
+        if (uwRecvLen) {
+            comm_progress(pRequest, uwRecvLen);
+            if (pRequest->m_lTransferred == pRequest->m_lSize || (pRequest->m_ucFlags & COMM_FLAG_PARTIAL)) {
+                comm_complete(&g_pRecvHead, COMM_STATUS_DONE);
+            }
+        }
+        else if (at_cipsend_check(&lWait) != AT_OK || at_is_link_id_connected(g_lSocket) != at_connected) {
+            comm_complete(&g_pRecvHead, COMM_STATUS_CLOSED);
+        }
+        else {
+            xSleep = lWait;
+            break;
+        }
     }
-    else {
-        at_timeout_rx_comms(pdMS_TO_TICKS(lTimeoutSecs*1000));
+
+    if (g_xTimeoutCipsend != g_xTimeoutTx) {
+        g_xTimeoutCipsend = g_xTimeoutTx;
+        at_timeout_tx_comms(g_xTimeoutCipsend);
     }
+
+    // Frees the queue of the data already sent, then queues and sends more
+    at_send_progress(NULL);
+    while ((pRequest = g_pSendHead) != NULL) {
+        int lSize = pRequest->m_lSize - pRequest->m_lTransferred;
+        uint16_t uwSendLen = at_send(g_lSocket, (uint16_t)(lSize > AT_SEND_LINK_SIZE ? AT_SEND_LINK_SIZE : lSize),
+            (uint8_t*)pRequest->m_pcBuffer + pRequest->m_lTransferred);
+        if (uwSendLen) {
+            comm_progress(pRequest, uwSendLen);
+            if (pRequest->m_lTransferred == pRequest->m_lSize) {
+                comm_complete(&g_pSendHead, COMM_STATUS_DONE);
+            }
+        }
+        else if (at_send_error(g_lSocket) != AT_OK || at_is_link_id_connected(g_lSocket) != at_connected) {
+            tfp_printf("at_send failed!\r\n");
+            comm_complete(&g_pSendHead, COMM_STATUS_FAILED);
+        }
+        else {
+            break;
+        }
+    }
+    if (at_send_progress(&lWait) == AT_DATA_WAITING && (TickType_t)lWait < xSleep) {
+        xSleep = lWait;
+    }
+    at_unlock();
+
+    return xSleep;
 }
 
-int comm_send(void *pvBuffer, int lSize)
+int comm_errno(void)
 {
-    //tfp_printf("  at_set_cipsend %d\r\n", lSize);
+    return 0;
+}
 
-    int8_t at_ret = at_set_cipsend(g_lSocket, lSize, (uint8_t *) pvBuffer);
-    if (at_ret != AT_OK) {
-        tfp_printf("at_set_cipsend failed!\r\n");
-        return -1;
-    }
 
-    return lSize;
+#elif (COMMUNICATION_IO==3) // RS485
+
+
+// Task waiting in comm_connect until the socket event task starts the connection
+static volatile TaskHandle_t g_xConnecting = NULL;
+static TaskHandle_t g_xConnectWaiter = NULL;
+
+
+int comm_get_server_port(void)
+{
+    return AVS_CONFIG_SERVER_PORT;
+}
+
+const void* comm_get_server_addr(void)
+{
+    static const uint32_t ulServerAddr = AVS_CONFIG_SERVER_ADDR;
+    return &ulServerAddr;
 }
 
-// TODO: Fix corruption issue
-int comm_recv(void *pvBuffer, int lSize)
+int comm_err(void)
+{
+    return g_lErr;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////
+// The serial bridge of the gateway connects to the server when it receives the CONNECT
+// of the device, and answers with CONNECT once connected or DISCONNECT on failure.
+// The link is only accessed by the socket event task.
+/////////////////////////////////////////////////////////////////////////////////////////////
+int comm_connect(void)
 {
-    int lRet = 0;
+    TickType_t xStart = xTaskGetTickCount();
 
-    if (lSize == 4) {
-        uint16_t uwRecvLen = (uint16_t)lSize;
-        at_register_ipd(uwRecvLen, pvBuffer);
 
-        //tfp_printf("comm_recv %d\r\n", lSize);
-        int8_t ipd_status = at_ipd((int8_t*)&g_lSocket, &uwRecvLen, (uint8_t **)&pvBuffer);
-        if (ipd_status == AT_DATA_WAITING) {
-            //tfp_printf("comm_recv at_ipd! %d %d\r\n", uwRecvLen, *((uint32_t*)pvBuffer));
-            lRet = uwRecvLen;
+    g_lErr = 0;
+    if (!g_xTask) {
+        g_lErr = 1;
+        return 0;
+    }
+
+    g_xConnecting = xTaskGetCurrentTaskHandle();
+    xTaskNotifyGive(g_xTask);
+    while (g_xConnecting || rs485_state() == RS485_STATE_CONNECTING) {
+        if (xTaskGetTickCount() - xStart >= g_xTimeoutTx) {
+            break;
         }
-        else if (ipd_status == AT_ERROR_TIMEOUT) {
-            lRet = -1;
+        comm_sleep(pdMS_TO_TICKS(100));
+    }
+
+    // The link carries a single connection
+    g_lSocket = 0;
+    if (rs485_state() != RS485_STATE_CONNECTED) {
+        comm_disconnect();
+        return 0;
+    }
+    return 1;
+}
+
+static void comm_close(void)
+{
+    if (g_lSocket >= 0) {
+        rs485_disconnect();
+        g_lSocket = -1;
+    }
+}
+
+int comm_isconnected(void)
+{
+    return (g_lSocket>-1);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////
+// Runs the link on every wake up of the socket event task,
+// as the bus master polls the device whether requests are pending or not.
+/////////////////////////////////////////////////////////////////////////////////////////////
+static void comm_service(void)
+{
+    if (g_xConnecting) {
+        rs485_connect(AVS_CONFIG_SERVER_ADDR, AVS_CONFIG_SERVER_PORT);
+        g_xConnectWaiter = g_xConnecting;
+        g_xConnecting = NULL;
+    }
+
+    rs485_process();
+
+    if (g_xConnectWaiter && rs485_state() != RS485_STATE_CONNECTING) {
+        comm_notify(g_xConnectWaiter);
+        g_xConnectWaiter = NULL;
+    }
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////
+// Progresses the queue heads through the window of the link.
+// Sends complete once queued in the window and are transmitted when the bridge polls
+// the device; the acknowledgements of the bridge then make room for the next ones.
+/////////////////////////////////////////////////////////////////////////////////////////////
+static TickType_t comm_poll(void)
+{
+    TCommRequest* pRequest;
+    int lRet;
+
+    while ((pRequest = g_pRecvHead) != NULL) {
+        lRet = rs485_read(pRequest->m_pcBuffer + pRequest->m_lTransferred,
+            pRequest->m_lSize - pRequest->m_lTransferred);
+        if (lRet > 0) {
+            comm_progress(pRequest, lRet);
+            if (pRequest->m_lTransferred == pRequest->m_lSize || (pRequest->m_ucFlags & COMM_FLAG_PARTIAL)) {
+                comm_complete(&g_pRecvHead, COMM_STATUS_DONE);
+            }
         }
-        else if (ipd_status == AT_NO_DATA) {
-            lRet = 0;
+        else if (lRet == 0) {
+            break;
         }
         else {
-            tfp_printf("at_ipd failed! %d\r\n", ipd_status);
-            lRet = -1;
+            comm_complete(&g_pRecvHead, COMM_STATUS_CLOSED);
         }
-        //at_delete_ipd(pvBuffer);
     }
-    else {
-        //tfp_printf("at_recv lSize %d\r\n", lSize);
-        lRet = at_recv(g_lSocket, (uint16_t)lSize, pvBuffer);
-        //tfp_printf("at_recv lRet %d\r\n", lRet);
+
+    while ((pRequest = g_pSendHead) != NULL) {
+        lRet = rs485_write(pRequest->m_pcBuffer + pRequest->m_lTransferred,
+            pRequest->m_lSize - pRequest->m_lTransferred);
+        if (lRet > 0) {
+            comm_progress(pRequest, lRet);
+            if (pRequest->m_lTransferred == pRequest->m_lSize) {
+                comm_complete(&g_pSendHead, COMM_STATUS_DONE);
+            }
+        }
+        else if (lRet == 0) {
+            break;
+        }
+        else {
+            comm_complete(&g_pSendHead, COMM_STATUS_FAILED);
+        }
     }
 
-    return lRet;
+    // The link wakes up the socket event task on the frames of the bridge
+    return portMAX_DELAY;
 }
 
 int comm_errno(void)
@@ -275,67 +736,391 @@ int comm_errno(void)
 }
 
 
-#elif (COMMUNICATION_IO==3) // RS485
+#elif (COMMUNICATION_IO==4) // Host
 
 
 int comm_get_server_port(void)
 {
-    // TODO RS485
-    return 0;
+    return AVS_CONFIG_SERVER_PORT;
 }
 
 const void* comm_get_server_addr(void)
 {
-    // TODO RS485
-    return NULL;
+    static struct in_addr tServerAddr;
+    tServerAddr.s_addr = htonl(AVS_CONFIG_SERVER_ADDR);
+    return &tServerAddr;
 }
 
 int comm_err(void)
 {
-    // TODO RS485
-    return 0;
+    return g_lErr;
 }
 
 int comm_connect(void)
 {
-    // TODO RS485
+    int lSocket = -1;
+    struct sockaddr_in tServer = {0};
+
+
+    // Set server info
+    tServer.sin_family = AF_INET;
+    tServer.sin_port = htons(AVS_CONFIG_SERVER_PORT);
+    tServer.sin_addr.s_addr = htonl(AVS_CONFIG_SERVER_ADDR);
+
+    // Create a TCP socket
+    g_lErr = 0;
+    if ((lSocket = socket(AF_INET, SOCK_STREAM, 0)) < 0) {
+        g_lErr = 1;
+        return 0;
+    }
+
+    // Connect to server
+    if (connect(lSocket, (struct sockaddr *) &tServer, sizeof(tServer)) < 0) {
+        close(lSocket);
+        return 0;
+    }
+
+    // The socket event task only uses non-blocking operations
+    fcntl(lSocket, F_SETFL, O_NONBLOCK);
+
+    g_lSocket = lSocket;
     return 1;
 }
 
-void comm_disconnect(void)
+static void comm_close(void)
 {
-    // TODO RS485
+    if (g_lSocket >= 0) {
+        shutdown(g_lSocket, SHUT_RDWR);
+        close(g_lSocket);
+        g_lSocket = -1;
+    }
 }
 
 int comm_isconnected(void)
 {
-    // TODO RS485
-    return 0;
+    return (g_lSocket>-1);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////
+// Progresses the queue heads with non-blocking operations like the Ethernet wrapper.
+// The host sockets have no event callback to wake up the socket event task,
+// so it looks again on the next tick while a request waits on the socket.
+/////////////////////////////////////////////////////////////////////////////////////////////
+static TickType_t comm_poll(void)
+{
+    TCommRequest* pRequest;
+    int lRet;
+
+    while ((pRequest = g_pRecvHead) != NULL) {
+        lRet = recv(g_lSocket, pRequest->m_pcBuffer + pRequest->m_lTransferred,
+            pRequest->m_lSize - pRequest->m_lTransferred, MSG_DONTWAIT);
+        if (lRet > 0) {
+            comm_progress(pRequest, lRet);
+            if (pRequest->m_lTransferred == pRequest->m_lSize || (pRequest->m_ucFlags & COMM_FLAG_PARTIAL)) {
+                comm_complete(&g_pRecvHead, COMM_STATUS_DONE);
+            }
+        }
+        else if (lRet < 0 && (errno == EWOULDBLOCK || errno == EAGAIN)) {
+            break;
+        }
+        else {
+            g_lErrno = lRet ? errno : 0;
+            comm_complete(&g_pRecvHead, lRet ? COMM_STATUS_FAILED : COMM_STATUS_CLOSED);
+        }
+    }
+
+    while ((pRequest = g_pSendHead) != NULL) {
+        lRet = send(g_lSocket, pRequest->m_pcBuffer + pRequest->m_lTransferred,
+            pRequest->m_lSize - pRequest->m_lTransferred, MSG_DONTWAIT | MSG_NOSIGNAL);
+        if (lRet > 0) {
+            comm_progress(pRequest, lRet);
+            if (pRequest->m_lTransferred == pRequest->m_lSize) {
+                comm_complete(&g_pSendHead, COMM_STATUS_DONE);
+            }
+        }
+        else if (lRet == 0 || errno == EWOULDBLOCK || errno == EAGAIN) {
+            break;
+        }
+        else {
+            g_lErrno = errno;
+            comm_complete(&g_pSendHead, COMM_STATUS_FAILED);
+        }
+    }
+
+    return (g_pSendHead || g_pRecvHead) ? 1 : portMAX_DELAY;
+}
+
+int comm_errno(void)
+{
+    return g_lErrno;
+}
+
+
+#endif // COMMUNICATION_IO
+
+
+
+#if (COMMUNICATION_IO==1) || (COMMUNICATION_IO==2) || (COMMUNICATION_IO==3) || (COMMUNICATION_IO==4)
+
+
+/////////////////////////////////////////////////////////////////////////////////////////////
+// Request queues
+// Tasks append requests; only the socket event task removes them.
+/////////////////////////////////////////////////////////////////////////////////////////////
+static int comm_submit(TCommRequest** ppHead, TCommRequest* pRequest, TickType_t xTimeout)
+{
+    if (!g_xTask || pRequest->m_lSize <= 0) {
+        return 0;
+    }
+
+    pRequest->m_lTransferred = 0;
+    pRequest->m_lStatus = COMM_STATUS_PENDING;
+    pRequest->m_pvWaiter = xTaskGetCurrentTaskHandle();
+    pRequest->m_ulDeadline = xTaskGetTickCount() + xTimeout;
+    pRequest->m_ulSubmitted = TRACE_TIME();
+    pRequest->m_pNext = NULL;
+
+    taskENTER_CRITICAL();
+    while (*ppHead) {
+        ppHead = &(*ppHead)->m_pNext;
+    }
+    *ppHead = pRequest;
+    taskEXIT_CRITICAL();
+
+    xTaskNotifyGive(g_xTask);
+    return 1;
+}
+
+static void comm_progress(TCommRequest* pRequest, int lBytes)
+{
+    pRequest->m_lTransferred += lBytes;
+    if (pRequest->m_fxnCallback) {
+        pRequest->m_fxnCallback(pRequest, lBytes, COMM_STATUS_PENDING);
+    }
+}
+
+static void comm_complete(TCommRequest** ppHead, int lStatus)
+{
+    TCommRequest* pRequest = *ppHead;
+    TaskHandle_t xWaiter = pRequest->m_pvWaiter;
+
+    taskENTER_CRITICAL();
+    *ppHead = pRequest->m_pNext;
+    taskEXIT_CRITICAL();
+    TRACE_DURATION(ppHead != &g_pRecvHead ? TRACE_COMM_SEND : TRACE_COMM_RECV, pRequest->m_ulSubmitted);
+
+    if (pRequest->m_fxnCallback) {
+        pRequest->m_fxnCallback(pRequest, 0, lStatus);
+    }
+
+    // The submitter may release the request once its status is set
+    pRequest->m_lStatus = lStatus;
+    comm_notify(xWaiter);
 }
 
+// The tasks waiting for the socket event task are notified with COMM_NOTIFY_BIT
+// so that the notifications they count for other purposes are kept
+static void comm_notify(TaskHandle_t xWaiter)
+{
+    xTaskNotify(xWaiter, COMM_NOTIFY_BIT, eSetBits);
+}
+
+static void comm_sleep(TickType_t xTicks)
+{
+    xTaskNotifyWait(0, COMM_NOTIFY_BIT, NULL, xTicks);
+}
+
+static void comm_fail(TCommRequest** ppHead)
+{
+    while (*ppHead) {
+        comm_complete(ppHead, COMM_STATUS_FAILED);
+    }
+}
+
+// Completes the head request if timed out; returns the ticks until the head times out
+static TickType_t comm_expire(TCommRequest** ppHead, TickType_t xSleep)
+{
+    TickType_t xNow = xTaskGetTickCount();
+
+    while (*ppHead) {
+        int32_t lLeft = (int32_t)((*ppHead)->m_ulDeadline - xNow);
+        if (lLeft <= 0) {
+            comm_complete(ppHead, COMM_STATUS_TIMEDOUT);
+            continue;
+        }
+        if ((TickType_t)lLeft < xSleep) {
+            xSleep = lLeft;
+        }
+        break;
+    }
+    return xSleep;
+}
+
+static void comm_task(void *pvParameters)
+{
+    (void) pvParameters;
+
+
+    while (1) {
+        TickType_t xSleep = portMAX_DELAY;
+
+#if (COMMUNICATION_IO==3)   // RS485
+        comm_service();
+#endif
+        if (g_xClosing) {
+            TaskHandle_t xClosing = g_xClosing;
+            comm_close();
+            comm_fail(&g_pSendHead);
+            comm_fail(&g_pRecvHead);
+#if (COMMUNICATION_IO==1)   // Ethernet
+            comm_fail(&g_pAckHead);
+#endif
+            g_xClosing = NULL;
+            comm_notify(xClosing);
+        }
+        else if (g_lSocket < 0) {
+            comm_fail(&g_pSendHead);
+            comm_fail(&g_pRecvHead);
+#if (COMMUNICATION_IO==1)   // Ethernet
+            comm_fail(&g_pAckHead);
+#endif
+        }
+#if (COMMUNICATION_IO==1)   // Ethernet
+        else if (g_pSendHead || g_pRecvHead || g_pAckHead) {
+            xSleep = comm_poll();
+            xSleep = comm_expire(&g_pSendHead, xSleep);
+            xSleep = comm_expire(&g_pRecvHead, xSleep);
+            xSleep = comm_expire(&g_pAckHead, xSleep);
+        }
+#else
+        else if (g_pSendHead || g_pRecvHead) {
+            xSleep = comm_poll();
+            xSleep = comm_expire(&g_pSendHead, xSleep);
+            xSleep = comm_expire(&g_pRecvHead, xSleep);
+        }
+#endif
+#if (COMMUNICATION_IO==2)   // WiFi
+        // The transmit queue of the link is sent after its requests completed
+        else if (at_send_in_flight(g_lSocket)) {
+            xSleep = comm_poll();
+        }
+#endif
+
+        // Sleep until a request is submitted, a socket event or a timeout
+        if (xSleep) {
+            ulTaskNotifyTake(pdTRUE, xSleep);
+        }
+    }
+}
+
+int comm_init(void)
+{
+    if (!g_xTask) {
+        if (xTaskCreate(comm_task, COMM_TASK_NAME, COMM_TASK_STACK_SIZE,
+            NULL, COMM_TASK_PRIORITY, &g_xTask) != pdTRUE) {
+            g_xTask = NULL;
+            return 0;
+        }
+#if (COMMUNICATION_IO==3)   // RS485
+        if (!rs485_open(AVS_CONFIG_RS485_BAUD, AVS_CONFIG_RS485_ADDRESS, g_xTask)) {
+            return 0;
+        }
+#endif
+    }
+    return 1;
+}
+
+// The socket event task is kept for the next comm_init (INCLUDE_vTaskDelete is 0)
+void comm_free(void)
+{
+    comm_disconnect();
+}
+
+void comm_disconnect(void)
+{
+    if (g_lSocket < 0) {
+        return;
+    }
+    if (!g_xTask) {
+        comm_close();
+        return;
+    }
+
+    // Close in the socket event task, failing the pending requests
+    g_xClosing = xTaskGetCurrentTaskHandle();
+    xTaskNotifyGive(g_xTask);
+    while (g_xClosing) {
+        comm_sleep(portMAX_DELAY);
+    }
+}
+
+// Sets the timeout of the next requests; the socket itself is not reconfigured
 void comm_setsockopt(int lTimeoutSecs, int lIsSend)
 {
-    // TODO RS485
+    if (lIsSend) {
+        g_xTimeoutTx = pdMS_TO_TICKS(lTimeoutSecs*1000);
+    }
+    else {
+        g_xTimeoutRx = pdMS_TO_TICKS(lTimeoutSecs*1000);
+    }
 }
 
-int comm_send(void *pvBuffer, int lSize)
+int comm_submit_send(TCommRequest* pRequest)
 {
-    // TODO RS485
-    return 0;
+    return comm_submit(&g_pSendHead, pRequest, g_xTimeoutTx);
 }
 
-int comm_recv(void *pvBuffer, int lSize)
+int comm_submit_recv(TCommRequest* pRequest)
 {
-    // TODO RS485
-    return 0;
+    return comm_submit(&g_pRecvHead, pRequest, g_xTimeoutRx);
 }
 
-int comm_errno(void)
+// Sleeps on COMM_NOTIFY_BIT only; the notifications given to the caller meanwhile are kept.
+// The status is set before the notification so a bit cleared by the caller elsewhere is not missed.
+int comm_wait(TCommRequest* pRequest)
 {
-    // TODO RS485
-    return 0;
+    while (pRequest->m_lStatus == COMM_STATUS_PENDING) {
+        comm_sleep(portMAX_DELAY);
+    }
+    return pRequest->m_lStatus;
 }
 
+int comm_send(void *pvBuffer, int lSize)
+{
+    TCommRequest tRequest = {0};
+
+    tRequest.m_pcBuffer = pvBuffer;
+    tRequest.m_lSize = lSize;
+    if (!comm_submit_send(&tRequest)) {
+        return -1;
+    }
+    if (comm_wait(&tRequest) != COMM_STATUS_DONE) {
+        return -1;
+    }
+    return tRequest.m_lTransferred;
+}
+
+// Returns the bytes received, 0 if the connection was closed, or -1 on timeout or error
+int comm_recv(void *pvBuffer, int lSize)
+{
+    TCommRequest tRequest = {0};
+
+    tRequest.m_pcBuffer = pvBuffer;
+    tRequest.m_lSize = lSize;
+    tRequest.m_ucFlags = COMM_FLAG_PARTIAL;
+    if (!comm_submit_recv(&tRequest)) {
+        return -1;
+    }
+    switch (comm_wait(&tRequest)) {
+        case COMM_STATUS_DONE:
+            return tRequest.m_lTransferred;
+        case COMM_STATUS_CLOSED:
+            return 0;
+        default:
+            break;
+    }
+    return -1;
+}
 
-#endif // COMMUNICATION_IO
 
+#endif // (COMMUNICATION_IO==1) || (COMMUNICATION_IO==2) || (COMMUNICATION_IO==3) || (COMMUNICATION_IO==4)
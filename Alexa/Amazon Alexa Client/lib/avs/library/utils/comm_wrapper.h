@@ -1,5 +1,6 @@
 #ifndef COMM_WRAPPER_H
 #define COMM_WRAPPER_H
+#include <stdint.h>
 
 
 int  comm_get_server_port(void);
@@ -7,14 +8,61 @@ const void* comm_get_server_addr(void);
 int  comm_err(void);
 int  comm_errno(void);
 
+int  comm_init(void);
+void comm_free(void);
+
 int  comm_connect(void);
 void comm_disconnect(void);
 int  comm_isconnected(void);
 
+// Timeout of the requests submitted afterwards
 void comm_setsockopt(int lTimeoutSecs, int lIsSend);
 
+// Blocking send and receive (submit and wait)
 int  comm_send(void *pvBuffer, int lSize);
 int  comm_recv(void *pvBuffer, int lSize);
 
 
+// Asynchronous requests, processed by the socket event task in submission order
+// The callback is called by the socket event task with the bytes transferred
+// (COMM_STATUS_PENDING) and once completed; it must not block.
+// The request must be kept until it completes; comm_wait blocks until then.
+#define COMM_STATUS_PENDING     (1)
+#define COMM_STATUS_DONE        (0)
+#define COMM_STATUS_TIMEDOUT    (-1)
+#define COMM_STATUS_CLOSED      (-2)    // receive only
+#define COMM_STATUS_FAILED      (-3)
+
+#define COMM_FLAG_PARTIAL       (1<<0)  // receive completes once some bytes are received
+#define COMM_FLAG_NOCOPY        (1<<1)  // Ethernet send; buffer referenced until completed, once acknowledged
+
+// Notification bit given to the tasks waiting in comm_wait, comm_connect and comm_disconnect
+#define COMM_NOTIFY_BIT         (1UL<<31)
+
+typedef struct _TCommRequest {
+    char*        m_pcBuffer;
+    int          m_lSize;
+    uint8_t      m_ucFlags;         // COMM_FLAG_xxx
+    void       (*m_fxnCallback)(struct _TCommRequest* pRequest, int lBytes, int lStatus);
+    void*        m_pvContext;
+    // Set by the socket event task
+    volatile int m_lTransferred;
+    volatile int m_lStatus;         // COMM_STATUS_xxx
+    uint32_t     m_ulMark;          // COMM_FLAG_NOCOPY
+    // Private
+    void*        m_pvWaiter;
+    uint32_t     m_ulDeadline;
+    uint32_t     m_ulSubmitted;     // AVS_CONFIG_TRACE
+    struct _TCommRequest* m_pNext;
+} TCommRequest;
+
+int  comm_submit_send(TCommRequest* pRequest);
+int  comm_submit_recv(TCommRequest* pRequest);
+int  comm_wait(TCommRequest* pRequest);
+
+#if (COMMUNICATION_IO==1)   // Ethernet
+int  comm_send_acked(uint32_t ulMark);
+#endif
+
+
 #endif // COMM_WRAPPER_H
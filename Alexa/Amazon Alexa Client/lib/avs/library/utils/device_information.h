@@ -11,12 +11,14 @@
               0001-mp3
               0010-wav
               0011-aac
+              0100-ima-adpcm (4 bits, first sample in high nibble)
 *************************************************/
 /*BITS  7-4:  bitDepth
               0000-8  bits 
               0001-16 bits 
               0010-24 bits
               0011-32 bits  
+              0100-4  bits (ima-adpcm)
 *************************************************/
 /*BITS 11-8:  bitRate
               0000-16000 hz
@@ -25,6 +27,7 @@
               0011-48000 hz
               0100-96000 hz
               0101-8000  hz
+              0110-24000 hz
 *************************************************/
 /*BITS 15-12: channels
               0000-1 ch mono
@@ -46,11 +49,13 @@
 #define DEVICE_CAPABILITIES_FORMAT_MP3       1
 #define DEVICE_CAPABILITIES_FORMAT_WAV       2
 #define DEVICE_CAPABILITIES_FORMAT_AAC       3
+#define DEVICE_CAPABILITIES_FORMAT_ADPCM     4
 
 #define DEVICE_CAPABILITIES_BITDEPTH_8       0
 #define DEVICE_CAPABILITIES_BITDEPTH_16      1
 #define DEVICE_CAPABILITIES_BITDEPTH_24      2
 #define DEVICE_CAPABILITIES_BITDEPTH_32      3
+#define DEVICE_CAPABILITIES_BITDEPTH_4       4
 
 #define DEVICE_CAPABILITIES_BITRATE_16000    0
 #define DEVICE_CAPABILITIES_BITRATE_32000    1
@@ -58,6 +63,7 @@
 #define DEVICE_CAPABILITIES_BITRATE_48000    3
 #define DEVICE_CAPABILITIES_BITRATE_96000    4
 #define DEVICE_CAPABILITIES_BITRATE_8000     5
+#define DEVICE_CAPABILITIES_BITRATE_24000    6
 
 #define DEVICE_CAPABILITIES_CHANNEL_1        0
 #define DEVICE_CAPABILITIES_CHANNEL_2        1
@@ -92,6 +98,92 @@ typedef struct _TDeviceInfo {
 #pragma pack(pop)
 
 
+/************************************************/
+/* CODEC NEGOTIATION                            */
+/************************************************/
+/* When enabled, TDeviceInfo (preferred codecs) is followed by TDeviceCodecs
+   listing every codec the device supports in each direction.
+   The gateway replies with a TDeviceInfo holding the codecs it selected,
+   normally the densest one supported by both sides.
+*************************************************/
+
+#define DEVICE_CODECS_MAGIC                  0x4E535641 // "AVSN"
+
+#define DEVICE_CODEC_PCM16                   (1<<0) // RAW, 16 bits
+#define DEVICE_CODEC_ULAW                    (1<<1) // RAW, 8 bits u-law
+#define DEVICE_CODEC_ADPCM                   (1<<2) // IMA-ADPCM, 4 bits
+
+#pragma pack(push, 1)
+typedef struct _TDeviceCodecs {
+
+    unsigned int m_ulMagic;
+    unsigned short m_uwSendCodecs;
+    unsigned short m_uwRecvCodecs;
+
+} TDeviceCodecs;
+#pragma pack(pop)
+
+
+/************************************************/
+/* FRAMED PROTOCOL                              */
+/************************************************/
+/* When enabled, TDeviceInfo (and TDeviceCodecs) is followed by TDeviceProtocol
+   with the highest protocol version of the device and the stream of its
+   interrupted request, if any. The gateway replies with a TDeviceProtocol
+   holding the version it selected and, if it still has that stream,
+   the bytes of it already received; the device then resends only the rest.
+   Version 1 is the 4-byte length followed by the audio.
+   Version 2 sends every message as a TDeviceFrame followed by m_ulLength bytes:
+   - AUDIO        request (device to gateway) or response (gateway to device) audio
+                  at m_ulOffset of stream m_uwStream; FLAG_END marks the last frame
+   - CONTROL      m_ucSubtype is a DEVICE_CONTROL_xxx code for stream m_uwStream
+   - DISPLAYCARD  display card of type m_ucSubtype, chunked like AUDIO
+   - VOLUME       m_ulOffset is the speaker volume in percent
+   - HEARTBEAT    no payload; sent by the gateway when idle
+   m_uwSequence counts the frames sent in each direction to detect gaps.
+   IMA-ADPCM audio resumed at an offset restarts from a reset state.
+*************************************************/
+
+#define DEVICE_PROTOCOL_MAGIC                0x46535641 // "AVSF"
+#define DEVICE_PROTOCOL_VERSION_LENGTH       1
+#define DEVICE_PROTOCOL_VERSION_FRAMED       2
+
+#define DEVICE_FRAME_AUDIO                   0
+#define DEVICE_FRAME_CONTROL                 1
+#define DEVICE_FRAME_DISPLAYCARD             2
+#define DEVICE_FRAME_VOLUME                  3
+#define DEVICE_FRAME_HEARTBEAT               4
+
+#define DEVICE_FRAME_FLAG_END                (1<<0) // last frame of the stream
+#define DEVICE_FRAME_FLAG_RESUME             (1<<1) // first frame of a resumed stream
+
+#define DEVICE_CONTROL_CANCEL                1 // stop the stream; no more frames follow
+
+#pragma pack(push, 1)
+typedef struct _TDeviceProtocol {
+
+    unsigned int m_ulMagic;
+    unsigned short m_uwVersion;
+    unsigned short m_uwStream;
+    unsigned int m_ulOffset;
+
+} TDeviceProtocol;
+
+typedef struct _TDeviceFrame {
+
+    unsigned char m_ucType;
+    unsigned char m_ucFlags;
+    unsigned char m_ucSubtype;
+    unsigned char m_ucReserved;
+    unsigned short m_uwStream;
+    unsigned short m_uwSequence;
+    unsigned int m_ulOffset;
+    unsigned int m_ulLength;
+
+} TDeviceFrame;
+#pragma pack(pop)
+
+
 /************************************************/
 
 
@@ -47,6 +47,7 @@
 #include <stdint.h>
 #include <string.h>
 #include <ft900.h>
+#include "FreeRTOS.h"
 #include "ff.h"
 #include "diskio.h"
 #include "assert.h"
@@ -55,6 +56,14 @@
 
 
 
+//#define DEBUG
+#ifdef DEBUG
+#define DEBUG_PRINTF(...) do {tfp_printf(__VA_ARGS__);} while (0)
+#else
+#define DEBUG_PRINTF(...)
+#endif
+
+
 #if defined(__FT900__)
 #define GPIO_SD_CLK  (19)
 #define GPIO_SD_CMD  (20)
@@ -99,6 +108,51 @@ static int sd_ready = 0;
 FATFS fs;
 
 
+/////////////////////////////////////////////////////////////////////////////////////////////
+// Recording file write cache
+// Writes are gathered in m_pcBuffer and handed to FatFs as whole buffers at offsets that are
+// multiples of the buffer size. With a buffer size dividing the cluster size, each flush is a
+// single multi-sector transfer within one cluster and no partial sector is ever read back.
+// The file is preallocated as a contiguous cluster run so no FAT update happens while recording;
+// sdcard_close truncates it to the bytes actually written.
+/////////////////////////////////////////////////////////////////////////////////////////////
+typedef struct _SDCardCacheContext {
+
+    char* m_pcBuffer;
+    uint32_t m_ulBufferSize;
+    uint32_t m_ulUsed;
+    FIL* m_pFile;               // file using the cache
+    FIL* m_pExpanded;           // file using a preallocated cluster run
+
+} SDCardCacheContext;
+
+static SDCardCacheContext g_hCache = {0};
+
+
+#if _USE_FASTSEEK
+/////////////////////////////////////////////////////////////////////////////////////////////
+// Fast seek link maps of the files opened for reading
+// The cluster link map table (CLMT) holds its size then a (length, first cluster) pair per
+// fragment, so FatFs finds the cluster of any offset without following the FAT chain.
+// A contiguous file needs 4 entries; a map larger than the slot is allocated from the heap.
+/////////////////////////////////////////////////////////////////////////////////////////////
+#define SDCARD_LINKMAP_SLOTS     2
+#define SDCARD_LINKMAP_ENTRIES   16  // up to 7 fragments without allocation
+
+typedef struct _SDCardLinkMapContext {
+
+    FIL* m_pFile;
+    DWORD* m_pulHeap;
+    DWORD m_aulTable[SDCARD_LINKMAP_ENTRIES];
+
+} SDCardLinkMapContext;
+
+static SDCardLinkMapContext g_hLinkMap[SDCARD_LINKMAP_SLOTS] = {0};
+static void sdcard_linkmap_create(FIL* f);
+static void sdcard_linkmap_free(SDCardLinkMapContext* pMap);
+#endif // _USE_FASTSEEK
+
+
 
 #if 0
 void sdcard_test_write(const char* filename);
@@ -263,6 +317,11 @@ int sdcard_open(FIL* f, const char* filename, int bWrite, int bRead) {
         //uart_puts(UART0, "Opening file for reading\r\n\r\n");
         res = f_open(f, filename, FA_READ);
         ASSERT_P(FR_OK, res, "Problem reading file");
+#if _USE_FASTSEEK
+        if (FR_OK == res) {
+            sdcard_linkmap_create(f);
+        }
+#endif
     }
 
     return res;
@@ -270,6 +329,230 @@ int sdcard_open(FIL* f, const char* filename, int bWrite, int bRead) {
 
 
 
+#if _USE_FASTSEEK
+/////////////////////////////////////////////////////////////////////////////////////////////
+// Enables fast seek on a file opened for reading
+// Without a free slot or heap for the map, the file is read by following the FAT chain.
+/////////////////////////////////////////////////////////////////////////////////////////////
+static void sdcard_linkmap_create(FIL* f)
+{
+    SDCardLinkMapContext* pMap = NULL;
+    FRESULT res;
+
+    for (int i=0; i<SDCARD_LINKMAP_SLOTS; i++) {
+        if (!g_hLinkMap[i].m_pFile) {
+            pMap = &g_hLinkMap[i];
+            break;
+        }
+    }
+    if (!pMap) {
+        DEBUG_PRINTF("sdcard_linkmap_create(): no free slot\r\n");
+        return;
+    }
+
+    f->cltbl = pMap->m_aulTable;
+    f->cltbl[0] = SDCARD_LINKMAP_ENTRIES;
+    res = f_lseek(f, CREATE_LINKMAP);
+    if (FR_NOT_ENOUGH_CORE == res) {
+        // Fragmented file; the required size was returned in the first entry
+        DWORD ulEntries = f->cltbl[0];
+        pMap->m_pulHeap = pvPortMalloc(ulEntries * sizeof(DWORD));
+        if (pMap->m_pulHeap) {
+            f->cltbl = pMap->m_pulHeap;
+            f->cltbl[0] = ulEntries;
+            res = f_lseek(f, CREATE_LINKMAP);
+        }
+    }
+
+    if (FR_OK != res) {
+        DEBUG_PRINTF("sdcard_linkmap_create(): failed %d\r\n", res);
+        f->cltbl = NULL;
+        sdcard_linkmap_free(pMap);
+        return;
+    }
+    pMap->m_pFile = f;
+}
+
+static void sdcard_linkmap_free(SDCardLinkMapContext* pMap)
+{
+    if (pMap->m_pulHeap) {
+        vPortFree(pMap->m_pulHeap);
+        pMap->m_pulHeap = NULL;
+    }
+    pMap->m_pFile = NULL;
+}
+#endif // _USE_FASTSEEK
+
+/////////////////////////////////////////////////////////////////////////////////////////////
+// Allocates the recording file write cache of ulBufferSize bytes (multiple of the sector size)
+/////////////////////////////////////////////////////////////////////////////////////////////
+int sdcard_cache_setup(uint32_t ulBufferSize)
+{
+    if (!ulBufferSize || (ulBufferSize % _MIN_SS)) {
+        DEBUG_PRINTF("sdcard_cache_setup(): invalid size %d\r\n", (int)ulBufferSize);
+        return 0;
+    }
+
+    g_hCache.m_pcBuffer = pvPortMalloc(ulBufferSize);
+    if (!g_hCache.m_pcBuffer) {
+        DEBUG_PRINTF("sdcard_cache_setup(): pvPortMalloc failed\r\n");
+        return 0;
+    }
+    g_hCache.m_ulBufferSize = ulBufferSize;
+
+    return 1;
+}
+
+void sdcard_cache_free(void)
+{
+    if (g_hCache.m_pcBuffer) {
+        vPortFree(g_hCache.m_pcBuffer);
+        g_hCache.m_pcBuffer = NULL;
+    }
+    g_hCache.m_ulBufferSize = 0;
+}
+
+static FRESULT sdcard_cache_flush(void)
+{
+    FRESULT res = FR_OK;
+    UINT written = 0;
+
+    if (g_hCache.m_ulUsed) {
+        res = f_write(g_hCache.m_pFile, g_hCache.m_pcBuffer, g_hCache.m_ulUsed, &written);
+        if (FR_OK == res && written != g_hCache.m_ulUsed) {
+            res = FR_DENIED; // volume full
+        }
+        g_hCache.m_ulUsed = 0;
+    }
+
+    return res;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////
+// Creates a recording file of up to ulSize bytes
+// - Preallocate a contiguous cluster run of ulSize bytes if the volume has one
+// - Cache the writes if the cache is set up and not used by another file
+/////////////////////////////////////////////////////////////////////////////////////////////
+int sdcard_open_record(FIL* f, const char* filename, uint32_t ulSize)
+{
+    FRESULT res = sdcard_open(f, filename, 1, 0);
+    if (FR_OK != res) {
+        return res;
+    }
+
+#if _USE_EXPAND
+    if (ulSize && !g_hCache.m_pExpanded) {
+        res = f_expand(f, ulSize, 1);
+        if (FR_OK == res) {
+            g_hCache.m_pExpanded = f;
+        }
+        else {
+            // Fragmented or full volume; clusters are allocated while writing instead
+            DEBUG_PRINTF("sdcard_open_record(): f_expand failed %d\r\n", res);
+            res = FR_OK;
+        }
+    }
+#endif
+
+    if (g_hCache.m_pcBuffer && !g_hCache.m_pFile) {
+        g_hCache.m_pFile = f;
+        g_hCache.m_ulUsed = 0;
+    }
+
+    return res;
+}
+
+FRESULT sdcard_write(FIL* f, const void* buff, UINT btw, UINT* bw)
+{
+    const char* pcSrc = (const char*)buff;
+    FRESULT res = FR_OK;
+
+
+    if (f != g_hCache.m_pFile) {
+        return f_write(f, buff, btw, bw);
+    }
+
+    *bw = 0;
+    while (btw) {
+        uint32_t ulCopy = g_hCache.m_ulBufferSize - g_hCache.m_ulUsed;
+        if (ulCopy > btw) {
+            ulCopy = btw;
+        }
+        memcpy(g_hCache.m_pcBuffer + g_hCache.m_ulUsed, pcSrc, ulCopy);
+        g_hCache.m_ulUsed += ulCopy;
+        pcSrc += ulCopy;
+        btw -= ulCopy;
+        *bw += ulCopy;
+
+        if (g_hCache.m_ulUsed == g_hCache.m_ulBufferSize) {
+            res = sdcard_cache_flush();
+            if (FR_OK != res) {
+                break;
+            }
+        }
+    }
+
+    return res;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////
+// Restarts a recording file from its beginning, discarding the bytes written so far
+// A preallocated cluster run is kept; sdcard_close truncates it to the bytes written after the rewind.
+/////////////////////////////////////////////////////////////////////////////////////////////
+FRESULT sdcard_rewind(FIL* f)
+{
+    FRESULT res = FR_OK;
+
+    if (f == g_hCache.m_pFile) {
+        g_hCache.m_ulUsed = 0;
+    }
+    res = f_lseek(f, 0);
+#if _USE_EXPAND
+    if (f == g_hCache.m_pExpanded) {
+        return res;
+    }
+#endif
+    if (FR_OK == res) {
+        res = f_truncate(f);
+    }
+
+    return res;
+}
+
+FRESULT sdcard_close(FIL* f)
+{
+    FRESULT res = FR_OK;
+
+    if (f == g_hCache.m_pFile) {
+        res = sdcard_cache_flush();
+        g_hCache.m_pFile = NULL;
+    }
+#if _USE_EXPAND
+    if (f == g_hCache.m_pExpanded) {
+        // Release the preallocated clusters past the bytes written, even if the flush failed;
+        // the first error is returned
+        FRESULT resTruncate = f_truncate(f);
+        if (FR_OK == res) {
+            res = resTruncate;
+        }
+        g_hCache.m_pExpanded = NULL;
+    }
+#endif
+
+#if _USE_FASTSEEK
+    for (int i=0; i<SDCARD_LINKMAP_SLOTS; i++) {
+        if (f == g_hLinkMap[i].m_pFile) {
+            sdcard_linkmap_free(&g_hLinkMap[i]);
+        }
+    }
+#endif
+
+    FRESULT resClose = f_close(f);
+    return (FR_OK != res) ? res : resClose;
+}
+
+
+
 /* Based on: http://elm-chan.org/fsw/ff/en/readdir.html */
 /** List the directory
  *  @param path The directory to list
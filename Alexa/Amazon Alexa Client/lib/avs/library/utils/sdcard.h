@@ -8,10 +8,16 @@ void sdcard_setup(void);
 int  sdcard_open(FIL* f, const char* filename, int bWrite, int bRead);
 void sdcard_dir(char* path);
 #define sdcard_read  f_read
-#define sdcard_write f_write
-#define sdcard_close f_close
 #define sdcard_size  f_size
 #define sdcard_lseek f_lseek
+FRESULT sdcard_write(FIL* f, const void* buff, UINT btw, UINT* bw);
+FRESULT sdcard_close(FIL* f);
+
+// Recording files (contiguous preallocation, cached writes)
+int  sdcard_cache_setup(uint32_t ulBufferSize);
+void sdcard_cache_free(void);
+int  sdcard_open_record(FIL* f, const char* filename, uint32_t ulSize);
+FRESULT sdcard_rewind(FIL* f);
 
 
 #endif // SDCARD_H
@@ -0,0 +1,193 @@
+/**
+  @file trace.c
+  @brief
+  Timestamped event ring of the request and response stages
+
+ */
+/*
+ * ============================================================================
+ * History
+ * =======
+ * 2026-10-16 : Created v1
+ *
+ * Copyright (C) Bridgetek Pte Ltd
+ * ============================================================================
+ *
+ * This source code ("the Software") is provided by Bridgetek Pte Ltd
+ * ("Bridgetek") subject to the licence terms set out
+ * http://brtchip.com/BRTSourceCodeLicenseAgreement/ ("the Licence Terms").
+ * You must read the Licence Terms before downloading or using the Software.
+ * By installing or using the Software you agree to the Licence Terms. If you
+ * do not agree to the Licence Terms then do not download or use the Software.
+ *
+ * Without prejudice to the Licence Terms, here is a summary of some of the key
+ * terms of the Licence Terms (and in the event of any conflict between this
+ * summary and the Licence Terms then the text of the Licence Terms will
+ * prevail).
+ *
+ * The Software is provided "as is".
+ * There are no warranties (or similar) in relation to the quality of the
+ * Software. You use it at your own risk.
+ * The Software should not be used in, or for, any medical device, system or
+ * appliance. There are exclusions of Bridgetek liability for certain types of loss
+ * such as: special loss or damage; incidental loss or damage; indirect or
+ * consequential loss or damage; loss of income; loss of business; loss of
+ * profits; loss of revenue; loss of contracts; business interruption; loss of
+ * the use of money or anticipated savings; loss of information; loss of
+ * opportunity; loss of goodwill or reputation; and/or loss of, damage to or
+ * corruption of data.
+ * There is a monetary cap on Bridgetek's liability.
+ * The Software may have subsequently been amended by another user and then
+ * distributed by that other user ("Adapted Software").  If so that user may
+ * have additional licence terms that apply to those amendments. However, Bridgetek
+ * has no liability in relation to those amendments.
+ * ============================================================================
+ */
+
+#include <stdint.h>
+#include <ft900.h>
+#include "FreeRTOS.h"
+#include "task.h"
+#include "trace.h"
+
+
+
+/////////////////////////////////////////////////////////////////////////////////////////////
+// Event ring
+// Records are 8 bytes stamped with the counter of the FreeRTOS port (ulPortProfilerCounterGet,
+// the tick timer at configCPU_CLOCK_HZ) so that recording costs a timer read and two stores.
+// m_ulHead and m_ulTail run freely and are masked with m_ulMask.
+// The counter may step back by one tick period when read while the tick interrupt is pending,
+// so times are kept monotonic and negative durations are clamped to 0.
+/////////////////////////////////////////////////////////////////////////////////////////////
+typedef struct _TraceContext {
+
+    TTraceRecord* m_pRecords;
+    uint32_t m_ulMask;
+    uint32_t m_ulHead;
+    uint32_t m_ulTail;
+    uint32_t m_ulLast;
+
+} TraceContext;
+
+static TraceContext g_tTrace = {0};
+
+
+
+int trace_setup(uint32_t ulEvents)
+{
+    if (g_tTrace.m_pRecords) {
+        return 1;
+    }
+    if (!ulEvents || (ulEvents & (ulEvents - 1))) {
+        return 0;
+    }
+    g_tTrace.m_pRecords = pvPortMalloc(ulEvents * sizeof(TTraceRecord));
+    if (!g_tTrace.m_pRecords) {
+        return 0;
+    }
+    g_tTrace.m_ulMask = ulEvents - 1;
+    g_tTrace.m_ulHead = 0;
+    g_tTrace.m_ulTail = 0;
+    return 1;
+}
+
+void trace_free(void)
+{
+    if (g_tTrace.m_pRecords) {
+        taskENTER_CRITICAL();
+        TTraceRecord* pRecords = g_tTrace.m_pRecords;
+        g_tTrace.m_pRecords = NULL;
+        taskEXIT_CRITICAL();
+        vPortFree(pRecords);
+    }
+}
+
+uint32_t trace_time(void)
+{
+    return ulPortProfilerCounterGet();
+}
+
+static void trace_record(ETraceEvent eEvent, uint32_t ulTime, uint32_t ulValue)
+{
+    if (ulValue > TRACE_VALUE_MAX) {
+        ulValue = TRACE_VALUE_MAX;
+    }
+
+    taskENTER_CRITICAL();
+    if (g_tTrace.m_pRecords) {
+        if ((int32_t)(ulTime - g_tTrace.m_ulLast) < 0) {
+            ulTime = g_tTrace.m_ulLast;
+        }
+        TTraceRecord* pRecord = &g_tTrace.m_pRecords[g_tTrace.m_ulHead & g_tTrace.m_ulMask];
+        pRecord->m_ulTime = ulTime;
+        pRecord->m_ulEvent = (uint32_t)eEvent | (ulValue << 8);
+        g_tTrace.m_ulHead++;
+        g_tTrace.m_ulLast = ulTime;
+    }
+    taskEXIT_CRITICAL();
+}
+
+void trace_event(ETraceEvent eEvent, uint32_t ulValue)
+{
+    trace_record(eEvent, trace_time(), ulValue);
+}
+
+void trace_duration(ETraceEvent eEvent, uint32_t ulStart)
+{
+    uint32_t ulTime = trace_time();
+    int32_t lDuration = (int32_t)(ulTime - ulStart);
+
+    trace_record(eEvent, ulTime, lDuration > 0 ? lDuration : 0);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////
+// Writes a TTraceHeader and the records since the last dump, oldest first.
+// The records are written from the ring so the writer may be slow (a 9600 baud UART);
+// events recorded meanwhile are kept for the next dump unless the ring wraps.
+/////////////////////////////////////////////////////////////////////////////////////////////
+uint32_t trace_dump(void (*fxnWrite)(const void* pvData, unsigned int ulSize))
+{
+    TTraceHeader tHeader = {0};
+    uint32_t ulHead, ulTail, ulSize;
+
+
+    if (!g_tTrace.m_pRecords) {
+        return 0;
+    }
+
+    taskENTER_CRITICAL();
+    ulHead = g_tTrace.m_ulHead;
+    ulTail = g_tTrace.m_ulTail;
+    taskEXIT_CRITICAL();
+
+    ulSize = g_tTrace.m_ulMask + 1;
+    if (ulHead - ulTail > ulSize) {
+        tHeader.m_ulLost = ulHead - ulTail - ulSize;
+        ulTail = ulHead - ulSize;
+    }
+
+    tHeader.m_ulMagic = TRACE_MAGIC;
+    tHeader.m_uwVersion = TRACE_VERSION;
+    tHeader.m_uwRecordSize = sizeof(TTraceRecord);
+    tHeader.m_ulFrequency = configCPU_CLOCK_HZ;
+    tHeader.m_ulCount = ulHead - ulTail;
+    (*fxnWrite)(&tHeader, sizeof(tHeader));
+
+    // Write the contiguous spans of the ring
+    while (ulTail != ulHead) {
+        uint32_t ulOffset = ulTail & g_tTrace.m_ulMask;
+        uint32_t ulCount = ulSize - ulOffset;
+        if (ulCount > ulHead - ulTail) {
+            ulCount = ulHead - ulTail;
+        }
+        (*fxnWrite)(&g_tTrace.m_pRecords[ulOffset], ulCount * sizeof(TTraceRecord));
+        ulTail += ulCount;
+    }
+
+    taskENTER_CRITICAL();
+    g_tTrace.m_ulTail = ulTail;
+    taskEXIT_CRITICAL();
+
+    return tHeader.m_ulCount;
+}
@@ -0,0 +1,88 @@
+#ifndef TRACE_H
+#define TRACE_H
+#include <stdint.h>
+
+
+// Events of the request and response stages
+// The value is a size in bytes, a duration in counter ticks (the events ending in a duration)
+// or a level in bytes (the watermarks).
+typedef enum _ETraceEvent {
+    TRACE_NONE = 0,
+
+    // Request
+    TRACE_CAPTURE_BEGIN,        // microphone started
+    TRACE_CAPTURE_END,          // microphone stopped; bytes recorded
+    TRACE_VAD_END,              // end of speech detected; speech end in ms from the capture begin
+    TRACE_SEND_BEGIN,           // first byte of the request queued; bytes to send (0 if streamed)
+    TRACE_SEND_END,             // last byte of the request sent; bytes sent
+    TRACE_ENCODE,               // duration of the downsampling and encoding of a chunk
+
+    // Response
+    TRACE_RESPONSE_BEGIN,       // header of the response received; bytes of the first audio segment
+    TRACE_RESPONSE_END,         // last byte of the response received; bytes received
+    TRACE_DECODE,               // duration of the decoding of a chunk to the speaker
+    TRACE_PLAY_BEGIN,           // first sample queued to the speaker
+    TRACE_PLAY_END,             // last sample played
+
+    // Calls
+    TRACE_SDCARD_READ,          // duration of sdcard_read
+    TRACE_SDCARD_WRITE,         // duration of sdcard_write
+    TRACE_COMM_SEND,            // duration of a send request, from submission to completion
+    TRACE_COMM_RECV,            // duration of a receive request, from submission to completion
+
+    // Watermarks
+    TRACE_MIC_HIGH,             // highest level of the microphone ring during the capture
+    TRACE_JITTER_LOW,           // lowest level of the jitter buffer once playing
+    TRACE_JITTER_PREBUFFER,     // prebuffer watermark of the jitter buffer when the response starts
+
+    TRACE_EVENT_COUNT
+
+} ETraceEvent;
+
+
+// Binary dump: a TTraceHeader followed by m_ulCount TTraceRecord (little endian)
+#define TRACE_MAGIC             (0x54535641) // "AVST"
+#define TRACE_VERSION           (1)
+#define TRACE_VALUE_MAX         (0x00FFFFFF)
+
+typedef struct _TTraceHeader {
+    uint32_t m_ulMagic;
+    uint16_t m_uwVersion;
+    uint16_t m_uwRecordSize;
+    uint32_t m_ulFrequency;     // counter ticks per second
+    uint32_t m_ulCount;         // records that follow
+    uint32_t m_ulLost;          // records overwritten before this dump
+} TTraceHeader;
+
+typedef struct _TTraceRecord {
+    uint32_t m_ulTime;          // counter ticks, wraps around
+    uint32_t m_ulEvent;         // ETraceEvent in bits 0-7, value in bits 8-31
+} TTraceRecord;
+
+
+// Event ring of ulEvents records (power of 2); the oldest records are overwritten
+int      trace_setup(uint32_t ulEvents);
+void     trace_free(void);
+
+// Counter of the FreeRTOS port (run time stats); safe to call from tasks only
+uint32_t trace_time(void);
+void     trace_event(ETraceEvent eEvent, uint32_t ulValue);
+void     trace_duration(ETraceEvent eEvent, uint32_t ulStart);
+
+// Writes the records since the last dump and empties the ring. Returns the records written.
+uint32_t trace_dump(void (*fxnWrite)(const void* pvData, unsigned int ulSize));
+
+
+// Hooks of the library, compiled out unless AVS_CONFIG_TRACE is set (include avs_config.h first)
+#if AVS_CONFIG_TRACE
+#define TRACE_EVENT(eEvent, ulValue)    trace_event(eEvent, ulValue)
+#define TRACE_TIME()                    trace_time()
+#define TRACE_DURATION(eEvent, ulStart) trace_duration(eEvent, ulStart)
+#else
+#define TRACE_EVENT(eEvent, ulValue)
+#define TRACE_TIME()                    (0)
+#define TRACE_DURATION(eEvent, ulStart) ((void)(ulStart))
+#endif
+
+
+#endif // TRACE_H
@@ -9,6 +9,12 @@
  * History
  * =======
  * 2019-04-25 : Created v1
+ * 2026-10-16 : Responses and +IPD data from the event-driven parser of at_parser.c
+ * 2026-10-16 : RTS held off by the parser while a link buffer is full
+ * 2026-10-16 : Transmit queue of the links sent by pipelined AT+CIPSEND
+ * 2026-10-16 : Passthrough transmission for AT+CIPMODE=1, left for commands
+ * 2026-10-16 : Baud rate negotiation and hardware flow control of the UART
+ * 2026-10-16 : Passive receive mode, statistics and locking of the links
  *
  * Copyright (C) Bridgetek Pte Ltd
  * ============================================================================
@@ -51,11 +57,12 @@
 
 #include "FreeRTOS.h"
 #include "task.h"
-#include "timers.h"
+#include "semphr.h"
 
 #include "ft900_uart_simple.h"
 #include "uartrb.h"
 #include "at.h"
+#include "at_parser.h"
 
 
 
@@ -78,16 +85,34 @@
 #define STATUS_CODE "STATUS"
 #define READY_CODE "ready"
 
-#define MARKER_MAX_LENGTH 20
-#define MARKER_WIFI_CONNECTED "WIFI CONNECTED\r\n"
-#define MARKER_WIFI_GOT_IP "WIFI GOT IP\r\n"
-#define MARKER_WIFI_DISCONNECTED "WIFI DISCONNECTED\r\n"
-#define MARKER_SERVER_CONNECT ",CONNECT\r\n"
-#define MARKER_SERVER_CLOSE ",CLOSED\r\n"
-#define MARKER_IPD "\r\n+IPD,"
-
 //#define RINGBUFFER_SIZE 64
-#define AT_MAX_COMMAND_LEN 256
+
+/* Passthrough is left by "+++" sent alone, with a silence of at least 20ms
+ * before and after it; the module takes commands 1s later. */
+#define AT_PASSTHROUGH_GUARD_MS 20
+#define AT_PASSTHROUGH_EXIT_MS 1000
+/* Longest sleep in at_send_progress while another task has data queued, as
+ * the parser only notifies the last task that progressed the queue */
+#define AT_SEND_POLL_MS 10
+
+/* The UART samples each bit 4 times from the 100MHz peripheral clock. */
+#define AT_UART_CLOCK 100000000UL
+#define AT_UART_SAMPLES 4
+#define AT_UART_FCR_FIFO_RESET 0x07 // FIFOs enabled and cleared
+/* Time for the last bytes to leave the FIFO, and the line to settle, when
+ * the baud rate changes */
+#define AT_UART_SETTLE_MS 10
+/* Timeout of the commands while probing and checking a baud rate */
+#define AT_UART_PROBE_MS 100
+#define AT_UART_CHECK_MS 500
+/* Number of AT+GMR that must match for a baud rate to be kept, and of
+ * attempts to go back to the previous rate when they do not */
+#define AT_UART_CHECKS 8
+#define AT_UART_RETRIES 3
+/* Length of the command the module echoes back when checking a baud rate,
+ * so that the direction to the module carries as much as AT+GMR the other
+ * way; within the 256 bytes the firmware takes */
+#define AT_UART_CHECK_LONG 200
 
 /* Define to echo commands sent to the AT firmware on the debug port.
  * The AT firmware will echo received commands anyway.
@@ -111,19 +136,46 @@ struct ipd_store {
 };
 
 static struct ipd_store *ipd_head;
-static struct ipd_store *ipd_write;
+
+/* Transmit queue of a link. The data is coalesced by at_send and sent by
+ * at_send_progress, called by any of the tasks holding at_lock in turn;
+ * task is the one that queued the data. */
+struct send_store {
+    uint8_t *buffer;
+    uint16_t wr_idx;
+    uint16_t rd_idx;
+    int8_t error;
+    TaskHandle_t task;
+};
+
+enum send_state {
+    send_idle,
+    send_prompt,
+    send_result,
+};
+
+static struct send_store send_links[AT_LINK_ID_COUNT];
+static enum send_state send_state = send_idle;
+static int8_t send_link = AT_LINK_ID_MAX;
+static uint16_t send_length;
+static TickType_t send_start;
+static char send_command[AT_MIN_COMMAND];
+
+/* Counters of each link since at_init, other than those of the parser */
+static struct at_link_stats_s link_stats[AT_LINK_ID_COUNT];
+
+/* Serialises the tasks using the module */
+static SemaphoreHandle_t at_mutex;
 
 static ft900_uart_regs_t *uart_at;
 static ft900_uart_regs_t *uart_monitor;
 
-/* Timeout counter */
-static TimerHandle_t at_timer;
+/* Timeouts in ticks */
 //static int at_tx_timeout_cmd = pdMS_TO_TICKS(20000);
 //static int at_rx_timeout_cmd = pdMS_TO_TICKS(20000);
 static int at_tx_timeout_cmd = pdMS_TO_TICKS(30000);
 static int at_rx_timeout_cmd = pdMS_TO_TICKS(30000);
 
-static TimerHandle_t cmd_timer;
 //static int cmd_timeout = pdMS_TO_TICKS(10000);
 //static int cmd_timeout_inet = pdMS_TO_TICKS(20000);
 //static int cmd_timeout_ipd = pdMS_TO_TICKS(500);
@@ -134,6 +186,7 @@ static int cmd_timeout = pdMS_TO_TICKS(30000); // 100 is too slow for AWS
 static int cmd_timeout_inet = pdMS_TO_TICKS(30000);
 static int cmd_timeout_ipd = pdMS_TO_TICKS(30000);
 static int cmd_timeout_ap = pdMS_TO_TICKS(30000);
+static int cmd_timeout_passthrough = pdMS_TO_TICKS(10000);
 
 /* AT device will normally echo commands */
 static enum at_echo at_echo = at_echo_off;
@@ -142,19 +195,37 @@ static enum at_cwlap_mask at_cwlapopt_mask = at_cwlap_mask_all;
 static enum at_enable at_cipmux = at_disable;
 static enum at_txmode at_cipmode = at_txmode_normal;
 static enum at_enable at_cipdinfo = at_disable;
+/* Passthrough transmission started by AT+CIPSEND with AT+CIPMODE=1 */
+static int8_t at_cipsend_active = 0;
+/* Tick of the last data written to the UART in passthrough */
+static TickType_t at_cipsend_tx_tick = 0;
+static enum at_recvmode at_ciprecvmode = at_recvmode_active;
+
+/* Baud rates tried by at_uart_negotiate, all within 0.5% on the UART (see
+ * uart_calculate_baud) and on the ESP32 */
+static const uint32_t at_uart_rates[] = {
+    115200, 230400, 460800, 921600, 1562500, 2500000, 3125000
+};
+#define AT_UART_RATES ((int8_t)(sizeof(at_uart_rates) / sizeof(at_uart_rates[0])))
 
-static int8_t at_state_ipd_pending = 0;
-static int8_t at_state_wifi_connected = 0;
-static int8_t at_state_wifi_station_has_ip = 0;
-static enum at_connection at_state_server_connect[AT_LINK_ID_COUNT] = {0};
+/* Settings of the UART, and those of the module after AT+RST */
+static uint32_t at_uart_rate = AT_UART_BAUD;
+static uint8_t at_uart_flow = AT_UART_FLOW_CTS;
+static uint32_t at_uart_rate_def = AT_UART_BAUD;
+static uint8_t at_uart_flow_def = AT_UART_FLOW_CTS;
+static int8_t at_uart_setup = 0;
 
+static int8_t at_txdata(const uint8_t *data, uint16_t length);
 static int8_t at_txcommand(const char *command);
 static int8_t at_rxresponse(char *response, uint16_t *length, int cmdtimeout);
 static int8_t at_txresponse(char *response, uint16_t length);
-
-static void peek_async_message(void);
-static uint16_t check_async_message(char *message, uint16_t length);
-static int8_t async_ipd_receive(void);
+static void at_command_mode(void);
+static int8_t at_cipsend_enter(void);
+static void at_uart_open(uint32_t baud, uint8_t flow);
+static int8_t at_uart_probe(void);
+static int8_t at_uart_check(struct at_cwgmr_s *gmr);
+static int8_t at_uart_check_long(void);
+static int8_t at_uart_step(uint32_t baud, uint8_t flow, struct at_cwgmr_s *gmr);
 
 static char *rsp_next_line(const char *line);
 static uint16_t rsp_get_line_length(const char *line);
@@ -173,166 +244,76 @@ static char *helper_strcpy_param_unescapify(char *dest, const char *src, uint16_
 
 static int8_t helper_query_uart(char *cmd, struct at_cwuart_s *uart);
 
-static int8_t at_txcommand(const char *command)
+/* Writes data to the transmit ring buffer as the ISR empties it.
+ * Times out when no room is made in the ring buffer for at_tx_timeout_cmd.
+ */
+static int8_t at_txdata(const uint8_t *data, uint16_t length)
 {
-    uint16_t espCount;
-    char *espPtr;
-    uint16_t dbgCount;
-    char *dbgPtr;
+    TickType_t start = xTaskGetTickCount();
     uint16_t count;
-    int8_t rsp = AT_ERROR_RESPONSE;
-
-    // Transmit AT command and optionally echo it to the debug line
-    espPtr = (char *)command;
-    espCount = strnlen(command, AT_MAX_COMMAND_LEN);
-
-#ifdef MONITOR_ECHO_TX
-    dbgPtr = espPtr;
-    dbgCount = espCount;
-#else // DEBUG_ECHO
-    (void)dbgPtr;
-    dbgCount = 0;
-#endif // DEBUG_ECHO
 
-    xTimerChangePeriod(at_timer, at_tx_timeout_cmd, 0);
-    DEBUG_PRINTF("\t[AT]: %s", command);
-    do
+    while (length)
     {
-        // Send command to AT
-        if (espCount > 0)
+        count = uartrb_write(uart_at, (uint8_t *)data, length);
+        if (count > 0)
         {
-            count = uartrb_write(uart_at, (uint8_t *)espPtr, espCount);
-            if (count > 0)
-            {
-                espCount -= count;
-                espPtr += count;
-            }
+            length -= count;
+            data += count;
+            start = xTaskGetTickCount();
         }
-
-#ifdef MONITOR_ECHO_TX
-        // Copy command to debug port
-        if (dbgCount > 0)
+        else if ((xTaskGetTickCount() - start) >= (TickType_t)at_tx_timeout_cmd)
         {
-            count = uartrb_write(uart_monitor, (uint8_t *)dbgPtr, dbgCount);
-            if (count > 0)
-            {
-                dbgCount -= count;
-                dbgPtr += count;
-            }
+            configPRINTF(("AT transmit timeout \r\n"));
+            return AT_ERROR_TIMEOUT;
         }
-#endif // DEBUG_ECHO
-
-        if (xTimerIsTimerActive(at_timer) == pdFALSE)
+        else
         {
-            configPRINTF(("AT timer not active \r\n"));
-            rsp = AT_ERROR_TIMEOUT;
-            break;
+            // The ring buffer is full: a tick sends 11 bytes at 115200 baud.
+            vTaskDelay(1);
         }
-
-        xTimerReset(at_timer, 0);
-
-    } while (espCount || dbgCount);
-
-    if (espCount == 0)
-    {
-        rsp = AT_OK;
     }
 
-    xTimerStop(at_timer, 0);
-
-    return rsp;
+    return AT_OK;
 }
 
-static int8_t at_rxresponse(char *response, uint16_t *length, int cmdtimeout)
+static int8_t at_txcommand(const char *command)
 {
-    uint16_t espCount = 0;
-    char *espPtr;
-    uint16_t rspLength = *length;
-    uint16_t count;
-    char *rspparams;
-    int8_t complete = 0;
-    int8_t rsp = AT_ERROR_RESPONSE;
-
-    // Receive response from AT
-    espPtr = response;
-    espCount = 0;
+    uint16_t espCount;
 
-    // Read an parse any async messages which may be pending.
-    peek_async_message();
+    // Transmit AT command and optionally echo it to the debug line
+    espCount = strlen(command);
 
-    // Read in echoed command and ignore.
-    if (at_echo == at_echo_on)
-    {
-        xTimerChangePeriod(at_timer, at_rx_timeout_cmd, 0);
+#ifdef MONITOR_ECHO_TX
+    uartrb_write(uart_monitor, (uint8_t *)command, espCount);
+#endif // DEBUG_ECHO
 
-        count = uartrb_readln(uart_at, (uint8_t *)espPtr, rspLength);
+    DEBUG_PRINTF("\t[AT]: %s", command);
 
-        if (xTimerIsTimerActive(at_timer) == pdFALSE)
-        {
-            rsp = AT_ERROR_TIMEOUT;
-        }
+    return at_txdata((const uint8_t *)command, espCount);
+}
 
-        xTimerStop(at_timer, 0);
+/* Waits for the final response of the command started with at_parser_begin.
+ * The parser has collected the other lines in the response buffer.
+ */
+static int8_t at_rxresponse(char *response, uint16_t *length, int cmdtimeout)
+{
+    uint16_t events;
+    int8_t rsp = AT_ERROR_TIMEOUT;
 
-        at_txresponse(espPtr, count);
-    }
+    events = at_parser_wait(AT_EVENT_OK | AT_EVENT_ERROR, cmdtimeout);
+    *length = at_parser_end();
 
-    if (rsp == AT_ERROR_TIMEOUT)
+    if (events & AT_EVENT_OK)
     {
-        return rsp;
+        rsp = AT_OK;
     }
-
-    xTimerChangePeriod(cmd_timer, cmdtimeout, 0);
-    //xTimerChangePeriod(at_timer, at_rx_timeout_cmd, 0);
-
-    do
+    else if (events & AT_EVENT_ERROR)
     {
-        count = uartrb_readln(uart_at, (uint8_t *)espPtr, rspLength - espCount);
-        if (count > 0)
-        {
-            rspparams = rsp_check_response(espPtr, "AT!");
-            if (rspparams)
-            {
-                rsp = strtol(rspparams, &rspparams, 16);
-            }
-            if (strncmp(espPtr, OK, count) == 0)
-            {
-                complete = 1;
-                rsp = AT_OK;
-            }
-            else if (strncmp(espPtr, ERROR, count) == 0)
-            {
-                complete = -1;
-            }
-
-            if (complete == 0)
-            {
-                espPtr += count;
-                espCount += (count + AT_STRING_LENGTH(CRLF));
-                *espPtr++ = '\r';
-                *espPtr++ = '\n';
-            }
-
-            xTimerReset(at_timer, 0);
-        }
-
-        //if (xTimerIsTimerActive(at_timer) == pdFALSE)
-        //{
-            //rsp = AT_ERROR_TIMEOUT;
-            //break;
-        //}
-
-        if (xTimerIsTimerActive(cmd_timer) == pdFALSE)
-        {
-            rsp = AT_ERROR_TIMEOUT;
-            break;
-        }
-    } while (!complete);
-
-    //xTimerStop(at_timer, 0);
-    xTimerStop(cmd_timer, 0);
+        // Any ERR CODE line is left in the response.
+        DEBUG_PRINTF("Error: %s \r\n", response);
+        rsp = AT_ERROR_RESPONSE;
+    }
 
-    *length = espCount;
     return rsp;
 }
 
@@ -341,64 +322,32 @@ static int8_t at_txresponse(char *response, uint16_t length)
     int8_t rsp = AT_OK;
 
 #if MONITOR_ECHO_RX
-    uint16_t dbgCount;
-    char *dbgPtr;
-    uint16_t count;
-
     // Copy response to debug port
-    dbgPtr = response;
-    dbgCount = length;
-
-    xTimerChangePeriod(at_timer, at_tx_timeout_cmd, 0);
-
-    do
-    {
-        if (dbgCount > 0)
-        {
-            count = uartrb_write(uart_monitor, (uint8_t *)dbgPtr, dbgCount);
-            if (count > 0)
-            {
-                dbgCount -= count;
-                dbgPtr += count;
-            }
-        }
-
-        if (xTimerIsTimerActive(at_timer) == pdFALSE)
-        {
-            rsp = AT_ERROR_TIMEOUT;
-        }
-    } while (dbgCount);
-
+    uartrb_write(uart_monitor, (uint8_t *)response, length);
     uartrb_putc(uart_monitor, '\r');
     uartrb_putc(uart_monitor, '\n');
-
-    xTimerStop(at_timer, 0);
-
 #endif // MONITOR_ECHO_RX
     return rsp;
 }
 
-static void at_timer_callback(TimerHandle_t xTimerHandle)
-{
-//    tfp_printf("%s \r\n", __FUNCTION__);
-    // Signal a timeout to the ring buffer so any blocking call
-    // to the AT is returned.
-    uartrb_timeout(uart_at);
-}
-
-static void cmd_timer_callback(TimerHandle_t xTimerHandle)
-{
-//    tfp_printf("%s \r\n", __FUNCTION__);
-    // No action
-}
-
 int8_t at_init(ft900_uart_regs_t *at, ft900_uart_regs_t *monitor)
 {
     enum at_cipstatus status = at_cipstatus_not_connected;
     int8_t count;
     struct at_cipstatus_s cipstatus[AT_LINK_ID_COUNT];
+    struct at_cwuart_s uart;
+    uint8_t flow;
     int8_t err;
 
+    if (at_mutex == NULL)
+    {
+        at_mutex = xSemaphoreCreateMutex();
+        if (at_mutex == NULL)
+        {
+            return AT_ERROR_RESOURCE;
+        }
+    }
+
     uart_at = at;
     uart_monitor = monitor;
 #ifdef UART_MONITOR
@@ -415,45 +364,51 @@ int8_t at_init(ft900_uart_regs_t *at, ft900_uart_regs_t *monitor)
 #endif
 
 
-    //uart_mode(uart_at, uart_mode_16550);
-    uart_mode(uart_at, 1); //uart_mode_16550 = 1
-
-    // Open UART 1 using the coding required.
-    uart_open(uart_at,                    /* Device */
-            1,                        /* Prescaler = 1 */
-            UART_DIVIDER_115200_BAUD,  /* Divider = 1302 */
-            8,         /* No. buffer Bits */
-            0,         /* Parity */
-            0);        /* No. Stop Bits */
-
-
-    // UART 0 is already set-up. This enabled interrupts and the ring buffers.
-    uartrb_setup(uart_at, uartrb_flow_none);
+    // Open UART 1 at the rate of the module after power-up. RTS is
+    // de-asserted when the receive ring buffer fills up, which it does
+    // while the parser holds +IPD data for a link buffer that is full.
+    at_uart_open(AT_UART_BAUD, AT_UART_FLOW_CTS);
 
-    at_timer = xTimerCreate("AT_COMMS", at_tx_timeout_cmd, pdFALSE, 0, at_timer_callback);
-    if (at_timer == NULL)
+    // The parser task is woken up by the receive interrupt from now on.
+    err = at_parser_init(uart_at);
+    if (err != AT_OK)
     {
-        return AT_ERROR_TIMER;
+        return err;
     }
 
-    cmd_timer = xTimerCreate("AT_CMD", cmd_timeout_inet, pdFALSE, 0, cmd_timer_callback);
-    if (cmd_timer == NULL)
+    // The module may be at the rate saved by at_uart_negotiate instead.
+    err = at_uart_probe();
+    if (err != AT_OK)
     {
-        return AT_ERROR_TIMER;
+        return err;
     }
-
-    uartrb_flush_read(uart_at);
-
-    if (at_query_cwjap(NULL) == AT_OK)
+    if (at_query_uart_def(&uart) == AT_OK)
     {
-        at_state_wifi_connected = 1;
+        at_uart_rate_def = uart.baud;
+        at_uart_flow_def = uart.flow;
     }
 
-    if (at_query_cipsta(NULL, NULL, NULL) == AT_OK)
+    // The probe leaves automatic flow control off, while the module may hold
+    // off the data with RTS since at_uart_negotiate saved it: it runs with
+    // the flow of AT+UART_DEF since its reset, or of AT+UART_CUR since.
+    flow = at_uart_flow_def;
+    if (at_query_uart_cur(&uart) == AT_OK)
     {
-        at_state_wifi_station_has_ip = 1;
+        flow = uart.flow;
+    }
+    if ((flow ^ at_uart_flow) & AT_UART_FLOW_RTS)
+    {
+        at_uart_open(at_uart_rate, flow);
+        if (at_at() != AT_OK)
+        {
+            DEBUG_PRINTF("UART flow %d failed \r\n", flow);
+            at_uart_open(at_uart_rate, AT_UART_FLOW_CTS);
+        }
     }
 
+    at_parser_set_wifi(at_query_cwjap(NULL) == AT_OK,
+            at_query_cipsta(NULL, NULL, NULL) == AT_OK);
+
     at_query_ate(&at_echo);
     at_query_cipmux(&at_cipmux);
     at_query_cipmode(&at_cipmode);
@@ -463,22 +418,313 @@ int8_t at_init(ft900_uart_regs_t *at, ft900_uart_regs_t *monitor)
     err = at_query_cipstatus(&status, &count, cipstatus);
     if ((err == AT_OK) && (count > 0))
     {
-        uint8_t link_id;
-
         // Set connection active for each link_id received.
-        while (--count > 0)
+        while (count-- > 0)
         {
-            link_id = cipstatus[count].link_id;
-            at_state_server_connect[link_id] = at_connected;
+            at_parser_set_link(cipstatus[count].link_id, at_connected);
         }
     }
 
     ipd_head = NULL;
-    ipd_write = NULL;
 
     return AT_OK;
 }
 
+/* Opens the UART at baud with its FIFOs enabled, automatic RTS/CTS if the
+ * module drives RTS (flow of AT+UART_CUR), RTS driven by the receive ring
+ * buffer otherwise.
+ */
+static void at_uart_open(uint32_t baud, uint8_t flow)
+{
+    TickType_t start = xTaskGetTickCount();
+    uartrb_flow_t rbflow = uartrb_flow_rts;
+    uart_mode_t mode = uart_mode_16550;
+    uint16_t divisor;
+    uint8_t prescaler;
+
+#if AT_UART_FLOW_AUTO
+    if (flow & AT_UART_FLOW_RTS)
+    {
+        rbflow = uartrb_flow_rts_cts_auto;
+        mode = uart_mode_16950;
+    }
+#endif
+    uart_calculate_baud(baud, AT_UART_SAMPLES, AT_UART_CLOCK, &divisor, &prescaler);
+
+    if (at_uart_setup)
+    {
+        // The last bytes leave at the previous rate, unless CTS holds them.
+        while (uartrb_waiting(uart_at) && ((xTaskGetTickCount() - start) < pdMS_TO_TICKS(AT_UART_CHECK_MS)))
+        {
+            vTaskDelay(1);
+        }
+        vTaskDelay(pdMS_TO_TICKS(AT_UART_SETTLE_MS));
+        uart_disable_interrupts_globally(uart_at);
+        uartrb_flush_write(uart_at);
+    }
+
+    // uart_mode resets the line settings and uart_open turns the FIFOs off.
+    uart_mode(uart_at, mode);
+    uart_open(uart_at, prescaler, divisor, uart_data_bits_8, uart_parity_none, uart_stop_bits_1);
+    uart_at->ISR_FCR_EFR = AT_UART_FCR_FIFO_RESET;
+
+    if (at_uart_setup)
+    {
+        uartrb_flow(uart_at, rbflow);
+        uart_enable_interrupts_globally(uart_at);
+        vTaskDelay(pdMS_TO_TICKS(AT_UART_SETTLE_MS));
+    }
+    else
+    {
+        // This enables interrupts and the ring buffers.
+        uartrb_setup(uart_at, rbflow);
+        at_uart_setup = 1;
+    }
+
+    // What was received meanwhile is noise.
+    uartrb_flush_read(uart_at);
+    at_parser_resync();
+
+    at_uart_rate = baud;
+    at_uart_flow = flow;
+}
+
+/* Finds the rate of the module, trying AT_UART_BAUD then the rates of
+ * at_uart_rates from the highest, until cmd_timeout. At a wrong rate the
+ * module receives noise, which the first "AT" may only terminate.
+ */
+static int8_t at_uart_probe(void)
+{
+    TickType_t start = xTaskGetTickCount();
+    uint32_t baud;
+    int8_t index;
+    int8_t tries;
+
+    do
+    {
+        for (index = -1; index < AT_UART_RATES; index++)
+        {
+            baud = (index < 0) ? AT_UART_BAUD : at_uart_rates[AT_UART_RATES - 1 - index];
+            if ((index >= 0) && (baud == AT_UART_BAUD))
+            {
+                continue;
+            }
+            at_uart_open(baud, AT_UART_FLOW_CTS);
+            for (tries = 0; tries < 2; tries++)
+            {
+                if (cmd_execute_with_timeout("AT" CRLF, pdMS_TO_TICKS(AT_UART_PROBE_MS)) == AT_OK)
+                {
+                    return AT_OK;
+                }
+            }
+        }
+    } while ((xTaskGetTickCount() - start) < (TickType_t)cmd_timeout);
+
+    return AT_ERROR_TIMEOUT;
+}
+
+/* Reads AT+GMR AT_UART_CHECKS times into gmr[1]: the version strings, and the
+ * echo of the command if any, must be those of gmr[0]. Then checks a long
+ * command on the way to the module, where the responses are short.
+ */
+static int8_t at_uart_check(struct at_cwgmr_s *gmr)
+{
+    int8_t count;
+    int8_t rsp;
+
+    for (count = 0; count < AT_UART_CHECKS; count++)
+    {
+        memset(&gmr[1], 0, sizeof(gmr[1]));
+        rsp = at_gmr(&gmr[1]);
+        if (rsp != AT_OK)
+        {
+            return rsp;
+        }
+        if (memcmp(&gmr[0], &gmr[1], sizeof(gmr[0])) != 0)
+        {
+            return AT_ERROR_RESPONSE;
+        }
+    }
+    return at_uart_check_long();
+}
+
+/* Sends an unknown command of AT_UART_CHECK_LONG characters with the echo
+ * on: the module answers ERROR after echoing what it received, which must
+ * be the command. The echo is then set back.
+ */
+static int8_t at_uart_check_long(void)
+{
+    enum at_echo echo = at_echo;
+    uint16_t cmd_length = AT_STRING_LENGTH("AT+") + AT_UART_CHECK_LONG + AT_STRING_LENGTH(CRLF);
+    uint16_t length = cmd_length + AT_MIN_RESPONSE;
+    char *cmd;
+    char *rsp;
+    uint16_t i;
+    int8_t err;
+
+    cmd = pvPortMalloc(cmd_length + 1 + length);
+    if (!cmd) return AT_ERROR_RESOURCE;
+    rsp = cmd + cmd_length + 1;
+
+    strcpy(cmd, "AT+");
+    for (i = 0; i < AT_UART_CHECK_LONG; i++)
+    {
+        cmd[AT_STRING_LENGTH("AT+") + i] = 'A' + (i % 26);
+    }
+    strcpy(cmd + AT_STRING_LENGTH("AT+") + AT_UART_CHECK_LONG, CRLF);
+
+    err = (echo == at_echo_on) ? AT_OK : at_ate(1);
+    if (err == AT_OK)
+    {
+        // Keep the echo in the response, like at_query_ate.
+        at_command_mode();
+        at_parser_begin(rsp, length, NULL);
+        err = at_txcommand(cmd);
+        if (err == AT_OK)
+        {
+            err = at_rxresponse(rsp, &length, cmd_timeout);
+        }
+        else
+        {
+            at_parser_end();
+        }
+
+        if (err == AT_ERROR_RESPONSE)
+        {
+            err = (strncmp(rsp, cmd, cmd_length) == 0) ? AT_OK : AT_ERROR_RESPONSE;
+        }
+        else if (err == AT_OK)
+        {
+            // The command was taken for another
+            err = AT_ERROR_RESPONSE;
+        }
+
+        if ((echo != at_echo_on) && (at_ate(0) != AT_OK))
+        {
+            err = AT_ERROR_RESPONSE;
+        }
+    }
+
+    vPortFree(cmd);
+    return err;
+}
+
+/* Moves the module then the UART to baud and flow. If the check fails they
+ * go back to the previous settings, the module being asked at both rates
+ * since its response to AT+UART_CUR may be what was lost.
+ */
+static int8_t at_uart_step(uint32_t baud, uint8_t flow, struct at_cwgmr_s *gmr)
+{
+    struct at_cwuart_s uart = {baud, 8, 1, 0, flow};
+    uint32_t prev_baud = at_uart_rate;
+    uint8_t prev_flow = at_uart_flow;
+    int8_t tries;
+    int8_t rsp;
+
+    // The module answers at the current rate then takes the new one.
+    rsp = at_set_uart_cur(&uart);
+    if (rsp != AT_OK)
+    {
+        return rsp;
+    }
+    at_uart_open(baud, flow);
+    rsp = at_uart_check(gmr);
+    if (rsp == AT_OK)
+    {
+        return AT_OK;
+    }
+    DEBUG_PRINTF("UART %ld flow %d failed \r\n", baud, flow);
+
+    uart.baud = prev_baud;
+    uart.flow = prev_flow;
+    for (tries = 0; tries < AT_UART_RETRIES; tries++)
+    {
+        // Without automatic flow control, which may be what failed. The
+        // first command ends the noise the module received meanwhile.
+        at_uart_open(baud, AT_UART_FLOW_CTS);
+        cmd_execute_with_timeout("AT" CRLF, pdMS_TO_TICKS(AT_UART_PROBE_MS));
+        at_set_uart_cur(&uart);
+        at_uart_open(prev_baud, prev_flow);
+        if (at_uart_check(gmr) == AT_OK)
+        {
+            return rsp;
+        }
+    }
+
+    at_uart_probe();
+    return rsp;
+}
+
+int8_t at_uart_negotiate(uint32_t max_baud, int8_t persist)
+{
+    struct at_cwgmr_s *gmr;
+    struct at_cwuart_s uart;
+    int timeout = cmd_timeout;
+    int8_t index;
+    int8_t rsp;
+
+    gmr = pvPortMalloc(2 * sizeof(struct at_cwgmr_s));
+    if (!gmr) return AT_ERROR_RESOURCE;
+
+    // A failed rate times out quickly.
+    cmd_timeout = pdMS_TO_TICKS(AT_UART_CHECK_MS);
+
+    // The reference, at the current rate.
+    memset(&gmr[0], 0, sizeof(gmr[0]));
+    rsp = at_gmr(&gmr[0]);
+    if (rsp == AT_OK)
+    {
+#if AT_UART_FLOW_AUTO
+        // Fails when the RTS of the module is not wired, keeping the
+        // receive ring buffer driving RTS.
+        at_uart_step(at_uart_rate, AT_UART_FLOW_RTS | AT_UART_FLOW_CTS, gmr);
+#endif
+        for (index = 0; index < AT_UART_RATES; index++)
+        {
+            if (at_uart_rates[index] <= at_uart_rate)
+            {
+                continue;
+            }
+            if ((at_uart_rates[index] > max_baud) ||
+                    (at_uart_step(at_uart_rates[index], at_uart_flow, gmr) != AT_OK))
+            {
+                break;
+            }
+        }
+    }
+
+    // Saved in the flash of the module only when it changes.
+    if ((rsp == AT_OK) && persist)
+    {
+        rsp = at_query_uart_def(&uart);
+        if ((rsp == AT_OK) && ((uart.flow != at_uart_flow) ||
+                (uart.baud < at_uart_rate - (at_uart_rate / 50)) ||
+                (uart.baud > at_uart_rate + (at_uart_rate / 50))))
+        {
+            uart.baud = at_uart_rate;
+            uart.databits = 8;
+            uart.stopbits = 1;
+            uart.parity = 0;
+            uart.flow = at_uart_flow;
+            rsp = at_set_uart_def(&uart);
+        }
+        if (rsp == AT_OK)
+        {
+            at_uart_rate_def = at_uart_rate;
+            at_uart_flow_def = at_uart_flow;
+        }
+    }
+
+    cmd_timeout = timeout;
+    vPortFree(gmr);
+    return rsp;
+}
+
+uint32_t at_uart_baud(void)
+{
+    return at_uart_rate;
+}
+
 int8_t at_timeout_tx_comms(int timeout)
 {
     at_tx_timeout_cmd = timeout;
@@ -522,11 +768,30 @@ int8_t at_timeout_ap(int timeout)
     return AT_OK;
 }
 
+int8_t at_timeout_passthrough(int timeout)
+{
+    cmd_timeout_passthrough = timeout;
+    return AT_OK;
+}
+
+/* Sends the data queued by at_send and leaves passthrough, so that a command
+ * can be sent.
+ */
+static void at_command_mode(void)
+{
+    at_send_flush();
+    at_cipsend_finish();
+}
+
 int8_t at_command(const char *command, uint16_t *length, char *response, int cmdtimeout)
 {
     int8_t complete;
 
-    peek_async_message();
+    // Commands go after the data queued by at_send.
+    at_command_mode();
+
+    // Collect the response from now on, leaving out the echo of the command.
+    at_parser_begin(response, *length, command);
 
     // Transmit command to AT.
     complete = at_txcommand(command);
@@ -537,6 +802,10 @@ int8_t at_command(const char *command, uint16_t *length, char *response, int cmd
         // Receive the response from the AT.
         complete = at_rxresponse(response, length, cmdtimeout);
     }
+    else
+    {
+        at_parser_end();
+    }
     if (complete == 0)
     {
         complete = at_txresponse(response, *length);
@@ -549,7 +818,12 @@ int8_t at_query_ate(enum at_echo *echo)
 {
     int8_t complete;
     char rsp[16];
-    uint16_t count;
+    uint16_t count = sizeof(rsp);
+
+    at_command_mode();
+
+    // Keep the echo, if any, in the response.
+    at_parser_begin(rsp, count, NULL);
 
     // Transmit command to AT.
     complete = at_txcommand(AT CRLF);
@@ -557,37 +831,24 @@ int8_t at_query_ate(enum at_echo *echo)
     // If transmission was successful.
     if (complete == 0)
     {
-        if (xTimerChangePeriod(at_timer, at_rx_timeout_cmd, 0) != pdPASS)
-        {
-            return AT_ERROR_TIMER;
-        }
+        complete = at_rxresponse(rsp, &count, at_rx_timeout_cmd);
+    }
+    else
+    {
+        at_parser_end();
+    }
 
-        count = uartrb_readln(uart_at, (uint8_t *)rsp, 16);
-        if (strncmp(rsp, AT CRLF, count) == 0)
+    if (complete == 0)
+    {
+        if (strncmp(rsp, AT CRLF, AT_STRING_LENGTH(AT CRLF)) == 0)
         {
             at_echo = at_echo_on;
-            *echo = at_echo_on;
         }
         else
         {
             at_echo = at_echo_off;
-            *echo = at_echo_off;
         }
-
-        while (1)
-        {
-            if (xTimerIsTimerActive(at_timer) == pdFALSE)
-            {
-                return AT_ERROR_TIMEOUT;
-            }
-            count = uartrb_readln(uart_at, (uint8_t *)rsp, 16);
-            if (strncmp(rsp, OK CRLF, count) == 0)
-            {
-                break;
-            }
-        }
-
-        xTimerStop(at_timer, 0);
+        *echo = at_echo;
     }
 
     return complete;
@@ -892,100 +1153,6 @@ static  __attribute__((unused)) char *rsp_skip_cmd_echo(const char *line)
     return end;
 }
 
-static void peek_async_message(void)
-{
-    char message[MARKER_MAX_LENGTH] = {0};
-    uint16_t count;
-    int8_t found;
-
-    do
-    {
-        count = uartrb_peek(uart_at, (uint8_t *)message, MARKER_MAX_LENGTH - 1);
-        message[count] = '\0';
-
-        if (count == 0)
-        {
-            break;
-        }
-
-        found = check_async_message(message, count);
-
-        // Remove the async message from ring buffer.
-        if (found)
-        {
-            count = uartrb_read(uart_at, (uint8_t *)message, found);
-            at_txresponse(message, count);
-        }
-
-    } while (found);
-}
-
-static uint16_t check_async_message(char *message, uint16_t length)
-{
-    int8_t link_id;
-    uint16_t found = 0;
-
-    if (length >= AT_STRING_LENGTH(MARKER_IPD))
-    {
-        if (strncmp(message, MARKER_IPD, AT_STRING_LENGTH(MARKER_IPD)) == 0)
-        {
-            //tfp_printf("IPD received \r\n");
-            async_ipd_receive();
-        }
-    }
-    if (length >= AT_STRING_LENGTH(MARKER_WIFI_CONNECTED))
-    {
-        if (strncmp(message, MARKER_WIFI_CONNECTED, AT_STRING_LENGTH(MARKER_WIFI_CONNECTED)) == 0)
-        {
-            at_state_wifi_connected = 1;
-            found = AT_STRING_LENGTH(MARKER_WIFI_CONNECTED);
-        }
-    }
-    if (length >= AT_STRING_LENGTH(MARKER_WIFI_GOT_IP))
-    {
-        if (strncmp(message, MARKER_WIFI_GOT_IP, AT_STRING_LENGTH(MARKER_WIFI_GOT_IP)) == 0)
-        {
-            at_state_wifi_station_has_ip = 1;
-            found = AT_STRING_LENGTH(MARKER_WIFI_GOT_IP);
-        }
-    }
-    if (length >= AT_STRING_LENGTH(MARKER_WIFI_DISCONNECTED))
-    {
-        if (strncmp(message, MARKER_WIFI_DISCONNECTED, AT_STRING_LENGTH(MARKER_WIFI_DISCONNECTED)) == 0)
-        {
-            at_state_wifi_connected = 0;
-            at_state_wifi_station_has_ip = 0;
-            found = AT_STRING_LENGTH(MARKER_WIFI_DISCONNECTED);
-        }
-    }
-    if (length >= AT_STRING_LENGTH(MARKER_SERVER_CONNECT))
-    {
-        if (strncmp(message + 1, MARKER_SERVER_CONNECT, AT_STRING_LENGTH(MARKER_SERVER_CONNECT)) == 0)
-        {
-            link_id = message[0] - '0';
-            if (link_id >= AT_LINK_ID_MIN && link_id <= AT_LINK_ID_MAX)
-            {
-                at_state_server_connect[link_id] = at_connected;
-            }
-            found = AT_STRING_LENGTH(MARKER_SERVER_CONNECT) + 1;
-        }
-    }
-    if (length >= AT_STRING_LENGTH(MARKER_SERVER_CLOSE))
-    {
-        if (strncmp(message + 1, MARKER_SERVER_CLOSE, AT_STRING_LENGTH(MARKER_SERVER_CLOSE)) == 0)
-        {
-            link_id = message[0] - '0';
-            if (link_id >= AT_LINK_ID_MIN && link_id <= AT_LINK_ID_MAX)
-            {
-                at_state_server_connect[link_id] = at_not_connected;
-            }
-            found = AT_STRING_LENGTH(MARKER_SERVER_CLOSE) + 1;
-        }
-    }
-
-    return found;
-}
-
 static char *rsp_check_response(const char *line, const char *expected)
 {
     char *rspcolon;
@@ -1130,9 +1297,7 @@ int8_t at_at(void)
 int8_t at_rst(void)
 {
     int8_t rsp;
-    char rsp_buffer[16];
-    uint16_t count;
-    int8_t complete = 0;
+    int8_t link_id;
 
     rsp = cmd_execute("AT+RST" CRLF);
     if (rsp == AT_OK)
@@ -1143,20 +1308,27 @@ int8_t at_rst(void)
         at_cipmux = at_disable;
         at_cipmode = at_txmode_normal;
         at_cipdinfo = at_disable;
+        at_ciprecvmode = at_recvmode_active;
+        at_cipsend_active = 0;
+        at_parser_passthrough(-1);
 
-        // Wait for "ready"
-        do
+        at_parser_set_wifi(0, 0);
+        for (link_id = AT_LINK_ID_MIN; link_id <= AT_LINK_ID_MAX; link_id++)
         {
-            count = uartrb_readln(uart_at, (uint8_t *)rsp_buffer, sizeof(rsp_buffer));
-            if (count > 0)
-            {
-                if (strncmp(rsp_buffer, READY_CODE, count) == 0)
-                {
-                    complete = 1;
-                    rsp = AT_OK;
-                }
-            }
-        } while (!complete);
+            at_parser_set_link(link_id, at_not_connected);
+        }
+
+        // The module restarts with the settings of AT+UART_DEF.
+        if ((at_uart_rate != at_uart_rate_def) || (at_uart_flow != at_uart_flow_def))
+        {
+            at_uart_open(at_uart_rate_def, at_uart_flow_def);
+        }
+
+        // Wait for "ready", latched by the parser since the command.
+        if (at_parser_wait(AT_EVENT_READY, cmd_timeout) == 0)
+        {
+            rsp = AT_ERROR_TIMEOUT;
+        }
     }
 
     return rsp;
@@ -1246,6 +1418,17 @@ int8_t at_restore(void)
         at_cipmux = at_disable;
         at_cipmode = at_txmode_normal;
         at_cipdinfo = at_disable;
+        at_ciprecvmode = at_recvmode_active;
+        at_cipsend_active = 0;
+        at_parser_passthrough(-1);
+
+        // The module restarts with the factory settings of the UART.
+        at_uart_rate_def = AT_UART_BAUD;
+        at_uart_flow_def = AT_UART_FLOW_CTS;
+        if ((at_uart_rate != at_uart_rate_def) || (at_uart_flow != at_uart_flow_def))
+        {
+            at_uart_open(at_uart_rate_def, at_uart_flow_def);
+        }
     }
     return rsp;
 }
@@ -1477,128 +1660,90 @@ int8_t at_set_cwlapopt(int8_t sort, int8_t mask)
 
 int8_t at_cwlap(struct at_cwlap_s *rsp_cwlap, int8_t *entries)
 {
-    char rspline[((AT_MAX_SSID_ESCAPED) + (AT_MAX_NUMBER * 3) + (AT_MAX_BSSID_ESCAPED))];
+    uint16_t rsp_length;
+    char *rsp_buffer;
+    char *rspline;
     char *rspparams;
     char *rspnext;
-    uint16_t count;
-    int8_t complete = 0;
     int8_t slot = 0;
-    int8_t rsp = AT_ERROR_RESPONSE;
+    int8_t rsp;
 
     if ((rsp_cwlap == 0) || (entries == 0))
         return AT_ERROR_PARAMETERS;
 
-    at_txcommand("AT+CWLAP" CRLF);
-
-    // Read in echoed command and ignore.
-    if (at_echo == at_echo_on)
-    {
-        xTimerChangePeriod(at_timer, at_rx_timeout_cmd, 0);
-
-        count = uartrb_readln(uart_at, (uint8_t *)rspline, AT_STRING_LENGTH(rspline));
-        rspnext = &rspline[count];
-
-        if (xTimerIsTimerActive(at_timer) == pdFALSE)
-        {
-            rsp = AT_ERROR_TIMEOUT;
-        }
-        xTimerStop(at_timer, 0);
-
-        at_txresponse(rspline, count);
-    }
+    // One line for each access point
+    rsp_length = AT_MIN_RESPONSE + (*entries * (AT_MIN_COMMAND + (AT_MAX_SSID_ESCAPED) + (AT_MAX_NUMBER * 3) + (AT_MAX_BSSID_ESCAPED)));
+    rsp_buffer = pvPortMalloc(rsp_length);
+    if (!rsp_buffer) return AT_ERROR_RESOURCE;
 
-    if (rsp == AT_ERROR_TIMEOUT)
+    rsp = at_command("AT+CWLAP" CRLF, &rsp_length, rsp_buffer, cmd_timeout_ap);
+    if (rsp == AT_OK)
     {
-        return rsp;
-    }
-
-    xTimerChangePeriod(cmd_timer, cmd_timeout_ap, 0);
+        rspline = rsp_buffer;
 
-    do
-    {
-        count = uartrb_readln(uart_at, (uint8_t *)rspline, AT_STRING_LENGTH(rspline));
-        if (count > 0)
+        // A line cut short by the end of the buffer is left out.
+        while ((slot < *entries) && (rsp_next_line(rspline)))
         {
-            if (strncmp(rspline, OK, count) == 0)
-            {
-                complete = 1;
-                rsp = AT_OK;
-            }
-            else if (strncmp(rspline, ERROR, count) == 0)
-            {
-                complete = -1;
-            }
-            else if (slot < *entries)
+            rspparams = rsp_check_response(rspline, "AT+CWLAP" CRLF);
+            if (rspparams)
             {
-                rspparams = rsp_check_response(rspline, "AT+CWLAP" CRLF);
-                if (rspparams)
-                {
-                    rspnext = rspparams;
-
-                    if (*rspnext == '(')
-                    {
-                        rspnext++;
-                    }
+                rspnext = rspparams;
 
-                    if ((rspnext) && (at_cwlapopt_mask & at_cwlap_mask_ecn))
-                    {
-                        rsp_cwlap[slot].ecn = strtol(rspnext, NULL, 10);
-                        rspnext = rsp_next_param(rspnext);
-                    }
-                    else
-                    {
-                        rsp_cwlap[slot].ecn = 0;
-                    }
+                if (*rspnext == '(')
+                {
+                    rspnext++;
+                }
 
-                    rsp_cwlap[slot].ssid[0] = 0;
-                    if ((rspnext) && (at_cwlapopt_mask & at_cwlap_mask_ssid))
-                    {
-                        helper_strcpy_param_unescapify(rsp_cwlap[slot].ssid, rspnext, rsp_get_param_length_max(rspnext, AT_STRING_LENGTH(rsp_cwlap[0].ssid)));
-                        rspnext = rsp_next_param(rspnext);
-                    }
+                if ((rspnext) && (at_cwlapopt_mask & at_cwlap_mask_ecn))
+                {
+                    rsp_cwlap[slot].ecn = strtol(rspnext, NULL, 10);
+                    rspnext = rsp_next_param(rspnext);
+                }
+                else
+                {
+                    rsp_cwlap[slot].ecn = 0;
+                }
 
-                    if ((rspnext) && (at_cwlapopt_mask & at_cwlap_mask_strength))
-                    {
-                        rsp_cwlap[slot].strength = strtol(rspnext, &rspnext, 10);
-                        rspnext = rsp_next_param(rspnext);
-                    }
-                    else
-                    {
-                        rsp_cwlap[slot].strength = 0;
-                    }
+                rsp_cwlap[slot].ssid[0] = 0;
+                if ((rspnext) && (at_cwlapopt_mask & at_cwlap_mask_ssid))
+                {
+                    helper_strcpy_param_unescapify(rsp_cwlap[slot].ssid, rspnext, rsp_get_param_length_max(rspnext, AT_STRING_LENGTH(rsp_cwlap[0].ssid)));
+                    rspnext = rsp_next_param(rspnext);
+                }
 
-                    rsp_cwlap[slot].bssid[0] = 0;
-                    if ((rspnext) && (at_cwlapopt_mask & at_cwlap_mask_bssid))
-                    {
-                        helper_strcpy_param_unescapify(rsp_cwlap[slot].bssid, rspnext, rsp_get_param_length_max(rspnext, AT_STRING_LENGTH(rsp_cwlap[0].bssid)));
-                        rspnext = rsp_next_param(rspnext);
-                    }
+                if ((rspnext) && (at_cwlapopt_mask & at_cwlap_mask_strength))
+                {
+                    rsp_cwlap[slot].strength = strtol(rspnext, &rspnext, 10);
+                    rspnext = rsp_next_param(rspnext);
+                }
+                else
+                {
+                    rsp_cwlap[slot].strength = 0;
+                }
 
-                    if ((rspnext) && (at_cwlapopt_mask & at_cwlap_mask_channel))
-                    {
-                        rsp_cwlap[slot].channel = strtol(rspnext, &rspnext, 10);
-                    }
-                    else
-                    {
-                        rsp_cwlap[slot].channel = 0;
-                    }
+                rsp_cwlap[slot].bssid[0] = 0;
+                if ((rspnext) && (at_cwlapopt_mask & at_cwlap_mask_bssid))
+                {
+                    helper_strcpy_param_unescapify(rsp_cwlap[slot].bssid, rspnext, rsp_get_param_length_max(rspnext, AT_STRING_LENGTH(rsp_cwlap[0].bssid)));
+                    rspnext = rsp_next_param(rspnext);
+                }
 
-                    slot++;
+                if ((rspnext) && (at_cwlapopt_mask & at_cwlap_mask_channel))
+                {
+                    rsp_cwlap[slot].channel = strtol(rspnext, &rspnext, 10);
+                }
+                else
+                {
+                    rsp_cwlap[slot].channel = 0;
                 }
-            }
 
-            if (xTimerIsTimerActive(cmd_timer) == pdFALSE)
-            {
-                rsp = AT_ERROR_TIMEOUT;
-                break;
+                slot++;
             }
-
-            xTimerReset(cmd_timer, 0);
+            rspline = rsp_next_line(rspline);
         }
+    }
 
-    } while (!complete);
-
-    xTimerStop(cmd_timer, 0);
+    vPortFree(rsp_buffer);
 
     *entries = slot;
 
@@ -2120,119 +2265,584 @@ int8_t at_set_cipstart_tls_helper(int8_t link_id, char *type, char *remote_ip, u
 }
 int8_t at_set_cipstart_tls(int8_t link_id, char *remote_ip, uint16_t remote_port, uint16_t tcp_keep_alive)
 {
-    return at_set_cipstart_tls_helper(link_id, "TCP", remote_ip, remote_port, tcp_keep_alive);
+    return at_set_cipstart_tls_helper(link_id, "TCP", remote_ip, remote_port, tcp_keep_alive);
+}
+static int8_t at_set_cipsend_all_helper(char *cmd, int8_t link_id, uint16_t length, uint8_t *buffer, char *remote_ip, uint16_t remote_port)
+{
+    int8_t rsp;
+    char params[(AT_MAX_IP * 2) + (AT_MAX_NUMBER * 3) + 8];
+    char *paramend = params;
+    uint16_t events;
+
+    if (at_cipmux == at_enable)
+    {
+        paramend += tfp_sprintf(paramend, "%d,", link_id);
+    }
+    paramend += tfp_sprintf(paramend, "%d", length);
+    if (remote_ip)
+    {
+        *paramend++ = ',';
+        paramend = helper_strcpy_param_escapify(paramend, remote_ip, AT_MAX_IP * 2);
+        paramend += tfp_sprintf(paramend, ",%d", remote_port);
+    }
+
+    rsp = cmd_set_with_timeout(cmd, params, cmd_timeout_inet);
+
+    if (rsp == AT_OK)
+    {
+        rsp = AT_ERROR_SET;
+
+        DEBUG_PRINTF("Wait for > \r\n");
+        // Wait for ">", latched by the parser since the command.
+        events = at_parser_wait(AT_EVENT_PROMPT | AT_EVENT_ERROR, cmd_timeout_inet);
+        if (events & AT_EVENT_PROMPT)
+        {
+            DEBUG_PRINTF("Write data \r\n");
+            rsp = at_txdata(buffer, length);
+        }
+        else if (events == 0)
+        {
+            rsp = AT_ERROR_TIMEOUT;
+        }
+
+        if (rsp == AT_OK)
+        {
+            DEBUG_PRINTF("Wait for SEND OK \r\n");
+            events = at_parser_wait(AT_EVENT_SEND_OK | AT_EVENT_SEND_FAIL | AT_EVENT_ERROR, cmd_timeout_inet);
+            if (events == 0)
+            {
+                rsp = AT_ERROR_TIMEOUT;
+            }
+            else if ((events & AT_EVENT_SEND_OK) == 0)
+            {
+                rsp = AT_ERROR_SET;
+            }
+        }
+        DEBUG_PRINTF("Finished \r\n");
+    }
+
+    return rsp;
+}
+
+static inline int8_t at_set_cipsend_helper(int8_t link_id, uint16_t length, uint8_t *buffer, char *remote_ip, uint16_t remote_port)
+{
+    return at_set_cipsend_all_helper("AT+CIPSEND", link_id, length, buffer, remote_ip, remote_port);
+}
+
+static int8_t at_set_cipsendex_helper(int8_t link_id, uint16_t length, uint8_t *buffer, char *remote_ip, uint16_t remote_port)
+{
+    return at_set_cipsend_all_helper("AT+CIPSENDEX", link_id, length, buffer, remote_ip, remote_port);
+}
+
+int8_t at_set_cipsend(int8_t link_id, uint16_t length, uint8_t *buffer)
+{
+    return at_set_cipsend_helper( link_id, length, buffer, NULL, 0);
+}
+
+int8_t at_set_cipsend_udp(int8_t link_id, uint16_t length, uint8_t *buffer, char *remote_ip, uint16_t remote_port)
+{
+    return at_set_cipsend_helper(link_id, length, buffer, remote_ip, remote_port);
+}
+
+/* AT+CIPSEND without at_command_mode, as at_send_progress uses it. */
+static int8_t at_cipsend_enter(void)
+{
+    int8_t rsp;
+    char rspbuf[AT_MIN_RESPONSE];
+    uint16_t length = sizeof(rspbuf);
+    uint16_t events;
+
+    // The data received after the ">" goes to link 0 as is.
+    at_parser_passthrough(0);
+    at_parser_begin(rspbuf, length, "AT+CIPSEND" CRLF);
+    rsp = at_txcommand("AT+CIPSEND" CRLF);
+    if (rsp == AT_OK)
+    {
+        rsp = at_rxresponse(rspbuf, &length, cmd_timeout_inet);
+    }
+    else
+    {
+        at_parser_end();
+    }
+    if (rsp == AT_OK)
+    {
+        events = at_parser_wait(AT_EVENT_PROMPT | AT_EVENT_ERROR, cmd_timeout_inet);
+        if (events == 0)
+        {
+            rsp = AT_ERROR_TIMEOUT;
+        }
+        else if ((events & AT_EVENT_PROMPT) == 0)
+        {
+            rsp = AT_ERROR_SET;
+        }
+    }
+
+    if (rsp != AT_OK)
+    {
+        at_parser_passthrough(-1);
+        return rsp;
+    }
+
+    at_cipsend_active = 1;
+    at_cipsend_tx_tick = xTaskGetTickCount();
+    return AT_OK;
+}
+
+/* Starts passthrough on the link of AT+CIPSTART, which needs AT+CIPMODE=1
+ * and AT+CIPMUX=0. From then on at_send writes the data without AT+CIPSEND
+ * and at_recv reads the data received without +IPD.
+ */
+int8_t at_cipsend_start(void)
+{
+    if (at_cipsend_active)
+    {
+        return AT_OK;
+    }
+    if ((at_cipmode != at_txmode_passthrough) || (at_cipmux == at_enable))
+    {
+        return AT_ERROR_PARAMETERS;
+    }
+
+    at_send_flush();
+    return at_cipsend_enter();
+}
+
+/* Leaves passthrough for command mode. Commands call it themselves, and
+ * at_send starts passthrough again for its next data.
+ */
+int8_t at_cipsend_finish(void)
+{
+    if (!at_cipsend_active)
+    {
+        return AT_OK;
+    }
+
+    // The transmit FIFO is empty within the guard time once the ring is.
+    while (uartrb_waiting(uart_at))
+    {
+        vTaskDelay(1);
+    }
+    vTaskDelay(pdMS_TO_TICKS(AT_PASSTHROUGH_GUARD_MS));
+    at_txdata((const uint8_t *)"+++", AT_STRING_LENGTH("+++"));
+
+    // The data received until then is still for the link.
+    vTaskDelay(pdMS_TO_TICKS(AT_PASSTHROUGH_EXIT_MS));
+    at_parser_passthrough(-1);
+    at_cipsend_active = 0;
+
+    return AT_OK;
+}
+
+/* The module keeps the link in passthrough without reporting its loss, so
+ * once nothing has been received nor written to the UART for the passthrough
+ * timeout the link is checked with AT+CIPSTATUS, going back to passthrough if
+ * it is connected. A module taking the data keeps its link, and the check
+ * would stop the transmission for the exit time of passthrough.
+ * Returns AT_OK, or AT_NO_DATA when the link is lost, with wait set to the
+ * ticks until the next check. Outside passthrough it returns AT_OK, the links
+ * being reported by at_is_link_id_connected.
+ */
+int8_t at_cipsend_check(int *wait)
+{
+    enum at_cipstatus status;
+    TickType_t idle;
+    TickType_t tx_idle;
+    int8_t rsp;
+
+    *wait = portMAX_DELAY;
+    if (!at_cipsend_active)
+    {
+        return AT_OK;
+    }
+
+    idle = at_parser_idle();
+    tx_idle = xTaskGetTickCount() - at_cipsend_tx_tick;
+    if (tx_idle < idle)
+    {
+        idle = tx_idle;
+    }
+    if (idle < (TickType_t)cmd_timeout_passthrough)
+    {
+        *wait = cmd_timeout_passthrough - idle;
+        return AT_OK;
+    }
+
+    rsp = at_query_cipstatus(&status, NULL, NULL);
+    if ((rsp == AT_OK) && (status != at_cipstatus_transmission))
+    {
+        DEBUG_PRINTF("Passthrough link lost \r\n");
+        at_parser_set_link(0, at_not_connected);
+        return AT_NO_DATA;
+    }
+
+    rsp = at_cipsend_enter();
+    if (rsp == AT_OK)
+    {
+        *wait = cmd_timeout_passthrough;
+    }
+    return rsp;
+}
+int8_t at_set_tlssend(int8_t link_id, uint16_t length, uint8_t *buffer)
+{
+    return at_set_cipsend_all_helper("AT+TLSSEND", link_id, length, buffer, NULL, 0);
+}
+int8_t at_set_cipsendex(int8_t link_id, uint16_t length, uint8_t *buffer)
+{
+    return at_set_cipsendex_helper( link_id, length, buffer, NULL, 0);
+}
+
+int8_t at_set_cipsendex_udp(int8_t link_id, uint16_t length, uint8_t *buffer, char *remote_ip, uint16_t remote_port)
+{
+    return at_set_cipsendex_helper(link_id, length, buffer, remote_ip, remote_port);
+}
+
+/* Queues up to length bytes to send on the link. Returns the number of bytes
+ * queued, 0 when the queue is full, the link is not connected or the send
+ * of previous data failed (see at_send_error).
+ */
+uint16_t at_send(int8_t link_id, uint16_t length, const uint8_t *buffer)
+{
+    struct send_store *link;
+    uint16_t free;
+    uint16_t offset;
+    uint16_t first;
+
+    if ((link_id < AT_LINK_ID_MIN) || (link_id > AT_LINK_ID_MAX))
+    {
+        return 0;
+    }
+    if (at_cipmux != at_enable)
+    {
+        link_id = 0;
+    }
+    link = &send_links[link_id];
+    if ((link->error != AT_OK) || (at_parser_link(link_id) != at_connected))
+    {
+        return 0;
+    }
+    if (link->buffer == NULL)
+    {
+        link->buffer = pvPortMalloc(AT_SEND_LINK_SIZE);
+        if (link->buffer == NULL)
+        {
+            link->error = AT_ERROR_RESOURCE;
+            return 0;
+        }
+    }
+
+    free = AT_SEND_LINK_SIZE - (uint16_t)(link->wr_idx - link->rd_idx);
+    if (length > free)
+    {
+        length = free;
+    }
+
+    offset = link->wr_idx & (AT_SEND_LINK_SIZE - 1);
+    first = AT_SEND_LINK_SIZE - offset;
+    if (first > length)
+    {
+        first = length;
+    }
+    memcpy(link->buffer + offset, buffer, first);
+    memcpy(link->buffer, buffer + first, length - first);
+    link->wr_idx += length;
+    link->task = xTaskGetCurrentTaskHandle();
+
+    return length;
+}
+
+/* Writes the data queued on link 0 straight to the module in passthrough,
+ * as much as the transmit ring buffer takes.
+ */
+static int8_t at_send_passthrough(int *wait)
+{
+    struct send_store *link = &send_links[0];
+    uint16_t offset;
+    uint16_t count;
+    uint16_t written;
+    int8_t rsp;
+
+    if (link->wr_idx == link->rd_idx)
+    {
+        return AT_OK;
+    }
+
+    if (!at_cipsend_active)
+    {
+        rsp = at_cipsend_enter();
+        if (rsp != AT_OK)
+        {
+            link->error = rsp;
+            link->rd_idx = link->wr_idx;
+            return AT_OK;
+        }
+    }
+
+    do
+    {
+        offset = link->rd_idx & (AT_SEND_LINK_SIZE - 1);
+        count = link->wr_idx - link->rd_idx;
+        if (count > AT_SEND_LINK_SIZE - offset)
+        {
+            count = AT_SEND_LINK_SIZE - offset;
+        }
+        written = uartrb_write(uart_at, link->buffer + offset, count);
+        link->rd_idx += written;
+        if (written)
+        {
+            at_cipsend_tx_tick = xTaskGetTickCount();
+        }
+    } while ((written == count) && (link->wr_idx != link->rd_idx));
+
+    if (link->wr_idx == link->rd_idx)
+    {
+        return AT_OK;
+    }
+
+    // A tick empties 11 bytes of the ring buffer at 115200 baud.
+    if (wait)
+    {
+        *wait = 1;
+    }
+    return AT_DATA_WAITING;
+}
+
+/* Fails the AT+CIPSEND in progress, discarding the data queued on its link */
+static void at_send_fail(int8_t rsp)
+{
+    struct send_store *link = &send_links[send_link];
+
+    at_parser_end();
+    DEBUG_PRINTF("Send failed %d \r\n", rsp);
+    link_stats[send_link].tx_errors++;
+    link->error = rsp;
+    link->rd_idx = link->wr_idx;
+    send_state = send_idle;
 }
-static int8_t at_set_cipsend_all_helper(char *cmd, int8_t link_id, uint16_t length, uint8_t *buffer, char *remote_ip, uint16_t remote_port)
+
+/* Progresses the queued data without waiting: an AT+CIPSEND of up to
+ * AT_SEND_MAX bytes at a time, taking the links in turn. The data queued
+ * while one is in progress is coalesced into the next one, which is
+ * started as soon as the parser has seen the SEND OK of the previous one.
+ * Returns AT_OK when all the queued data has been sent or AT_DATA_WAITING
+ * with wait set to the ticks until the timeout of the AT+CIPSEND. The
+ * calling task is notified of the next response by the parser.
+ */
+int8_t at_send_progress(int *wait)
 {
+    struct send_store *link;
+    TickType_t elapsed;
+    uint16_t events;
+    uint16_t offset;
+    uint16_t first;
+    int8_t check;
     int8_t rsp;
-    char params[(AT_MAX_IP * 2) + (AT_MAX_NUMBER * 3) + 8];
-    char *paramend = params;
-    char rsp_buffer[16 + AT_MAX_NUMBER];
-    uint16_t count;
-    int8_t complete = 0;
 
-    if (at_cipmux == at_enable)
+    if ((at_cipmode == at_txmode_passthrough) && (at_cipmux != at_enable))
     {
-        paramend += tfp_sprintf(paramend, "%d,", link_id);
+        return at_send_passthrough(wait);
     }
-    paramend += tfp_sprintf(paramend, "%d", length);
-    if (remote_ip)
+
+    while (1)
     {
-        *paramend++ = ',';
-        paramend = helper_strcpy_param_escapify(paramend, remote_ip, AT_MAX_IP * 2);
-        paramend += tfp_sprintf(paramend, ",%d", remote_port);
-    }
+        if (send_state == send_idle)
+        {
+            for (check = 1; check <= AT_LINK_ID_COUNT; check++)
+            {
+                link = &send_links[(send_link + check) % AT_LINK_ID_COUNT];
+                if (link->wr_idx != link->rd_idx)
+                {
+                    break;
+                }
+            }
+            if (check > AT_LINK_ID_COUNT)
+            {
+                return AT_OK;
+            }
+            send_link = (send_link + check) % AT_LINK_ID_COUNT;
+            send_length = link->wr_idx - link->rd_idx;
+            if (send_length > AT_SEND_MAX)
+            {
+                send_length = AT_SEND_MAX;
+            }
 
-    rsp = cmd_set_with_timeout(cmd, params, cmd_timeout_inet);
+            if (at_cipmux == at_enable)
+            {
+                tfp_sprintf(send_command, "AT+CIPSEND=%d,%d" CRLF, send_link, send_length);
+            }
+            else
+            {
+                tfp_sprintf(send_command, "AT+CIPSEND=%d" CRLF, send_length);
+            }
+            at_parser_begin(NULL, 0, send_command);
+            rsp = at_txcommand(send_command);
+            if (rsp != AT_OK)
+            {
+                at_send_fail(rsp);
+                continue;
+            }
+            send_start = xTaskGetTickCount();
+            send_state = send_prompt;
+        }
 
-    if (rsp == AT_OK)
-    {
-        rsp = AT_ERROR_SET;
+        link = &send_links[send_link];
+        if (send_state == send_prompt)
+        {
+            events = at_parser_poll(AT_EVENT_PROMPT | AT_EVENT_ERROR);
+            if (events & AT_EVENT_PROMPT)
+            {
+                // The data is written from the queue, in at most two segments.
+                offset = link->rd_idx & (AT_SEND_LINK_SIZE - 1);
+                first = AT_SEND_LINK_SIZE - offset;
+                if (first > send_length)
+                {
+                    first = send_length;
+                }
+                rsp = at_txdata(link->buffer + offset, first);
+                if (rsp == AT_OK)
+                {
+                    rsp = at_txdata(link->buffer, send_length - first);
+                }
+                if (rsp != AT_OK)
+                {
+                    at_send_fail(rsp);
+                    continue;
+                }
+                link->rd_idx += send_length;
+                send_start = xTaskGetTickCount();
+                send_state = send_result;
+            }
+            else if (events)
+            {
+                at_send_fail(AT_ERROR_SET);
+                continue;
+            }
+        }
 
-        DEBUG_PRINTF("Wait for > \r\n");
-        // Wait for ">"
-        do
+        if (send_state == send_result)
         {
-            uartrb_getc(uart_at, (uint8_t *)rsp_buffer);
+            events = at_parser_poll(AT_EVENT_SEND_OK | AT_EVENT_SEND_FAIL | AT_EVENT_ERROR);
+            if (events & AT_EVENT_SEND_OK)
+            {
+                at_parser_end();
+                link_stats[send_link].tx_bytes += send_length;
+                link_stats[send_link].tx_sends++;
+                send_state = send_idle;
+                continue;
+            }
+            else if (events)
+            {
+                at_send_fail(AT_ERROR_SET);
+                continue;
+            }
+        }
 
-        } while (*rsp_buffer != '>');
-        DEBUG_PRINTF("Write data \r\n");
-        uartrb_write_wait(uart_at, buffer, length);
-        DEBUG_PRINTF("Wait for SEND OK \r\n");
-        do
+        elapsed = xTaskGetTickCount() - send_start;
+        if (elapsed >= (TickType_t)cmd_timeout_inet)
         {
-            count = uartrb_readln(uart_at, (uint8_t *)rsp_buffer, sizeof(rsp_buffer));
-//            DEBUG_PRINTF("Resp: %s \r\n", rsp_buffer);
-            if (count > 0)
+            at_send_fail(AT_ERROR_TIMEOUT);
+            continue;
+        }
+        if (wait)
+        {
+            *wait = cmd_timeout_inet - elapsed;
+            for (check = AT_LINK_ID_MIN; check <= AT_LINK_ID_MAX; check++)
             {
-                if (strncmp(rsp_buffer, "SEND OK", count) == 0)
+                if ((send_links[check].task != xTaskGetCurrentTaskHandle()) && at_send_in_flight(check))
                 {
-                    complete = 1;
-                    rsp = AT_OK;
+                    if (*wait > pdMS_TO_TICKS(AT_SEND_POLL_MS))
+                    {
+                        *wait = pdMS_TO_TICKS(AT_SEND_POLL_MS);
+                    }
                 }
             }
-        } while (!complete);
-        DEBUG_PRINTF("Finished \r\n");
+        }
+        return AT_DATA_WAITING;
     }
-
-    return rsp;
 }
 
-static inline int8_t at_set_cipsend_helper(int8_t link_id, uint16_t length, uint8_t *buffer, char *remote_ip, uint16_t remote_port)
+/* Waits until all the queued data has been sent */
+int8_t at_send_flush(void)
 {
-    return at_set_cipsend_all_helper("AT+CIPSEND", link_id, length, buffer, remote_ip, remote_port);
-}
+    int wait;
 
-static int8_t at_set_cipsendex_helper(int8_t link_id, uint16_t length, uint8_t *buffer, char *remote_ip, uint16_t remote_port)
-{
-    return at_set_cipsend_all_helper("AT+CIPSENDEX", link_id, length, buffer, remote_ip, remote_port);
-}
+    while (at_send_progress(&wait) == AT_DATA_WAITING)
+    {
+        ulTaskNotifyTake(pdTRUE, wait);
+    }
 
-int8_t at_set_cipsend(int8_t link_id, uint16_t length, uint8_t *buffer)
-{
-    return at_set_cipsend_helper( link_id, length, buffer, NULL, 0);
+    return AT_OK;
 }
 
-int8_t at_set_cipsend_udp(int8_t link_id, uint16_t length, uint8_t *buffer, char *remote_ip, uint16_t remote_port)
+/* Returns and clears the error of the last failed send on the link */
+int8_t at_send_error(int8_t link_id)
 {
-    return at_set_cipsend_helper(link_id, length, buffer, remote_ip, remote_port);
-}
+    int8_t rsp;
 
-int8_t at_cipsend_start(void)
-{
-    return cmd_execute("AT+CIPSEND" CRLF);
-}
+    if ((link_id < AT_LINK_ID_MIN) || (link_id > AT_LINK_ID_MAX))
+    {
+        return AT_ERROR_PARAMETERS;
+    }
+    if (at_cipmux != at_enable)
+    {
+        link_id = 0;
+    }
+    rsp = send_links[link_id].error;
+    send_links[link_id].error = AT_OK;
 
-int8_t at_cipsend_finish(void)
-{
-    return cmd_execute("+++");
-}
-int8_t at_set_tlssend(int8_t link_id, uint16_t length, uint8_t *buffer)
-{
-    return at_set_cipsend_all_helper("AT+TLSSEND", link_id, length, buffer, NULL, 0);
-}
-int8_t at_set_cipsendex(int8_t link_id, uint16_t length, uint8_t *buffer)
-{
-    return at_set_cipsendex_helper( link_id, length, buffer, NULL, 0);
+    return rsp;
 }
 
-int8_t at_set_cipsendex_udp(int8_t link_id, uint16_t length, uint8_t *buffer, char *remote_ip, uint16_t remote_port)
+/* Bytes queued on the link or sent to the module without a SEND OK yet */
+uint16_t at_send_in_flight(int8_t link_id)
 {
-    return at_set_cipsendex_helper(link_id, length, buffer, remote_ip, remote_port);
+    struct send_store *link;
+    uint16_t count;
+
+    if ((link_id < AT_LINK_ID_MIN) || (link_id > AT_LINK_ID_MAX))
+    {
+        return 0;
+    }
+    if (at_cipmux != at_enable)
+    {
+        link_id = 0;
+    }
+    link = &send_links[link_id];
+    count = link->wr_idx - link->rd_idx;
+    if ((send_state == send_result) && (send_link == link_id))
+    {
+        count += send_length;
+    }
+
+    return count;
 }
 
 int8_t at_set_cipclose(int8_t link_id)
 {
     char params[AT_MAX_NUMBER * 2];
+    int8_t rsp;
 
     if (at_cipmux == at_enable)
     {
         tfp_sprintf(params, "%d", link_id);
 
-        return cmd_set("AT+CIPCLOSE", params);
+        rsp = cmd_set("AT+CIPCLOSE", params);
+    }
+    else
+    {
+        link_id = 0;
+        rsp = cmd_execute("AT+CIPCLOSE" CRLF);
+    }
+
+    // Data left unread on the link, all received before the response,
+    // would otherwise hold off the parser
+    if ((link_id >= AT_LINK_ID_MIN) && (link_id <= AT_LINK_ID_MAX))
+    {
+        at_parser_flush(link_id);
+        send_links[link_id].rd_idx = send_links[link_id].wr_idx;
+        send_links[link_id].error = AT_OK;
     }
 
-    return cmd_execute("AT+CIPCLOSE" CRLF);
+    return rsp;
 }
 
 int8_t at_set_tlsclose(int8_t link_id)
@@ -2469,7 +3079,6 @@ int8_t at_register_ipd(uint16_t length, uint8_t *buffer)
     if (ipd_head == NULL)
     {
         ipd_head = new_ipd;
-        ipd_write = ipd_head;
     }
     else
     {
@@ -2523,243 +3132,189 @@ int8_t at_delete_ipd(uint8_t *buffer)
     return AT_OK;
 }
 
-static int8_t async_ipd_receive(void)
+/* Waits for the length registered with at_register_ipd to be received,
+ * on any link when AT+CIPMUX=1, and copies it to the registered buffer.
+ * remote_ip takes AT_MAX_IP characters, with the terminator.
+ */
+inline int8_t at_ipd_info(int8_t *link_id, char *remote_ip, uint16_t *remote_port, uint16_t *length, uint8_t **buffer)
 {
-    char rspparams[16 + (AT_MAX_NUMBER * 3) + AT_MAX_IP];
-    char *rspnext;
-    char *rspcolon;
-    uint16_t packetlen = 0;
-    uint16_t infolen;
-    int8_t rsp = AT_NO_DATA;
-    char val;
-
-    at_state_ipd_pending = 0;
+    struct ipd_store *ipd_next;
+    int8_t ipd_link_id = 0;
+    int8_t rsp;
 
-    if (ipd_write == NULL)
+    if (length == 0)
+        return AT_ERROR_PARAMETERS;
+    if (at_cipmux == at_enable)
     {
-        ipd_write = ipd_head;
-
-        while (ipd_write)
-        {
-            // Look for a free slot
-            if (ipd_write->valid == at_ipd_status_waiting)
-            {
-                break;
-            }
-            ipd_write = ipd_write->next;
-        }
+        if (link_id == 0)
+            return AT_ERROR_PARAMETERS;
+        ipd_link_id = -1;
     }
+    if (ipd_head == NULL)
+        return AT_NO_DATA;
 
-    if ((ipd_head == NULL) || (ipd_write == NULL))
+    // AT_NO_DATA when the link is closed first.
+    rsp = at_parser_wait_recv(&ipd_link_id, ipd_head->length, at_rx_timeout_cmd);
+    if (rsp != AT_OK)
     {
-        uartrb_flush_read(uart_at);
-        return AT_NO_DATA;
+        return rsp;
     }
 
-    // +IPD found. Process it.
-    rsp = AT_ERROR_RESPONSE;
+    ipd_head->length = at_parser_recv(ipd_link_id, ipd_head->buffer, ipd_head->length);
+    ipd_head->link_id = ipd_link_id;
+    at_parser_remote(ipd_link_id, ipd_head->remote_ip, &ipd_head->remote_port);
+    ipd_head->valid = at_ipd_status_data;
 
-    xTimerChangePeriod(at_timer, at_rx_timeout_cmd, 0);
+    if (length) *length = ipd_head->length;
+    if (buffer) *buffer = ipd_head->buffer;
+    if (remote_port) *remote_port = ipd_head->remote_port;
+    if (remote_ip) strlcpy(remote_ip, ipd_head->remote_ip, AT_MAX_IP);
+    if (link_id) *link_id = ipd_head->link_id;
 
-    // Store info string up to the colon ":" which precedes the data.
-    rspnext = rspparams;
-    infolen = sizeof(rspparams);
-    do
-    {
-        while (uartrb_getc(uart_at, (uint8_t *)&val) == 0);
-        *rspnext++ = val;
-        if (infolen-- == 0)
-        {
-            rspnext = 0;
-            break;
-        }
+    ipd_next = ipd_head->next;
+    vPortFree(ipd_head);
+    ipd_head = ipd_next;
 
-        if (xTimerIsTimerActive(at_timer) == pdFALSE)
-        {
-            tfp_printf("[%s:%d] Time out", __FUNCTION__, __LINE__);
-            rsp = AT_ERROR_TIMEOUT;
-            break;
-        }
-    } while (val != ':');
+    return AT_DATA_WAITING;
+}
 
-    xTimerStop(at_timer, 0);
+int8_t at_ipd(int8_t *link_id, uint16_t *length, uint8_t **buffer)
+{
+    return at_ipd_info(link_id, NULL, NULL, length, buffer);
+}
 
-    if (rsp == AT_ERROR_TIMEOUT)
+static uint16_t at_recv_timeout(int8_t link_id, uint16_t length, uint8_t *buffer, int timeout)
+{
+    if ((link_id < AT_LINK_ID_MIN) || (link_id > AT_LINK_ID_MAX))
     {
-        return rsp;
+        return 0;
     }
 
-    // Null terminate the info string and point parsing point to start.
-    if (rspnext)
+    at_parser_wait_recv(&link_id, 1, timeout);
+
+    // In passive mode the data is read from the module once the buffer of
+    // the link is empty, as much as the buffer takes.
+    if ((at_parser_available(link_id) == 0) && (at_parser_pending(link_id)))
     {
-        *rspnext = '\0';
-        rspnext = rspparams;
+        at_ciprecvdata(link_id, AT_PARSER_LINK_SIZE);
     }
 
-    at_txresponse(rspparams, strlen(rspparams));
+    return at_parser_recv(link_id, buffer, length);
+}
 
-    vTaskDelay (pdMS_TO_TICKS(50));
+/* Reads up to length bytes received on the link, waiting up to the
+ * receive timeout for the first one. Returns 0 if none was received.
+ */
+uint16_t at_recv(int8_t link_id, uint16_t length, uint8_t *buffer)
+{
+    return at_recv_timeout(link_id, length, buffer, at_rx_timeout_cmd);
+}
 
-    xTimerChangePeriod(at_timer, at_rx_timeout_cmd * 1000, 0);
+/* Like at_recv, but returns 0 at once if nothing was received, whatever
+ * the receive timeout of the other commands.
+ */
+uint16_t at_recv_nowait(int8_t link_id, uint16_t length, uint8_t *buffer)
+{
+    return at_recv_timeout(link_id, length, buffer, 0);
+}
 
-    rspnext = rspparams + AT_STRING_LENGTH(MARKER_IPD);
+int8_t at_ciprecvdata(int8_t link_id, uint16_t length)
+{
+    char params[AT_MAX_NUMBER * 2];
+    int8_t rsp;
 
-    if (rspnext)
+    if ((link_id < AT_LINK_ID_MIN) || (link_id > AT_LINK_ID_MAX))
     {
-        if (at_cipmux == at_enable)
-        {
-            ipd_write->link_id = strtol(rspnext, &rspnext, 10);
-            rspnext = rsp_next_param(rspnext);
-        }
-    }
-    if (rspnext)
-    {
-        packetlen = strtol(rspnext, &rspnext, 10);
-        rspnext = rsp_next_param(rspnext);
-        rsp = AT_OK;
+        return AT_ERROR_PARAMETERS;
     }
-    if (rspnext)
+    if (at_cipmux != at_enable)
     {
-        if (at_cipdinfo == at_enable)
-        {
-            helper_strcpy_param_unescapify(ipd_write->remote_ip, rspnext, rsp_get_param_length_max(rspnext, AT_MAX_IP));
-            rspnext = rsp_next_param(rspnext);
-        }
+        link_id = 0;
     }
-    if (rspnext)
+
+    length = at_parser_recvdata(link_id, length);
+    if (length == 0)
     {
-        if (at_cipdinfo == at_enable)
-        {
-            ipd_write->remote_port = strtol(rspnext, &rspnext, 10);
-            rspnext = rsp_next_param(rspnext);
-        }
+        return AT_NO_DATA;
     }
 
-    if (rsp == AT_OK)
+    if (at_cipmux == at_enable)
     {
-        rspcolon = strchr(rspparams, ':');
-        if (rspcolon)
-        {
-        	//tfp_printf("ipd_write->length=%d\r\n", ipd_write->length);
-            if (packetlen > ipd_write->length)
-            {
-                packetlen = ipd_write->length;
-            }
-
-            vTaskDelay (pdMS_TO_TICKS(50));
-            // Read in packet data from the device.
-            ipd_write->length = uartrb_read_wait(uart_at, ipd_write->buffer, packetlen);
-            vTaskDelay (pdMS_TO_TICKS(50));
-            //tfp_printf("ipd_write->length=%d\r\n", *((uint32_t*)ipd_write->buffer));
-
-            if (xTimerIsTimerActive(at_timer) == pdFALSE)
-            {
-                rsp = AT_ERROR_TIMEOUT;
-            }
-            else
-            {
-                ipd_write->valid = at_ipd_status_data;
-                vTaskDelay (pdMS_TO_TICKS(50));
-                ipd_write = ipd_write->next;
-            }
-        }
-        else
-        {
-            rsp = AT_ERROR_QUERY;
-        }
+        tfp_sprintf(params, "%d,%d", link_id, length);
     }
-
-    xTimerStop(at_timer, 0);
-
-    if (rsp == AT_ERROR_TIMEOUT)
+    else
     {
-        return rsp;
+        tfp_sprintf(params, "%d", length);
     }
+    rsp = cmd_set_with_timeout("AT+CIPRECVDATA", params, cmd_timeout_ipd);
+    at_parser_recvdata_end();
+    link_stats[link_id].rx_requests++;
+
     return rsp;
 }
 
-inline int8_t at_ipd_info(int8_t *link_id, char *remote_ip, uint16_t *remote_port, uint16_t *length, uint8_t **buffer)
+int8_t at_set_ciprecvmode(enum at_recvmode mode)
 {
-    if (length == 0)
-        return AT_ERROR_PARAMETERS;
-    if (at_cipmux == at_enable)
-        if (link_id == 0)
-            return AT_ERROR_PARAMETERS;
-
-    xTimerChangePeriod(cmd_timer, at_rx_timeout_cmd, 0);
-    do
-    {
-        // Look for data or a disconnect.
-        peek_async_message();
-
-        if (xTimerIsTimerActive(cmd_timer) == pdFALSE)
-        {
-            return AT_ERROR_TIMEOUT;
-        }
+    char params[AT_MAX_NUMBER];
+    int8_t rsp;
 
-    } while (ipd_head->valid != at_ipd_status_data);
+    tfp_sprintf(params, "%d", mode);
 
-    xTimerStop(cmd_timer, 0);
+    rsp = cmd_set("AT+CIPRECVMODE", params);
 
-    if (ipd_head->valid == at_ipd_status_data)
+    if (rsp == AT_OK)
     {
-        struct ipd_store *ipd_next;
-
-        if (length) *length = ipd_head->length;
-        if (buffer) *buffer = ipd_head->buffer;
-        if (remote_port) *remote_port = ipd_head->remote_port;
-        if (remote_ip) strncpy(remote_ip, ipd_head->remote_ip, sizeof(ipd_head->remote_ip));
-        if (link_id) *link_id = ipd_head->link_id;
+        at_ciprecvmode = mode;
+    }
 
-        ipd_next = ipd_head->next;
-        vPortFree(ipd_head);
-        ipd_head = ipd_next;
+    return rsp;
+}
 
-        return AT_DATA_WAITING;
+int8_t at_link_stats(int8_t link_id, struct at_link_stats_s *stats)
+{
+    if ((link_id < AT_LINK_ID_MIN) || (link_id > AT_LINK_ID_MAX) || (stats == NULL))
+    {
+        return AT_ERROR_PARAMETERS;
     }
 
-    return AT_NO_DATA;
+    *stats = link_stats[link_id];
+    stats->rx_bytes = at_parser_received(link_id);
+    stats->rx_dropped = at_parser_dropped(link_id);
+
+    return AT_OK;
 }
 
-int8_t at_ipd(int8_t *link_id, uint16_t *length, uint8_t **buffer)
+void at_lock(void)
 {
-    return at_ipd_info(link_id, NULL, NULL, length, buffer);
+    xSemaphoreTake(at_mutex, portMAX_DELAY);
 }
 
-uint16_t at_recv(int8_t link_id, uint16_t length, uint8_t *buffer)
+void at_unlock(void)
 {
-    uint16_t offset = 0;
-    uint16_t len= 0;
-
-    xTimerChangePeriod(at_timer, pdMS_TO_TICKS(50), 0);
-    do {
-        len = uartrb_read(uart_at, buffer+offset, length-offset);
-        offset += len;
-        if (xTimerIsTimerActive(at_timer) == pdFALSE) {
-            break;
-        }
-    }
-    while (offset < length);
-    xTimerStop(at_timer, 0);
+    xSemaphoreGive(at_mutex);
+}
 
-    if (offset != length) {
-        // TODO: investigate packet loss
-        offset = length;
+/* Bytes of +IPD data dropped on the link. For a link_id out of range this is
+ * the data that could not be given to a link, including the bytes dropped by
+ * the UART receive ring buffer.
+ */
+uint32_t at_recv_dropped(int8_t link_id)
+{
+    if ((link_id < AT_LINK_ID_MIN) || (link_id > AT_LINK_ID_MAX))
+    {
+        return at_parser_dropped(link_id) + uartrb_dropped(uart_at);
     }
-
-    return offset;
+    return at_parser_dropped(link_id);
 }
 
 int8_t at_is_wifi_connected()
 {
-    peek_async_message();
-    return at_state_wifi_connected;
+    return at_parser_wifi_connected();
 }
 
 int8_t at_wifi_station_ip()
 {
-    peek_async_message();
-    return at_state_wifi_station_has_ip;
+    return at_parser_wifi_got_ip();
 }
 
 enum at_connection at_is_server_connected()
@@ -2767,10 +3322,9 @@ enum at_connection at_is_server_connected()
     int8_t check;
     enum at_connection connect = at_not_connected;
 
-    peek_async_message();
     for (check = AT_LINK_ID_MIN; check <= AT_LINK_ID_MAX; check++)
     {
-        connect |= at_state_server_connect[check];
+        connect |= at_parser_link(check);
     }
 
     return connect;
@@ -2778,7 +3332,6 @@ enum at_connection at_is_server_connected()
 
 enum at_connection at_is_link_id_connected(int8_t link_id)
 {
-    peek_async_message();
-    return at_state_server_connect[link_id];
+    return at_parser_link(link_id);
 }
 #endif
@@ -9,6 +9,10 @@
  * History
  * =======
  * 2019-04-25 : Created v1
+ * 2026-10-16 : Transmit queue of the links sent by pipelined AT+CIPSEND
+ * 2026-10-16 : Passthrough transmission for AT+CIPMODE=1, left for commands
+ * 2026-10-16 : Baud rate negotiation and hardware flow control of the UART
+ * 2026-10-16 : Passive receive mode, statistics and locking of the links
  *
  * Copyright (C) Bridgetek Pte Ltd
  * ============================================================================
@@ -75,6 +79,32 @@ extern "C" {
 #define AT_LINK_ID_MIN 0
 #define AT_LINK_ID_COUNT (AT_LINK_ID_MAX + 1)
 
+// Transmit queue of each link for at_send (power of 2, at most 32768),
+// allocated on the first at_send of the link.
+#ifndef AT_SEND_LINK_SIZE
+#define AT_SEND_LINK_SIZE 4096
+#endif
+// Largest AT+CIPSEND the module accepts
+#define AT_SEND_MAX 2048
+
+// Baud rate of the module after power-up, and the highest rate
+// at_uart_negotiate steps it up to.
+#ifndef AT_UART_BAUD
+#define AT_UART_BAUD 115200
+#endif
+#ifndef AT_UART_BAUD_MAX
+#define AT_UART_BAUD_MAX 2500000
+#endif
+// Flow control of AT+UART_CUR: the module drives RTS (the CTS of the FT900)
+// and/or waits for CTS (the RTS of the FT900).
+#define AT_UART_FLOW_RTS 1
+#define AT_UART_FLOW_CTS 2
+// The UART drives RTS and waits for CTS by itself when the module drives its
+// RTS, instead of RTS driven by the receive ring buffer with CTS ignored.
+#ifndef AT_UART_FLOW_AUTO
+#define AT_UART_FLOW_AUTO 1
+#endif
+
 
 enum PACKED {
 	AT_OK,
@@ -135,6 +165,16 @@ enum at_tetype {
 	at_tetype_server = 1,
 };
 
+// Counters of a link since at_init
+struct at_link_stats_s {
+	uint32_t tx_bytes; // acknowledged by SEND OK
+	uint32_t tx_sends; // AT+CIPSEND
+	uint32_t tx_errors; // AT+CIPSEND failed, discarding the queue
+	uint32_t rx_bytes;
+	uint32_t rx_dropped;
+	uint32_t rx_requests; // AT+CIPRECVDATA in passive mode
+};
+
 struct at_cipstatus_s {
 	int8_t link_id;
 	enum at_link_type type;
@@ -208,6 +248,11 @@ enum PACKED at_txmode {
 	at_txmode_passthrough = 1,
 };
 
+enum PACKED at_recvmode {
+	at_recvmode_active = 0,
+	at_recvmode_passive = 1,
+};
+
 enum PACKED at_ipd_status {
 	at_ipd_status_not_ready = 0,
 	at_ipd_status_waiting = 1,
@@ -228,6 +273,18 @@ int8_t at_timeout_cmd(int timeout);
 int8_t at_timeout_inet(int timeout);
 int8_t at_timeout_ipd(int timeout);
 int8_t at_timeout_ap(int timeout);
+int8_t at_timeout_passthrough(int timeout);
+
+// Serialises the tasks using the module: a task holds the lock while calling
+// the functions below, but not while waiting for data.
+void at_lock(void);
+void at_unlock(void);
+
+// Steps the UART and the module up from the current rate to the highest rate
+// up to max_baud that passes a check at AT+GMR, saved with AT+UART_DEF when
+// persist is set.
+int8_t at_uart_negotiate(uint32_t max_baud, int8_t persist);
+uint32_t at_uart_baud(void);
 
 // Override
 int8_t at_command(const char *command, uint16_t *length, char *response, int rxtimeout);
@@ -289,6 +346,7 @@ int8_t at_set_cipsend(int8_t link_id, uint16_t length, uint8_t *buffer);
 int8_t at_set_cipsend_udp(int8_t link_id, uint16_t length, uint8_t *buffer, char *remote_ip, uint16_t remote_port);
 int8_t at_cipsend_start(void);
 int8_t at_cipsend_finish(void);
+int8_t at_cipsend_check(int *wait);
 int8_t at_set_cipsendex(int8_t link_id, uint16_t length, uint8_t *buffer);
 int8_t at_set_cipsendex_udp(int8_t link_id, uint16_t length, uint8_t *buffer, char *remote_ip, uint16_t remote_port);
 int8_t at_set_cipclose(int8_t link_id);
@@ -302,11 +360,23 @@ int8_t at_set_cipsto(uint16_t timeout);
 int8_t at_query_cipsto(uint16_t *timeout);
 int8_t at_query_cipdinfo(enum at_enable *enable);
 int8_t at_set_cipdinfo(enum at_enable enable);
+// In passive mode at_recv reads the data held by the module for the link once
+// its buffer is empty.
+int8_t at_set_ciprecvmode(enum at_recvmode mode);
+int8_t at_ciprecvdata(int8_t link_id, uint16_t length);
 int8_t at_register_ipd(uint16_t length, uint8_t *buffer);
 int8_t at_delete_ipd(uint8_t *buffer);
 int8_t at_ipd(int8_t *link_id, uint16_t *length, uint8_t **buffer);
 int8_t at_ipd_info(int8_t *link_id, char *remote_ip, uint16_t *remote_port, uint16_t *length, uint8_t **buffer);
 uint16_t at_recv(int8_t link_id, uint16_t length, uint8_t *buffer);
+uint16_t at_recv_nowait(int8_t link_id, uint16_t length, uint8_t *buffer);
+uint32_t at_recv_dropped(int8_t link_id);
+uint16_t at_send(int8_t link_id, uint16_t length, const uint8_t *buffer);
+int8_t at_send_progress(int *wait);
+int8_t at_send_flush(void);
+int8_t at_send_error(int8_t link_id);
+uint16_t at_send_in_flight(int8_t link_id);
+int8_t at_link_stats(int8_t link_id, struct at_link_stats_s *stats);
 
 int8_t at_is_wifi_connected();
 int8_t at_wifi_station_ip();
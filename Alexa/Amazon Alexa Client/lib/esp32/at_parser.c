@@ -0,0 +1,973 @@
+/**
+  @file at_parser.c
+  @brief
+  ESP32 Wifi module.
+  Event-driven parser of the AT responses received from the ESP32.
+
+ */
+/*
+ * ============================================================================
+ * History
+ * =======
+ * 2026-10-16 : Created v1
+ * 2026-10-16 : +IPD data copied from the UART ring buffer in place; held off while
+ *              the link buffer is full; dropped byte counters
+ * 2026-10-16 : Events polled without waiting
+ * 2026-10-16 : Passthrough mode
+ * 2026-10-16 : Resynchronisation after a baud rate change
+ * 2026-10-16 : Passive receive mode and a reader task for each link
+ *
+ * Copyright (C) Bridgetek Pte Ltd
+ * ============================================================================
+ *
+ * This source code ("the Software") is provided by Bridgetek Pte Ltd
+ * ("Bridgetek") subject to the licence terms set out
+ * http://brtchip.com/BRTSourceCodeLicenseAgreement/ ("the Licence Terms").
+ * You must read the Licence Terms before downloading or using the Software.
+ * By installing or using the Software you agree to the Licence Terms. If you
+ * do not agree to the Licence Terms then do not download or use the Software.
+ *
+ * Without prejudice to the Licence Terms, here is a summary of some of the key
+ * terms of the Licence Terms (and in the event of any conflict between this
+ * summary and the Licence Terms then the text of the Licence Terms will
+ * prevail).
+ *
+ * The Software is provided "as is".
+ * There are no warranties (or similar) in relation to the quality of the
+ * Software. You use it at your own risk.
+ * The Software should not be used in, or for, any medical device, system or
+ * appliance. There are exclusions of Bridgetek liability for certain types of loss
+ * such as: special loss or damage; incidental loss or damage; indirect or
+ * consequential loss or damage; loss of income; loss of business; loss of
+ * profits; loss of revenue; loss of contracts; business interruption; loss of
+ * the use of money or anticipated savings; loss of information; loss of
+ * opportunity; loss of goodwill or reputation; and/or loss of, damage to or
+ * corruption of data.
+ * There is a monetary cap on Bridgetek's liability.
+ * The Software may have subsequently been amended by another user and then
+ * distributed by that other user ("Adapted Software").  If so that user may
+ * have additional licence terms that apply to those amendments. However, Bridgetek
+ * has no liability in relation to those amendments.
+ * ============================================================================
+ */
+#if (COMMUNICATION_IO==2) // WiFi
+#include <stdint.h>
+#include <string.h>
+#include <stdlib.h>
+#include "ft900.h"
+
+#include "FreeRTOS.h"
+#include "task.h"
+
+#include "ft900_uart_simple.h"
+#include "uartrb.h"
+#include "at.h"
+#include "at_parser.h"
+
+#if (AT_PARSER_LINK_SIZE & (AT_PARSER_LINK_SIZE - 1)) || (AT_PARSER_LINK_SIZE > 32768)
+#error "AT_PARSER_LINK_SIZE must be a power of 2 up to 32768"
+#endif
+
+/* The parser task runs above the application tasks so that the lines are
+ * classified as they arrive rather than when a task polls for them. */
+#define AT_PARSER_TASK_NAME "AT"
+#define AT_PARSER_TASK_STACK_SIZE 256
+#define AT_PARSER_TASK_PRIORITY 2
+
+#define MARKER_IPD "+IPD,"
+#define MARKER_RECVDATA "+CIPRECVDATA"
+
+/* Stops the compiler from moving the copy of the data across the update
+ * of the index that publishes it. */
+#define AT_PARSER_BARRIER() __asm__ __volatile__ ("" ::: "memory")
+
+/* Receive buffer of a link. The indexes run freely and are masked on access:
+ * the parser task is the only writer of wr_idx and the reading task the only
+ * writer of rd_idx. */
+struct at_link {
+    uint8_t *buffer;
+    volatile uint16_t wr_idx;
+    volatile uint16_t rd_idx;
+    volatile enum at_connection state;
+    volatile int8_t pending; // data held by the module in passive mode
+    TaskHandle_t reader;
+    char remote_ip[AT_MAX_IP];
+    uint16_t remote_port;
+};
+
+static ft900_uart_regs_t *parser_uart;
+static TaskHandle_t parser_task;
+
+/* Line being received */
+static char parser_line[AT_PARSER_LINE_SIZE];
+static uint16_t parser_line_len;
+
+/* +IPD data still to be received and its link (negative to drop it) */
+static uint16_t parser_ipd_left;
+static int8_t parser_ipd_link;
+
+/* Set while the parser leaves +IPD data in the UART ring buffer because the
+ * receive buffer of its link is full. The reader wakes up the parser when it
+ * makes space, as does a command waiting for a response behind the data.
+ * parser_waiting holds the events the command waits for. */
+static volatile int8_t parser_stalled;
+static volatile uint16_t parser_waiting;
+
+/* Link taking all the received data in passthrough mode, negative in command
+ * mode. Passthrough starts at the ">" prompt of AT+CIPSEND once armed. */
+static volatile int8_t parser_passthrough = -1;
+static volatile int8_t parser_passthrough_armed = -1;
+static volatile TickType_t parser_rx_tick;
+
+/* Data bytes dropped on each link and on links that are not valid */
+static volatile uint32_t parser_dropped[AT_LINK_ID_COUNT];
+static volatile uint32_t parser_dropped_other;
+static volatile uint32_t parser_received[AT_LINK_ID_COUNT];
+
+/* Link and length of the AT+CIPRECVDATA in progress, link negative if none */
+static volatile int8_t parser_recvdata_link = -1;
+static uint16_t parser_recvdata_length;
+
+/* Task waiting on a command and its response buffer */
+static TaskHandle_t parser_waiter;
+static char *parser_response;
+static uint16_t parser_response_size;
+static uint16_t parser_response_len;
+static const char *parser_echo;
+static volatile uint16_t parser_events;
+
+/* Task reading any link, notified on data and link changes, as is the
+ * reader of each link. parser_reader_pending has a bit for each link. */
+#define AT_PARSER_ALL_LINKS ((1 << AT_LINK_ID_COUNT) - 1)
+static TaskHandle_t parser_reader;
+static volatile uint8_t parser_reader_pending;
+
+/* State reported by the unsolicited messages */
+static volatile int8_t parser_wifi_connected;
+static volatile int8_t parser_wifi_got_ip;
+static struct at_link parser_links[AT_LINK_ID_COUNT];
+
+static void at_parser_task(void *pvParameters);
+static uint16_t at_parser_input(const uint8_t *data, uint16_t length);
+static void at_parser_char(char c);
+static void at_parser_line(char *line);
+static void at_parser_ipd(char *header);
+static void at_parser_ipd_notice(char *header);
+static void at_parser_recvdata_header(char *header);
+static int8_t at_parser_link_event(const char *message, int8_t link_id);
+static void at_parser_response(const char *line);
+static void at_parser_event(uint16_t events);
+static uint16_t at_parser_link_write(int8_t link_id, const uint8_t *data, uint16_t length);
+static void at_parser_link_read(void);
+
+static void at_parser_task(void *pvParameters)
+{
+    uint8_t *data;
+    uint16_t count;
+    uint16_t used;
+    uint8_t pending;
+    int8_t link_id;
+
+    (void)pvParameters;
+
+    while (1)
+    {
+        /* The data is parsed in place in the UART ring buffer, and the
+           +IPD data is copied from there to the buffer of its link */
+        used = 0;
+        count = uartrb_span(parser_uart, &data);
+        if (count)
+        {
+            parser_rx_tick = xTaskGetTickCount();
+            used = at_parser_input(data, count);
+            uartrb_consume(parser_uart, used);
+        }
+
+        /* Wake up the readers once per span rather than once per +IPD */
+        pending = parser_reader_pending;
+        if (pending)
+        {
+            parser_reader_pending = 0;
+            if (parser_reader)
+            {
+                xTaskNotifyGive(parser_reader);
+            }
+            for (link_id = AT_LINK_ID_MIN; link_id <= AT_LINK_ID_MAX; link_id++)
+            {
+                if ((pending & (1 << link_id)) && (parser_links[link_id].reader) &&
+                        (parser_links[link_id].reader != parser_reader))
+                {
+                    xTaskNotifyGive(parser_links[link_id].reader);
+                }
+            }
+        }
+
+        if (used == 0)
+        {
+            /* Sleep until the receive interrupt adds data to the ring or,
+               when stalled, until the reader makes space */
+            ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        }
+    }
+}
+
+/* Returns the number of bytes used, less than length when stalled */
+static uint16_t at_parser_input(const uint8_t *data, uint16_t length)
+{
+    uint16_t used = 0;
+    uint16_t count;
+
+    while (used < length)
+    {
+        if (parser_passthrough >= 0)
+        {
+            /* No framing: everything is data of the link */
+            count = at_parser_link_write(parser_passthrough, data + used, length - used);
+            if (count == 0)
+            {
+                break;
+            }
+        }
+        else if (parser_ipd_left)
+        {
+            /* Data of a +IPD goes to its link, not to the line */
+            count = parser_ipd_left;
+            if (count > length - used)
+            {
+                count = length - used;
+            }
+            count = at_parser_link_write(parser_ipd_link, data + used, count);
+            if (count == 0)
+            {
+                /* The rest stays in the UART ring buffer which, once full,
+                   holds off the module with RTS */
+                break;
+            }
+            parser_ipd_left -= count;
+        }
+        else
+        {
+            at_parser_char((char)data[used]);
+            count = 1;
+        }
+        used += count;
+    }
+
+    return used;
+}
+
+static void at_parser_char(char c)
+{
+    if (c == '\r')
+    {
+        return;
+    }
+    if (c == '\n')
+    {
+        parser_line[parser_line_len] = '\0';
+        at_parser_line(parser_line);
+        parser_line_len = 0;
+        return;
+    }
+
+    if (parser_line_len == 0)
+    {
+        /* The prompt of AT+CIPSEND is "> " without an end of line */
+        if (c == '>')
+        {
+            if (parser_passthrough_armed >= 0)
+            {
+                parser_passthrough = parser_passthrough_armed;
+                parser_passthrough_armed = -1;
+            }
+            at_parser_event(AT_EVENT_PROMPT);
+            return;
+        }
+        if (c == ' ')
+        {
+            return;
+        }
+    }
+
+    /* The rest of a line longer than the buffer is dropped */
+    if (parser_line_len < AT_PARSER_LINE_SIZE - 1)
+    {
+        parser_line[parser_line_len++] = c;
+    }
+
+    /* "+IPD,<header>:" is followed by the data, not by an end of line */
+    if ((c == ':') && (strncmp(parser_line, MARKER_IPD, AT_STRING_LENGTH(MARKER_IPD)) == 0))
+    {
+        parser_line[parser_line_len - 1] = '\0';
+        at_parser_ipd(parser_line + AT_STRING_LENGTH(MARKER_IPD));
+        parser_line_len = 0;
+    }
+
+    /* The data of AT+CIPRECVDATA follows "+CIPRECVDATA,<len>:" or, from
+       AT version 2, "+CIPRECVDATA:<len>," */
+    if ((parser_recvdata_link >= 0) && (parser_line_len > AT_STRING_LENGTH(MARKER_RECVDATA) + 1) &&
+            (strncmp(parser_line, MARKER_RECVDATA, AT_STRING_LENGTH(MARKER_RECVDATA)) == 0) &&
+            (((c == ':') && (parser_line[AT_STRING_LENGTH(MARKER_RECVDATA)] == ',')) ||
+            ((c == ',') && (parser_line[AT_STRING_LENGTH(MARKER_RECVDATA)] == ':'))))
+    {
+        parser_line[parser_line_len - 1] = '\0';
+        at_parser_recvdata_header(parser_line + AT_STRING_LENGTH(MARKER_RECVDATA) + 1);
+        parser_line_len = 0;
+    }
+}
+
+static void at_parser_ipd(char *header)
+{
+    char *field[4];
+    int8_t fields = 0;
+    int8_t link_id = 0;
+    long length;
+    char *ip = NULL;
+    char *port = NULL;
+    struct at_link *link;
+
+    /* +IPD,[<link ID>,]<len>[,<remote IP>,<remote port>] */
+    field[fields++] = header;
+    while ((*header) && (fields < 4))
+    {
+        if (*header == ',')
+        {
+            *header = '\0';
+            field[fields++] = header + 1;
+        }
+        header++;
+    }
+
+    if ((fields == 2) || (fields == 4))
+    {
+        link_id = strtol(field[0], NULL, 10);
+        length = strtol(field[1], NULL, 10);
+        if (fields == 4)
+        {
+            ip = field[2];
+            port = field[3];
+        }
+    }
+    else
+    {
+        length = strtol(field[0], NULL, 10);
+        if (fields == 3)
+        {
+            ip = field[1];
+            port = field[2];
+        }
+    }
+
+    if ((length <= 0) || (length > 0xffff))
+    {
+        return;
+    }
+    parser_ipd_left = (uint16_t)length;
+    parser_ipd_link = -1;
+
+    if ((link_id >= AT_LINK_ID_MIN) && (link_id <= AT_LINK_ID_MAX))
+    {
+        link = &parser_links[link_id];
+        if (link->buffer == NULL)
+        {
+            link->buffer = pvPortMalloc(AT_PARSER_LINK_SIZE);
+        }
+        if (link->buffer)
+        {
+            parser_ipd_link = link_id;
+        }
+
+        if (ip)
+        {
+            if (*ip == '"')
+            {
+                ip++;
+            }
+            strncpy(link->remote_ip, ip, AT_MAX_IP - 1);
+            link->remote_ip[strcspn(link->remote_ip, "\"")] = '\0';
+            link->remote_port = strtol(port, NULL, 10);
+        }
+    }
+}
+
+/* +IPD,[<link ID>,]<len> without the data, in passive mode */
+static void at_parser_ipd_notice(char *header)
+{
+    int8_t link_id = 0;
+    char *comma;
+
+    comma = strchr(header, ',');
+    if (comma)
+    {
+        link_id = strtol(header, NULL, 10);
+    }
+
+    if ((link_id >= AT_LINK_ID_MIN) && (link_id <= AT_LINK_ID_MAX))
+    {
+        parser_links[link_id].pending = 1;
+        parser_reader_pending |= (1 << link_id);
+    }
+}
+
+static void at_parser_recvdata_header(char *header)
+{
+    long length = strtol(header, NULL, 10);
+    int8_t link_id = parser_recvdata_link;
+
+    parser_recvdata_link = -1;
+    if ((length <= 0) || (length > parser_recvdata_length))
+    {
+        return;
+    }
+
+    /* The module may hold more if it sent all that was asked for */
+    if (length == parser_recvdata_length)
+    {
+        parser_links[link_id].pending = 1;
+    }
+    parser_ipd_left = (uint16_t)length;
+    parser_ipd_link = link_id;
+}
+
+static void at_parser_line(char *line)
+{
+    uint16_t len;
+
+    if (*line == '\0')
+    {
+        return;
+    }
+
+    /* Leave out the echo of the command */
+    if (parser_echo)
+    {
+        len = strlen(line);
+        if ((strncmp(line, parser_echo, len) == 0) && (strcmp(parser_echo + len, "\r\n") == 0))
+        {
+            parser_echo = NULL;
+            return;
+        }
+    }
+
+    if (strcmp(line, "OK") == 0)
+    {
+        at_parser_event(AT_EVENT_OK);
+    }
+    else if ((strcmp(line, "ERROR") == 0) || (strcmp(line, "FAIL") == 0))
+    {
+        at_parser_event(AT_EVENT_ERROR);
+    }
+    else if (strcmp(line, "SEND OK") == 0)
+    {
+        at_parser_event(AT_EVENT_SEND_OK);
+    }
+    else if (strcmp(line, "SEND FAIL") == 0)
+    {
+        at_parser_event(AT_EVENT_SEND_FAIL);
+    }
+    else if (strcmp(line, "ready") == 0)
+    {
+        at_parser_event(AT_EVENT_READY);
+    }
+    else if (strcmp(line, "WIFI CONNECTED") == 0)
+    {
+        parser_wifi_connected = 1;
+    }
+    else if (strcmp(line, "WIFI GOT IP") == 0)
+    {
+        parser_wifi_got_ip = 1;
+    }
+    else if (strncmp(line, "WIFI DISCONNECT", 15) == 0)
+    {
+        parser_wifi_connected = 0;
+        parser_wifi_got_ip = 0;
+        parser_reader_pending = AT_PARSER_ALL_LINKS;
+    }
+    else if (strncmp(line, MARKER_IPD, AT_STRING_LENGTH(MARKER_IPD)) == 0)
+    {
+        at_parser_ipd_notice(line + AT_STRING_LENGTH(MARKER_IPD));
+    }
+    else if ((line[0] >= '0') && (line[0] <= '9') && (line[1] == ','))
+    {
+        /* <link ID>,CONNECT or <link ID>,CLOSED when AT+CIPMUX=1 */
+        if (!at_parser_link_event(line + 2, line[0] - '0'))
+        {
+            at_parser_response(line);
+        }
+    }
+    else if (!at_parser_link_event(line, 0))
+    {
+        at_parser_response(line);
+    }
+}
+
+static int8_t at_parser_link_event(const char *message, int8_t link_id)
+{
+    enum at_connection state;
+
+    if (strcmp(message, "CONNECT") == 0)
+    {
+        state = at_connected;
+    }
+    else if ((strcmp(message, "CLOSED") == 0) || (strcmp(message, "CONNECT FAIL") == 0))
+    {
+        state = at_not_connected;
+    }
+    else
+    {
+        return 0;
+    }
+
+    if (link_id <= AT_LINK_ID_MAX)
+    {
+        parser_links[link_id].state = state;
+        parser_reader_pending |= (1 << link_id);
+    }
+    return 1;
+}
+
+static void at_parser_response(const char *line)
+{
+    uint16_t len = strlen(line);
+    uint16_t space;
+
+    taskENTER_CRITICAL();
+    if (parser_response)
+    {
+        /* Lines are separated by CRLF and the response is NULL terminated */
+        space = parser_response_size - parser_response_len - 1;
+        if (len > space)
+        {
+            len = space;
+        }
+        memcpy(parser_response + parser_response_len, line, len);
+        parser_response_len += len;
+        space -= len;
+        if (space >= 2)
+        {
+            parser_response[parser_response_len++] = '\r';
+            parser_response[parser_response_len++] = '\n';
+        }
+        parser_response[parser_response_len] = '\0';
+    }
+    taskEXIT_CRITICAL();
+}
+
+static void at_parser_event(uint16_t events)
+{
+    TaskHandle_t waiter;
+
+    taskENTER_CRITICAL();
+    parser_events |= events;
+    waiter = parser_waiter;
+    taskEXIT_CRITICAL();
+
+    if (waiter)
+    {
+        xTaskNotifyGive(waiter);
+    }
+}
+
+/* Returns the number of bytes written or dropped, 0 to stall */
+static uint16_t at_parser_link_write(int8_t link_id, const uint8_t *data, uint16_t length)
+{
+    struct at_link *link;
+    uint16_t free;
+    uint16_t offset;
+    uint16_t first;
+
+    if (link_id < 0)
+    {
+        parser_dropped_other += length;
+        return length;
+    }
+    link = &parser_links[link_id];
+    if (link->buffer == NULL)
+    {
+        parser_dropped[link_id] += length;
+        return length;
+    }
+
+    /* Stalled is set before reading rd_idx so that a reader making space
+       afterwards sees it and wakes up the parser */
+    parser_stalled = 1;
+    AT_PARSER_BARRIER();
+    free = AT_PARSER_LINK_SIZE - (uint16_t)(link->wr_idx - link->rd_idx);
+    if (free == 0)
+    {
+        if ((parser_waiting == 0) || (parser_events & parser_waiting))
+        {
+            return 0;
+        }
+        /* The response of the waiting command is behind this data, so the
+           data is dropped rather than failing the command on its timeout */
+        parser_stalled = 0;
+        parser_dropped[link_id] += length;
+        return length;
+    }
+    parser_stalled = 0;
+    if (length > free)
+    {
+        length = free;
+    }
+
+    offset = link->wr_idx & (AT_PARSER_LINK_SIZE - 1);
+    first = AT_PARSER_LINK_SIZE - offset;
+    if (first > length)
+    {
+        first = length;
+    }
+    memcpy(link->buffer + offset, data, first);
+    memcpy(link->buffer, data + first, length - first);
+
+    AT_PARSER_BARRIER();
+    link->wr_idx += length;
+    parser_received[link_id] += length;
+    parser_reader_pending |= (1 << link_id);
+
+    return length;
+}
+
+/* Called after making space in the receive buffer of a link */
+static void at_parser_link_read(void)
+{
+    AT_PARSER_BARRIER();
+    if (parser_stalled)
+    {
+        parser_stalled = 0;
+        xTaskNotifyGive(parser_task);
+    }
+}
+
+/* API functions */
+
+int8_t at_parser_init(ft900_uart_regs_t *dev)
+{
+    parser_uart = dev;
+    parser_line_len = 0;
+    parser_ipd_left = 0;
+    parser_stalled = 0;
+
+    /* The task is kept for the next at_init (INCLUDE_vTaskDelete is 0) */
+    if (parser_task == NULL)
+    {
+        if (xTaskCreate(at_parser_task, AT_PARSER_TASK_NAME, AT_PARSER_TASK_STACK_SIZE,
+                NULL, AT_PARSER_TASK_PRIORITY, &parser_task) != pdPASS)
+        {
+            parser_task = NULL;
+            return AT_ERROR_RESOURCE;
+        }
+    }
+
+    uartrb_notify(dev, parser_task);
+    xTaskNotifyGive(parser_task);
+
+    return AT_OK;
+}
+
+void at_parser_begin(char *response, uint16_t length, const char *echo)
+{
+    taskENTER_CRITICAL();
+    parser_waiter = xTaskGetCurrentTaskHandle();
+    parser_response = length ? response : NULL;
+    parser_response_size = length;
+    parser_response_len = 0;
+    if (parser_response)
+    {
+        *parser_response = '\0';
+    }
+    parser_echo = echo;
+    parser_events = 0;
+    taskEXIT_CRITICAL();
+}
+
+uint16_t at_parser_wait(uint16_t events, TickType_t timeout)
+{
+    TickType_t start = xTaskGetTickCount();
+    TickType_t elapsed;
+
+    parser_waiter = xTaskGetCurrentTaskHandle();
+    parser_waiting = events;
+    at_parser_link_read();
+
+    /* Notifications are also used by the caller for other purposes,
+       so the events are checked again after each one */
+    while ((parser_events & events) == 0)
+    {
+        elapsed = xTaskGetTickCount() - start;
+        if (elapsed >= timeout)
+        {
+            break;
+        }
+        ulTaskNotifyTake(pdTRUE, timeout - elapsed);
+    }
+    parser_waiting = 0;
+
+    return parser_events & events;
+}
+
+uint16_t at_parser_poll(uint16_t events)
+{
+    /* Expected until at_parser_end, so that data held behind the response
+       is dropped rather than stalling the command */
+    parser_waiter = xTaskGetCurrentTaskHandle();
+    parser_waiting = events;
+    at_parser_link_read();
+
+    return parser_events & events;
+}
+
+uint16_t at_parser_end(void)
+{
+    uint16_t length;
+
+    taskENTER_CRITICAL();
+    length = parser_response_len;
+    parser_response = NULL;
+    parser_echo = NULL;
+    parser_waiting = 0;
+    taskEXIT_CRITICAL();
+
+    return length;
+}
+
+int8_t at_parser_wifi_connected(void)
+{
+    return parser_wifi_connected;
+}
+
+int8_t at_parser_wifi_got_ip(void)
+{
+    return parser_wifi_got_ip;
+}
+
+void at_parser_set_wifi(int8_t connected, int8_t got_ip)
+{
+    parser_wifi_connected = connected;
+    parser_wifi_got_ip = got_ip;
+}
+
+enum at_connection at_parser_link(int8_t link_id)
+{
+    if ((link_id < AT_LINK_ID_MIN) || (link_id > AT_LINK_ID_MAX))
+    {
+        return at_not_connected;
+    }
+    return parser_links[link_id].state;
+}
+
+void at_parser_set_link(int8_t link_id, enum at_connection state)
+{
+    if ((link_id >= AT_LINK_ID_MIN) && (link_id <= AT_LINK_ID_MAX))
+    {
+        parser_links[link_id].state = state;
+    }
+}
+
+int8_t at_parser_wait_recv(int8_t *link_id, uint16_t length, TickType_t timeout)
+{
+    TickType_t start = xTaskGetTickCount();
+    TickType_t elapsed;
+    int8_t check;
+    int8_t connected;
+
+    if (*link_id < 0)
+    {
+        parser_reader = xTaskGetCurrentTaskHandle();
+    }
+    else
+    {
+        parser_links[*link_id].reader = xTaskGetCurrentTaskHandle();
+    }
+    if (length > AT_PARSER_LINK_SIZE)
+    {
+        length = AT_PARSER_LINK_SIZE;
+    }
+
+    while (1)
+    {
+        connected = 0;
+        for (check = AT_LINK_ID_MIN; check <= AT_LINK_ID_MAX; check++)
+        {
+            if ((*link_id >= 0) && (check != *link_id))
+            {
+                continue;
+            }
+            if ((at_parser_available(check) >= length) || (parser_links[check].pending))
+            {
+                *link_id = check;
+                return AT_OK;
+            }
+            connected |= (parser_links[check].state == at_connected);
+        }
+        if (!connected)
+        {
+            return AT_NO_DATA;
+        }
+
+        elapsed = xTaskGetTickCount() - start;
+        if (elapsed >= timeout)
+        {
+            return AT_ERROR_TIMEOUT;
+        }
+        ulTaskNotifyTake(pdTRUE, timeout - elapsed);
+    }
+}
+
+uint16_t at_parser_available(int8_t link_id)
+{
+    struct at_link *link = &parser_links[link_id];
+
+    return (uint16_t)(link->wr_idx - link->rd_idx);
+}
+
+uint16_t at_parser_recv(int8_t link_id, uint8_t *buffer, uint16_t length)
+{
+    struct at_link *link = &parser_links[link_id];
+    uint16_t avail = at_parser_available(link_id);
+    uint16_t offset;
+    uint16_t first;
+
+    if (length > avail)
+    {
+        length = avail;
+    }
+    if (length == 0)
+    {
+        return 0;
+    }
+
+    AT_PARSER_BARRIER();
+    offset = link->rd_idx & (AT_PARSER_LINK_SIZE - 1);
+    first = AT_PARSER_LINK_SIZE - offset;
+    if (first > length)
+    {
+        first = length;
+    }
+    memcpy(buffer, link->buffer + offset, first);
+    memcpy(buffer + first, link->buffer, length - first);
+
+    AT_PARSER_BARRIER();
+    link->rd_idx += length;
+    at_parser_link_read();
+
+    return length;
+}
+
+void at_parser_remote(int8_t link_id, char *remote_ip, uint16_t *remote_port)
+{
+    struct at_link *link = &parser_links[link_id];
+
+    if (remote_ip)
+    {
+        strncpy(remote_ip, link->remote_ip, AT_MAX_IP);
+    }
+    if (remote_port)
+    {
+        *remote_port = link->remote_port;
+    }
+}
+
+void at_parser_flush(int8_t link_id)
+{
+    struct at_link *link = &parser_links[link_id];
+
+    link->pending = 0;
+    link->reader = NULL;
+    link->rd_idx = link->wr_idx;
+    at_parser_link_read();
+}
+
+int8_t at_parser_pending(int8_t link_id)
+{
+    return parser_links[link_id].pending;
+}
+
+uint16_t at_parser_recvdata(int8_t link_id, uint16_t length)
+{
+    struct at_link *link = &parser_links[link_id];
+    uint16_t free;
+
+    if (link->buffer == NULL)
+    {
+        link->buffer = pvPortMalloc(AT_PARSER_LINK_SIZE);
+        if (link->buffer == NULL)
+        {
+            return 0;
+        }
+    }
+
+    /* No more than fits, so that the data never stalls the parser */
+    free = AT_PARSER_LINK_SIZE - at_parser_available(link_id);
+    if (length > free)
+    {
+        length = free;
+    }
+    if (length)
+    {
+        taskENTER_CRITICAL();
+        link->pending = 0;
+        parser_recvdata_length = length;
+        parser_recvdata_link = link_id;
+        taskEXIT_CRITICAL();
+    }
+    return length;
+}
+
+void at_parser_recvdata_end(void)
+{
+    parser_recvdata_link = -1;
+}
+
+void at_parser_passthrough(int8_t link_id)
+{
+    struct at_link *link;
+
+    if ((link_id >= AT_LINK_ID_MIN) && (link_id <= AT_LINK_ID_MAX))
+    {
+        link = &parser_links[link_id];
+        if (link->buffer == NULL)
+        {
+            link->buffer = pvPortMalloc(AT_PARSER_LINK_SIZE);
+        }
+        parser_rx_tick = xTaskGetTickCount();
+        parser_passthrough_armed = link_id;
+        return;
+    }
+
+    /* The module is back in command mode: start from a new line */
+    taskENTER_CRITICAL();
+    parser_passthrough_armed = -1;
+    parser_passthrough = -1;
+    taskEXIT_CRITICAL();
+    at_parser_resync();
+}
+
+void at_parser_resync(void)
+{
+    taskENTER_CRITICAL();
+    parser_line_len = 0;
+    parser_ipd_left = 0;
+    taskEXIT_CRITICAL();
+}
+
+TickType_t at_parser_idle(void)
+{
+    return xTaskGetTickCount() - parser_rx_tick;
+}
+
+uint32_t at_parser_received(int8_t link_id)
+{
+    return parser_received[link_id];
+}
+
+uint32_t at_parser_dropped(int8_t link_id)
+{
+    if ((link_id < AT_LINK_ID_MIN) || (link_id > AT_LINK_ID_MAX))
+    {
+        return parser_dropped_other;
+    }
+    return parser_dropped[link_id];
+}
+/* end */
+#endif
@@ -0,0 +1,156 @@
+/**
+  @file at_parser.h
+  @brief
+  ESP32 Wifi module.
+  Event-driven parser of the AT responses received from the ESP32.
+
+ */
+/*
+ * ============================================================================
+ * History
+ * =======
+ * 2026-10-16 : Created v1
+ * 2026-10-16 : +IPD data copied from the UART ring buffer in place; held off while
+ *              the link buffer is full; dropped byte counters
+ * 2026-10-16 : Events polled without waiting
+ * 2026-10-16 : Passthrough mode
+ * 2026-10-16 : Resynchronisation after a baud rate change
+ * 2026-10-16 : Passive receive mode and a reader task for each link
+ *
+ * Copyright (C) Bridgetek Pte Ltd
+ * ============================================================================
+ *
+ * This source code ("the Software") is provided by Bridgetek Pte Ltd
+ * ("Bridgetek") subject to the licence terms set out
+ * http://brtchip.com/BRTSourceCodeLicenseAgreement/ ("the Licence Terms").
+ * You must read the Licence Terms before downloading or using the Software.
+ * By installing or using the Software you agree to the Licence Terms. If you
+ * do not agree to the Licence Terms then do not download or use the Software.
+ *
+ * Without prejudice to the Licence Terms, here is a summary of some of the key
+ * terms of the Licence Terms (and in the event of any conflict between this
+ * summary and the Licence Terms then the text of the Licence Terms will
+ * prevail).
+ *
+ * The Software is provided "as is".
+ * There are no warranties (or similar) in relation to the quality of the
+ * Software. You use it at your own risk.
+ * The Software should not be used in, or for, any medical device, system or
+ * appliance. There are exclusions of Bridgetek liability for certain types of loss
+ * such as: special loss or damage; incidental loss or damage; indirect or
+ * consequential loss or damage; loss of income; loss of business; loss of
+ * profits; loss of revenue; loss of contracts; business interruption; loss of
+ * the use of money or anticipated savings; loss of information; loss of
+ * opportunity; loss of goodwill or reputation; and/or loss of, damage to or
+ * corruption of data.
+ * There is a monetary cap on Bridgetek's liability.
+ * The Software may have subsequently been amended by another user and then
+ * distributed by that other user ("Adapted Software").  If so that user may
+ * have additional licence terms that apply to those amendments. However, Bridgetek
+ * has no liability in relation to those amendments.
+ * ============================================================================
+ */
+#if (COMMUNICATION_IO==2) // WiFi
+#ifndef _AT_PARSER_H
+#define _AT_PARSER_H
+
+#include <stdint.h>
+#include "FreeRTOS.h"
+#include "task.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/* Longest response line kept; the rest of a longer line is dropped. */
+#ifndef AT_PARSER_LINE_SIZE
+#define AT_PARSER_LINE_SIZE 256
+#endif
+
+/* Receive buffer of each link (power of 2, at most 32768), allocated on
+ * the first +IPD of the link. */
+#ifndef AT_PARSER_LINK_SIZE
+#define AT_PARSER_LINK_SIZE 2048
+#endif
+
+/* Events latched for the task waiting on a command. */
+#define AT_EVENT_OK         0x0001 /**< OK */
+#define AT_EVENT_ERROR      0x0002 /**< ERROR or FAIL */
+#define AT_EVENT_SEND_OK    0x0004 /**< SEND OK */
+#define AT_EVENT_SEND_FAIL  0x0008 /**< SEND FAIL */
+#define AT_EVENT_PROMPT     0x0010 /**< ">" prompt for the data of AT+CIPSEND */
+#define AT_EVENT_READY      0x0020 /**< ready, after a reset */
+
+/* Starts the parser task fed by the receive interrupt of dev. */
+int8_t at_parser_init(ft900_uart_regs_t *dev);
+
+/* Command responses, one command at a time.
+ * at_parser_begin clears the events and collects the response lines, other
+ * than the final and unsolicited ones, in response (CRLF separated and NULL
+ * terminated) until at_parser_end, which returns their length. When echo is
+ * set, the echo of that command is left out. The events stay latched for
+ * at_parser_wait until the next at_parser_begin.
+ * at_parser_poll returns the latched events without waiting, for a command
+ * progressed by a task that sleeps on its own; the caller is notified of the
+ * next events as with at_parser_wait. */
+void at_parser_begin(char *response, uint16_t length, const char *echo);
+uint16_t at_parser_wait(uint16_t events, TickType_t timeout);
+uint16_t at_parser_poll(uint16_t events);
+uint16_t at_parser_end(void);
+
+/* State reported by the unsolicited messages */
+int8_t at_parser_wifi_connected(void);
+int8_t at_parser_wifi_got_ip(void);
+void at_parser_set_wifi(int8_t connected, int8_t got_ip);
+enum at_connection at_parser_link(int8_t link_id);
+void at_parser_set_link(int8_t link_id, enum at_connection state);
+
+/* Data received on each link; the remote address is the one of the last +IPD
+ * when AT+CIPDINFO is enabled.
+ * at_parser_wait_recv waits until length bytes are received on *link_id,
+ * or on any link when *link_id is negative, and sets *link_id. Data held by
+ * the module in passive mode counts as received.
+ * It returns AT_OK, AT_ERROR_TIMEOUT, or AT_NO_DATA if the link closed first.
+ * The waiting task is also notified on later data and link changes of that
+ * link, or of any link, until at_parser_flush. */
+int8_t at_parser_wait_recv(int8_t *link_id, uint16_t length, TickType_t timeout);
+uint16_t at_parser_available(int8_t link_id);
+uint16_t at_parser_recv(int8_t link_id, uint8_t *buffer, uint16_t length);
+void at_parser_remote(int8_t link_id, char *remote_ip, uint16_t *remote_port);
+void at_parser_flush(int8_t link_id);
+
+/* +IPD data bytes dropped on a link, or on links that are not valid when
+ * link_id is out of range. Data is held in the UART ring buffer while the
+ * buffer of its link is full and is only dropped if a command is waiting for
+ * a response behind it or the buffer could not be allocated. */
+uint32_t at_parser_dropped(int8_t link_id);
+uint32_t at_parser_received(int8_t link_id);
+
+/* Passive receive mode (AT+CIPRECVMODE=1): the module holds the data of each
+ * link, announced by "+IPD,<link ID>,<len>", until read by AT+CIPRECVDATA.
+ * at_parser_pending is set while the module may hold data for the link.
+ * at_parser_recvdata arms the parser for the data of an AT+CIPRECVDATA on
+ * link_id, and returns the length to ask for: no more than length nor than
+ * the free space of the buffer of the link. at_parser_recvdata_end disarms it
+ * if the command failed. AT+CIPDINFO must be disabled. */
+int8_t at_parser_pending(int8_t link_id);
+uint16_t at_parser_recvdata(int8_t link_id, uint16_t length);
+void at_parser_recvdata_end(void);
+
+/* Passthrough mode (AT+CIPMODE=1): from the ">" prompt of the next AT+CIPSEND
+ * all the data received goes to link_id, until called with a negative link_id
+ * once the module is back in command mode after "+++".
+ * at_parser_idle returns the ticks since data was last received. */
+void at_parser_passthrough(int8_t link_id);
+TickType_t at_parser_idle(void);
+
+/* Drops the partial line or +IPD being parsed, after the UART changed baud
+ * rate for instance. */
+void at_parser_resync(void);
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif /* __cplusplus */
+
+#endif /* _AT_PARSER_H */
+#endif
@@ -9,6 +9,8 @@
  * History
  * =======
  * 2019-04-25 : Created v1
+ * 2026-10-16 : FIFO reads and writes for the interrupt handlers
+ * 2026-10-16 : Automatic RTS/CTS flow control
  *
  * Copyright (C) Bridgetek Pte Ltd
  * ============================================================================
@@ -268,6 +270,26 @@ size_t uart_read(ft900_uart_regs_t *dev, uint8_t *buffer);
  */
 size_t uart_readn(ft900_uart_regs_t *dev, uint8_t *buffer, size_t len);
 
+/** @brief Read the data words waiting in the receive FIFO of a UART
+ *
+ *  @param dev The device to use
+ *  @param buffer A pointer to the array of data words to store into
+ *  @param len The maximum number of data words to read
+ *
+ *  @returns The number of bytes read (0 when the FIFO is empty) or -1 otherwise (invalid device).
+ */
+size_t uart_read_fifo(ft900_uart_regs_t *dev, uint8_t *buffer, size_t len);
+
+/** @brief Write a series of data words to the transmit FIFO of a UART if it is empty
+ *
+ *  @param dev The device to use
+ *  @param buffer A pointer to the array to send
+ *  @param len The size of buffer, at most the size of the FIFO
+ *
+ *  @returns The number of bytes written (0 when still transmitting) or -1 otherwise (invalid device).
+ */
+size_t uart_write_fifo(ft900_uart_regs_t *dev, uint8_t *buffer, size_t len);
+
 /** @brief Write a string to the serial port
  *  @param dev The device to use
  *  @param str The null-terminated string to write
@@ -370,6 +392,16 @@ int8_t uart_dcd(ft900_uart_regs_t *dev);
  */
 int8_t uart_mode(ft900_uart_regs_t *dev, uart_mode_t mode);
 
+/** @brief Set automatic flow control
+ *  @details With uart_flow_rts_cts the UART de-asserts RTS while its receive
+ *  FIFO is nearly full and holds the transmitter while CTS is de-asserted.
+ *  Needs the 128-byte FIFOs of the 16950 mode, and sets their trigger levels.
+ *  @param dev The device to use
+ *  @param flow uart_flow_none or uart_flow_rts_cts
+ *  @returns 0 if successful, -1 otherwise (invalid device or flow control).
+ */
+int8_t uart_set_flow_control(ft900_uart_regs_t *dev, uart_flow_t flow);
+
 #ifdef __cplusplus
 } /* extern "C" */
 #endif /* __cplusplus */
@@ -9,6 +9,8 @@
  * History
  * =======
  * 2019-04-25 : Created v1
+ * 2026-10-16 : FIFO reads and writes for the interrupt handlers
+ * 2026-10-16 : Automatic RTS/CTS flow control
  *
  * Copyright (C) Bridgetek Pte Ltd
  * ============================================================================
@@ -57,6 +59,20 @@
 #define PRESCALER_MAX       (31)
 #define DIVISOR_MAX         (65535)
 
+/* Enhanced registers, accessed while LCR holds LCR_EFR_ACCESS */
+#define LCR_EFR_ACCESS      (0xBF)
+#define EFR_AUTO_RTS        (0x40)
+#define EFR_AUTO_CTS        (0x80)
+#define ACR_950_LEVELS      (0x20)
+
+/* Trigger levels of the 128-byte FIFOs with automatic flow control: RTS is
+   de-asserted once the receive FIFO holds FLOW_RTS_OFF bytes and asserted
+   again below FLOW_RTS_ON. The transmit interrupt stays on an empty FIFO. */
+#define FLOW_TX_LEVEL       (0)
+#define FLOW_RX_LEVEL       (32)
+#define FLOW_RTS_OFF        (96)
+#define FLOW_RTS_ON         (32)
+
 /* GLOBAL VARIABLES ****************************************************************/
 
 /* LOCAL VARIABLES *****************************************************************/
@@ -78,6 +94,16 @@ static inline void uart_spr_write(ft900_uart_regs_t *uart, uint8_t location, uin
   __asm__("" ::: "memory");
 }
 
+/* Leaves the enhanced mode and automatic flow control of a 16650/16950 mode */
+static inline void uart_efr_clear(ft900_uart_regs_t *uart)
+{
+  uint8_t lcr = uart->LCR_RFL;
+  uart->LCR_RFL = LCR_EFR_ACCESS;
+  uart->ISR_FCR_EFR = 0x00;
+  uart->LCR_RFL = lcr;
+  __asm__("" ::: "memory");
+}
+
 /* FUNCTIONS ***********************************************************************/
 
 /** @brief Open a UART for communication
@@ -449,6 +475,72 @@ size_t uart_readn(ft900_uart_regs_t *dev, uint8_t *buffer, size_t len)
 }
 
 
+/** @brief Read the data words waiting in the receive FIFO of a UART
+ *
+ *  @param dev The device to use
+ *  @param buffer A pointer to the array of data words to store into
+ *  @param len The maximum number of data words to read
+ *
+ *  @returns The number of bytes read (0 when the FIFO is empty) or -1 otherwise
+ */
+size_t uart_read_fifo(ft900_uart_regs_t *dev, uint8_t *buffer, size_t len)
+{
+        size_t iRet = 0;
+
+    if (dev == NULL)
+    {
+        /* Unknown device */
+        iRet = -1;
+    }
+
+    if (iRet == 0)
+    {
+        while (len && (dev->LSR_ICR_XON2 & MASK_UART_LSR_DR))
+        {
+            *buffer = dev->RHR_THR_DLL;
+            buffer++;
+            iRet++;
+            len--;
+        }
+    }
+
+    return iRet;
+}
+
+
+/** @brief Write a series of data words to the transmit FIFO of a UART if it is empty
+ *
+ *  @param dev The device to use
+ *  @param buffer A pointer to the array to send
+ *  @param len The size of buffer, at most the size of the FIFO
+ *
+ *  @returns The number of bytes written (0 when still transmitting) or -1 otherwise
+ */
+size_t uart_write_fifo(ft900_uart_regs_t *dev, uint8_t *buffer, size_t len)
+{
+        size_t iRet = 0;
+
+    if (dev == NULL)
+    {
+        /* Unknown device */
+        iRet = -1;
+    }
+
+    if ((iRet == 0) && (dev->LSR_ICR_XON2 & MASK_UART_LSR_THRE))
+    {
+        while (len)
+        {
+            dev->RHR_THR_DLL = *buffer;
+            buffer++;
+            iRet++;
+            len--;
+        }
+    }
+
+    return iRet;
+}
+
+
 /** @brief Write a string to the serial port
  *  @param dev The device to use
  *  @param str The null-terminated string to write
@@ -808,6 +900,50 @@ int8_t uart_dcd(ft900_uart_regs_t *dev)
 	return iRet;
 }
 
+int8_t uart_set_flow_control(ft900_uart_regs_t *dev, uart_flow_t flow)
+{
+    int8_t iRet = 0;
+    uint8_t lcr;
+    uint8_t efr;
+
+    if (dev == NULL)
+    {
+        /* Unknown device */
+        iRet = -1;
+    }
+
+    if (iRet == 0)
+    {
+        lcr = dev->LCR_RFL;
+        dev->LCR_RFL = LCR_EFR_ACCESS;
+        efr = dev->ISR_FCR_EFR & ~(EFR_AUTO_RTS | EFR_AUTO_CTS);
+
+        switch (flow)
+        {
+        case uart_flow_none:
+            dev->ISR_FCR_EFR = efr;
+            dev->LCR_RFL = lcr;
+            uart_spr_write(dev, OFFSET_UART_SPR_ACR, 0x00);
+            break;
+        case uart_flow_rts_cts:
+            dev->ISR_FCR_EFR = efr | EFR_AUTO_RTS | EFR_AUTO_CTS;
+            dev->LCR_RFL = lcr;
+            uart_spr_write(dev, OFFSET_UART_SPR_TTL, FLOW_TX_LEVEL);
+            uart_spr_write(dev, OFFSET_UART_SPR_RTL, FLOW_RX_LEVEL);
+            uart_spr_write(dev, OFFSET_UART_SPR_FCL, FLOW_RTS_ON);
+            uart_spr_write(dev, OFFSET_UART_SPR_FCH, FLOW_RTS_OFF);
+            uart_spr_write(dev, OFFSET_UART_SPR_ACR, ACR_950_LEVELS);
+            break;
+        default:
+            dev->LCR_RFL = lcr;
+            iRet = -1;
+            break;
+        }
+    }
+
+    return iRet;
+}
+
 int8_t uart_mode(ft900_uart_regs_t *dev, uart_mode_t mode)
 {
     int8_t iRet = 0;
@@ -823,9 +959,11 @@ int8_t uart_mode(ft900_uart_regs_t *dev, uart_mode_t mode)
     	switch (mode)
     	{
     	case uart_mode_16450:
+            uart_efr_clear(dev);
             dev->ISR_FCR_EFR = 0x00; /* FIFOs off 16450 mode. */
             break;
     	case uart_mode_16550:
+            uart_efr_clear(dev);
             dev->ISR_FCR_EFR = 0x01; /* 16 byte FIFOs 16550 mode. */
             break;
     	case uart_mode_16650:
@@ -9,6 +9,10 @@
  * History
  * =======
  * 2019-04-25 : Created v1
+ * 2026-10-16 : Lock-free ring indexes and span copies; FIFO bursts in the ISR
+ * 2026-10-16 : Receive notification to a task; FIFO accessed through uart_simple
+ * 2026-10-16 : In-place reads of the receive ring; RTS only flow control
+ * 2026-10-16 : Automatic RTS/CTS flow control; receive timeout interrupt
  *
  * Copyright (C) Bridgetek Pte Ltd
  * ============================================================================
@@ -49,7 +53,8 @@
 
 #include "ft900_uart_simple.h"
 #include <ft900.h>
-#include "FreeRTOSConfig.h"
+#include "FreeRTOS.h"
+#include "task.h"
 #include "uartrb.h"
 
 /* Enable mode for the FT9xx internal FIFOs.
@@ -59,11 +64,12 @@
  */
 #define ENABLE_FIFO 16
 
-/* Suggested size of ring buffer used for both receive and transmit.
- * Reading and writing to the UART FIFO is gernerally performed by
- * an interrupt service routine.
- */
-#define RINGBUFFER_SIZE 2048
+#if (UARTRB_RX_SIZE & (UARTRB_RX_SIZE - 1)) || (UARTRB_RX_SIZE > 32768)
+#error "UARTRB_RX_SIZE must be a power of 2 up to 32768"
+#endif
+#if (UARTRB_TX_SIZE & (UARTRB_TX_SIZE - 1)) || (UARTRB_TX_SIZE > 32768)
+#error "UARTRB_TX_SIZE must be a power of 2 up to 32768"
+#endif
 
 /* Threshold number of bytes in the receive buffer where flow control
  * is to be enacted and signals are de-asserted. When a FIFO is enabled
@@ -75,38 +81,63 @@
 /* Hysteresis value to re-enable flow control by asserting signal. */
 #define RINGBUFFER_THRESHOLD_HYST 4
 
+/* Interrupt identification of the data left in the receive FIFO below its
+ * trigger level once the line is idle. */
+#define UART_INTERRUPT_RX_TIMEOUT 0x0C
+
 /* End-of-line marker */
 #define EOL_CR 1
 #define EOL_LF 2
 #define EOL_CRLF 3
 #define END_OF_LINE CRLF
 
-/* Structure used to store received data and ring buffer indexes. */
+/* Stops the compiler from moving the copy of the data across the update
+ * of the index that publishes it. */
+#define RINGBUFFER_BARRIER() __asm__ __volatile__ ("" ::: "memory")
+
+/* Structure used to store received data and ring buffer indexes.
+ * The indexes run freely and are masked on access: wr_idx - rd_idx is the
+ * number of bytes used. Each index has a single writer, the producer for
+ * wr_idx and the consumer for rd_idx, so the data is copied without masking
+ * interrupts. The receive ring is filled by the ISR and emptied by one task;
+ * the transmit ring is filled by one task and emptied by the ISR.
+ */
 typedef struct
 {
-    uint8_t     buffer[RINGBUFFER_SIZE];
+    uint8_t     *buffer;
+    uint16_t    mask;
     volatile uint16_t wr_idx;
     volatile uint16_t rd_idx;
     volatile uint8_t wait;
+    volatile uint32_t dropped;
 } RingBuffer_t;
 
 /* Receive buffer */
-//static RingBuffer_t uart0BufferRx = { {0}, 0, 0, 0 };
-static RingBuffer_t uart1BufferRx = { {0}, 0, 0, 0 };
+static uint8_t uart1DataRx[UARTRB_RX_SIZE];
+//static RingBuffer_t uart0BufferRx = { ... };
+static RingBuffer_t uart1BufferRx = { uart1DataRx, UARTRB_RX_SIZE - 1, 0, 0, 0, 0 };
 /* Transmit buffer */
-//static RingBuffer_t uart0BufferTx = { {0}, 0, 0, 0 };
-static RingBuffer_t uart1BufferTx = { {0}, 0, 0, 0 };
+static uint8_t uart1DataTx[UARTRB_TX_SIZE];
+//static RingBuffer_t uart0BufferTx = { ... };
+static RingBuffer_t uart1BufferTx = { uart1DataTx, UARTRB_TX_SIZE - 1, 0, 0, 0, 0 };
 /* Flow control settings */
 //static uartrb_flow_t uart0Flow = uartrb_flow_none;
 static uartrb_flow_t uart1Flow = uartrb_flow_none;
+/* Task notified when received data is added to the ring */
+//static TaskHandle_t uart0Task = NULL;
+static TaskHandle_t uart1Task = NULL;
 /* Timeout flags */
 //static volatile int8_t uart0Timeout = 0;
 static volatile int8_t uart1Timeout = 0;
 
 /* Local functions. */
 static void uartrb_starttx(ft900_uart_regs_t *dev, RingBuffer_t *uartBuffer);
+static void uartrb_filltx(ft900_uart_regs_t *dev, RingBuffer_t *uartBuffer);
 static uint16_t uartrb_available_int(RingBuffer_t *uartBuffer);
 static uint16_t uartrb_used_int(RingBuffer_t *uartBuffer);
+static void uartrb_copy_in(RingBuffer_t *uartBuffer, uint16_t idx, const uint8_t *buffer, uint16_t len);
+static void uartrb_copy_out(RingBuffer_t *uartBuffer, uint16_t idx, uint8_t *buffer, uint16_t len);
+static void uartrb_consumed(ft900_uart_regs_t *dev, RingBuffer_t *uartBuffer, uint16_t len);
 static void uartrb_ISR(ft900_uart_regs_t *dev);
 //static void uartrb_0_ISR();
 static void uartrb_1_ISR();
@@ -132,8 +163,12 @@ static void uartrb_1_ISR()
 static void uartrb_ISR(ft900_uart_regs_t *dev)
 {
     static uint8_t c;
-    static int16_t avail;
+    static uint16_t avail;
+    static uint16_t span;
+    static uint16_t wr_idx;
+    static size_t count;
     static uint8_t curint;
+    BaseType_t xHigherPriorityTaskWoken = pdFALSE;
 
     static RingBuffer_t *uartBuffer;
     uartrb_flow_t flow = uart1Flow;//(dev == UART0)?uart0Flow:uart1Flow;
@@ -146,65 +181,77 @@ static void uartrb_ISR(ft900_uart_regs_t *dev)
     {
         uartBuffer = &uart1BufferTx;//(dev == UART0)?&uart0BufferTx:&uart1BufferTx;
 
-        /* Check to see how much data we have to transmit... */
-        avail = uartrb_used_int(uartBuffer);
-
-        /* Out buffer read pointer is not the same as the write pointer...
-         * If flow control is enabled then CTS or DSR must be asserted. */
+        /* If flow control is enabled then CTS or DSR must be asserted. */
         if (flow == uartrb_flow_rts_cts)
         {
-            if (!uart_cts(dev))
-            {
-                avail = 0;
-                uartBuffer->wait = 1;
-            }
+            uartBuffer->wait = !uart_cts(dev);
         }
         else if (flow == uartrb_flow_dtr_dsr)
         {
-            if (!uart_dsr(dev))
-            {
-                avail = 0;
-                uartBuffer->wait = 1;
-            }
+            uartBuffer->wait = !uart_dsr(dev);
         }
 
-        if (avail)
-        {
-            /* Copy out the byte to be transmitted so that the uart_write is
-               the last thing we do... */
-            c = uartBuffer->buffer[uartBuffer->rd_idx];
-
-            /* Increment the pointer and wrap around */
-            uartBuffer->rd_idx++;
-            if (uartBuffer->rd_idx == RINGBUFFER_SIZE) uartBuffer->rd_idx = 0;
-
-            /* Write out a new byte, the following Transmit interrupt should handle
-               the remaning bytes... */
-            uart_write(dev, c);
-            uartBuffer->wait = 0;
-        }
+        /* Refill the transmit FIFO, the following Transmit interrupt
+           should handle the remaining bytes... */
+        uartrb_filltx(dev, uartBuffer);
     }
 
     /* Receive interrupt... */
-    if (curint == uart_interrupt_rx)
+    if ((curint == uart_interrupt_rx) || (curint == UART_INTERRUPT_RX_TIMEOUT))
     {
         uartBuffer = &uart1BufferRx;//(dev == UART0)?&uart0BufferRx:&uart1BufferRx;
 
         avail = uartrb_available_int(uartBuffer);
+        wr_idx = uartBuffer->wr_idx;
 
-        /* Read a byte into the Ring Buffer... */
-        uart_read(dev, &c);
-        uartBuffer->buffer[uartBuffer->wr_idx] = c;
+        /* Drain the receive FIFO straight into the free space of the Ring
+           Buffer, up to its end then from its start; the bytes that do not fit
+           are dropped and counted rather than overwriting unread data... */
+        do
+        {
+            if (avail)
+            {
+                span = uartBuffer->mask + 1 - (wr_idx & uartBuffer->mask);
+                if (span > avail)
+                {
+                    span = avail;
+                }
+                count = uart_read_fifo(dev, uartBuffer->buffer + (wr_idx & uartBuffer->mask), span);
+                wr_idx += count;
+                avail -= count;
+            }
+            else if (flow == uartrb_flow_rts_cts_auto)
+            {
+                /* The data is left in the FIFO, where it makes the UART
+                   de-assert RTS, until the reader makes space */
+                uart_disable_interrupt(dev, uart_interrupt_rx);
+                uartBuffer->wait = 1;
+                count = 0;
+            }
+            else
+            {
+                count = uart_read_fifo(dev, &c, 1);
+                uartBuffer->dropped += count;
+            }
+        } while (count);
+
+        /* Publish the bytes to the reader and wake it up */
+        if (wr_idx != uartBuffer->wr_idx)
+        {
+            RINGBUFFER_BARRIER();
+            uartBuffer->wr_idx = wr_idx;
 
-        /* Increment the pointer and wrap around */
-        uartBuffer->wr_idx++;
-        if (uartBuffer->wr_idx == RINGBUFFER_SIZE) uartBuffer->wr_idx = 0;
+            if (uart1Task)//(dev == UART0)?uart0Task:uart1Task
+            {
+                vTaskNotifyGiveFromISR(uart1Task, &xHigherPriorityTaskWoken);
+            }
+        }
 
         /* Enact flow control for CTS/RTS or DSR/DTR */
         /* De-assert RTS or DTR - receive buffer full */
         if (avail <= RINGBUFFER_THRESHOLD)
         {
-            if (flow == uartrb_flow_rts_cts)
+            if ((flow == uartrb_flow_rts_cts) || (flow == uartrb_flow_rts))
             {
                 uart_rts(dev, 0);
                 uartBuffer->wait = 1;
@@ -216,56 +263,91 @@ static void uartrb_ISR(ft900_uart_regs_t *dev)
             }
         }
     }
+
+    if (xHigherPriorityTaskWoken)
+    {
+        portYIELD_FROM_ISR();
+    }
+}
+
+/* Writes up to a FIFO of data to the transmitter when it is empty.
+   Called from the ISR or with interrupts masked. */
+static void uartrb_filltx(ft900_uart_regs_t *dev, RingBuffer_t *uartBuffer)
+{
+    uint16_t avail;
+    uint16_t offset;
+
+    if (uartBuffer->wait)
+    {
+        return;
+    }
+
+    avail = uartrb_used_int(uartBuffer);
+    if (avail > ENABLE_FIFO)
+    {
+        avail = ENABLE_FIFO;
+    }
+    if (avail == 0)
+    {
+        return;
+    }
+
+    /* The FIFO is loaded from one span of the ring: a fill that wraps
+       sends the rest of the FIFO on the next Transmit interrupt. While the
+       transmitter is still busy nothing is written. */
+    offset = uartBuffer->rd_idx & uartBuffer->mask;
+    if (avail > uartBuffer->mask + 1 - offset)
+    {
+        avail = uartBuffer->mask + 1 - offset;
+    }
+    uartBuffer->rd_idx += (uint16_t)uart_write_fifo(dev, uartBuffer->buffer + offset, avail);
 }
 
 static void uartrb_starttx(ft900_uart_regs_t *dev, RingBuffer_t *uartBuffer)
 {
-    uint8_t c;
 //    configPRINTF(("%s %d %d\n", __FUNCTION__, __LINE__, uartBuffer->wait));
+    /* The ISR also empties the transmit ring */
     CRITICAL_SECTION_BEGIN
-    if (!uartBuffer->wait)
-    {
-        if (uartBuffer->rd_idx != uartBuffer->wr_idx)
-        {
-            //uart_disable_interrupts_globally(dev);
-            c= uartBuffer->buffer[uartBuffer->rd_idx];
-            /* Increment the pointer and wrap around */
-            uartBuffer->rd_idx++;
-            if (uartBuffer->rd_idx == RINGBUFFER_SIZE) uartBuffer->rd_idx = 0;
-            //uart_enable_interrupts_globally(dev);
-
-            uart_write(dev, c);
-        }
-    }
+    uartrb_filltx(dev, uartBuffer);
     CRITICAL_SECTION_END
 }
 
 static uint16_t uartrb_available_int(RingBuffer_t *uartBuffer)
 {
-    int16_t diff;
+    return (uint16_t)(uartBuffer->mask + 1 - uartrb_used_int(uartBuffer));
+}
 
-    diff = uartBuffer->rd_idx - uartBuffer->wr_idx;
+static uint16_t uartrb_used_int(RingBuffer_t *uartBuffer)
+{
+    return (uint16_t)(uartBuffer->wr_idx - uartBuffer->rd_idx);
+}
 
-    if (diff <= 0)
+/* Copies len bytes to the ring from the index idx, in at most two segments */
+static void uartrb_copy_in(RingBuffer_t *uartBuffer, uint16_t idx, const uint8_t *buffer, uint16_t len)
+{
+    uint16_t offset = idx & uartBuffer->mask;
+    uint16_t first = uartBuffer->mask + 1 - offset;
+
+    if (first > len)
     {
-        diff += RINGBUFFER_SIZE;
+        first = len;
     }
-
-    return (uint16_t)diff;
+    memcpy(uartBuffer->buffer + offset, buffer, first);
+    memcpy(uartBuffer->buffer, buffer + first, len - first);
 }
 
-static uint16_t uartrb_used_int(RingBuffer_t *uartBuffer)
+/* Copies len bytes from the ring from the index idx, in at most two segments */
+static void uartrb_copy_out(RingBuffer_t *uartBuffer, uint16_t idx, uint8_t *buffer, uint16_t len)
 {
-    int16_t diff;
-
-    diff = uartBuffer->wr_idx - uartBuffer->rd_idx;
+    uint16_t offset = idx & uartBuffer->mask;
+    uint16_t first = uartBuffer->mask + 1 - offset;
 
-    if (diff < 0)
+    if (first > len)
     {
-        diff += RINGBUFFER_SIZE;
+        first = len;
     }
-
-    return (uint16_t)diff;
+    memcpy(buffer, uartBuffer->buffer + offset, first);
+    memcpy(buffer + first, uartBuffer->buffer, len - first);
 }
 
 static void uartrb_flow_int(ft900_uart_regs_t *dev, RingBuffer_t *uartBuffer)
@@ -278,7 +360,7 @@ static void uartrb_flow_int(ft900_uart_regs_t *dev, RingBuffer_t *uartBuffer)
 
         if (avail > RINGBUFFER_THRESHOLD + RINGBUFFER_THRESHOLD_HYST)
         {
-            if (flow == uartrb_flow_rts_cts)
+            if ((flow == uartrb_flow_rts_cts) || (flow == uartrb_flow_rts))
             {
                 uart_rts(dev, 1);
                 uartBuffer->wait = 0;
@@ -288,10 +370,30 @@ static void uartrb_flow_int(ft900_uart_regs_t *dev, RingBuffer_t *uartBuffer)
                 uart_dtr(dev, 1);
                 uartBuffer->wait = 0;
             }
+            else if (flow == uartrb_flow_rts_cts_auto)
+            {
+                uart_enable_interrupt(dev, uart_interrupt_rx);
+                uartBuffer->wait = 0;
+            }
         }
     }
 }
 
+/* Releases len bytes read from the receive ring to the ISR */
+static void uartrb_consumed(ft900_uart_regs_t *dev, RingBuffer_t *uartBuffer, uint16_t len)
+{
+    RINGBUFFER_BARRIER();
+    uartBuffer->rd_idx += len;
+
+    /* The ISR de-asserts the signal, so only re-asserting it needs the lock */
+    if (uartBuffer->wait)
+    {
+        CRITICAL_SECTION_BEGIN
+        uartrb_flow_int(dev, uartBuffer);
+        CRITICAL_SECTION_END
+    }
+}
+
 /* API functions */
 
 void uartrb_setup(ft900_uart_regs_t *dev, uartrb_flow_t flow)
@@ -306,36 +408,63 @@ void uartrb_setup(ft900_uart_regs_t *dev, uartrb_flow_t flow)
     {
         // ERROR TX
     }
-    if (flow != uartrb_flow_none)
-    {
-        /* Enable the UART to fire interrupts when modem changes occur... */
-        if (uart_enable_interrupt(dev, uart_interrupt_dcd_ri_dsr_cts) == -1)
-        {
-            // ERROR FLOW
-        }
-    }
-    else if (flow == uartrb_flow_rts_cts_auto)
-    {
-        // ERROR NOT SUPPORTED YET
-    }
 
     /* Attach the interrupt so it can be called... */
     //if (dev == UART0)
     //{
     //    interrupt_attach(interrupt_uart0, (uint8_t) interrupt_uart0, uartrb_0_ISR);
-    //    uart0Flow = flow;
     //}
     //else
     {
         interrupt_attach(interrupt_uart1, (uint8_t) interrupt_uart1, uartrb_1_ISR);
-        uart1Flow = flow;
     }
 
+    uartrb_flow(dev, flow);
+
     /* Enable interrupts to be fired... */
     uart_enable_interrupts_globally(dev);
 
+    while (uart_get_interrupt(dev) != uart_interrupt_none);
+}
+
+/**
+ Sets the flow control of a UART set up by uartrb_setup, after it is opened
+ again at another baud rate. uartrb_flow_rts_cts_auto needs the 16950 mode.
+ */
+void uartrb_flow(ft900_uart_regs_t *dev, uartrb_flow_t flow)
+{
+    RingBuffer_t *uartBuffer = &uart1BufferRx;//(dev == UART0)?&uart0BufferRx:&uart1BufferRx;
+
+    if (flow == uartrb_flow_rts_cts_auto)
+    {
+        /* The UART drives RTS and waits for CTS by itself */
+        if (uart_set_flow_control(dev, uart_flow_rts_cts) == -1)
+        {
+            // ERROR FLOW
+        }
+        uart_disable_interrupt(dev, uart_interrupt_dcd_ri_dsr_cts);
+    }
+    else if ((flow != uartrb_flow_none) && (flow != uartrb_flow_rts))
+    {
+        /* Enable the UART to fire interrupts when modem changes occur... */
+        if (uart_enable_interrupt(dev, uart_interrupt_dcd_ri_dsr_cts) == -1)
+        {
+            // ERROR FLOW
+        }
+    }
+    else
+    {
+        uart_disable_interrupt(dev, uart_interrupt_dcd_ri_dsr_cts);
+    }
+
+    //uart0Flow = flow;
+    uart1Flow = flow;
+    uart1BufferTx.wait = 0;
+    uartBuffer->wait = 0;
+    uart_enable_interrupt(dev, uart_interrupt_rx);
+
     /* Enable RTS to start receiving data. */
-    if (flow == uartrb_flow_rts_cts)
+    if ((flow == uartrb_flow_rts_cts) || (flow == uartrb_flow_rts))
     {
         uart_rts(dev, 1);
     }
@@ -343,8 +472,6 @@ void uartrb_setup(ft900_uart_regs_t *dev, uartrb_flow_t flow)
     {
         uart_dtr(dev, 1);
     }
-
-    while (uart_get_interrupt(dev) != uart_interrupt_none);
 }
 
 /**
@@ -354,30 +481,7 @@ void uartrb_setup(ft900_uart_regs_t *dev, uartrb_flow_t flow)
  */
 uint16_t uartrb_putc(ft900_uart_regs_t *dev, uint8_t val)
 {
-    uint16_t free;
-    uint16_t copied = 0;
-    RingBuffer_t *uartBuffer = &uart1BufferTx;//(dev == UART0)?&uart0BufferTx:&uart1BufferTx;
-
-    /* Determine how much space we have ... */
-    CRITICAL_SECTION_BEGIN
-    free = uartrb_available_int(uartBuffer);
-
-    /* Copy in as much data as we can... */
-    if (free)
-    {
-        uartBuffer->buffer[uartBuffer->wr_idx] = val;
-        /* Increment the pointer and wrap around */
-        uartBuffer->wr_idx++;
-        if (uartBuffer->wr_idx == RINGBUFFER_SIZE) uartBuffer->wr_idx = 0;
-
-        copied = 1;
-    }
-    CRITICAL_SECTION_END
-
-    /* Start a transmission if nothing is being transmitted... */
-    uartrb_starttx(dev, uartBuffer);
-
-    return copied;
+    return uartrb_write(dev, &val, 1);
 }
 
 /**
@@ -388,35 +492,32 @@ uint16_t uartrb_putc(ft900_uart_regs_t *dev, uint8_t val)
 uint16_t uartrb_write(ft900_uart_regs_t *dev, uint8_t *buffer, uint16_t len)
 {
 //    configPRINTF(("%s %d %s\n", __FUNCTION__, __LINE__, buffer));
-    uint16_t avail;
     uint16_t free;
-    uint16_t copied = 0;
+    uint16_t wr_idx;
     RingBuffer_t *uartBuffer = &uart1BufferTx;//(dev == UART0)?&uart0BufferTx:&uart1BufferTx;
 
     if (len == 0)
     {
         return 0;
     }
+
     /* Determine how much space we have ... */
-    CRITICAL_SECTION_BEGIN
-    free = avail = uartrb_available_int(uartBuffer);
+    free = uartrb_available_int(uartBuffer);
 
     /* Copy in as much data as we can... */
-    while (len-- && free--)
+    if (len > free)
     {
-        uartBuffer->buffer[uartBuffer->wr_idx] = *buffer++;
-        /* Increment the pointer and wrap around */
-        uartBuffer->wr_idx++;
-        if (uartBuffer->wr_idx == RINGBUFFER_SIZE) uartBuffer->wr_idx = 0;
-
-        copied++;
+        len = free;
     }
-    CRITICAL_SECTION_END
+    wr_idx = uartBuffer->wr_idx;
+    uartrb_copy_in(uartBuffer, wr_idx, buffer, len);
+    RINGBUFFER_BARRIER();
+    uartBuffer->wr_idx = wr_idx + len;
 
     /* Start a transmission if nothing is being transmitted... */
     uartrb_starttx(dev, uartBuffer);
 
-    return copied;
+    return len;
 }
 
 uint16_t uartrb_write_wait(ft900_uart_regs_t *dev, uint8_t *buffer, uint16_t len)
@@ -444,7 +545,6 @@ uint16_t uartrb_write_wait(ft900_uart_regs_t *dev, uint8_t *buffer, uint16_t len
 
 uint16_t uartrb_readln(ft900_uart_regs_t *dev, uint8_t *buffer, uint16_t len)
 {
-    uint16_t avail;
     uint16_t copied = 0;
     int cr = 0;
     RingBuffer_t *uartBuffer = &uart1BufferRx;//(dev == UART0)?&uart0BufferRx:&uart1BufferRx;
@@ -464,20 +564,11 @@ uint16_t uartrb_readln(ft900_uart_regs_t *dev, uint8_t *buffer, uint16_t len)
         }
 
         /* WAIT and BLOCK for new data to be available */
-        do
-        {
-            CRITICAL_SECTION_BEGIN
-            avail = uartrb_used_int(uartBuffer);
-            CRITICAL_SECTION_END
-        } while (avail == 0);
+        while (uartrb_used_int(uartBuffer) == 0);
 
-        CRITICAL_SECTION_BEGIN
-        *buffer = uartBuffer->buffer[uartBuffer->rd_idx];
-        /* Increment the pointer and wrap around */
-        uartBuffer->rd_idx++;
-        if (uartBuffer->rd_idx == RINGBUFFER_SIZE) uartBuffer->rd_idx = 0;
-        uartrb_flow_int(dev, uartBuffer);
-        CRITICAL_SECTION_END
+        RINGBUFFER_BARRIER();
+        *buffer = uartBuffer->buffer[uartBuffer->rd_idx & uartBuffer->mask];
+        uartrb_consumed(dev, uartBuffer, 1);
 
         if (*buffer == '\r')
         {
@@ -528,34 +619,26 @@ uint16_t uartrb_readln(ft900_uart_regs_t *dev, uint8_t *buffer, uint16_t len)
 uint16_t uartrb_read(ft900_uart_regs_t *dev, uint8_t *buffer, uint16_t len)
 {
     uint16_t avail;
-    uint16_t copied = 0;
     RingBuffer_t *uartBuffer = &uart1BufferRx;//(dev == UART0)?&uart0BufferRx:&uart1BufferRx;
 
-    CRITICAL_SECTION_BEGIN
     avail = uartrb_used_int(uartBuffer);
     /* Copy in as much data as we can ...
        This can be either the maximum size of the buffer being given
        or the maximum number of bytes available in the Serial Port
        buffer */
-    while(len && avail)
+    if (len > avail)
     {
-        len--;
-        avail--;
-
-        *buffer = uartBuffer->buffer[uartBuffer->rd_idx];
-        /* Increment the pointer and wrap around */
-        uartBuffer->rd_idx++;
-        if (uartBuffer->rd_idx == RINGBUFFER_SIZE) uartBuffer->rd_idx = 0;
-
-        buffer++;
-        copied++;
+        len = avail;
+    }
+    if (len)
+    {
+        RINGBUFFER_BARRIER();
+        uartrb_copy_out(uartBuffer, uartBuffer->rd_idx, buffer, len);
+        uartrb_consumed(dev, uartBuffer, len);
     }
-
-    uartrb_flow_int(dev, uartBuffer);
-    CRITICAL_SECTION_END
 
     /* Report back how many bytes have been copied into the buffer...*/
-    return copied;
+    return len;
 }
 
 uint16_t uartrb_read_wait(ft900_uart_regs_t *dev, uint8_t *buffer, uint16_t len)
@@ -582,111 +665,105 @@ uint16_t uartrb_read_wait(ft900_uart_regs_t *dev, uint8_t *buffer, uint16_t len)
 }
 
 /**
- Receive one byte from the UART ring buffer
+ Get the received data in place: the bytes up to the end of the ring buffer,
+ to be released with uartrb_consume
 
- @return The number of bytes read
+ @params span - Set to the first available byte
+ @return The number of bytes available from span
  */
-uint16_t uartrb_getc(ft900_uart_regs_t *dev, uint8_t *val)
+uint16_t uartrb_span(ft900_uart_regs_t *dev, uint8_t **span)
 {
     uint16_t avail;
-    uint16_t copied = 0;
+    uint16_t offset;
     RingBuffer_t *uartBuffer = &uart1BufferRx;//(dev == UART0)?&uart0BufferRx:&uart1BufferRx;
 
-    CRITICAL_SECTION_BEGIN
     avail = uartrb_used_int(uartBuffer);
-    /* Copy in as much data as we can ...
-       This can be either the maximum size of the buffer being given
-       or the maximum number of bytes available in the Serial Port
-       buffer */
-    if (avail)
+    offset = uartBuffer->rd_idx & uartBuffer->mask;
+    if (avail > uartBuffer->mask + 1 - offset)
     {
-        *val = uartBuffer->buffer[uartBuffer->rd_idx];
-        /* Increment the pointer and wrap around */
-        uartBuffer->rd_idx++;
-        if (uartBuffer->rd_idx == RINGBUFFER_SIZE) uartBuffer->rd_idx = 0;
-
-        copied = 1;
+        avail = uartBuffer->mask + 1 - offset;
     }
-    uartrb_flow_int(dev, uartBuffer);
-    CRITICAL_SECTION_END
+    RINGBUFFER_BARRIER();
+    *span = uartBuffer->buffer + offset;
 
-    /* Report back how many bytes have been copied into the buffer...*/
-    return copied;
+    return avail;
 }
 
 /**
- See how much data is available in the UART1 ring buffer
+ Release bytes read in place with uartrb_span to the ISR
+ */
+void uartrb_consume(ft900_uart_regs_t *dev, uint16_t len)
+{
+    RingBuffer_t *uartBuffer = &uart1BufferRx;//(dev == UART0)?&uart0BufferRx:&uart1BufferRx;
 
- @return The number of bytes available
+    uartrb_consumed(dev, uartBuffer, len);
+}
+
+/**
+ Receive one byte from the UART ring buffer
+
+ @return The number of bytes read
+ */
+uint16_t uartrb_getc(ft900_uart_regs_t *dev, uint8_t *val)
+{
+    return uartrb_read(dev, val, 1);
+}
+
+/**
+ See how much space is free in the UART1 receive ring buffer
+
+ @return The number of bytes free
  */
 uint16_t uartrb_available(ft900_uart_regs_t *dev)
 {
-    uint16_t diff;
     RingBuffer_t *uartBuffer = &uart1BufferRx;//(dev == UART0)?&uart0BufferRx:&uart1BufferRx;
 
-    CRITICAL_SECTION_BEGIN
-    diff = uartrb_available_int(uartBuffer);
-    CRITICAL_SECTION_END
-
-    return diff;
+    return uartrb_available_int(uartBuffer);
 }
 
+/**
+ See how much data is available in the UART1 receive ring buffer
+
+ @return The number of bytes available
+ */
 uint16_t uartrb_used(ft900_uart_regs_t *dev)
 {
-    uint16_t diff;
     RingBuffer_t *uartBuffer = &uart1BufferRx;//(dev == UART0)?&uart0BufferRx:&uart1BufferRx;
 
-    CRITICAL_SECTION_BEGIN
-    diff = uartrb_used_int(uartBuffer);
-    CRITICAL_SECTION_END
-
-    return diff;
+    return uartrb_used_int(uartBuffer);
 }
 
 /**
- See how much data is available in the UART1 ring buffer
+ See how much data is waiting to be transmitted in the UART1 ring buffer
 
- @return The number of bytes available
+ @return The number of bytes waiting
  */
 uint16_t uartrb_waiting(ft900_uart_regs_t *dev)
 {
-    uint16_t diff;
     RingBuffer_t *uartBuffer = &uart1BufferTx;//(dev == UART0)?&uart0BufferTx:&uart1BufferTx;
 
-    CRITICAL_SECTION_BEGIN
-    diff = uartrb_used_int(uartBuffer);
-    CRITICAL_SECTION_END
-
-    return diff;
+    return uartrb_used_int(uartBuffer);
 }
 
 uint16_t uartrb_peek(ft900_uart_regs_t *dev, uint8_t *buffer, uint16_t len)
 {
     uint16_t avail;
-    uint16_t copied = 0;
     RingBuffer_t *uartBuffer = &uart1BufferRx;//(dev == UART0)?&uart0BufferRx:&uart1BufferRx;
-    uint16_t peek_idx = uartBuffer->rd_idx;
 
-    CRITICAL_SECTION_BEGIN
     avail = uartrb_used_int(uartBuffer);
     /* Copy in as much data as we can ...
        This can be either the maximum size of the buffer being given
        or the maximum number of bytes available in the Serial Port
        buffer */
-    while(len-- && avail--)
+    if (len > avail)
     {
-        *buffer = uartBuffer->buffer[peek_idx];
-        /* Increment the pointer and wrap around */
-        peek_idx++;
-        if (peek_idx == RINGBUFFER_SIZE) peek_idx = 0;
-
-        buffer++;
-        copied++;
+        len = avail;
     }
-    CRITICAL_SECTION_END
+    RINGBUFFER_BARRIER();
+    uartrb_copy_out(uartBuffer, uartBuffer->rd_idx, buffer, len);
 
     /* Report back how many bytes have been copied into the buffer...*/
-    return copied;
+    return len;
 }
 
 /**
@@ -697,18 +774,25 @@ uint16_t uartrb_peek(ft900_uart_regs_t *dev, uint8_t *buffer, uint16_t len)
  */
 uint16_t uartrb_peekc(ft900_uart_regs_t *dev, uint8_t *val)
 {
-    uint16_t copied = 0;
-    RingBuffer_t *uartBuffer = &uart1BufferRx;//(dev == UART0)?&uart0BufferRx:&uart1BufferRx;
+    return uartrb_peek(dev, val, 1);
+}
 
-    CRITICAL_SECTION_BEGIN
-    if (uartBuffer->wr_idx != uartBuffer->rd_idx)
+/**
+ Set the task notified (xTaskNotifyGive) by the ISR each time received
+ data is added to the ring buffer
+
+ @params task - The task to wake up or NULL for none
+ */
+void uartrb_notify(ft900_uart_regs_t *dev, TaskHandle_t task)
+{
+    //if (dev == UART0)
+    //{
+    //    uart0Task = task;
+    //}
+    //else
     {
-        *val = uartBuffer->buffer[uartBuffer->rd_idx];
-        copied = 1;
+        uart1Task = task;
     }
-    CRITICAL_SECTION_END
-
-    return copied;
 }
 
 void uartrb_timeout(ft900_uart_regs_t *dev)
@@ -727,10 +811,32 @@ void uartrb_flush_read(ft900_uart_regs_t *dev)
 {
     RingBuffer_t *uartBuffer = &uart1BufferRx;//(dev == UART0)?&uart0BufferRx:&uart1BufferRx;
 
+    uartrb_consumed(dev, uartBuffer, uartrb_used_int(uartBuffer));
+}
+
+/**
+ Drops the data not transmitted yet, held by flow control for instance
+ */
+void uartrb_flush_write(ft900_uart_regs_t *dev)
+{
+    RingBuffer_t *uartBuffer = &uart1BufferTx;//(dev == UART0)?&uart0BufferTx:&uart1BufferTx;
+
+    /* The ISR also moves rd_idx */
     CRITICAL_SECTION_BEGIN
     uartBuffer->rd_idx = uartBuffer->wr_idx;
-    uartrb_flow_int(dev, uartBuffer);
     CRITICAL_SECTION_END
 }
+
+/**
+ Number of received bytes dropped because the receive ring buffer was full
+
+ @return The number of bytes dropped since startup
+ */
+uint32_t uartrb_dropped(ft900_uart_regs_t *dev)
+{
+    RingBuffer_t *uartBuffer = &uart1BufferRx;//(dev == UART0)?&uart0BufferRx:&uart1BufferRx;
+
+    return uartBuffer->dropped;
+}
 /* end */
 #endif
@@ -9,6 +9,10 @@
  * History
  * =======
  * 2019-04-25 : Created v1
+ * 2026-10-16 : Configurable ring sizes
+ * 2026-10-16 : Receive notification to a task
+ * 2026-10-16 : In-place reads of the receive ring; RTS only flow control
+ * 2026-10-16 : Automatic RTS/CTS flow control
  *
  * Copyright (C) Bridgetek Pte Ltd
  * ============================================================================
@@ -51,30 +55,50 @@
 extern "C" {
 #endif /* __cplusplus */
 
+/* Size of the receive and transmit ring buffers (power of 2, at most 32768).
+ * The receive ring should hold a full TCP window of the ESP32 (5744 bytes
+ * by default) so that a burst of +IPD data is not dropped: define
+ * UARTRB_RX_SIZE=8192 in the build settings when the memory is available.
+ */
+#ifndef UARTRB_RX_SIZE
+#define UARTRB_RX_SIZE 2048
+#endif
+#ifndef UARTRB_TX_SIZE
+#define UARTRB_TX_SIZE 2048
+#endif
+
 /** @brief UART Ring Buffer Flow Control */
 typedef enum
 {
     uartrb_flow_none, /**< No flow control */
     uartrb_flow_rts_cts, /**< Software controlled RTS/CTS flow control */
-    uartrb_flow_rts_cts_auto, /**< Hardware controlled RTS/CTS flow control */
+    uartrb_flow_rts_cts_auto, /**< Hardware controlled RTS/CTS flow control (16950 mode) */
     uartrb_flow_dtr_dsr, /**< DTR/DSR flow control */
-	uartrb_flow_xon_xoff /**< XON/XOFF flow control */
+	uartrb_flow_xon_xoff, /**< XON/XOFF flow control */
+    uartrb_flow_rts /**< Software controlled RTS only: the receiver holds off the sender, CTS is ignored */
 } uartrb_flow_t;
 
 void uartrb_setup(ft900_uart_regs_t *dev, uartrb_flow_t flow);
+void uartrb_flow(ft900_uart_regs_t *dev, uartrb_flow_t flow);
 uint16_t uartrb_putc(ft900_uart_regs_t *dev, uint8_t val);
 uint16_t uartrb_write(ft900_uart_regs_t *dev, uint8_t *buffer, uint16_t len);
 uint16_t uartrb_write_wait(ft900_uart_regs_t *dev, uint8_t *buffer, uint16_t len);
 uint16_t uartrb_read(ft900_uart_regs_t *dev, uint8_t *buffer, uint16_t len);
 uint16_t uartrb_read_wait(ft900_uart_regs_t *dev, uint8_t *buffer, uint16_t len);
 uint16_t uartrb_readln(ft900_uart_regs_t *dev, uint8_t *buffer, uint16_t len);
+uint16_t uartrb_span(ft900_uart_regs_t *dev, uint8_t **span);
+void uartrb_consume(ft900_uart_regs_t *dev, uint16_t len);
 uint16_t uartrb_getc(ft900_uart_regs_t *dev, uint8_t *val);
 uint16_t uartrb_available(ft900_uart_regs_t *dev);
+uint16_t uartrb_used(ft900_uart_regs_t *dev);
 uint16_t uartrb_waiting(ft900_uart_regs_t *dev);
 uint16_t uartrb_peek(ft900_uart_regs_t *dev, uint8_t *buffer, uint16_t len);
 uint16_t uartrb_peekc(ft900_uart_regs_t *dev, uint8_t *val);
+void uartrb_notify(ft900_uart_regs_t *dev, TaskHandle_t task);
 void uartrb_timeout(ft900_uart_regs_t *dev);
 void uartrb_flush_read(ft900_uart_regs_t *dev);
+void uartrb_flush_write(ft900_uart_regs_t *dev);
+uint32_t uartrb_dropped(ft900_uart_regs_t *dev);
 
 #ifdef __cplusplus
 } /* extern "C" */
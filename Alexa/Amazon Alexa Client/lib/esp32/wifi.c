@@ -9,6 +9,9 @@
  * History
  * =======
  * 2019-04-25 : Created v1
+ * 2026-10-16 : Negotiates the baud rate of the UART in WIFI_On
+ * 2026-10-16 : Sockets on the links of the module (AT+CIPMUX=1)
+ * 2026-10-16 : Single link (AT+CIPMUX=0) for the passthrough of the AVS link
  *
  * Copyright (C) Bridgetek Pte Ltd
  * ============================================================================
@@ -46,6 +49,7 @@
 #if (COMMUNICATION_IO==2) // WiFi
 /* FreeRTOS includes. */
 #include <stdint.h>
+#include <string.h>
 #include <wifi.h>
 #include "FreeRTOS.h"
 #include "task.h"
@@ -55,6 +59,8 @@
 
 /* Socket and WiFi interface includes. */
 #include "at.h"
+#include "at_parser.h"
+#include "avs_config.h"
 
 
 
@@ -70,11 +76,28 @@
 
 
 
+/* Passthrough (AT+CIPMODE=1) needs AT+CIPMUX=0, which leaves only link 0 */
+#if AVS_CONFIG_WIFI_PASSTHROUGH
+#define WIFI_CIPMUX      at_disable
+#define WIFI_LINK_ID_MAX AT_LINK_ID_MIN
+#else // AVS_CONFIG_WIFI_PASSTHROUGH
+#define WIFI_CIPMUX      at_enable
+#define WIFI_LINK_ID_MAX AT_LINK_ID_MAX
+#endif // AVS_CONFIG_WIFI_PASSTHROUGH
+
+
+
 /**
  * @brief WiFi initialization status.
  */
 static BaseType_t xWIFIInitDone = pdFALSE;
 
+/**
+ * @brief Links used by the sockets, and their counters when connected.
+ */
+static BaseType_t xSocketInUse[ AT_LINK_ID_COUNT ];
+static struct at_link_stats_s xSocketBase[ AT_LINK_ID_COUNT ];
+
 /**
  * @brief Maximum time to wait in ticks for obtaining the WiFi semaphore
  * before failing the operation.
@@ -94,10 +117,23 @@ WIFIReturnCode_t WIFI_On( void )
         int8_t atRet = at_init(UART1, NULL);
         if(AT_OK == atRet)
         {
+            /* The link keeps working at the current rate if this fails. */
+            if(AT_OK != at_uart_negotiate(AT_UART_BAUD_MAX, 1))
+            {
+                DEBUG_PRINTF("UART negotiation failed \r\n");
+            }
+            DEBUG_PRINTF("UART at %ld baud \r\n", at_uart_baud());
+
             atRet = at_set_cwmode(at_mode_station);
-            atRet |= at_set_cipmux(at_enable);
+            atRet |= at_set_cipmux(WIFI_CIPMUX);
             if(AT_OK == atRet)
             {
+                /* Older firmware keeps sending +IPD data as it comes. */
+                if(AT_OK != at_set_ciprecvmode(at_recvmode_passive))
+                {
+                    DEBUG_PRINTF("Passive receive mode not supported \r\n");
+                }
+
                 xWIFIInitDone = pdTRUE;
                 xRetVal = eWiFiSuccess;
             }
@@ -131,7 +167,9 @@ WIFIReturnCode_t WIFI_ConnectAP( const WIFINetworkParams_t * const pxNetworkPara
         memcpy(cwjap_data.ssid, pxNetworkParams->pcSSID, pxNetworkParams->ucSSIDLength);
         memcpy(cwjap_data.pwd, pxNetworkParams->pcPassword, pxNetworkParams->ucPasswordLength);
         memset(cwjap_data.bssid, 0x00, sizeof(cwjap_data.bssid));
+        at_lock();
         int8_t ret = at_set_cwjap(&cwjap_data);
+        at_unlock();
         if(ret == AT_OK)
             xRetVal = eWiFiSuccess;
         else
@@ -146,7 +184,9 @@ WIFIReturnCode_t WIFI_ConnectAP( const WIFINetworkParams_t * const pxNetworkPara
 WIFIReturnCode_t WIFI_Disconnect( void )
 {
     WIFIReturnCode_t xRetVal = eWiFiFailure;
+    at_lock();
     at_cwqap();
+    at_unlock();
     DEBUG_PRINTF("Disconnect from AP \r\n");
     return xRetVal;
 }
@@ -181,7 +221,9 @@ WIFIReturnCode_t WIFI_SetMode( WIFIDeviceMode_t xDeviceMode )
     WIFIReturnCode_t xRetVal = eWiFiFailure;
 
     enum at_mode x = device_to_wifi_mode(xDeviceMode);
+    at_lock();
     int8_t at_ret = at_set_cwmode(x);
+    at_unlock();
     if(AT_OK == at_ret)
         xRetVal = eWiFiSuccess;
     return xRetVal;
@@ -208,7 +250,9 @@ WIFIReturnCode_t WIFI_GetMode( WIFIDeviceMode_t * pxDeviceMode )
 {
     WIFIReturnCode_t xRetVal = eWiFiFailure;
     enum at_mode x;
+    at_lock();
     int8_t at_ret = at_query_cwmode(&x);
+    at_unlock();
     if(at_ret == AT_OK)
     {
         *pxDeviceMode = wifi_to_device_mode(x);
@@ -264,7 +308,9 @@ WIFIReturnCode_t WIFI_Ping( uint8_t * pucIPAddr,
 WIFIReturnCode_t WIFI_GetIP( uint8_t * pucIPAddr, uint8_t * pucGateway, uint8_t * pucMask )
 {
     WIFIReturnCode_t xRetVal = eWiFiFailure;
+    at_lock();
     int8_t at_ret = at_query_cipsta((char*)pucIPAddr, (char*)pucGateway, (char*)pucMask);
+    at_unlock();
     if (AT_OK == at_ret)
     {
         xRetVal = eWiFiSuccess;
@@ -352,4 +398,269 @@ WIFIReturnCode_t WIFI_GetPMMode( WIFIPMMode_t * pxPMModeType,
 
     return xRetVal;
 }
+/*-----------------------------------------------------------*/
+
+static BaseType_t prvSocketValid( WIFISocket_t xSocket )
+{
+    return ( xSocket >= AT_LINK_ID_MIN ) && ( xSocket <= AT_LINK_ID_MAX ) &&
+           ( xSocketInUse[ xSocket ] == pdTRUE );
+}
+
+WIFISocket_t WIFI_SocketConnect( WIFISocketType_t xType,
+                                 const char * pcHost,
+                                 uint16_t usPort )
+{
+    WIFISocket_t xSocket;
+    int8_t at_ret = AT_ERROR_PARAMETERS;
+
+    if( xWIFIInitDone == pdFALSE )
+    {
+        return WIFI_SOCKET_INVALID;
+    }
+
+    at_lock();
+    for( xSocket = AT_LINK_ID_MIN; xSocket <= WIFI_LINK_ID_MAX; xSocket++ )
+    {
+        if( ( xSocketInUse[ xSocket ] == pdFALSE ) &&
+            ( at_is_link_id_connected( xSocket ) != at_connected ) )
+        {
+            break;
+        }
+    }
+    if( xSocket > WIFI_LINK_ID_MAX )
+    {
+        at_unlock();
+        DEBUG_PRINTF("No free link \r\n");
+        return WIFI_SOCKET_INVALID;
+    }
+
+    switch( xType )
+    {
+        case eWiFiSocketTCP:
+            at_ret = at_set_cipstart_tcp( xSocket, ( char * ) pcHost, usPort, 0 );
+            break;
+
+        case eWiFiSocketUDP:
+            at_ret = at_set_cipstart_udp( xSocket, ( char * ) pcHost, usPort, 0, 0 );
+            break;
+
+        case eWiFiSocketSSL:
+            at_ret = at_set_cipstart_ssl( xSocket, ( char * ) pcHost, usPort, 0 );
+            break;
+    }
+    if( at_ret == AT_OK )
+    {
+        xSocketInUse[ xSocket ] = pdTRUE;
+        at_send_error( xSocket );
+        at_link_stats( xSocket, &xSocketBase[ xSocket ] );
+    }
+    at_unlock();
+
+    if( at_ret != AT_OK )
+    {
+        DEBUG_PRINTF("Connect on link %ld failed with code %d \r\n", xSocket, at_ret);
+        return WIFI_SOCKET_INVALID;
+    }
+    return xSocket;
+}
+
+/*-----------------------------------------------------------*/
+
+int32_t WIFI_SocketSend( WIFISocket_t xSocket,
+                         const void * pvBuffer,
+                         uint32_t ulLength,
+                         TickType_t xTimeout )
+{
+    TickType_t xStart = xTaskGetTickCount();
+    TickType_t xElapsed;
+    TickType_t xSleep;
+    uint32_t ulSent = 0;
+    uint32_t ulCount;
+    uint16_t usInFlight;
+    int lWait;
+    int8_t at_ret;
+
+    if( !prvSocketValid( xSocket ) )
+    {
+        return WIFI_SOCKET_ERROR;
+    }
+
+    while( 1 )
+    {
+        at_lock();
+        /* Frees the queue of the data already sent, then queues more */
+        at_send_progress( NULL );
+        while( ulSent < ulLength )
+        {
+            ulCount = ulLength - ulSent;
+            if( ulCount > AT_SEND_LINK_SIZE )
+            {
+                ulCount = AT_SEND_LINK_SIZE;
+            }
+            ulCount = at_send( xSocket, ( uint16_t ) ulCount, ( const uint8_t * ) pvBuffer + ulSent );
+            if( ulCount == 0 )
+            {
+                break;
+            }
+            ulSent += ulCount;
+        }
+        if( ulSent < ulLength )
+        {
+            at_ret = at_send_error( xSocket );
+            if( ( at_ret != AT_OK ) || ( at_is_link_id_connected( xSocket ) != at_connected ) )
+            {
+                at_unlock();
+                DEBUG_PRINTF("Send on link %ld failed with code %d \r\n", xSocket, at_ret);
+                return ( ulSent > 0 ) ? ( int32_t ) ulSent : WIFI_SOCKET_ERROR;
+            }
+        }
+        at_ret = at_send_progress( &lWait );
+        usInFlight = at_send_in_flight( xSocket );
+        at_unlock();
+
+        xElapsed = xTaskGetTickCount() - xStart;
+        if( ( xTimeout == 0 ) || ( xElapsed >= xTimeout ) ||
+            ( ( ulSent == ulLength ) && ( usInFlight == 0 ) ) )
+        {
+            break;
+        }
+
+        /* Woken up by the response, or by the data and link changes */
+        xSleep = xTimeout - xElapsed;
+        if( ( at_ret == AT_DATA_WAITING ) && ( ( TickType_t ) lWait < xSleep ) )
+        {
+            xSleep = lWait;
+        }
+        if( xSleep > pdMS_TO_TICKS( wificonfigSOCKET_POLL_MS ) )
+        {
+            xSleep = pdMS_TO_TICKS( wificonfigSOCKET_POLL_MS );
+        }
+        ulTaskNotifyTake( pdTRUE, xSleep );
+    }
+
+    return ( int32_t ) ulSent;
+}
+
+/*-----------------------------------------------------------*/
+
+int32_t WIFI_SocketRecv( WIFISocket_t xSocket,
+                         void * pvBuffer,
+                         uint32_t ulLength,
+                         TickType_t xTimeout )
+{
+    TickType_t xStart = xTaskGetTickCount();
+    TickType_t xElapsed;
+    TickType_t xSleep;
+    uint16_t usCount;
+    enum at_connection xConnected;
+    int lWait;
+    int8_t at_ret;
+
+    if( !prvSocketValid( xSocket ) )
+    {
+        return WIFI_SOCKET_ERROR;
+    }
+    if( ulLength > 0xFFFF )
+    {
+        ulLength = 0xFFFF;
+    }
+
+    while( 1 )
+    {
+        at_lock();
+        at_ret = at_send_progress( &lWait );
+        /* Takes the data of the link without waiting; this task is notified
+           of the next data of the link */
+        usCount = at_recv_nowait( xSocket, ( uint16_t ) ulLength, ( uint8_t * ) pvBuffer );
+        xConnected = at_is_link_id_connected( xSocket );
+        at_unlock();
+
+        if( usCount )
+        {
+            return usCount;
+        }
+        if( xConnected != at_connected )
+        {
+            return WIFI_SOCKET_ERROR;
+        }
+
+        xElapsed = xTaskGetTickCount() - xStart;
+        if( xElapsed >= xTimeout )
+        {
+            return 0;
+        }
+        xSleep = xTimeout - xElapsed;
+        if( ( at_ret == AT_DATA_WAITING ) && ( ( TickType_t ) lWait < xSleep ) )
+        {
+            xSleep = lWait;
+        }
+        ulTaskNotifyTake( pdTRUE, xSleep );
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+TickType_t WIFI_SocketPoll( void )
+{
+    int lWait;
+    int8_t at_ret;
+
+    at_lock();
+    at_ret = at_send_progress( &lWait );
+    at_unlock();
+
+    return ( at_ret == AT_DATA_WAITING ) ? ( TickType_t ) lWait : portMAX_DELAY;
+}
+
+/*-----------------------------------------------------------*/
+
+WIFIReturnCode_t WIFI_SocketClose( WIFISocket_t xSocket )
+{
+    WIFIReturnCode_t xRetVal = eWiFiFailure;
+    enum at_connection xConnected;
+
+    if( prvSocketValid( xSocket ) )
+    {
+        at_lock();
+        /* Also drops the data left on the link, closed by the server or not */
+        xConnected = at_is_link_id_connected( xSocket );
+        if( ( at_set_cipclose( xSocket ) == AT_OK ) || ( xConnected != at_connected ) )
+        {
+            xRetVal = eWiFiSuccess;
+        }
+        xSocketInUse[ xSocket ] = pdFALSE;
+        at_unlock();
+    }
+
+    return xRetVal;
+}
+
+/*-----------------------------------------------------------*/
+
+WIFIReturnCode_t WIFI_SocketGetStats( WIFISocket_t xSocket,
+                                      WIFISocketStats_t * pxStats )
+{
+    struct at_link_stats_s xStats;
+
+    if( !prvSocketValid( xSocket ) || ( pxStats == NULL ) )
+    {
+        return eWiFiFailure;
+    }
+
+    at_lock();
+    at_link_stats( xSocket, &xStats );
+    pxStats->usTxQueued = at_send_in_flight( xSocket );
+    pxStats->usRxQueued = at_parser_available( xSocket );
+    at_unlock();
+
+    pxStats->ulTxBytes = xStats.tx_bytes - xSocketBase[ xSocket ].tx_bytes;
+    pxStats->ulTxSends = xStats.tx_sends - xSocketBase[ xSocket ].tx_sends;
+    pxStats->ulTxErrors = xStats.tx_errors - xSocketBase[ xSocket ].tx_errors;
+    pxStats->ulRxBytes = xStats.rx_bytes - xSocketBase[ xSocket ].rx_bytes;
+    pxStats->ulRxDropped = xStats.rx_dropped - xSocketBase[ xSocket ].rx_dropped;
+    pxStats->ulRxRequests = xStats.rx_requests - xSocketBase[ xSocket ].rx_requests;
+
+    return eWiFiSuccess;
+}
+
 #endif
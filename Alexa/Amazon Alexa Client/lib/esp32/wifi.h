@@ -9,6 +9,7 @@
  * History
  * =======
  * 2019-04-25 : Created v1
+ * 2026-10-16 : Sockets on the links of the module (AT+CIPMUX=1)
  *
  * Copyright (C) Bridgetek Pte Ltd
  * ============================================================================
@@ -48,11 +49,13 @@
 #define _WIFI_H_
 
 #include <stdint.h>
+#include "FreeRTOS.h"
 
 /* WiFi configuration. */
 #define wificonfigMAX_SSID_LEN                ( 32 )
 #define wificonfigMAX_BSSID_LEN               ( 6 )
 #define wificonfigMAX_PASSPHRASE_LEN          ( 32 )
+#define wificonfigSOCKET_POLL_MS              ( 10 )
 
 /**
  * @brief Return code from various APIs.
@@ -446,5 +449,107 @@ WIFIReturnCode_t WIFI_SetPMMode( WIFIPMMode_t xPMModeType,
 WIFIReturnCode_t WIFI_GetPMMode( WIFIPMMode_t * pxPMModeType,
                                  void * pvOptionValue );
 
+/**
+ * @brief Socket on one of the 5 links of the module, WIFI_SOCKET_INVALID
+ * if none.
+ */
+typedef int32_t WIFISocket_t;
+
+#define WIFI_SOCKET_INVALID    ( ( WIFISocket_t ) -1 )
+
+/**
+ * @brief Error returned by WIFI_SocketSend and WIFI_SocketRecv when the link
+ * is closed or its data could not be sent.
+ */
+#define WIFI_SOCKET_ERROR      ( -1 )
+
+/**
+ * @brief Socket types.
+ */
+typedef enum
+{
+    eWiFiSocketTCP = 0, /**< TCP. */
+    eWiFiSocketUDP,     /**< UDP. */
+    eWiFiSocketSSL      /**< SSL. */
+} WIFISocketType_t;
+
+/**
+ * @brief Counters of a socket since WIFI_SocketConnect.
+ */
+typedef struct
+{
+    uint32_t ulTxBytes;    /**< Bytes acknowledged by the module. */
+    uint32_t ulTxSends;    /**< AT+CIPSEND commands. */
+    uint32_t ulTxErrors;   /**< Failed AT+CIPSEND, discarding the queue. */
+    uint32_t ulRxBytes;    /**< Bytes received. */
+    uint32_t ulRxDropped;  /**< Bytes dropped. */
+    uint32_t ulRxRequests; /**< AT+CIPRECVDATA commands, in passive mode. */
+    uint16_t usTxQueued;   /**< Bytes queued or not acknowledged yet. */
+    uint16_t usRxQueued;   /**< Bytes received and not read yet. */
+} WIFISocketStats_t;
+
+/**
+ * @brief Opens a connection on a free link.
+ *
+ * The links are shared by the tasks: the data of each one is sent in turn,
+ * and received by the module in passive mode (AT+CIPRECVMODE=1) so that a
+ * link not read does not hold off the others.
+ *
+ * @param[in] xType - TCP, UDP or SSL.
+ * @param[in] pcHost - IP address or domain name of the server.
+ * @param[in] usPort - Port of the server.
+ *
+ * @return The socket, WIFI_SOCKET_INVALID if no link is free or the
+ * connection failed.
+ */
+WIFISocket_t WIFI_SocketConnect( WIFISocketType_t xType,
+                                 const char * pcHost,
+                                 uint16_t usPort );
+
+/**
+ * @brief Queues data to send.
+ *
+ * With a timeout of 0, queues what fits and returns. Otherwise waits up to
+ * xTimeout for all the data to be queued and acknowledged by the module.
+ * The queues are progressed by the calls of the socket functions.
+ *
+ * @return The number of bytes queued, 0 if the queue is full, WIFI_SOCKET_ERROR
+ * if the link is closed or the data queued before could not be sent.
+ */
+int32_t WIFI_SocketSend( WIFISocket_t xSocket,
+                         const void * pvBuffer,
+                         uint32_t ulLength,
+                         TickType_t xTimeout );
+
+/**
+ * @brief Receives data, waiting up to xTimeout for some.
+ *
+ * @return The number of bytes received, 0 on timeout, WIFI_SOCKET_ERROR once
+ * the link is closed and all its data read.
+ */
+int32_t WIFI_SocketRecv( WIFISocket_t xSocket,
+                         void * pvBuffer,
+                         uint32_t ulLength,
+                         TickType_t xTimeout );
+
+/**
+ * @brief Progresses the data queued on all the sockets.
+ *
+ * @return The ticks until it should be called again, portMAX_DELAY when no
+ * data is queued. The calling task is notified of the responses.
+ */
+TickType_t WIFI_SocketPoll( void );
+
+/**
+ * @brief Closes the connection and frees the link.
+ */
+WIFIReturnCode_t WIFI_SocketClose( WIFISocket_t xSocket );
+
+/**
+ * @brief Gets the counters of a socket.
+ */
+WIFIReturnCode_t WIFI_SocketGetStats( WIFISocket_t xSocket,
+                                      WIFISocketStats_t * pxStats );
+
 #endif /* _WIFI_H_ */
 #endif
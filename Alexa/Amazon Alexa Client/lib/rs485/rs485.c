@@ -0,0 +1,689 @@
+/**
+  @file rs485.c
+  @brief
+  RS485 link to the serial bridge of the Alexa gateway
+  Interrupt-driven UART1 with framed, CRC-checked and windowed transfers
+
+ */
+/*
+ * ============================================================================
+ * History
+ * =======
+ * 2026-10-16 : Created v1
+ *
+ * Copyright (C) Bridgetek Pte Ltd
+ * ============================================================================
+ *
+ * This source code ("the Software") is provided by Bridgetek Pte Ltd
+ * ("Bridgetek") subject to the licence terms set out
+ * http://brtchip.com/BRTSourceCodeLicenseAgreement/ ("the Licence Terms").
+ * You must read the Licence Terms before downloading or using the Software.
+ * By installing or using the Software you agree to the Licence Terms. If you
+ * do not agree to the Licence Terms then do not download or use the Software.
+ *
+ * Without prejudice to the Licence Terms, here is a summary of some of the key
+ * terms of the Licence Terms (and in the event of any conflict between this
+ * summary and the Licence Terms then the text of the Licence Terms will
+ * prevail).
+ *
+ * The Software is provided "as is".
+ * There are no warranties (or similar) in relation to the quality of the
+ * Software. You use it at your own risk.
+ * The Software should not be used in, or for, any medical device, system or
+ * appliance. There are exclusions of Bridgetek liability for certain types of loss
+ * such as: special loss or damage; incidental loss or damage; indirect or
+ * consequential loss or damage; loss of income; loss of business; loss of
+ * profits; loss of revenue; loss of contracts; business interruption; loss of
+ * the use of money or anticipated savings; loss of information; loss of
+ * opportunity; loss of goodwill or reputation; and/or loss of, damage to or
+ * corruption of data.
+ * There is a monetary cap on Bridgetek's liability.
+ * The Software may have subsequently been amended by another user and then
+ * distributed by that other user ("Adapted Software").  If so that user may
+ * have additional licence terms that apply to those amendments. However, Bridgetek
+ * has no liability in relation to those amendments.
+ * ============================================================================
+ */
+
+#if (COMMUNICATION_IO==3) // RS485
+#include <stdint.h>
+#include <string.h>
+#include <ft900.h>
+#include "tinyprintf.h"
+#include "FreeRTOS.h"
+#include "task.h"
+#include "rs485.h"
+
+
+
+//#define DEBUG
+#ifdef DEBUG
+#define DEBUG_PRINTF(...) do {tfp_printf(__VA_ARGS__);} while (0)
+#else
+#define DEBUG_PRINTF(...)
+#endif
+
+
+
+/////////////////////////////////////////////////////////////////////////////////////////////
+// Frame format
+// Frames are delimited by RS485_FLAG. RS485_FLAG and RS485_ESCAPE inside a frame are sent
+// as RS485_ESCAPE followed by the byte XORed with RS485_ESCAPE_XOR (HDLC byte stuffing).
+//
+//   address | type | seq | ack | credit | payload (0 to RS485_PAYLOAD_SIZE) | crc16
+//
+// address  Device address; RS485_ADDRESS_DEVICE is set on the frames sent by the device
+// type     RS485_FRAME_xxx; RS485_FRAME_FINAL grants the turn (bridge) or ends it (device)
+// seq      Sequence number of DATA; session number of CONNECT and DISCONNECT
+// ack      Sequence number of the next DATA expected from the peer
+// credit   DATA frames accepted from ack onwards
+// crc16    CRC-16/CCITT-FALSE of the fields before it, big endian
+//
+// The bridge is the bus master. It polls the devices in turn and a device only transmits
+// during its turn. DATA frames still unacknowledged on the next turn are sent again
+// (go-back-N) so a lost frame costs one turn.
+// CONNECT carries the server address and port the bridge connects to for the device.
+/////////////////////////////////////////////////////////////////////////////////////////////
+#define RS485_FLAG              (0x7E)
+#define RS485_ESCAPE            (0x7D)
+#define RS485_ESCAPE_XOR        (0x20)
+#define RS485_ADDRESS_DEVICE    (0x80)
+
+#define RS485_FRAME_DATA        (0)
+#define RS485_FRAME_CONNECT     (1)
+#define RS485_FRAME_DISCONNECT  (2)
+#define RS485_FRAME_POLL        (3)
+#define RS485_FRAME_FINAL       (0x80)
+
+#define RS485_HEADER_SIZE       (5)
+#define RS485_CRC_SIZE          (2)
+#define RS485_FRAME_SIZE        (RS485_HEADER_SIZE + RS485_PAYLOAD_SIZE + RS485_CRC_SIZE)
+#define RS485_STUFFED_SIZE(x)   (2*(RS485_HEADER_SIZE + (x) + RS485_CRC_SIZE) + 2) // worst case with both flags
+
+#define RS485_RX_FRAMES         (8)     // received frames waiting for the task, power of 2 holding a turn of the bridge
+#define RS485_RX_STREAM_SIZE    (RS485_PAYLOAD_SIZE * RS485_WINDOW)
+#define RS485_TX_BUFFER_SIZE    (1280)  // stuffed frames of one turn
+
+// UART
+#define RS485_UART              UART1
+#define RS485_UART_CLOCK        (100000000UL)
+#define RS485_FIFO_SIZE         (128)
+#define RS485_FIFO_TX_LEVEL     (16)    // transmit interrupt when the FIFO has at most this many bytes
+#define RS485_FIFO_RX_LEVEL     (64)    // receive interrupt at this many bytes, or when the line is idle
+#define RS485_ACR_DTR_TX_ENABLE (0x10)  // DTR drives the driver enable of the transceiver while transmitting
+#define RS485_ACR_950_LEVELS    (0x20)  // TTL and RTL set the trigger levels
+#define RS485_FCR_FIFO_RESET    (0x07)  // FIFOs enabled and cleared
+#define RS485_ISR_NONE          (0x01)
+#define RS485_ISR_TX            (0x02)
+
+
+
+typedef struct _TRs485Frame {
+    uint8_t  m_aucData[RS485_FRAME_SIZE];
+    uint16_t m_uwSize;
+} TRs485Frame;
+
+typedef struct _TRs485Slot {
+    uint8_t  m_aucPayload[RS485_PAYLOAD_SIZE];
+    uint16_t m_uwSize;
+} TRs485Slot;
+
+
+static uint8_t g_ucAddress = 0;
+static TaskHandle_t g_xTask = NULL;
+static volatile uint32_t g_ulErrors = 0;
+
+// Receive frames
+// The ISR decodes into g_atRxFrame[g_ucRxHead] and the task releases g_atRxFrame[g_ucRxTail].
+// Each index has exactly one writer so no lock is needed between the task and the ISR.
+static TRs485Frame g_atRxFrame[RS485_RX_FRAMES];
+static volatile uint8_t g_ucRxHead = 0;
+static volatile uint8_t g_ucRxTail = 0;
+static uint16_t g_uwRxSize = 0;
+static uint8_t g_bRxEscape = 0;
+static uint8_t g_bRxSkip = 0;
+
+// Transmit buffer of the turn, drained by the ISR
+static uint8_t g_aucTxBuffer[RS485_TX_BUFFER_SIZE];
+static const uint8_t* volatile g_pucTx = NULL;
+static volatile uint16_t g_uwTxLeft = 0;
+
+// Link state, only accessed by the task
+static uint8_t g_ucState = RS485_STATE_IDLE;
+static uint8_t g_ucSession = 0;
+static uint8_t g_bTurn = 0;                 // turn granted, sent once the transmitter is idle
+static uint8_t g_bAnswerDisconnect = 0;
+static uint32_t g_ulServerAddr = 0;
+static uint16_t g_uwServerPort = 0;
+
+// Transmit window; DATA frame seq uses g_atTxSlot[seq % RS485_WINDOW].
+// Frames from g_ucTxAcked to g_ucTxQueued are complete, g_ucTxQueued is being filled.
+static TRs485Slot g_atTxSlot[RS485_WINDOW];
+static uint8_t g_ucTxAcked = 0;
+static uint8_t g_ucTxQueued = 0;
+static uint8_t g_ucTxCredit = 0;
+
+// Receive stream of the DATA payloads
+static uint8_t g_aucRxStream[RS485_RX_STREAM_SIZE];
+static uint16_t g_uwRxStreamHead = 0;
+static uint16_t g_uwRxStreamSize = 0;
+static uint8_t g_ucRxExpected = 0;
+
+
+// CRC-16/CCITT-FALSE, 4 bits at a time
+static const uint16_t g_auwCrcTable[16] = {
+    0x0000, 0x1021, 0x2042, 0x3063, 0x4084, 0x50A5, 0x60C6, 0x70E7,
+    0x8108, 0x9129, 0xA14A, 0xB16B, 0xC18C, 0xD1AD, 0xE1CE, 0xF1EF
+};
+
+
+
+static uint16_t rs485_crc(uint16_t uwCrc, const uint8_t* pucData, uint16_t uwSize)
+{
+    while (uwSize--) {
+        uwCrc = (uwCrc << 4) ^ g_auwCrcTable[(uwCrc >> 12) ^ (*pucData >> 4)];
+        uwCrc = (uwCrc << 4) ^ g_auwCrcTable[(uwCrc >> 12) ^ (*pucData & 0x0F)];
+        pucData++;
+    }
+    return uwCrc;
+}
+
+static inline void rs485_spr_write(uint8_t ucLocation, uint8_t ucValue)
+{
+    RS485_UART->SPR_XOFF2 = ucLocation;
+    RS485_UART->LSR_ICR_XON2 = ucValue;
+    __asm__("" ::: "memory");
+}
+
+// baud = clock / (samples * divisor) with 4 to 16 samples per bit
+static int rs485_baud(uint32_t ulBaud, uint8_t* pucSamples, uint16_t* puwDivisor)
+{
+    uint32_t ulBestError = ulBaud;
+    uint8_t ucSamples;
+
+    if (!ulBaud) {
+        return 0;
+    }
+    for (ucSamples = 16; ucSamples >= 4; ucSamples--) {
+        uint32_t ulDivisor = (RS485_UART_CLOCK + ucSamples*ulBaud/2) / (ucSamples*ulBaud);
+        uint32_t ulActual, ulError;
+        if (!ulDivisor || ulDivisor > 0xFFFF) {
+            continue;
+        }
+        ulActual = RS485_UART_CLOCK / (ucSamples*ulDivisor);
+        ulError = (ulActual > ulBaud) ? ulActual - ulBaud : ulBaud - ulActual;
+        if (ulError < ulBestError) {
+            ulBestError = ulError;
+            *pucSamples = ucSamples;
+            *puwDivisor = ulDivisor;
+        }
+    }
+
+    // Both ends must be within 2%
+    return (ulBestError <= ulBaud/50);
+}
+
+
+
+/////////////////////////////////////////////////////////////////////////////////////////////
+// UART1 interrupt handler
+// Decodes the frames addressed to the device into g_atRxFrame and refills the transmit FIFO.
+// The task is notified when a frame is received or the turn has been written to the FIFO.
+/////////////////////////////////////////////////////////////////////////////////////////////
+static inline int rs485_isr_rx(uint8_t ucByte)
+{
+    if (ucByte == RS485_FLAG) {
+        int bComplete = (!g_bRxSkip && g_uwRxSize >= RS485_HEADER_SIZE + RS485_CRC_SIZE);
+        if (bComplete) {
+            g_atRxFrame[g_ucRxHead % RS485_RX_FRAMES].m_uwSize = g_uwRxSize;
+            g_ucRxHead++;
+        }
+        g_uwRxSize = 0;
+        g_bRxEscape = 0;
+        g_bRxSkip = 0;
+        return bComplete;
+    }
+    if (g_bRxSkip) {
+        return 0;
+    }
+    if (ucByte == RS485_ESCAPE) {
+        g_bRxEscape = 1;
+        return 0;
+    }
+    if (g_bRxEscape) {
+        ucByte ^= RS485_ESCAPE_XOR;
+        g_bRxEscape = 0;
+    }
+
+    if (!g_uwRxSize) {
+        // Skip the frames of the other devices and the frames sent by the devices
+        if (ucByte != g_ucAddress) {
+            g_bRxSkip = 1;
+            return 0;
+        }
+        if ((uint8_t)(g_ucRxHead - g_ucRxTail) == RS485_RX_FRAMES) {
+            g_bRxSkip = 1;
+            g_ulErrors++;
+            return 0;
+        }
+    }
+    else if (g_uwRxSize == RS485_FRAME_SIZE) {
+        g_bRxSkip = 1;
+        g_ulErrors++;
+        return 0;
+    }
+    g_atRxFrame[g_ucRxHead % RS485_RX_FRAMES].m_aucData[g_uwRxSize++] = ucByte;
+    return 0;
+}
+
+static void rs485_isr(void)
+{
+    BaseType_t xHigherPriorityTaskWoken = pdFALSE;
+    int bNotify = 0;
+    uint8_t ucIsr;
+    uint8_t ucLsr;
+
+    // The interrupt identification is auto clearing
+    while (!((ucIsr = RS485_UART->ISR_FCR_EFR & 0x3F) & RS485_ISR_NONE)) {
+        if (ucIsr == RS485_ISR_TX) {
+            uint16_t uwCount = g_uwTxLeft;
+            if (uwCount > RS485_FIFO_SIZE - RS485_FIFO_TX_LEVEL) {
+                uwCount = RS485_FIFO_SIZE - RS485_FIFO_TX_LEVEL;
+            }
+            g_uwTxLeft -= uwCount;
+            while (uwCount--) {
+                RS485_UART->RHR_THR_DLL = *g_pucTx++;
+            }
+            if (!g_uwTxLeft) {
+                uart_disable_interrupt(RS485_UART, uart_interrupt_tx);
+                bNotify = 1;
+            }
+            continue;
+        }
+
+        // Receive level, receive timeout or line status
+        while ((ucLsr = RS485_UART->LSR_ICR_XON2) & MASK_UART_LSR_DR) {
+            if (ucLsr & (MASK_UART_LSR_OE | MASK_UART_LSR_FE)) {
+                g_bRxSkip = 1;
+                g_ulErrors++;
+            }
+            bNotify |= rs485_isr_rx(RS485_UART->RHR_THR_DLL);
+        }
+    }
+
+    if (bNotify && g_xTask) {
+        vTaskNotifyGiveFromISR(g_xTask, &xHigherPriorityTaskWoken);
+    }
+    if (xHigherPriorityTaskWoken) {
+        portYIELD_FROM_ISR();
+    }
+}
+
+
+
+/////////////////////////////////////////////////////////////////////////////////////////////
+// Frames sent in the turn of the device
+/////////////////////////////////////////////////////////////////////////////////////////////
+static uint8_t* rs485_stuff(uint8_t* pucDst, const uint8_t* pucSrc, uint16_t uwSize)
+{
+    while (uwSize--) {
+        uint8_t ucByte = *pucSrc++;
+        if (ucByte == RS485_FLAG || ucByte == RS485_ESCAPE) {
+            *pucDst++ = RS485_ESCAPE;
+            ucByte ^= RS485_ESCAPE_XOR;
+        }
+        *pucDst++ = ucByte;
+    }
+    return pucDst;
+}
+
+static uint8_t rs485_credit(void)
+{
+    uint16_t uwFree = RS485_RX_STREAM_SIZE - g_uwRxStreamSize;
+
+    if (g_ucState != RS485_STATE_CONNECTED) {
+        return 0;
+    }
+    return uwFree / RS485_PAYLOAD_SIZE;
+}
+
+static uint16_t rs485_encode(uint8_t* pucDst, uint8_t ucType, uint8_t ucSeq, const uint8_t* pucPayload, uint16_t uwSize)
+{
+    uint8_t aucHeader[RS485_HEADER_SIZE];
+    uint8_t aucCrc[RS485_CRC_SIZE];
+    uint8_t* pucStart = pucDst;
+    uint16_t uwCrc;
+
+    aucHeader[0] = g_ucAddress | RS485_ADDRESS_DEVICE;
+    aucHeader[1] = ucType;
+    aucHeader[2] = ucSeq;
+    aucHeader[3] = g_ucRxExpected;
+    aucHeader[4] = rs485_credit();
+    uwCrc = rs485_crc(0xFFFF, aucHeader, sizeof(aucHeader));
+    uwCrc = rs485_crc(uwCrc, pucPayload, uwSize);
+    aucCrc[0] = (uint8_t)(uwCrc >> 8);
+    aucCrc[1] = (uint8_t)(uwCrc);
+
+    *pucDst++ = RS485_FLAG;
+    pucDst = rs485_stuff(pucDst, aucHeader, sizeof(aucHeader));
+    pucDst = rs485_stuff(pucDst, pucPayload, uwSize);
+    pucDst = rs485_stuff(pucDst, aucCrc, sizeof(aucCrc));
+    *pucDst++ = RS485_FLAG;
+    return pucDst - pucStart;
+}
+
+static void rs485_turn(void)
+{
+    uint8_t* pucTx = g_aucTxBuffer;
+    uint8_t* pucEnd = g_aucTxBuffer + sizeof(g_aucTxBuffer) - RS485_STUFFED_SIZE(0);
+    uint8_t aucServer[6];
+    TRs485Slot* pSlot;
+    uint8_t ucSeq;
+
+
+    if (g_bAnswerDisconnect) {
+        pucTx += rs485_encode(pucTx, RS485_FRAME_DISCONNECT, g_ucSession, NULL, 0);
+        g_bAnswerDisconnect = 0;
+    }
+
+    switch (g_ucState) {
+        case RS485_STATE_CONNECTING:
+            aucServer[0] = (uint8_t)(g_ulServerAddr >> 24);
+            aucServer[1] = (uint8_t)(g_ulServerAddr >> 16);
+            aucServer[2] = (uint8_t)(g_ulServerAddr >> 8);
+            aucServer[3] = (uint8_t)(g_ulServerAddr);
+            aucServer[4] = (uint8_t)(g_uwServerPort >> 8);
+            aucServer[5] = (uint8_t)(g_uwServerPort);
+            pucTx += rs485_encode(pucTx, RS485_FRAME_CONNECT, g_ucSession, aucServer, sizeof(aucServer));
+            break;
+
+        case RS485_STATE_CLOSING:
+            pucTx += rs485_encode(pucTx, RS485_FRAME_DISCONNECT, g_ucSession, NULL, 0);
+            break;
+
+        case RS485_STATE_CONNECTED:
+            // Complete the frame being filled so that it goes out in this turn
+            pSlot = &g_atTxSlot[g_ucTxQueued % RS485_WINDOW];
+            if (pSlot->m_uwSize && (uint8_t)(g_ucTxQueued - g_ucTxAcked) < RS485_WINDOW) {
+                g_ucTxQueued++;
+            }
+
+            // Unacknowledged frames first, within the credit of the bridge
+            for (ucSeq = g_ucTxAcked; ucSeq != g_ucTxQueued; ucSeq++) {
+                if ((uint8_t)(ucSeq - g_ucTxAcked) >= g_ucTxCredit) {
+                    break;
+                }
+                pSlot = &g_atTxSlot[ucSeq % RS485_WINDOW];
+                if (pucTx + RS485_STUFFED_SIZE(pSlot->m_uwSize) > pucEnd) {
+                    break;
+                }
+                pucTx += rs485_encode(pucTx, RS485_FRAME_DATA, ucSeq, pSlot->m_aucPayload, pSlot->m_uwSize);
+            }
+            break;
+
+        default:
+            break;
+    }
+
+    // End the turn; the poll also carries the acknowledgement and the credit
+    pucTx += rs485_encode(pucTx, RS485_FRAME_POLL | RS485_FRAME_FINAL, 0, NULL, 0);
+
+    g_pucTx = g_aucTxBuffer;
+    g_uwTxLeft = pucTx - g_aucTxBuffer;
+    // The ISR fills the FIFO from the first transmit interrupt
+    uart_enable_interrupt(RS485_UART, uart_interrupt_tx);
+}
+
+
+
+/////////////////////////////////////////////////////////////////////////////////////////////
+// Frames received from the bridge
+/////////////////////////////////////////////////////////////////////////////////////////////
+static void rs485_reset(void)
+{
+    int i;
+
+    for (i = 0; i < RS485_WINDOW; i++) {
+        g_atTxSlot[i].m_uwSize = 0;
+    }
+    g_ucTxAcked = 0;
+    g_ucTxQueued = 0;
+    g_ucTxCredit = 0;
+    g_uwRxStreamHead = 0;
+    g_uwRxStreamSize = 0;
+    g_ucRxExpected = 0;
+}
+
+static void rs485_receive_data(const uint8_t* pucPayload, uint16_t uwSize)
+{
+    uint16_t uwOffset = (g_uwRxStreamHead + g_uwRxStreamSize) % RS485_RX_STREAM_SIZE;
+    uint16_t uwCount = RS485_RX_STREAM_SIZE - uwOffset;
+
+    if (uwCount > uwSize) {
+        uwCount = uwSize;
+    }
+    memcpy(g_aucRxStream + uwOffset, pucPayload, uwCount);
+    memcpy(g_aucRxStream, pucPayload + uwCount, uwSize - uwCount);
+    g_uwRxStreamSize += uwSize;
+}
+
+static void rs485_receive(const uint8_t* pucFrame, uint16_t uwSize)
+{
+    uint8_t ucType = pucFrame[1] & ~RS485_FRAME_FINAL;
+    uint8_t ucSeq = pucFrame[2];
+    uint8_t ucAck = pucFrame[3];
+    uint8_t ucCredit = pucFrame[4];
+
+    uwSize -= RS485_HEADER_SIZE;
+    switch (ucType) {
+        case RS485_FRAME_CONNECT:
+            if (g_ucState == RS485_STATE_CONNECTING && ucSeq == g_ucSession) {
+                rs485_reset();
+                g_ucState = RS485_STATE_CONNECTED;
+                DEBUG_PRINTF("rs485: connected %d\r\n", ucSeq);
+            }
+            break;
+
+        case RS485_FRAME_DISCONNECT:
+            if (ucSeq != g_ucSession) {
+                break;
+            }
+            // Answer unless the device is the one disconnecting
+            if (g_ucState != RS485_STATE_CLOSING) {
+                g_bAnswerDisconnect = 1;
+            }
+            DEBUG_PRINTF("rs485: disconnected %d\r\n", ucSeq);
+            g_ucState = RS485_STATE_IDLE;
+            break;
+
+        case RS485_FRAME_DATA:
+            // Frames out of sequence or without room are dropped; the ack makes the bridge send them again
+            if (g_ucState == RS485_STATE_CONNECTED && ucSeq == g_ucRxExpected &&
+                uwSize <= RS485_RX_STREAM_SIZE - g_uwRxStreamSize) {
+                rs485_receive_data(pucFrame + RS485_HEADER_SIZE, uwSize);
+                g_ucRxExpected++;
+            }
+            break;
+
+        default:
+            break;
+    }
+
+    if (g_ucState == RS485_STATE_CONNECTED) {
+        // Release the acknowledged frames
+        if ((uint8_t)(ucAck - g_ucTxAcked) <= (uint8_t)(g_ucTxQueued - g_ucTxAcked)) {
+            while (g_ucTxAcked != ucAck) {
+                g_atTxSlot[g_ucTxAcked % RS485_WINDOW].m_uwSize = 0;
+                g_ucTxAcked++;
+            }
+        }
+        g_ucTxCredit = (ucCredit > RS485_WINDOW) ? RS485_WINDOW : ucCredit;
+    }
+
+    if (pucFrame[1] & RS485_FRAME_FINAL) {
+        g_bTurn = 1;
+    }
+}
+
+
+
+/////////////////////////////////////////////////////////////////////////////////////////////
+// API
+/////////////////////////////////////////////////////////////////////////////////////////////
+int rs485_open(uint32_t ulBaud, uint8_t ucAddress, TaskHandle_t xTask)
+{
+    uint8_t ucSamples = 16;
+    uint16_t uwDivisor = 0;
+
+
+    if (!ucAddress || ucAddress >= RS485_ADDRESS_DEVICE) {
+        DEBUG_PRINTF("rs485_open(): invalid address %d\r\n", ucAddress);
+        return 0;
+    }
+    if (!rs485_baud(ulBaud, &ucSamples, &uwDivisor)) {
+        DEBUG_PRINTF("rs485_open(): unsupported baud %d\r\n", (int)ulBaud);
+        return 0;
+    }
+
+    g_ucAddress = ucAddress;
+    g_xTask = xTask;
+    g_ucRxHead = g_ucRxTail = 0;
+    g_uwRxSize = 0;
+    g_bRxSkip = 1;
+    g_uwTxLeft = 0;
+    g_bTurn = 0;
+    g_bAnswerDisconnect = 0;
+    g_ucState = RS485_STATE_IDLE;
+    rs485_reset();
+
+    // 128-byte FIFOs with programmable trigger levels and RS485 driver enable
+    uart_mode(RS485_UART, uart_mode_16950);
+    uart_open(RS485_UART, 1, uwDivisor, uart_data_bits_8, uart_parity_none, uart_stop_bits_1);
+    rs485_spr_write(OFFSET_UART_SPR_TCR, ucSamples & 0x0F);
+    rs485_spr_write(OFFSET_UART_SPR_TTL, RS485_FIFO_TX_LEVEL);
+    rs485_spr_write(OFFSET_UART_SPR_RTL, RS485_FIFO_RX_LEVEL);
+    rs485_spr_write(OFFSET_UART_SPR_ACR, RS485_ACR_950_LEVELS | RS485_ACR_DTR_TX_ENABLE);
+    RS485_UART->ISR_FCR_EFR = RS485_FCR_FIFO_RESET;
+
+    interrupt_attach(interrupt_uart1, (uint8_t) interrupt_uart1, rs485_isr);
+    uart_enable_interrupt(RS485_UART, uart_interrupt_rx);
+    uart_enable_interrupts_globally(RS485_UART);
+
+    DEBUG_PRINTF("rs485_open(): address %d baud %d (%d samples, divisor %d)\r\n",
+        ucAddress, (int)(RS485_UART_CLOCK / (ucSamples*uwDivisor)), ucSamples, uwDivisor);
+    return 1;
+}
+
+void rs485_close(void)
+{
+    uart_disable_interrupts_globally(RS485_UART);
+    interrupt_detach(interrupt_uart1);
+    uart_close(RS485_UART);
+    g_uwTxLeft = 0;
+    g_xTask = NULL;
+    g_ucState = RS485_STATE_IDLE;
+}
+
+// Handles the received frames and sends the turn of the device when polled
+void rs485_process(void)
+{
+    while (g_ucRxTail != g_ucRxHead) {
+        TRs485Frame* pFrame = &g_atRxFrame[g_ucRxTail % RS485_RX_FRAMES];
+        if (rs485_crc(0xFFFF, pFrame->m_aucData, pFrame->m_uwSize) == 0) {
+            rs485_receive(pFrame->m_aucData, pFrame->m_uwSize - RS485_CRC_SIZE);
+        }
+        else {
+            g_ulErrors++;
+        }
+        // Release the frame to the ISR
+        g_ucRxTail++;
+    }
+
+    if (g_bTurn && !g_uwTxLeft) {
+        g_bTurn = 0;
+        rs485_turn();
+    }
+}
+
+// ulServerAddr is ((a<<24)|(b<<16)|(c<<8)|d), or 0 for the server configured on the bridge
+void rs485_connect(uint32_t ulServerAddr, uint16_t uwServerPort)
+{
+    rs485_reset();
+    g_ulServerAddr = ulServerAddr;
+    g_uwServerPort = uwServerPort;
+    g_ucSession++;
+    g_ucState = RS485_STATE_CONNECTING;
+}
+
+// Unsent and unacknowledged data is dropped
+void rs485_disconnect(void)
+{
+    if (g_ucState == RS485_STATE_CONNECTING || g_ucState == RS485_STATE_CONNECTED) {
+        rs485_reset();
+        g_ucState = RS485_STATE_CLOSING;
+    }
+}
+
+int rs485_state(void)
+{
+    return g_ucState;
+}
+
+// Returns the bytes queued for the next turns, 0 if the window is full, or -1 if not connected
+int rs485_write(const char* pcBuffer, int lSize)
+{
+    int lWritten = 0;
+
+    if (g_ucState != RS485_STATE_CONNECTED) {
+        return -1;
+    }
+
+    while (lSize > 0 && (uint8_t)(g_ucTxQueued - g_ucTxAcked) < RS485_WINDOW) {
+        TRs485Slot* pSlot = &g_atTxSlot[g_ucTxQueued % RS485_WINDOW];
+        int lCount = RS485_PAYLOAD_SIZE - pSlot->m_uwSize;
+        if (lCount > lSize) {
+            lCount = lSize;
+        }
+        memcpy(pSlot->m_aucPayload + pSlot->m_uwSize, pcBuffer, lCount);
+        pSlot->m_uwSize += lCount;
+        if (pSlot->m_uwSize == RS485_PAYLOAD_SIZE) {
+            g_ucTxQueued++;
+        }
+        pcBuffer += lCount;
+        lSize -= lCount;
+        lWritten += lCount;
+    }
+    return lWritten;
+}
+
+// Returns the bytes received, 0 if none yet, or -1 if the connection was closed
+int rs485_read(char* pcBuffer, int lSize)
+{
+    int lCount = g_uwRxStreamSize;
+    int lFirst = RS485_RX_STREAM_SIZE - g_uwRxStreamHead;
+
+    if (!lCount) {
+        return (g_ucState == RS485_STATE_CONNECTED) ? 0 : -1;
+    }
+
+    if (lCount > lSize) {
+        lCount = lSize;
+    }
+    if (lFirst > lCount) {
+        lFirst = lCount;
+    }
+    memcpy(pcBuffer, g_aucRxStream + g_uwRxStreamHead, lFirst);
+    memcpy(pcBuffer + lFirst, g_aucRxStream, lCount - lFirst);
+    g_uwRxStreamHead = (g_uwRxStreamHead + lCount) % RS485_RX_STREAM_SIZE;
+    g_uwRxStreamSize -= lCount;
+    return lCount;
+}
+
+// Frames dropped for CRC errors, UART errors or overruns
+uint32_t rs485_errors(void)
+{
+    return g_ulErrors;
+}
+
+
+#endif // (COMMUNICATION_IO==3) // RS485
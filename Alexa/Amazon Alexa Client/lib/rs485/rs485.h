@@ -0,0 +1,54 @@
+/**
+  @file rs485.h
+  @brief
+  RS485 link to the serial bridge of the Alexa gateway
+
+ */
+/*
+ * ============================================================================
+ * History
+ * =======
+ * 2026-10-16 : Created v1
+ *
+ * ============================================================================
+ */
+#if (COMMUNICATION_IO==3) // RS485
+#ifndef _RS485_H
+#define _RS485_H
+
+#include <stdint.h>
+#include "FreeRTOS.h"
+#include "task.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/* Link states */
+#define RS485_STATE_IDLE        (0) /**< No connection */
+#define RS485_STATE_CONNECTING  (1) /**< CONNECT sent on each turn until the bridge answers */
+#define RS485_STATE_CONNECTED   (2)
+#define RS485_STATE_CLOSING     (3) /**< DISCONNECT sent on each turn until the bridge answers */
+
+#define RS485_PAYLOAD_SIZE      (240)   /**< Maximum payload of a DATA frame */
+#define RS485_WINDOW            (4)     /**< Maximum unacknowledged DATA frames per direction */
+
+/* Opens UART1 with the ISR; xTask is notified when frames are received or sent */
+int  rs485_open(uint32_t ulBaud, uint8_t ucAddress, TaskHandle_t xTask);
+void rs485_close(void);
+
+/* The functions below must be called from the notified task */
+void rs485_process(void);
+void rs485_connect(uint32_t ulServerAddr, uint16_t uwServerPort);
+void rs485_disconnect(void);
+int  rs485_state(void);
+int  rs485_write(const char* pcBuffer, int lSize);
+int  rs485_read(char* pcBuffer, int lSize);
+uint32_t rs485_errors(void);
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif /* __cplusplus */
+
+#endif /* _RS485_H */
+#endif
@@ -0,0 +1,502 @@
+/**
+  @file audio_host.c
+  @brief
+  Host build of libavs
+  Speaker and microphone module on an emulated I2S peripheral
+  - A thread clocks the FIFOs at the sampling rate (16-bit stereo) and raises the pending flags
+  - The ISR of audio_setup runs on that thread inside the critical section, like an interrupt
+  - The microphone plays a RAW or WAV file and the speaker output is written to a WAV file
+
+ */
+/*
+ * ============================================================================
+ * History
+ * =======
+ * 2026-10-16 : Created v1
+ *
+ * ============================================================================
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <pthread.h>
+#include <ft900.h>
+#include "FreeRTOS.h"
+#include "task.h"
+#include "audio.h"
+#include "host.h"
+
+
+
+#define AUDIO_HOST_TICK_US      (1000)  // period of the I2S clock thread
+#define AUDIO_HOST_FRAME_SIZE   (4)     // 16-bit stereo
+#define WAV_HEADER_SIZE         (44)
+
+
+typedef struct _AudioHostFifo {
+
+    uint8_t m_aucData[AUDIO_FIFO_SIZE];
+    uint32_t m_ulHead;              // bytes written, free running
+    uint32_t m_ulTail;              // bytes read, free running
+    uint8_t m_ucRunning;
+    uint64_t m_ullStart;            // host_time_us when started
+    uint64_t m_ullClocked;          // bytes clocked since started
+
+} AudioHostFifo;
+
+typedef struct _AudioHostContext {
+
+    void (*m_fxnIsr)(void);
+    uint32_t m_ulBytesPerSecond;
+    uint32_t m_ulSpeed;
+    AudioHostFifo m_tTx;
+    AudioHostFifo m_tRx;
+
+    // Microphone source, 16-bit mono
+    char* m_pcSource;
+    uint32_t m_ulSourceSize;
+    uint32_t m_ulSourceOffset;
+
+    // Speaker sink, 16-bit stereo WAV
+    FILE* m_pSink;
+    uint32_t m_ulSinkSize;
+
+    int m_lSpeakerVolume;
+    int m_lMicVolume;
+
+} AudioHostContext;
+
+static AudioHostContext g_hAudio = {0};
+
+// Interrupt enables and pending flags
+static ft900_i2s_regs_t g_tI2S;
+ft900_i2s_regs_t* I2S = &g_tI2S;
+static pthread_t g_xClock;
+
+
+
+static uint32_t audio_fifo_level(const AudioHostFifo* pFifo)
+{
+    return pFifo->m_ulHead - pFifo->m_ulTail;
+}
+
+static void audio_fifo_start(AudioHostFifo* pFifo)
+{
+    pFifo->m_ucRunning = 1;
+    pFifo->m_ullStart = host_time_us();
+    pFifo->m_ullClocked = 0;
+}
+
+// Bytes the I2S clock moved since the last call
+static uint32_t audio_fifo_clock(AudioHostFifo* pFifo, uint64_t ullNow)
+{
+    uint64_t ullDue;
+    uint32_t ulBytes;
+
+    if (!pFifo->m_ucRunning) {
+        return 0;
+    }
+    ullDue = (ullNow - pFifo->m_ullStart) * g_hAudio.m_ulBytesPerSecond * g_hAudio.m_ulSpeed / 1000000;
+    ullDue &= ~(uint64_t)(AUDIO_HOST_FRAME_SIZE - 1);
+    ulBytes = (uint32_t)(ullDue - pFifo->m_ullClocked);
+    pFifo->m_ullClocked = ullDue;
+    return ulBytes;
+}
+
+static void audio_sink_write(const uint8_t* pucData, uint32_t ulSize)
+{
+    static const uint8_t aucSilence[256] = {0};
+
+    if (!g_hAudio.m_pSink) {
+        return;
+    }
+    if (pucData) {
+        fwrite(pucData, 1, ulSize, g_hAudio.m_pSink);
+    }
+    else {
+        for (uint32_t ulChunk; ulSize; ulSize -= ulChunk) {
+            ulChunk = ulSize < sizeof(aucSilence) ? ulSize : sizeof(aucSilence);
+            fwrite(aucSilence, 1, ulChunk, g_hAudio.m_pSink);
+        }
+    }
+    g_hAudio.m_ulSinkSize += ulSize;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////
+// Speaker: the clock drains the TX FIFO to the sink, or silence once empty
+// TX_HALF_FULL is raised when the level falls to half, TX_EMPTY when it falls to 0
+/////////////////////////////////////////////////////////////////////////////////////////////
+static void audio_tx_clock(uint64_t ullNow)
+{
+    AudioHostFifo* pFifo = &g_hAudio.m_tTx;
+    uint32_t ulBytes = audio_fifo_clock(pFifo, ullNow);
+    uint32_t ulLevel = audio_fifo_level(pFifo);
+
+    if (!ulBytes) {
+        return;
+    }
+
+    for (uint32_t ulDrain = ulBytes < ulLevel ? ulBytes : ulLevel; ulDrain; ) {
+        uint32_t ulOffset = pFifo->m_ulTail % AUDIO_FIFO_SIZE;
+        uint32_t ulChunk = AUDIO_FIFO_SIZE - ulOffset;
+        if (ulChunk > ulDrain) {
+            ulChunk = ulDrain;
+        }
+        audio_sink_write(pFifo->m_aucData + ulOffset, ulChunk);
+        pFifo->m_ulTail += ulChunk;
+        ulDrain -= ulChunk;
+        ulBytes -= ulChunk;
+    }
+    audio_sink_write(NULL, ulBytes);
+
+    if (ulLevel > (AUDIO_FIFO_SIZE>>1) && audio_fifo_level(pFifo) <= (AUDIO_FIFO_SIZE>>1)) {
+        g_tI2S.I2S_IRQ_PEND |= MASK_I2S_PEND_FIFO_TX_HALF_FULL;
+    }
+    if (ulLevel && !audio_fifo_level(pFifo)) {
+        g_tI2S.I2S_IRQ_PEND |= MASK_I2S_PEND_FIFO_TX_EMPTY;
+    }
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////
+// Microphone: the clock fills the RX FIFO from the source duplicated to both channels
+// RX_HALF_FULL is raised when the level reaches half, RX_FULL when full, RX_OVER when samples are lost
+/////////////////////////////////////////////////////////////////////////////////////////////
+static void audio_rx_clock(uint64_t ullNow)
+{
+    AudioHostFifo* pFifo = &g_hAudio.m_tRx;
+    uint32_t ulBytes = audio_fifo_clock(pFifo, ullNow);
+    uint32_t ulLevel = audio_fifo_level(pFifo);
+
+    for (; ulBytes; ulBytes -= AUDIO_HOST_FRAME_SIZE) {
+        int16_t sSample = 0;
+
+        if (g_hAudio.m_ulSourceOffset + sizeof(sSample) <= g_hAudio.m_ulSourceSize) {
+            memcpy(&sSample, g_hAudio.m_pcSource + g_hAudio.m_ulSourceOffset, sizeof(sSample));
+            g_hAudio.m_ulSourceOffset += sizeof(sSample);
+        }
+        else if (g_hAudio.m_pcSource && !g_tHostStats.m_ullCaptureEnd) {
+            host_stats_mark(&g_tHostStats.m_ullCaptureEnd);
+        }
+
+        if (audio_fifo_level(pFifo) == AUDIO_FIFO_SIZE) {
+            g_tI2S.I2S_IRQ_PEND |= MASK_I2S_PEND_FIFO_RX_OVER;
+            continue;
+        }
+        uint8_t* pucFrame = pFifo->m_aucData + (pFifo->m_ulHead % AUDIO_FIFO_SIZE);
+        memcpy(pucFrame, &sSample, sizeof(sSample));
+        memcpy(pucFrame + sizeof(sSample), &sSample, sizeof(sSample));
+        pFifo->m_ulHead += AUDIO_HOST_FRAME_SIZE;
+    }
+
+    if (ulLevel < (AUDIO_FIFO_SIZE>>1) && audio_fifo_level(pFifo) >= (AUDIO_FIFO_SIZE>>1)) {
+        g_tI2S.I2S_IRQ_PEND |= MASK_I2S_PEND_FIFO_RX_HALF_FULL;
+    }
+    if (ulLevel < AUDIO_FIFO_SIZE && audio_fifo_level(pFifo) == AUDIO_FIFO_SIZE) {
+        g_tI2S.I2S_IRQ_PEND |= MASK_I2S_PEND_FIFO_RX_FULL;
+    }
+}
+
+static void* audio_clock_thread(void* pvParameters)
+{
+    struct timespec tTick = {0, AUDIO_HOST_TICK_US * 1000};
+    (void) pvParameters;
+
+
+    while (1) {
+        nanosleep(&tTick, NULL);
+
+        taskENTER_CRITICAL();
+        uint64_t ullNow = host_time_us();
+        audio_tx_clock(ullNow);
+        audio_rx_clock(ullNow);
+        if ((g_tI2S.I2S_IRQ_PEND & g_tI2S.I2S_IRQ_EN) && g_hAudio.m_fxnIsr) {
+            g_hAudio.m_fxnIsr();
+        }
+        taskEXIT_CRITICAL();
+    }
+    return NULL;
+}
+
+
+
+/////////////////////////////////////////////////////////////////////////////////////////////
+// I2S driver
+/////////////////////////////////////////////////////////////////////////////////////////////
+void i2s_start_tx(void)
+{
+    taskENTER_CRITICAL();
+    audio_fifo_start(&g_hAudio.m_tTx);
+    taskEXIT_CRITICAL();
+}
+
+void i2s_stop_tx(void)
+{
+    taskENTER_CRITICAL();
+    g_hAudio.m_tTx.m_ucRunning = 0;
+    g_hAudio.m_tTx.m_ulTail = g_hAudio.m_tTx.m_ulHead;
+    taskEXIT_CRITICAL();
+}
+
+void i2s_start_rx(void)
+{
+    taskENTER_CRITICAL();
+    g_hAudio.m_tRx.m_ulTail = g_hAudio.m_tRx.m_ulHead;
+    audio_fifo_start(&g_hAudio.m_tRx);
+    g_tHostStats.m_ullCaptureStart = g_hAudio.m_tRx.m_ullStart;
+    taskEXIT_CRITICAL();
+}
+
+void i2s_stop_rx(void)
+{
+    taskENTER_CRITICAL();
+    g_hAudio.m_tRx.m_ucRunning = 0;
+    if (!g_tHostStats.m_ullCaptureEnd) {
+        host_stats_mark(&g_tHostStats.m_ullCaptureEnd);
+    }
+    taskEXIT_CRITICAL();
+}
+
+uint16_t i2s_write(const uint8_t *data, const uint16_t num_bytes)
+{
+    AudioHostFifo* pFifo = &g_hAudio.m_tTx;
+    uint16_t uwWritten = 0;
+
+
+    taskENTER_CRITICAL();
+    if (num_bytes && !g_tHostStats.m_ullPlayStart) {
+        host_stats_mark(&g_tHostStats.m_ullPlayStart);
+    }
+    while (uwWritten < num_bytes && audio_fifo_level(pFifo) < AUDIO_FIFO_SIZE) {
+        pFifo->m_aucData[pFifo->m_ulHead % AUDIO_FIFO_SIZE] = data[uwWritten++];
+        pFifo->m_ulHead++;
+    }
+    g_tHostStats.m_ullI2S += uwWritten;
+    taskEXIT_CRITICAL();
+
+    return uwWritten;
+}
+
+uint16_t i2s_read(uint8_t *data, const uint16_t num_bytes)
+{
+    AudioHostFifo* pFifo = &g_hAudio.m_tRx;
+    uint16_t uwRead = 0;
+
+
+    taskENTER_CRITICAL();
+    while (uwRead < num_bytes && audio_fifo_level(pFifo)) {
+        data[uwRead++] = pFifo->m_aucData[pFifo->m_ulTail % AUDIO_FIFO_SIZE];
+        pFifo->m_ulTail++;
+    }
+    // Reading an empty FIFO returns zeros
+    memset(data + uwRead, 0, num_bytes - uwRead);
+    g_tHostStats.m_ullI2S += num_bytes;
+    taskEXIT_CRITICAL();
+
+    return num_bytes;
+}
+
+uint16_t i2s_get_status(void)
+{
+    return g_tI2S.I2S_IRQ_PEND;
+}
+
+void i2s_clear_int_flag(uint16_t mask)
+{
+    taskENTER_CRITICAL();
+    g_tI2S.I2S_IRQ_PEND &= ~mask;
+    taskEXIT_CRITICAL();
+}
+
+void i2s_enable_int(uint16_t mask)
+{
+    taskENTER_CRITICAL();
+    g_tI2S.I2S_IRQ_EN |= mask;
+    taskEXIT_CRITICAL();
+}
+
+void i2s_disable_int(uint16_t mask)
+{
+    taskENTER_CRITICAL();
+    g_tI2S.I2S_IRQ_EN &= ~mask;
+    taskEXIT_CRITICAL();
+}
+
+
+
+/////////////////////////////////////////////////////////////////////////////////////////////
+// Speaker and Microphone setup
+/////////////////////////////////////////////////////////////////////////////////////////////
+void audio_setup(void (*audio_isr)(void), int sampling_rate)
+{
+    uint32_t ulRate = 16000;
+
+    switch (sampling_rate) {
+        case SAMPLING_RATE_44100HZ: ulRate = 44100; break;
+        case SAMPLING_RATE_48KHZ:   ulRate = 48000; break;
+        case SAMPLING_RATE_32KHZ:   ulRate = 32000; break;
+        case SAMPLING_RATE_8KHZ:    ulRate = 8000;  break;
+        default: break;
+    }
+
+    taskENTER_CRITICAL();
+    g_hAudio.m_ulBytesPerSecond = ulRate * AUDIO_HOST_FRAME_SIZE;
+    if (!g_hAudio.m_ulSpeed) {
+        g_hAudio.m_ulSpeed = 1;
+    }
+    g_tI2S.I2S_IRQ_EN = 0;
+    g_tI2S.I2S_IRQ_PEND = 0;
+    if (!g_hAudio.m_fxnIsr) {
+        g_hAudio.m_fxnIsr = audio_isr;
+        pthread_create(&g_xClock, NULL, audio_clock_thread, NULL);
+    }
+    g_hAudio.m_fxnIsr = audio_isr;
+    taskEXIT_CRITICAL();
+}
+
+void host_audio_set_speed(uint32_t ulSpeed)
+{
+    g_hAudio.m_ulSpeed = ulSpeed ? ulSpeed : 1;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////
+// Loads the microphone source; the 44-byte header of a WAV file is skipped
+/////////////////////////////////////////////////////////////////////////////////////////////
+int host_audio_set_source(const char* pcFileName)
+{
+    FILE* pFile = fopen(pcFileName, "rb");
+    char* pcSource = NULL;
+    long lSize = 0;
+
+
+    if (!pFile) {
+        return 0;
+    }
+    fseek(pFile, 0, SEEK_END);
+    lSize = ftell(pFile);
+    fseek(pFile, 0, SEEK_SET);
+    pcSource = malloc(lSize > 0 ? lSize : 1);
+    if (!pcSource || fread(pcSource, 1, lSize, pFile) != (size_t)lSize) {
+        free(pcSource);
+        fclose(pFile);
+        return 0;
+    }
+    fclose(pFile);
+
+    taskENTER_CRITICAL();
+    free(g_hAudio.m_pcSource);
+    g_hAudio.m_pcSource = pcSource;
+    g_hAudio.m_ulSourceSize = lSize;
+    g_hAudio.m_ulSourceOffset = 0;
+    if (lSize >= WAV_HEADER_SIZE && !memcmp(pcSource, "RIFF", 4)) {
+        g_hAudio.m_ulSourceOffset = WAV_HEADER_SIZE;
+    }
+    taskEXIT_CRITICAL();
+
+    return 1;
+}
+
+int host_audio_source_ended(void)
+{
+    return g_hAudio.m_ulSourceOffset + sizeof(int16_t) > g_hAudio.m_ulSourceSize;
+}
+
+static void audio_sink_header(void)
+{
+    uint32_t ulRate = g_hAudio.m_ulBytesPerSecond / AUDIO_HOST_FRAME_SIZE;
+    uint8_t aucHeader[WAV_HEADER_SIZE];
+    uint32_t aulFields[] = {
+        36 + g_hAudio.m_ulSinkSize, 16, 1 | (2 << 16), ulRate, ulRate * AUDIO_HOST_FRAME_SIZE,
+        AUDIO_HOST_FRAME_SIZE | (16 << 16), g_hAudio.m_ulSinkSize
+    };
+
+    // Little-endian host
+    memcpy(aucHeader +  0, "RIFF", 4);
+    memcpy(aucHeader +  4, &aulFields[0], 4);
+    memcpy(aucHeader +  8, "WAVEfmt ", 8);
+    memcpy(aucHeader + 16, &aulFields[1], 20);
+    memcpy(aucHeader + 36, "data", 4);
+    memcpy(aucHeader + 40, &aulFields[6], 4);
+    fseek(g_hAudio.m_pSink, 0, SEEK_SET);
+    fwrite(aucHeader, 1, sizeof(aucHeader), g_hAudio.m_pSink);
+    fseek(g_hAudio.m_pSink, 0, SEEK_END);
+}
+
+int host_audio_set_sink(const char* pcFileName)
+{
+    FILE* pFile = fopen(pcFileName, "wb");
+
+    if (!pFile) {
+        return 0;
+    }
+
+    taskENTER_CRITICAL();
+    g_hAudio.m_pSink = pFile;
+    g_hAudio.m_ulSinkSize = 0;
+    audio_sink_header();
+    taskEXIT_CRITICAL();
+
+    return 1;
+}
+
+void host_audio_close_sink(void)
+{
+    taskENTER_CRITICAL();
+    if (g_hAudio.m_pSink) {
+        audio_sink_header();
+        fclose(g_hAudio.m_pSink);
+        g_hAudio.m_pSink = NULL;
+    }
+    taskEXIT_CRITICAL();
+}
+
+
+
+/////////////////////////////////////////////////////////////////////////////////////////////
+// Volume control
+// The codec registers are kept; the gain table of the board is computed (1 percent is 0.8dB)
+/////////////////////////////////////////////////////////////////////////////////////////////
+static int audio_clamp_volume(int percent)
+{
+    if (percent > 100) {
+        return 100;
+    }
+    else if (percent < 0) {
+        return 0;
+    }
+    return percent;
+}
+
+int32_t audio_speaker_volume_to_gain(int percent)
+{
+    if (percent <= 0) {
+        return AUDIO_GAIN_UNITY;
+    }
+    else if (percent >= 100) {
+        return 0;
+    }
+    return (int32_t)(32767 * pow(10, -0.04 * percent));
+}
+
+void audio_speaker_set_volume(int percent)
+{
+    g_hAudio.m_lSpeakerVolume = audio_clamp_volume(percent);
+}
+
+int audio_speaker_get_volume(void)
+{
+    return g_hAudio.m_lSpeakerVolume;
+}
+
+void audio_mic_set_volume(int percent)
+{
+    g_hAudio.m_lMicVolume = audio_clamp_volume(percent);
+}
+
+int audio_mic_get_volume(void)
+{
+    return g_hAudio.m_lMicVolume;
+}
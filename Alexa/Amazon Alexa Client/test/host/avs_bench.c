@@ -0,0 +1,401 @@
+/**
+  @file avs_bench.c
+  @brief
+  Host build of libavs
+  Latency benchmark of the request and response pipeline
+  - Commander task like Sources/main.c: records or reads test/REQUESTn.RAW and sends it
+  - Streamer task like Sources/main.c: receives and plays the response
+  The loopback gateway sends each request back as its response.
+  For each request it reports in milliseconds
+  - rec->send: end of the speech (or start of the upload from the SD card) to the end of the upload
+  - ttfb:      end of the upload to the first byte of the response
+  - play:      end of the upload to the first samples written to the speaker
+  and the bytes copied per second of request audio.
+
+ */
+/*
+ * ============================================================================
+ * History
+ * =======
+ * 2026-10-16 : Created v1
+ *
+ * ============================================================================
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "FreeRTOS.h"
+#include "task.h"
+#include "avs_config.h"
+#include "avs/avs.h"
+#include "host.h"
+#include "loopback.h"
+
+
+
+#define BENCH_REQUESTS          8
+#define BENCH_AUDIO_RATE        (16000 * 2) // bytes per second of test/REQUESTn.RAW, 16-bit mono 16KHz
+#define BENCH_TIMEOUT_MS        (10000)     // added to twice the request duration
+
+#define BENCH_MODE_STREAM       0 // avs_record_and_send_request, microphone to socket
+#define BENCH_MODE_RECORD       1 // avs_record_request then avs_send_request, through the SD card
+#define BENCH_MODE_FILE         2 // avs_send_request of the file of the test directory
+
+#define TASK_BENCH_STACK_SIZE   (1024)
+#define TASK_BENCH_PRIORITY     (1)
+
+
+typedef struct _BenchResult {
+    double m_dAudio;            // seconds of request audio
+    double m_dRecordToSend;     // ms
+    double m_dFirstByte;        // ms
+    double m_dPlayStart;        // ms
+    double m_adCopied[5];       // bytes per second of audio: memcpy, convert, socket, sdcard, i2s
+    unsigned int m_ulUnderruns;
+} BenchResult;
+
+typedef struct _BenchOptions {
+    int m_lMode;
+    const char* m_pcTestDir;
+    const char* m_pcWorkDir;
+    const char* m_pcSink;
+    const char* m_pcTrace;
+    int m_lRepeat;
+    uint32_t m_ulSpeed;
+    uint32_t m_ulThinkMs;
+    int m_bExternal;
+    int m_alRequests[BENCH_REQUESTS];
+    int m_lRequests;
+} BenchOptions;
+
+static BenchOptions g_tOptions = {BENCH_MODE_STREAM, "../../test", ".", NULL, NULL, 1, 1, 0, 0, {0}, 0};
+static TaskHandle_t g_xCommander = NULL;
+static volatile int g_lResponse = 0;
+static volatile char g_cConnected = 0; // the streamer waits for the handshake of avs_connect
+static FILE* g_pTrace = NULL;
+
+static const char* g_pcMode[] = {"stream", "record", "file"};
+static const char* g_pcCopied[] = {"memcpy", "convert", "socket", "sdcard", "i2s"};
+
+
+
+static char cbRecordVoice(void)
+{
+    return !host_audio_source_ended();
+}
+
+static char cbSendTriggered(void)
+{
+    return 0;
+}
+
+static void cbDumpTrace(const void* pvData, unsigned int ulSize)
+{
+    fwrite(pvData, 1, ulSize, g_pTrace);
+}
+
+static double bench_ms(uint64_t ullFrom, uint64_t ullTo)
+{
+    if (!ullFrom || !ullTo) {
+        return -1;
+    }
+    return ((double)ullTo - (double)ullFrom) / 1000;
+}
+
+static void bench_print(const char* pcName, const BenchResult* pResult)
+{
+    double dTotal = 0;
+
+    for (int i=0; i<5; i++) {
+        dTotal += pResult->m_adCopied[i];
+    }
+    printf("%-14s %6.2f %9.1f %8.1f %8.1f %9.0f", pcName, pResult->m_dAudio,
+        pResult->m_dRecordToSend, pResult->m_dFirstByte, pResult->m_dPlayStart, dTotal / 1024);
+    for (int i=0; i<5; i++) {
+        printf(" %7.0f", pResult->m_adCopied[i] / 1024);
+    }
+    printf(" %4u\n", pResult->m_ulUnderruns);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////
+// Sends one request and waits until its response has been played
+/////////////////////////////////////////////////////////////////////////////////////////////
+static int bench_request(int lRequest, BenchResult* pResult)
+{
+    char acFileName[16];
+    char acPath[512];
+    struct stat tStat;
+    uint64_t ullStart, ullSent;
+    unsigned int ulUnderruns = avs_get_jitter_underruns();
+    int lRet = 0;
+
+
+    snprintf(acFileName, sizeof(acFileName), "REQUEST%d.RAW", lRequest);
+    snprintf(acPath, sizeof(acPath), "%s/%s", g_tOptions.m_pcTestDir, acFileName);
+    if (stat(acPath, &tStat)) {
+        printf("%s not found\n", acPath);
+        return 0;
+    }
+    pResult->m_dAudio = (double)tStat.st_size / BENCH_AUDIO_RATE;
+
+    host_stats_reset();
+    g_lResponse = 0;
+    ulTaskNotifyTake(pdTRUE, 0);
+
+    if (g_tOptions.m_lMode != BENCH_MODE_FILE && !host_audio_set_source(acPath)) {
+        printf("%s cannot be read\n", acPath);
+        return 0;
+    }
+    ullStart = host_time_us();
+    switch (g_tOptions.m_lMode) {
+        case BENCH_MODE_STREAM:
+            lRet = avs_record_and_send_request(cbRecordVoice);
+            break;
+        case BENCH_MODE_RECORD:
+            if (avs_record_request(acFileName, cbRecordVoice) > 0) {
+                lRet = avs_send_request(acFileName);
+            }
+            break;
+        default:
+            lRet = avs_send_request(acFileName);
+            break;
+    }
+    ullSent = host_time_us();
+    if (lRet <= 0) {
+        printf("%s send failed %d\n", acFileName, lRet);
+        return 0;
+    }
+
+    // The streamer notifies once the response has been played
+    TickType_t xTimeout = pdMS_TO_TICKS(g_tOptions.m_ulThinkMs + BENCH_TIMEOUT_MS + pResult->m_dAudio * 2000);
+    while (!g_lResponse) {
+        if (!ulTaskNotifyTake(pdTRUE, xTimeout)) {
+            printf("%s response timed out\n", acFileName);
+            return 0;
+        }
+    }
+
+    if (g_tOptions.m_lMode == BENCH_MODE_FILE) {
+        pResult->m_dRecordToSend = bench_ms(ullStart, ullSent);
+    }
+    else {
+        // The end of the speech found by the VAD, else the end of the recording
+        uint64_t ullSpeechEnd = g_tHostStats.m_ullCaptureEnd;
+        if (avs_get_speech_end() && g_tHostStats.m_ullCaptureStart) {
+            ullSpeechEnd = g_tHostStats.m_ullCaptureStart + (uint64_t)avs_get_speech_end() * 1000 / g_tOptions.m_ulSpeed;
+        }
+        pResult->m_dRecordToSend = bench_ms(ullSpeechEnd, ullSent);
+    }
+    pResult->m_dFirstByte = bench_ms(ullSent, g_tHostStats.m_ullFirstRecv);
+    pResult->m_dPlayStart = bench_ms(ullSent, g_tHostStats.m_ullPlayStart);
+    pResult->m_adCopied[0] = g_tHostStats.m_ullMemcpy / pResult->m_dAudio;
+    pResult->m_adCopied[1] = g_tHostStats.m_ullConvert / pResult->m_dAudio;
+    pResult->m_adCopied[2] = g_tHostStats.m_ullSocket / pResult->m_dAudio;
+    pResult->m_adCopied[3] = g_tHostStats.m_ullSDCard / pResult->m_dAudio;
+    pResult->m_adCopied[4] = g_tHostStats.m_ullI2S / pResult->m_dAudio;
+    pResult->m_ulUnderruns = avs_get_jitter_underruns() - ulUnderruns;
+    return 1;
+}
+
+static void vTaskBenchCommander(void *pvParameters)
+{
+    BenchResult tTotal = {0};
+    int lResults = 0;
+    int lFailed = 0;
+    (void) pvParameters;
+
+
+    if (!avs_init()) {
+        printf("avs_init failed\n");
+        exit(1);
+    }
+    if (!avs_connect()) {
+        printf("avs_connect failed\n");
+        exit(1);
+    }
+    g_cConnected = 1;
+
+    printf("mode %s, speed x%u, think %u ms; copied in KB per second of request audio\n",
+        g_pcMode[g_tOptions.m_lMode], g_tOptions.m_ulSpeed, g_tOptions.m_ulThinkMs);
+    printf("%-14s %6s %9s %8s %8s %9s", "request", "audio", "rec->send", "ttfb", "play", "copied");
+    for (int i=0; i<5; i++) {
+        printf(" %7s", g_pcCopied[i]);
+    }
+    printf(" %4s\n", "jitr");
+
+    for (int r=0; r<g_tOptions.m_lRepeat; r++) {
+        for (int i=0; i<g_tOptions.m_lRequests; i++) {
+            BenchResult tResult = {0};
+            char acName[16];
+
+            if (!bench_request(g_tOptions.m_alRequests[i], &tResult)) {
+                lFailed++;
+                if (!avs_isconnected()) {
+                    g_cConnected = 0;
+                    if (!avs_connect()) {
+                        printf("avs_connect failed\n");
+                        exit(1);
+                    }
+                    g_cConnected = 1;
+                }
+                continue;
+            }
+            snprintf(acName, sizeof(acName), "REQUEST%d.RAW", g_tOptions.m_alRequests[i]);
+            bench_print(acName, &tResult);
+            if (g_pTrace) {
+                avs_trace_dump(cbDumpTrace);
+            }
+
+            tTotal.m_dAudio += tResult.m_dAudio;
+            tTotal.m_dRecordToSend += tResult.m_dRecordToSend;
+            tTotal.m_dFirstByte += tResult.m_dFirstByte;
+            tTotal.m_dPlayStart += tResult.m_dPlayStart;
+            for (int j=0; j<5; j++) {
+                tTotal.m_adCopied[j] += tResult.m_adCopied[j] * tResult.m_dAudio;
+            }
+            tTotal.m_ulUnderruns += tResult.m_ulUnderruns;
+            lResults++;
+        }
+    }
+
+    // Latencies are averaged per request and copies per second of all the audio
+    if (lResults) {
+        tTotal.m_dRecordToSend /= lResults;
+        tTotal.m_dFirstByte /= lResults;
+        tTotal.m_dPlayStart /= lResults;
+        for (int j=0; j<5; j++) {
+            tTotal.m_adCopied[j] /= tTotal.m_dAudio;
+        }
+        bench_print("average", &tTotal);
+    }
+    if (lFailed) {
+        printf("%d requests failed\n", lFailed);
+    }
+
+    avs_disconnect();
+    host_audio_close_sink();
+    if (g_pTrace) {
+        fclose(g_pTrace);
+    }
+    exit(lFailed ? 1 : 0);
+}
+
+static void vTaskBenchStreamer(void *pvParameters)
+{
+    (void) pvParameters;
+
+    while (1) {
+        if (!g_cConnected || !avs_isconnected()) {
+            vTaskDelay(pdMS_TO_TICKS(10));
+            continue;
+        }
+
+        int lRet = avs_recv_and_play_response_threaded(cbSendTriggered);
+        if (lRet > 0) {
+            g_lResponse = lRet;
+            xTaskNotifyGive(g_xCommander);
+        }
+        else if (lRet == 0) {
+            vTaskDelay(pdMS_TO_TICKS(10));
+        }
+    }
+}
+
+
+
+static void usage(const char* pcName)
+{
+    printf("usage: %s [options] [request numbers 1-%d]\n"
+        "  -m mode     stream (default), record or file\n"
+        "  -d dir      directory of REQUESTn.RAW (%s)\n"
+        "  -w dir      SD card directory of the record mode (%s)\n"
+        "  -o file     write the speaker output to a WAV file\n"
+        "  -e file     write the event trace of each request (AVS_CONFIG_TRACE) for avs_trace\n"
+        "  -n count    repeat the requests\n"
+        "  -s speed    run the audio clock faster than real time\n"
+        "  -t ms       think time of the loopback gateway\n"
+        "  -x          use the gateway at AVS_CONFIG_SERVER_ADDR instead of the loopback\n",
+        pcName, BENCH_REQUESTS, g_tOptions.m_pcTestDir, g_tOptions.m_pcWorkDir);
+}
+
+int main(int argc, char** argv)
+{
+    int lOption;
+
+
+    setvbuf(stdout, NULL, _IOLBF, 0);
+    while ((lOption = getopt(argc, argv, "m:d:w:o:e:n:s:t:xh")) != -1) {
+        switch (lOption) {
+            case 'm':
+                for (g_tOptions.m_lMode=0; g_tOptions.m_lMode<3; g_tOptions.m_lMode++) {
+                    if (!strcmp(optarg, g_pcMode[g_tOptions.m_lMode])) {
+                        break;
+                    }
+                }
+                if (g_tOptions.m_lMode == 3) {
+                    usage(argv[0]);
+                    return 1;
+                }
+                break;
+            case 'd': g_tOptions.m_pcTestDir = optarg; break;
+            case 'w': g_tOptions.m_pcWorkDir = optarg; break;
+            case 'o': g_tOptions.m_pcSink = optarg; break;
+            case 'e': g_tOptions.m_pcTrace = optarg; break;
+            case 'n': g_tOptions.m_lRepeat = atoi(optarg); break;
+            case 's': g_tOptions.m_ulSpeed = atoi(optarg); break;
+            case 't': g_tOptions.m_ulThinkMs = atoi(optarg); break;
+            case 'x': g_tOptions.m_bExternal = 1; break;
+            default: usage(argv[0]); return 1;
+        }
+    }
+    for (; optind < argc && g_tOptions.m_lRequests < BENCH_REQUESTS; optind++) {
+        int lRequest = atoi(argv[optind]);
+        if (lRequest < 1 || lRequest > BENCH_REQUESTS) {
+            usage(argv[0]);
+            return 1;
+        }
+        g_tOptions.m_alRequests[g_tOptions.m_lRequests++] = lRequest;
+    }
+    if (!g_tOptions.m_lRequests) {
+        for (int i=0; i<BENCH_REQUESTS; i++) {
+            g_tOptions.m_alRequests[g_tOptions.m_lRequests++] = i + 1;
+        }
+    }
+
+    host_audio_set_speed(g_tOptions.m_ulSpeed);
+    host_sdcard_set_root(g_tOptions.m_lMode == BENCH_MODE_FILE ? g_tOptions.m_pcTestDir : g_tOptions.m_pcWorkDir);
+    if (g_tOptions.m_pcSink && !host_audio_set_sink(g_tOptions.m_pcSink)) {
+        printf("%s cannot be written\n", g_tOptions.m_pcSink);
+        return 1;
+    }
+    if (g_tOptions.m_pcTrace && !(g_pTrace = fopen(g_tOptions.m_pcTrace, "wb"))) {
+        printf("%s cannot be written\n", g_tOptions.m_pcTrace);
+        return 1;
+    }
+
+    if (!g_tOptions.m_bExternal) {
+        TLoopbackConfig tConfig = {AVS_CONFIG_SERVER_PORT, g_tOptions.m_ulThinkMs, 1024, 0};
+        if (!loopback_start(&tConfig)) {
+            printf("loopback: port %d cannot be opened\n", AVS_CONFIG_SERVER_PORT);
+            return 1;
+        }
+    }
+
+    if (xTaskCreate(vTaskBenchCommander, "Commander", TASK_BENCH_STACK_SIZE,
+        NULL, TASK_BENCH_PRIORITY, &g_xCommander) != pdTRUE) {
+        printf("vTaskBenchCommander failed\n");
+        return 1;
+    }
+    if (xTaskCreate(vTaskBenchStreamer, "Streamer", TASK_BENCH_STACK_SIZE,
+        NULL, TASK_BENCH_PRIORITY, NULL) != pdTRUE) {
+        printf("vTaskBenchStreamer failed\n");
+        return 1;
+    }
+
+    vTaskStartScheduler();
+    return 0;
+}
@@ -0,0 +1,56 @@
+/**
+  @file avs_loopback.c
+  @brief
+  Host build of libavs
+  Loopback stand-in of the Alexa gateway for a board or another host
+
+ */
+/*
+ * ============================================================================
+ * History
+ * =======
+ * 2026-10-16 : Created v1
+ *
+ * ============================================================================
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "loopback.h"
+
+
+
+static void usage(const char* pcName)
+{
+    printf("usage: %s [-p port] [-t think_ms] [-f frame_size] [-q]\n", pcName);
+}
+
+int main(int argc, char** argv)
+{
+    TLoopbackConfig tConfig = {11234, 0, 1024, 1};
+    int lOption;
+
+
+    setvbuf(stdout, NULL, _IOLBF, 0);
+    while ((lOption = getopt(argc, argv, "p:t:f:qh")) != -1) {
+        switch (lOption) {
+            case 'p': tConfig.m_uwPort = atoi(optarg); break;
+            case 't': tConfig.m_ulThinkMs = atoi(optarg); break;
+            case 'f': tConfig.m_ulFrameSize = atoi(optarg); break;
+            case 'q': tConfig.m_ucVerbose = 0; break;
+            default: usage(argv[0]); return 1;
+        }
+    }
+    if (!tConfig.m_ulFrameSize) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    printf("loopback: listening on port %d\n", tConfig.m_uwPort);
+    if (!loopback_run(&tConfig)) {
+        printf("loopback: port %d cannot be opened\n", tConfig.m_uwPort);
+        return 1;
+    }
+    return 0;
+}
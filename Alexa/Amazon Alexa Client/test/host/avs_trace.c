@@ -0,0 +1,319 @@
+/**
+  @file avs_trace.c
+  @brief
+  Host build of libavs
+  Decoder of the event trace (AVS_CONFIG_TRACE)
+  Reads the dumps of avs_trace_dump in files written by avs_bench -e or raw captures of the
+  FT900 UART (the dumps are found by their magic between the logs) and prints the percentiles of
+  - the stages of each request: capture, upload, time to first byte, first sample played
+  - the durations of the encoding, decoding, SD card and communication calls
+  - the watermarks of the microphone ring and the jitter buffer
+
+ */
+/*
+ * ============================================================================
+ * History
+ * =======
+ * 2026-10-16 : Created v1
+ *
+ * ============================================================================
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "trace.h"
+
+
+
+#define TRACE_UNIT_MS           0 // stages, from one event to another
+#define TRACE_UNIT_US           1 // durations carried by the events
+#define TRACE_UNIT_BYTES        2 // watermarks carried by the events
+
+typedef struct _TraceStage {
+    const char* m_pcName;
+    ETraceEvent m_eFrom;
+    ETraceEvent m_eTo;
+} TraceStage;
+
+typedef struct _TraceSamples {
+    double* m_pdValues;
+    uint32_t m_ulCount;
+    uint32_t m_ulSize;
+} TraceSamples;
+
+static const char* g_pcEvent[TRACE_EVENT_COUNT] = {
+    "none",
+    "capture_begin", "capture_end", "vad_end", "send_begin", "send_end", "encode",
+    "response_begin", "response_end", "decode", "play_begin", "play_end",
+    "sdcard_read", "sdcard_write", "comm_send", "comm_recv",
+    "mic_high", "jitter_low", "jitter_prebuffer",
+};
+
+// Stages of a request, in milliseconds
+static const TraceStage g_atStage[] = {
+    {"capture",         TRACE_CAPTURE_BEGIN,  TRACE_CAPTURE_END},
+    {"vad->sent",       TRACE_VAD_END,        TRACE_SEND_END},
+    {"captured->sent",  TRACE_CAPTURE_END,    TRACE_SEND_END},
+    {"upload",          TRACE_SEND_BEGIN,     TRACE_SEND_END},
+    {"ttfb",            TRACE_SEND_END,       TRACE_RESPONSE_BEGIN},
+    {"response->play",  TRACE_RESPONSE_BEGIN, TRACE_PLAY_BEGIN},
+    {"sent->play",      TRACE_SEND_END,       TRACE_PLAY_BEGIN},
+    {"receive",         TRACE_RESPONSE_BEGIN, TRACE_RESPONSE_END},
+    {"playback",        TRACE_PLAY_BEGIN,     TRACE_PLAY_END},
+};
+#define TRACE_STAGES (sizeof(g_atStage) / sizeof(g_atStage[0]))
+
+// Events carrying a duration or a watermark
+static const ETraceEvent g_aeCall[] = {
+    TRACE_ENCODE, TRACE_DECODE, TRACE_SDCARD_READ, TRACE_SDCARD_WRITE, TRACE_COMM_SEND, TRACE_COMM_RECV,
+};
+static const ETraceEvent g_aeLevel[] = {
+    TRACE_MIC_HIGH, TRACE_JITTER_LOW, TRACE_JITTER_PREBUFFER,
+};
+#define TRACE_CALLS  (sizeof(g_aeCall) / sizeof(g_aeCall[0]))
+#define TRACE_LEVELS (sizeof(g_aeLevel) / sizeof(g_aeLevel[0]))
+
+static TraceSamples g_atStageSamples[TRACE_STAGES];
+static TraceSamples g_atEventSamples[TRACE_EVENT_COUNT];
+static uint32_t g_ulRequests = 0;
+static int g_bRaw = 0;
+
+
+
+static int trace_is_call(ETraceEvent eEvent)
+{
+    for (uint32_t i=0; i<TRACE_CALLS; i++) {
+        if (g_aeCall[i] == eEvent) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static void trace_add(TraceSamples* pSamples, double dValue)
+{
+    if (pSamples->m_ulCount == pSamples->m_ulSize) {
+        pSamples->m_ulSize = pSamples->m_ulSize ? pSamples->m_ulSize * 2 : 64;
+        pSamples->m_pdValues = realloc(pSamples->m_pdValues, pSamples->m_ulSize * sizeof(double));
+        if (!pSamples->m_pdValues) {
+            perror("realloc");
+            exit(1);
+        }
+    }
+    pSamples->m_pdValues[pSamples->m_ulCount++] = dValue;
+}
+
+static int trace_compare(const void* pvA, const void* pvB)
+{
+    double dA = *(const double*)pvA;
+    double dB = *(const double*)pvB;
+    return (dA > dB) - (dA < dB);
+}
+
+// Nearest-rank percentile of sorted samples
+static double trace_percentile(const TraceSamples* pSamples, uint32_t ulPercent)
+{
+    uint32_t ulRank = (pSamples->m_ulCount * ulPercent + 99) / 100;
+    return pSamples->m_pdValues[ulRank ? ulRank - 1 : 0];
+}
+
+static void trace_print(const char* pcName, TraceSamples* pSamples, int lUnit)
+{
+    static const char* pcFormat[] = {" %9.1f", " %9.0f", " %9.0f"};
+
+    if (!pSamples->m_ulCount) {
+        return;
+    }
+    qsort(pSamples->m_pdValues, pSamples->m_ulCount, sizeof(double), trace_compare);
+    printf("%-18s %6u", pcName, pSamples->m_ulCount);
+    printf(pcFormat[lUnit], pSamples->m_pdValues[0]);
+    printf(pcFormat[lUnit], trace_percentile(pSamples, 50));
+    printf(pcFormat[lUnit], trace_percentile(pSamples, 90));
+    printf(pcFormat[lUnit], trace_percentile(pSamples, 99));
+    printf(pcFormat[lUnit], pSamples->m_pdValues[pSamples->m_ulCount - 1]);
+    printf("\n");
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////
+// Groups the events into requests and collects the samples
+// A request starts with its capture or its upload, whichever comes first
+// (avs_record_and_send_request starts the upload before the capture);
+// its stages are measured from the first event of each kind.
+/////////////////////////////////////////////////////////////////////////////////////////////
+static void trace_process(const TTraceRecord* pRecords, uint32_t ulCount, uint32_t ulFrequency)
+{
+    static uint32_t aulTime[TRACE_EVENT_COUNT];
+    static char abSeen[TRACE_EVENT_COUNT];
+    static uint32_t ulFirst = 0;
+    static int bFirst = 1;
+    static int bRequest = 0;
+    double dTicksPerUs = (double)ulFrequency / 1000000;
+
+
+    for (uint32_t i=0; i<ulCount; i++) {
+        uint32_t ulTime = pRecords[i].m_ulTime;
+        ETraceEvent eEvent = (ETraceEvent)(pRecords[i].m_ulEvent & 0xFF);
+        uint32_t ulValue = pRecords[i].m_ulEvent >> 8;
+
+        if (eEvent <= TRACE_NONE || eEvent >= TRACE_EVENT_COUNT) {
+            continue;
+        }
+        if (bFirst) {
+            ulFirst = ulTime;
+            bFirst = 0;
+        }
+        if (g_bRaw) {
+            printf("%12.3f ms  %-18s %u%s\n", (uint32_t)(ulTime - ulFirst) / dTicksPerUs / 1000, g_pcEvent[eEvent],
+                trace_is_call(eEvent) ? (unsigned int)(ulValue / dTicksPerUs) : ulValue,
+                trace_is_call(eEvent) ? " us" : "");
+        }
+
+        // New request
+        if ((eEvent == TRACE_CAPTURE_BEGIN || eEvent == TRACE_SEND_BEGIN) &&
+            (!bRequest || abSeen[eEvent] || abSeen[TRACE_SEND_END] || abSeen[TRACE_RESPONSE_BEGIN])) {
+            memset(abSeen, 0, sizeof(abSeen));
+            bRequest = 1;
+            g_ulRequests++;
+        }
+
+        switch (eEvent) {
+            case TRACE_ENCODE:
+            case TRACE_DECODE:
+            case TRACE_SDCARD_READ:
+            case TRACE_SDCARD_WRITE:
+            case TRACE_COMM_SEND:
+            case TRACE_COMM_RECV:
+                trace_add(&g_atEventSamples[eEvent], ulValue / dTicksPerUs);
+                continue;
+            case TRACE_MIC_HIGH:
+            case TRACE_JITTER_LOW:
+            case TRACE_JITTER_PREBUFFER:
+                trace_add(&g_atEventSamples[eEvent], ulValue);
+                continue;
+            default:
+                break;
+        }
+
+        // Stages ending with this event
+        if (abSeen[eEvent]) {
+            continue;
+        }
+        abSeen[eEvent] = 1;
+        aulTime[eEvent] = ulTime;
+        for (uint32_t j=0; j<TRACE_STAGES; j++) {
+            if (g_atStage[j].m_eTo == eEvent && abSeen[g_atStage[j].m_eFrom]) {
+                uint32_t ulTicks = ulTime - aulTime[g_atStage[j].m_eFrom];
+                trace_add(&g_atStageSamples[j], ulTicks / dTicksPerUs / 1000);
+            }
+        }
+    }
+}
+
+// Finds the dumps in the file; returns the number of dumps
+static int trace_read(const char* pcFileName)
+{
+    FILE* pFile = fopen(pcFileName, "rb");
+    unsigned char* pucData = NULL;
+    long lSize = 0;
+    int lDumps = 0;
+
+
+    if (!pFile) {
+        perror(pcFileName);
+        return -1;
+    }
+    fseek(pFile, 0, SEEK_END);
+    lSize = ftell(pFile);
+    fseek(pFile, 0, SEEK_SET);
+    pucData = malloc(lSize ? lSize : 1);
+    if (!pucData || fread(pucData, 1, lSize, pFile) != (size_t)lSize) {
+        perror(pcFileName);
+        fclose(pFile);
+        free(pucData);
+        return -1;
+    }
+    fclose(pFile);
+
+    for (long lOffset = 0; lOffset + (long)sizeof(TTraceHeader) <= lSize; ) {
+        TTraceHeader tHeader;
+        memcpy(&tHeader, pucData + lOffset, sizeof(tHeader));
+        if (tHeader.m_ulMagic != TRACE_MAGIC || tHeader.m_uwVersion != TRACE_VERSION ||
+            tHeader.m_uwRecordSize != sizeof(TTraceRecord) || !tHeader.m_ulFrequency) {
+            lOffset++;
+            continue;
+        }
+        lOffset += sizeof(tHeader);
+        if ((uint64_t)tHeader.m_ulCount * sizeof(TTraceRecord) > (uint64_t)(lSize - lOffset)) {
+            printf("%s: dump %d truncated\n", pcFileName, lDumps + 1);
+            tHeader.m_ulCount = (lSize - lOffset) / sizeof(TTraceRecord);
+        }
+        if (tHeader.m_ulLost) {
+            printf("%s: dump %d lost %u events; dump more often or raise AVS_CONFIG_TRACE_EVENTS\n",
+                pcFileName, lDumps + 1, tHeader.m_ulLost);
+        }
+
+        TTraceRecord* pRecords = malloc(tHeader.m_ulCount * sizeof(TTraceRecord) + 1);
+        memcpy(pRecords, pucData + lOffset, tHeader.m_ulCount * sizeof(TTraceRecord));
+        trace_process(pRecords, tHeader.m_ulCount, tHeader.m_ulFrequency);
+        free(pRecords);
+
+        lOffset += tHeader.m_ulCount * sizeof(TTraceRecord);
+        lDumps++;
+    }
+
+    free(pucData);
+    return lDumps;
+}
+
+static void usage(const char* pcName)
+{
+    printf("usage: %s [-r] file...\n"
+        "  -r          list the events\n", pcName);
+}
+
+int main(int argc, char** argv)
+{
+    int lOption;
+    int lDumps = 0;
+
+
+    while ((lOption = getopt(argc, argv, "rh")) != -1) {
+        switch (lOption) {
+            case 'r': g_bRaw = 1; break;
+            default: usage(argv[0]); return 1;
+        }
+    }
+    if (optind == argc) {
+        usage(argv[0]);
+        return 1;
+    }
+    for (; optind < argc; optind++) {
+        int lRet = trace_read(argv[optind]);
+        if (lRet < 0) {
+            return 1;
+        }
+        lDumps += lRet;
+    }
+    if (!lDumps) {
+        printf("no event trace found\n");
+        return 1;
+    }
+
+    printf("%d dumps, %u requests\n", lDumps, g_ulRequests);
+    printf("%-18s %6s %9s %9s %9s %9s %9s\n", "stage (ms)", "count", "min", "p50", "p90", "p99", "max");
+    for (uint32_t i=0; i<TRACE_STAGES; i++) {
+        trace_print(g_atStage[i].m_pcName, &g_atStageSamples[i], TRACE_UNIT_MS);
+    }
+    printf("%-18s %6s %9s %9s %9s %9s %9s\n", "call (us)", "count", "min", "p50", "p90", "p99", "max");
+    for (uint32_t i=0; i<TRACE_CALLS; i++) {
+        trace_print(g_pcEvent[g_aeCall[i]], &g_atEventSamples[g_aeCall[i]], TRACE_UNIT_US);
+    }
+    printf("%-18s %6s %9s %9s %9s %9s %9s\n", "watermark (bytes)", "count", "min", "p50", "p90", "p99", "max");
+    for (uint32_t i=0; i<TRACE_LEVELS; i++) {
+        trace_print(g_pcEvent[g_aeLevel[i]], &g_atEventSamples[g_aeLevel[i]], TRACE_UNIT_BYTES);
+    }
+    return 0;
+}
@@ -0,0 +1,712 @@
+/**
+  @file codec_bench.c
+  @brief
+  Host build of libavs
+  Bit exactness check and benchmark of the audio codecs (audio_compression.c)
+  - u-law: linear2ulaw for all 65536 inputs and ulaw2linear for all 256 codes against the
+    G.711 reference the table driven codec replaced, then audio_pcm16_to_ulaw, audio_ulaw_to_pcm16
+    and audio_ulaw_to_pcm16_stereo for every source/destination alignment, lengths 0 to 67 and in-place
+  - channels (audio_conversion.c): audio_stereo_to_mono, audio_stereo_to_mono_average and the unity path
+    of audio_mono_to_stereo against the 16-bit loops, for the aligned and misaligned cases and in-place
+  - resampling: audio_resample_up/down by 2 and 3 against a direct convolution with the same filters,
+    in blocks of random sizes and in-place, then the SNR of a 1KHz tone and the rejection of a tone
+    above the output Nyquist frequency
+  - benchmark: nanoseconds per sample of each conversion and of the reference loop
+  Returns 1 if any output differs from the reference or the resampling quality is below its limits.
+
+ */
+/*
+ * ============================================================================
+ * History
+ * =======
+ * 2026-10-16 : Created v1
+ *
+ * ============================================================================
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+#include "ft900.h"
+#include "audio.h"
+
+
+
+#define CODEC_CHECK_LENGTH_MAX  68          // bytes of 16-bit input checked at each alignment
+#define CODEC_BENCH_SAMPLES     (1 << 16)   // samples per benchmark pass
+#define CODEC_BENCH_MS          (200)       // minimum duration of each benchmark
+#define CODEC_RESAMPLE_SAMPLES  (4800)      // input samples of the resampling checks
+#define CODEC_RESAMPLE_SNR_MIN  (60.0)      // dB of a 1KHz tone after resampling
+#define CODEC_RESAMPLE_REJECT_MIN (50.0)    // dB of a tone at 0.7 of the output rate, folded by downsampling
+
+
+typedef struct _CodecOptions {
+    uint32_t m_ulBenchMs;
+    int m_bCheckOnly;
+} CodecOptions;
+
+static CodecOptions g_tOptions = {CODEC_BENCH_MS, 0};
+static uint32_t m_ulFailures = 0;
+
+unsigned char linear2ulaw(short pcm_val);
+short ulaw2linear(unsigned char u_val);
+
+
+
+///////////////////////////////////////////////////////////////////////////////////////////
+// G.711 reference: the u-law codec of audio_compression.c before the lookup tables
+///////////////////////////////////////////////////////////////////////////////////////////
+
+#define REF_SIGN_BIT    (0x80)
+#define REF_QUANT_MASK  (0xf)
+#define REF_SEG_SHIFT   (4)
+#define REF_SEG_MASK    (0x70)
+#define REF_BIAS        (0x84)
+#define REF_CLIP        (8159)
+
+static short ref_seg_uend[8] = {0x3F, 0x7F, 0xFF, 0x1FF, 0x3FF, 0x7FF, 0xFFF, 0x1FFF};
+
+static unsigned char ref_linear2ulaw(short pcm_val)
+{
+    short mask;
+    short seg;
+
+    pcm_val = pcm_val >> 2;
+    if (pcm_val < 0) {
+        pcm_val = -pcm_val;
+        mask = 0x7F;
+    } else {
+        mask = 0xFF;
+    }
+    if (pcm_val > REF_CLIP) {
+        pcm_val = REF_CLIP;
+    }
+    pcm_val += (REF_BIAS >> 2);
+
+    for (seg = 0; seg < 8 && pcm_val > ref_seg_uend[seg]; seg++) {
+    }
+    if (seg >= 8) {
+        return (unsigned char)(0x7F ^ mask);
+    }
+    return (unsigned char)(((seg << 4) | ((pcm_val >> (seg + 1)) & 0xF)) ^ mask);
+}
+
+static short ref_ulaw2linear(unsigned char u_val)
+{
+    u_val = ~u_val;
+    short t = ((u_val & REF_QUANT_MASK) << 3) + REF_BIAS;
+    t <<= ((unsigned)u_val & REF_SEG_MASK) >> REF_SEG_SHIFT;
+    return ((u_val & REF_SIGN_BIT) ? (REF_BIAS - t) : (t - REF_BIAS));
+}
+
+static void ref_pcm16_to_ulaw(int lSrcLen, const char *pcSrc, char *pcDst)
+{
+    for (int i=0; i < lSrcLen / 2; i++) {
+        short sSample;
+        memcpy(&sSample, pcSrc + i*2, sizeof(sSample));
+        pcDst[i] = ref_linear2ulaw(sSample);
+    }
+}
+
+static void ref_ulaw_to_pcm16(int lSrcLen, const char *pcSrc, char *pcDst, int lChannels)
+{
+    for (int i=0; i < lSrcLen; i++) {
+        short sSample = ref_ulaw2linear((unsigned char)pcSrc[i]);
+        for (int j=0; j < lChannels; j++) {
+            memcpy(pcDst + (i*lChannels + j)*2, &sSample, sizeof(sSample));
+        }
+    }
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////////////////
+// Channel reference: the 16-bit loops of audio_conversion.c before the word kernels
+///////////////////////////////////////////////////////////////////////////////////////////
+
+static void ref_mono_to_stereo(char* pDst, char* pSrc, uint32_t ulSize)
+{
+    // From the end, since pSrc may be the upper half of pDst
+    for (int i=(int)ulSize-2; i>=0; i-=2) {
+        short sSample;
+        memcpy(&sSample, pSrc + i, sizeof(sSample));
+        memcpy(pDst + i*2, &sSample, sizeof(sSample));
+        memcpy(pDst + i*2 + 2, &sSample, sizeof(sSample));
+    }
+}
+
+static void ref_stereo_to_mono(char* pDst, char* pSrc, uint32_t ulSize, int bAverage)
+{
+    for (uint32_t i=0; i<ulSize; i+=2) {
+        short sLeft, sRight;
+        memcpy(&sLeft, pSrc + i*2, sizeof(sLeft));
+        memcpy(&sRight, pSrc + i*2 + 2, sizeof(sRight));
+        if (bAverage) {
+            sLeft = (short)((sLeft + sRight) >> 1);
+        }
+        memcpy(pDst + i, &sLeft, sizeof(sLeft));
+    }
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////////////////
+// Resampling reference: direct convolution of the whole signal with the filters of
+// audio_conversion.c, Q15 with rounding and saturation
+///////////////////////////////////////////////////////////////////////////////////////////
+
+#define REF_RESAMPLE_TAPS   (8)
+
+static const short ref_resample_up2[2][REF_RESAMPLE_TAPS] = {
+    {    -94,    940,  -3470,  10824,  26800,  -2473,    151,     90 },
+    {     90,    151,  -2473,  26800,  10824,  -3470,    940,    -94 },
+};
+static const short ref_resample_up3[3][REF_RESAMPLE_TAPS] = {
+    {    -98,    880,  -2951,   7941,  28243,  -1130,   -347,    231 },
+    {   -116,   1022,  -4346,  19824,  19824,  -4346,   1022,   -116 },
+    {    231,   -347,  -1130,  28243,   7941,  -2951,    880,    -98 },
+};
+static const short ref_resample_down2[REF_RESAMPLE_TAPS*2] = {
+       -47,     45,    470,     75,  -1735,  -1237,   5412,  13400,
+     13400,   5412,  -1237,  -1735,     75,    470,     45,    -47,
+};
+static const short ref_resample_down3[REF_RESAMPLE_TAPS*3] = {
+       -33,    -39,     77,    293,    340,   -116,   -984,  -1447,
+      -377,   2648,   6602,   9418,   9418,   6602,   2648,   -377,
+     -1447,   -984,   -116,    340,    293,     77,    -39,    -33,
+};
+
+// Coefficient k applies to x[n-k]; the samples before the signal are 0
+static short ref_fir(const short* psCoef, int lTaps, const short* psSignal, int n)
+{
+    int32_t lAcc = 1 << 14;
+
+    for (int k=0; k<lTaps && k<=n; k++) {
+        lAcc += psCoef[k] * psSignal[n - k];
+    }
+    lAcc >>= 15;
+    if (lAcc > 32767) {
+        lAcc = 32767;
+    }
+    else if (lAcc < -32768) {
+        lAcc = -32768;
+    }
+    return (short)lAcc;
+}
+
+// Returns the output samples
+static int ref_resample(short* psDst, const short* psSrc, int lCount, int lFactor, int bUp)
+{
+    int lOut = 0;
+
+    for (int n=0; n<lCount; n++) {
+        if (bUp) {
+            for (int p=0; p<lFactor; p++) {
+                const short* psCoef = (lFactor == 2) ? ref_resample_up2[p] : ref_resample_up3[p];
+                psDst[lOut++] = ref_fir(psCoef, REF_RESAMPLE_TAPS, psSrc, n);
+            }
+        }
+        else if ((n + 1) % lFactor == 0) {
+            const short* psCoef = (lFactor == 2) ? ref_resample_down2 : ref_resample_down3;
+            psDst[lOut++] = ref_fir(psCoef, REF_RESAMPLE_TAPS * lFactor, psSrc, n);
+        }
+    }
+    return lOut;
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////////////////
+// Helpers
+///////////////////////////////////////////////////////////////////////////////////////////
+
+static uint64_t codec_time_ns(void)
+{
+    struct timespec tNow;
+
+    clock_gettime(CLOCK_MONOTONIC, &tNow);
+    return (uint64_t)tNow.tv_sec * 1000000000 + tNow.tv_nsec;
+}
+
+static void codec_fail(const char* pcName, int lOffset, int lLength, int lAt)
+{
+    if (m_ulFailures++ < 10) {
+        printf("%s differs: offsets %d, length %d, at byte %d\n", pcName, lOffset, lLength, lAt);
+    }
+}
+
+static int codec_compare(const char* pcName, const char* pcOut, const char* pcRef, int lSize, int lOffset, int lLength)
+{
+    for (int i=0; i<lSize; i++) {
+        if (pcOut[i] != pcRef[i]) {
+            codec_fail(pcName, lOffset, lLength, i);
+            return 0;
+        }
+    }
+    return 1;
+}
+
+// Uniform random bytes, so that 16-bit samples use every segment of both signs
+static void codec_fill(char* pcBuffer, uint32_t ulSize, unsigned int* pulSeed)
+{
+    for (uint32_t i=0; i<ulSize; i++) {
+        pcBuffer[i] = (char)rand_r(pulSeed);
+    }
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////////////////
+// Bit exactness
+///////////////////////////////////////////////////////////////////////////////////////////
+
+static void check_ulaw_scalar(void)
+{
+    for (int i=-32768; i<=32767; i++) {
+        if (linear2ulaw((short)i) != ref_linear2ulaw((short)i)) {
+            if (m_ulFailures++ < 10) {
+                printf("linear2ulaw(%d) = 0x%02X, reference 0x%02X\n", i, linear2ulaw((short)i), ref_linear2ulaw((short)i));
+            }
+        }
+    }
+    for (int i=0; i<256; i++) {
+        if (ulaw2linear((unsigned char)i) != ref_ulaw2linear((unsigned char)i)) {
+            if (m_ulFailures++ < 10) {
+                printf("ulaw2linear(0x%02X) = %d, reference %d\n", i, ulaw2linear((unsigned char)i), ref_ulaw2linear((unsigned char)i));
+            }
+        }
+    }
+}
+
+// Every alignment of the source and destination (offsets 0 to 3 each) and every length
+static void check_ulaw_buffers(void)
+{
+    static uint32_t aulSrc[64], aulDst[128], aulRef[128];
+    char* pcSrcBase = (char*)aulSrc;
+    char* pcDstBase = (char*)aulDst;
+    char* pcRef = (char*)aulRef;
+    unsigned int ulSeed = 1;
+
+    for (int lSrcOffset=0; lSrcOffset<4; lSrcOffset++) {
+        for (int lDstOffset=0; lDstOffset<4; lDstOffset++) {
+            for (int lLength=0; lLength<CODEC_CHECK_LENGTH_MAX; lLength++) {
+                char* pcSrc = pcSrcBase + lSrcOffset;
+                char* pcDst = pcDstBase + lDstOffset;
+                int lOffset = lSrcOffset*10 + lDstOffset;
+
+                codec_fill(pcSrc, lLength, &ulSeed);
+
+                // 16-bit to u-law
+                memset(aulDst, 0xA5, sizeof(aulDst));
+                memset(aulRef, 0xA5, sizeof(aulRef));
+                audio_pcm16_to_ulaw(lLength, pcSrc, pcDst);
+                ref_pcm16_to_ulaw(lLength, pcSrc, pcRef + lDstOffset);
+                codec_compare("audio_pcm16_to_ulaw", pcDstBase, pcRef, sizeof(aulDst), lOffset, lLength);
+
+                // u-law to 16-bit mono and stereo
+                memset(aulDst, 0xA5, sizeof(aulDst));
+                memset(aulRef, 0xA5, sizeof(aulRef));
+                audio_ulaw_to_pcm16(lLength, pcSrc, pcDst);
+                ref_ulaw_to_pcm16(lLength, pcSrc, pcRef + lDstOffset, 1);
+                codec_compare("audio_ulaw_to_pcm16", pcDstBase, pcRef, sizeof(aulDst), lOffset, lLength);
+
+                memset(aulDst, 0xA5, sizeof(aulDst));
+                memset(aulRef, 0xA5, sizeof(aulRef));
+                audio_ulaw_to_pcm16_stereo(lLength, pcSrc, pcDst);
+                ref_ulaw_to_pcm16(lLength, pcSrc, pcRef + lDstOffset, 2);
+                codec_compare("audio_ulaw_to_pcm16_stereo", pcDstBase, pcRef, sizeof(aulDst), lOffset, lLength);
+            }
+        }
+
+        // In-place encoding, as avs.c does before sending
+        for (int lLength=0; lLength<CODEC_CHECK_LENGTH_MAX; lLength++) {
+            char* pcSrc = pcSrcBase + lSrcOffset;
+            codec_fill(pcSrc, lLength, &ulSeed);
+            ref_pcm16_to_ulaw(lLength, pcSrc, pcRef);
+            audio_pcm16_to_ulaw(lLength, pcSrc, pcSrc);
+            codec_compare("audio_pcm16_to_ulaw in-place", pcSrc, pcRef, lLength / 2, lSrcOffset, lLength);
+        }
+    }
+}
+
+
+
+// The word kernels need 32-bit aligned buffers; 16-bit aligned ones take the sample loop
+static void check_channels(void)
+{
+    static uint32_t aulSrc[80], aulDst[80], aulRef[80];
+    char* pcSrcBase = (char*)aulSrc;
+    char* pcDstBase = (char*)aulDst;
+    char* pcRef = (char*)aulRef;
+    unsigned int ulSeed = 3;
+
+    for (int lSrcOffset=0; lSrcOffset<4; lSrcOffset+=2) {
+        for (int lDstOffset=0; lDstOffset<4; lDstOffset+=2) {
+            for (int lLength=0; lLength<CODEC_CHECK_LENGTH_MAX; lLength+=2) {
+                char* pcSrc = pcSrcBase + lSrcOffset;
+                char* pcDst = pcDstBase + lDstOffset;
+                int lOffset = lSrcOffset*10 + lDstOffset;
+
+                // Stereo to mono, left channel and average; lLength is the mono size
+                codec_fill(pcSrc, lLength * 2, &ulSeed);
+                memset(aulDst, 0xA5, sizeof(aulDst));
+                memset(aulRef, 0xA5, sizeof(aulRef));
+                audio_stereo_to_mono(pcDst, pcSrc, lLength);
+                ref_stereo_to_mono(pcRef + lDstOffset, pcSrc, lLength, 0);
+                codec_compare("audio_stereo_to_mono", pcDstBase, pcRef, sizeof(aulDst), lOffset, lLength);
+
+                memset(aulDst, 0xA5, sizeof(aulDst));
+                memset(aulRef, 0xA5, sizeof(aulRef));
+                audio_stereo_to_mono_average(pcDst, pcSrc, lLength);
+                ref_stereo_to_mono(pcRef + lDstOffset, pcSrc, lLength, 1);
+                codec_compare("audio_stereo_to_mono_average", pcDstBase, pcRef, sizeof(aulDst), lOffset, lLength);
+
+                // Mono to stereo at unity gain
+                memset(aulDst, 0xA5, sizeof(aulDst));
+                memset(aulRef, 0xA5, sizeof(aulRef));
+                audio_mono_to_stereo(pcDst, pcSrc, lLength);
+                ref_mono_to_stereo(pcRef + lDstOffset, pcSrc, lLength);
+                codec_compare("audio_mono_to_stereo", pcDstBase, pcRef, sizeof(aulDst), lOffset, lLength);
+            }
+        }
+
+        // In-place: stereo to mono over its source, mono to stereo from the upper half, as avs.c does
+        for (int lLength=0; lLength<CODEC_CHECK_LENGTH_MAX; lLength+=2) {
+            char* pcBuffer = pcSrcBase + lSrcOffset;
+
+            codec_fill(pcBuffer, lLength * 2, &ulSeed);
+            ref_stereo_to_mono(pcRef, pcBuffer, lLength, 0);
+            audio_stereo_to_mono(pcBuffer, pcBuffer, lLength);
+            codec_compare("audio_stereo_to_mono in-place", pcBuffer, pcRef, lLength, lSrcOffset, lLength);
+
+            codec_fill(pcBuffer + lLength, lLength, &ulSeed);
+            ref_mono_to_stereo(pcRef, pcBuffer + lLength, lLength);
+            audio_mono_to_stereo(pcBuffer, pcBuffer + lLength, lLength);
+            codec_compare("audio_mono_to_stereo in-place", pcBuffer, pcRef, lLength * 2, lSrcOffset, lLength);
+        }
+    }
+}
+
+// Resamples psSrc in blocks of random sizes; in-place copies each block to the destination first
+static int check_resample_blocks(short* psDst, const short* psSrc, int lCount, int lFactor, int bUp, int bInPlace,
+    unsigned int* pulSeed)
+{
+    TAudioResampler tState;
+    char* pcDst = (char*)psDst;
+    int lIn = 0;
+
+    audio_resample_reset(&tState, lFactor);
+    while (lIn < lCount) {
+        int lBlock = 1 + rand_r(pulSeed) % 300;
+        if (lBlock > lCount - lIn) {
+            lBlock = lCount - lIn;
+        }
+        if (bInPlace) {
+            memmove(pcDst, psSrc + lIn, lBlock * 2);
+            pcDst += audio_resample_down(pcDst, pcDst, lBlock * 2, &tState);
+        }
+        else if (bUp) {
+            pcDst += audio_resample_up(pcDst, (const char*)(psSrc + lIn), lBlock * 2, &tState);
+        }
+        else {
+            pcDst += audio_resample_down(pcDst, (const char*)(psSrc + lIn), lBlock * 2, &tState);
+        }
+        lIn += lBlock;
+    }
+    return (int)(pcDst - (char*)psDst) / 2;
+}
+
+static void check_resample(void)
+{
+    static short asSrc[CODEC_RESAMPLE_SAMPLES], asDst[CODEC_RESAMPLE_SAMPLES * 3], asRef[CODEC_RESAMPLE_SAMPLES * 3];
+    static const char* apcName[2][2] = {{"audio_resample_down", "audio_resample_down in-place"}, {"audio_resample_up", ""}};
+    unsigned int ulSeed = 4;
+
+    // Full scale noise also checks the saturation
+    codec_fill((char*)asSrc, sizeof(asSrc), &ulSeed);
+    for (int lFactor=2; lFactor<=3; lFactor++) {
+        for (int bUp=0; bUp<2; bUp++) {
+            for (int bInPlace=0; bInPlace<2-bUp; bInPlace++) {
+                int lRef = ref_resample(asRef, asSrc, CODEC_RESAMPLE_SAMPLES, lFactor, bUp);
+                int lOut = check_resample_blocks(asDst, asSrc, CODEC_RESAMPLE_SAMPLES, lFactor, bUp, bInPlace, &ulSeed);
+                if (lOut != lRef) {
+                    if (m_ulFailures++ < 10) {
+                        printf("%s by %d: %d samples, reference %d\n", apcName[bUp][bInPlace], lFactor, lOut, lRef);
+                    }
+                    continue;
+                }
+                char acName[48];
+                snprintf(acName, sizeof(acName), "%s by %d", apcName[bUp][bInPlace], lFactor);
+                codec_compare(acName, (char*)asDst, (char*)asRef, lOut * 2, 0, CODEC_RESAMPLE_SAMPLES * 2);
+            }
+        }
+    }
+}
+
+// Power of the least squares fit of a tone at dFrequency (cycles per sample) to psSignal,
+// and of the residual, after the filter settled
+static void resample_tone_power(const short* psSignal, int lCount, double dFrequency, double* pdTone, double* pdRest)
+{
+    const int lSkip = 64;
+    double dSS = 0, dSC = 0, dCC = 0, dXS = 0, dXC = 0;
+    double dTone = 0, dRest = 0;
+
+    for (int n=lSkip; n<lCount; n++) {
+        double dSin = sin(2 * M_PI * dFrequency * n);
+        double dCos = cos(2 * M_PI * dFrequency * n);
+        dSS += dSin * dSin;
+        dSC += dSin * dCos;
+        dCC += dCos * dCos;
+        dXS += psSignal[n] * dSin;
+        dXC += psSignal[n] * dCos;
+    }
+
+    double dDet = dSS * dCC - dSC * dSC;
+    double dA = (dXS * dCC - dXC * dSC) / dDet;
+    double dB = (dXC * dSS - dXS * dSC) / dDet;
+    for (int n=lSkip; n<lCount; n++) {
+        double dFit = dA * sin(2 * M_PI * dFrequency * n) + dB * cos(2 * M_PI * dFrequency * n);
+        dTone += dFit * dFit;
+        dRest += (psSignal[n] - dFit) * (psSignal[n] - dFit);
+    }
+    *pdTone = dTone / (lCount - lSkip);
+    *pdRest = dRest / (lCount - lSkip);
+}
+
+static void check_resample_quality(void)
+{
+    static short asSrc[CODEC_RESAMPLE_SAMPLES * 3], asDst[CODEC_RESAMPLE_SAMPLES * 3];
+    const double dRate = 16000;
+
+    printf("\n%-28s %8s %8s\n", "resampling of 16KHz", "SNR dB", "reject");
+    for (int lFactor=2; lFactor<=3; lFactor++) {
+        TAudioResampler tState;
+        double dTone, dRest, dInput;
+        int lOut;
+        char acName[32];
+
+        // 1KHz at 16KHz, upsampled
+        for (int n=0; n<CODEC_RESAMPLE_SAMPLES; n++) {
+            asSrc[n] = (short)(16384 * sin(2 * M_PI * 1000 / dRate * n));
+        }
+        audio_resample_reset(&tState, lFactor);
+        lOut = audio_resample_up((char*)asDst, (char*)asSrc, CODEC_RESAMPLE_SAMPLES * 2, &tState) / 2;
+        resample_tone_power(asDst, lOut, 1000 / (dRate * lFactor), &dTone, &dRest);
+        double dUp = 10 * log10(dTone / dRest);
+
+        // 1KHz at 16KHz x factor, downsampled
+        for (int n=0; n<CODEC_RESAMPLE_SAMPLES * lFactor; n++) {
+            asSrc[n] = (short)(16384 * sin(2 * M_PI * 1000 / (dRate * lFactor) * n));
+        }
+        audio_resample_reset(&tState, lFactor);
+        lOut = audio_resample_down((char*)asDst, (char*)asSrc, CODEC_RESAMPLE_SAMPLES * lFactor * 2, &tState) / 2;
+        resample_tone_power(asDst, lOut, 1000 / dRate, &dTone, &dRest);
+        double dDown = 10 * log10(dTone / dRest);
+
+        // 0.7 x 16KHz is above the output Nyquist frequency: whatever comes out is aliasing
+        for (int n=0; n<CODEC_RESAMPLE_SAMPLES * lFactor; n++) {
+            asSrc[n] = (short)(16384 * sin(2 * M_PI * 0.7 / lFactor * n));
+        }
+        resample_tone_power(asSrc, CODEC_RESAMPLE_SAMPLES * lFactor, 0.7 / lFactor, &dInput, &dRest);
+        audio_resample_reset(&tState, lFactor);
+        lOut = audio_resample_down((char*)asDst, (char*)asSrc, CODEC_RESAMPLE_SAMPLES * lFactor * 2, &tState) / 2;
+        resample_tone_power(asDst, lOut, 0.3, &dTone, &dRest);
+        double dReject = 10 * log10(dInput / (dTone + dRest));
+
+        snprintf(acName, sizeof(acName), "up %d", lFactor);
+        printf("%-28s %8.1f\n", acName, dUp);
+        snprintf(acName, sizeof(acName), "down %d", lFactor);
+        printf("%-28s %8.1f %8.1f\n", acName, dDown, dReject);
+        if (dUp < CODEC_RESAMPLE_SNR_MIN || dDown < CODEC_RESAMPLE_SNR_MIN || dReject < CODEC_RESAMPLE_REJECT_MIN) {
+            printf("resampling by %d below %.0f dB SNR or %.0f dB rejection\n", lFactor,
+                CODEC_RESAMPLE_SNR_MIN, CODEC_RESAMPLE_REJECT_MIN);
+            m_ulFailures++;
+        }
+    }
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////////////////
+// Benchmark
+///////////////////////////////////////////////////////////////////////////////////////////
+
+typedef void (*CodecFunction)(int lSrcLen, const char *pcSrc, char *pcDst);
+
+static void ref_ulaw_to_pcm16_mono(int lSrcLen, const char *pcSrc, char *pcDst)
+{
+    ref_ulaw_to_pcm16(lSrcLen, pcSrc, pcDst, 1);
+}
+
+static void ref_ulaw_to_pcm16_stereo(int lSrcLen, const char *pcSrc, char *pcDst)
+{
+    ref_ulaw_to_pcm16(lSrcLen, pcSrc, pcDst, 2);
+}
+
+// Nanoseconds per sample, repeating the conversion for at least the benchmark duration
+static double bench_run(CodecFunction fxnCodec, int lSrcLen, const char* pcSrc, char* pcDst, uint32_t ulSamples)
+{
+    uint64_t ullStart = codec_time_ns();
+    uint64_t ullEnd = ullStart + (uint64_t)g_tOptions.m_ulBenchMs * 1000000;
+    uint64_t ullPasses = 0;
+    uint64_t ullNow;
+
+    do {
+        fxnCodec(lSrcLen, pcSrc, pcDst);
+        ullPasses++;
+        ullNow = codec_time_ns();
+    } while (ullNow < ullEnd);
+
+    return (double)(ullNow - ullStart) / ((double)ullPasses * ulSamples);
+}
+
+static void bench_print(const char* pcName, double dNew, double dRef)
+{
+    printf("%-28s %8.2f %8.2f %7.1fx\n", pcName, dNew, dRef, dRef / dNew);
+}
+
+static void bench_ulaw(void)
+{
+    static uint32_t aulPcm[CODEC_BENCH_SAMPLES];        // 16-bit stereo
+    static uint32_t aulUlaw[CODEC_BENCH_SAMPLES / 4];
+    unsigned int ulSeed = 2;
+
+    codec_fill((char*)aulPcm, CODEC_BENCH_SAMPLES * 2, &ulSeed);
+    codec_fill((char*)aulUlaw, CODEC_BENCH_SAMPLES, &ulSeed);
+
+    bench_print("pcm16 to u-law",
+        bench_run(audio_pcm16_to_ulaw, CODEC_BENCH_SAMPLES * 2, (char*)aulPcm, (char*)aulUlaw, CODEC_BENCH_SAMPLES),
+        bench_run(ref_pcm16_to_ulaw, CODEC_BENCH_SAMPLES * 2, (char*)aulPcm, (char*)aulUlaw, CODEC_BENCH_SAMPLES));
+    bench_print("u-law to pcm16",
+        bench_run(audio_ulaw_to_pcm16, CODEC_BENCH_SAMPLES, (char*)aulUlaw, (char*)aulPcm, CODEC_BENCH_SAMPLES),
+        bench_run(ref_ulaw_to_pcm16_mono, CODEC_BENCH_SAMPLES, (char*)aulUlaw, (char*)aulPcm, CODEC_BENCH_SAMPLES));
+    bench_print("u-law to pcm16 stereo",
+        bench_run(audio_ulaw_to_pcm16_stereo, CODEC_BENCH_SAMPLES / 2, (char*)aulUlaw, (char*)aulPcm, CODEC_BENCH_SAMPLES / 2),
+        bench_run(ref_ulaw_to_pcm16_stereo, CODEC_BENCH_SAMPLES / 2, (char*)aulUlaw, (char*)aulPcm, CODEC_BENCH_SAMPLES / 2));
+}
+
+
+static void bench_stereo_to_mono(int lSrcLen, const char *pcSrc, char *pcDst)
+{
+    audio_stereo_to_mono(pcDst, (char*)pcSrc, lSrcLen / 2);
+}
+
+static void bench_stereo_to_mono_average(int lSrcLen, const char *pcSrc, char *pcDst)
+{
+    audio_stereo_to_mono_average(pcDst, (char*)pcSrc, lSrcLen / 2);
+}
+
+static void bench_mono_to_stereo(int lSrcLen, const char *pcSrc, char *pcDst)
+{
+    audio_mono_to_stereo(pcDst, (char*)pcSrc, lSrcLen);
+}
+
+static void ref_bench_stereo_to_mono(int lSrcLen, const char *pcSrc, char *pcDst)
+{
+    ref_stereo_to_mono(pcDst, (char*)pcSrc, lSrcLen / 2, 0);
+}
+
+static void ref_bench_stereo_to_mono_average(int lSrcLen, const char *pcSrc, char *pcDst)
+{
+    ref_stereo_to_mono(pcDst, (char*)pcSrc, lSrcLen / 2, 1);
+}
+
+static void ref_bench_mono_to_stereo(int lSrcLen, const char *pcSrc, char *pcDst)
+{
+    ref_mono_to_stereo(pcDst, (char*)pcSrc, lSrcLen);
+}
+
+static TAudioResampler m_tBenchResampler;
+
+static void bench_resample_up(int lSrcLen, const char *pcSrc, char *pcDst)
+{
+    audio_resample_up(pcDst, pcSrc, lSrcLen, &m_tBenchResampler);
+}
+
+static void bench_resample_down(int lSrcLen, const char *pcSrc, char *pcDst)
+{
+    audio_resample_down(pcDst, pcSrc, lSrcLen, &m_tBenchResampler);
+}
+
+static void bench_channels(void)
+{
+    static uint32_t aulStereo[CODEC_BENCH_SAMPLES];
+    static uint32_t aulMono[CODEC_BENCH_SAMPLES / 2];
+    unsigned int ulSeed = 5;
+
+    codec_fill((char*)aulStereo, sizeof(aulStereo), &ulSeed);
+    codec_fill((char*)aulMono, sizeof(aulMono), &ulSeed);
+
+    bench_print("stereo to mono",
+        bench_run(bench_stereo_to_mono, sizeof(aulStereo), (char*)aulStereo, (char*)aulMono, CODEC_BENCH_SAMPLES),
+        bench_run(ref_bench_stereo_to_mono, sizeof(aulStereo), (char*)aulStereo, (char*)aulMono, CODEC_BENCH_SAMPLES));
+    bench_print("stereo to mono average",
+        bench_run(bench_stereo_to_mono_average, sizeof(aulStereo), (char*)aulStereo, (char*)aulMono, CODEC_BENCH_SAMPLES),
+        bench_run(ref_bench_stereo_to_mono_average, sizeof(aulStereo), (char*)aulStereo, (char*)aulMono, CODEC_BENCH_SAMPLES));
+    bench_print("mono to stereo",
+        bench_run(bench_mono_to_stereo, sizeof(aulMono), (char*)aulMono, (char*)aulStereo, CODEC_BENCH_SAMPLES),
+        bench_run(ref_bench_mono_to_stereo, sizeof(aulMono), (char*)aulMono, (char*)aulStereo, CODEC_BENCH_SAMPLES));
+}
+
+// Per input sample; the reference is the whole signal convolution, so it has no column
+static void bench_resample(void)
+{
+    static short asSrc[CODEC_BENCH_SAMPLES / 4], asDst[CODEC_BENCH_SAMPLES * 3 / 4];
+    unsigned int ulSeed = 6;
+
+    codec_fill((char*)asSrc, sizeof(asSrc), &ulSeed);
+    for (int lFactor=2; lFactor<=3; lFactor++) {
+        char acName[32];
+
+        audio_resample_reset(&m_tBenchResampler, lFactor);
+        snprintf(acName, sizeof(acName), "resample up %d", lFactor);
+        printf("%-28s %8.2f\n", acName,
+            bench_run(bench_resample_up, sizeof(asSrc), (char*)asSrc, (char*)asDst, CODEC_BENCH_SAMPLES / 4));
+        audio_resample_reset(&m_tBenchResampler, lFactor);
+        snprintf(acName, sizeof(acName), "resample down %d", lFactor);
+        printf("%-28s %8.2f\n", acName,
+            bench_run(bench_resample_down, sizeof(asSrc), (char*)asSrc, (char*)asDst, CODEC_BENCH_SAMPLES / 4));
+    }
+}
+
+
+
+static void usage(const char* pcName)
+{
+    printf("usage: %s [options]\n"
+        "  -t ms       minimum duration of each benchmark (%d)\n"
+        "  -c          bit exactness checks only\n",
+        pcName, CODEC_BENCH_MS);
+}
+
+int main(int argc, char* argv[])
+{
+    int lOption;
+
+    while ((lOption = getopt(argc, argv, "t:ch")) != -1) {
+        switch (lOption) {
+            case 't': g_tOptions.m_ulBenchMs = atoi(optarg); break;
+            case 'c': g_tOptions.m_bCheckOnly = 1; break;
+            default:  usage(argv[0]); return 1;
+        }
+    }
+
+    check_ulaw_scalar();
+    check_ulaw_buffers();
+    check_channels();
+    check_resample();
+    printf("bit exactness: %s\n", m_ulFailures ? "FAILED" : "passed");
+    check_resample_quality();
+
+    if (!g_tOptions.m_bCheckOnly) {
+        printf("\n%-28s %8s %8s %8s\n", "ns per sample", "codec", "ref", "speedup");
+        bench_ulaw();
+        bench_channels();
+        bench_resample();
+    }
+    return m_ulFailures ? 1 : 0;
+}
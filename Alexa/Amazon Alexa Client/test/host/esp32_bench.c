@@ -0,0 +1,535 @@
+/**
+  @file esp32_bench.c
+  @brief
+  Host build of the ESP32 driver
+  Benchmark and stress test of at.c, at_parser.c, uartrb.c and wifi.c against the AT firmware stand-in
+  - turnaround: at_at from the command written to the OK parsed, in microseconds
+  - throughput: a task per link sends its data and reads it back (WIFI_Socket*); KB per second of data
+    each way, its share of the line rate, and the CPU time of the process per KB sent and received
+  - stress (-s): random send sizes and pauses of the readers; the test fails if a byte differs or is missing,
+    or if uartrb.c, at_parser.c or the FIFO of the FT900 dropped data
+  In active mode (-a) a link keeps no more than AT_PARSER_LINK_SIZE in flight, since its ring is the only buffer.
+  With -p the module loses bytes on the way to the FT900: the data is expected to differ, and the test
+  checks that every link ends and that the driver still answers AT.
+  Built with AVS_CONFIG_WIFI_PASSTHROUGH (esp32_passthrough), the single link is the one of the AVS client:
+  WIFI_On, comm_connect and comm_send/comm_recv of comm_wrapper.c put it in passthrough (AT+CIPMUX=0,
+  AT+CIPMODE=1) like on the board, and its socket event task checks it with at_cipsend_check; once its data
+  is back, the module drops it silently and comm_recv must see it.
+
+ */
+/*
+ * ============================================================================
+ * History
+ * =======
+ * 2026-10-16 : Created v1
+ *
+ * ============================================================================
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include "ft900.h"
+#include "FreeRTOS.h"
+#include "task.h"
+#include "uartrb.h"
+#include "at.h"
+#include "at_parser.h"
+#include "wifi.h"
+#include "avs_config.h"
+#if AVS_CONFIG_WIFI_PASSTHROUGH
+#include "comm_wrapper.h"
+#endif
+#include "host.h"
+#include "esp32_emu.h"
+
+
+
+#if AVS_CONFIG_WIFI_PASSTHROUGH
+#define BENCH_LINKS_MAX         1           // the link of the AVS client
+#define BENCH_LINKS             1
+#else
+#define BENCH_LINKS_MAX         5
+#define BENCH_LINKS             4
+#endif
+#define BENCH_SEND_MAX          3000        // largest WIFI_SocketSend of the stress test
+#define BENCH_SEND_SIZE         2048        // WIFI_SocketSend of the throughput test, one AT+CIPSEND
+#define BENCH_RECV_TIMEOUT_MS   (1000)      // once all the data of a link is sent
+#define BENCH_TIMEOUT_MS        (120000)
+#define BENCH_PASSTHROUGH_MS    (300)       // at_timeout_passthrough with AVS_CONFIG_WIFI_PASSTHROUGH
+
+#define TASK_BENCH_STACK_SIZE   (1024)
+#define TASK_BENCH_PRIORITY     (1)
+
+
+typedef struct _BenchLink {
+    uint32_t m_ulIndex;
+    WIFISocket_t m_xSocket;
+    uint32_t m_ulSent;
+    uint32_t m_ulReceived;
+    uint32_t m_ulDiffers;       // bytes received that differ from the ones sent
+    int m_lResult;              // 1 all the data came back, -1 the link failed
+    uint64_t m_ullEnd;
+    WIFISocketStats_t m_tStats;
+} BenchLink;
+
+typedef struct _BenchOptions {
+    TEsp32EmuConfig m_tEmu;
+    uint32_t m_ulLinks;
+    uint32_t m_ulBytes;         // per link
+    uint32_t m_ulCommands;
+    int m_bStress;
+} BenchOptions;
+
+static BenchOptions g_tOptions;
+static BenchLink g_atLinks[BENCH_LINKS_MAX];
+static TaskHandle_t g_xBench = NULL;
+
+
+
+// Data of a link at an offset, so that the reader can check it without a copy of what was sent
+static uint8_t bench_byte(uint32_t ulLink, uint32_t ulOffset)
+{
+    uint32_t x = ulOffset * 2654435761u + ulLink * 40503u;
+
+    return (uint8_t)((x >> 24) ^ (x >> 11));
+}
+
+static uint64_t bench_cpu_us(void)
+{
+    struct rusage tUsage;
+
+    getrusage(RUSAGE_SELF, &tUsage);
+    return (uint64_t)(tUsage.ru_utime.tv_sec + tUsage.ru_stime.tv_sec) * 1000000 +
+        tUsage.ru_utime.tv_usec + tUsage.ru_stime.tv_usec;
+}
+
+static int bench_compare(const void* pvA, const void* pvB)
+{
+    uint32_t a = *(const uint32_t*)pvA;
+    uint32_t b = *(const uint32_t*)pvB;
+
+    return (a > b) - (a < b);
+}
+
+#if AVS_CONFIG_WIFI_PASSTHROUGH
+// The link of the AVS client, connected by comm_wrapper.c like on the board
+static int bench_connect(BenchLink* pLink)
+{
+    if (!comm_connect()) {
+        return 0;
+    }
+    // WIFI_On left the single link of AT+CIPMUX=0
+    pLink->m_xSocket = AT_LINK_ID_MIN;
+    return 1;
+}
+
+static int32_t bench_send(BenchLink* pLink, const uint8_t* pucSend, uint32_t ulSize)
+{
+    (void) pLink;
+    return comm_send((void*)pucSend, ulSize);
+}
+
+// Like WIFI_SocketRecv: the bytes received, 0 if none before the timeout, -1 once the link is closed or lost
+static int32_t bench_recv(BenchLink* pLink, uint8_t* pucRecv, uint32_t ulTimeoutMs)
+{
+    int lRet;
+    (void) pLink;
+
+    comm_setsockopt(ulTimeoutMs / 1000, 0);
+    lRet = comm_recv(pucRecv, BENCH_SEND_MAX);
+    return lRet > 0 ? lRet : (lRet == 0 ? -1 : 0);
+}
+
+static void bench_close(BenchLink* pLink)
+{
+    WIFI_SocketGetStats(pLink->m_xSocket, &pLink->m_tStats);
+    comm_disconnect();
+}
+
+// The module drops the link without telling in passthrough: the socket event task has to find it out
+static int bench_drop(BenchLink* pLink)
+{
+    static uint8_t aucRecv[BENCH_SEND_MAX];
+    TickType_t xStart = xTaskGetTickCount();
+
+    if (bench_send(pLink, (const uint8_t*)"DROP", 4) != 4) {
+        printf("link %u: DROP not sent\n", pLink->m_ulIndex);
+        return 0;
+    }
+    while (bench_recv(pLink, aucRecv, BENCH_RECV_TIMEOUT_MS) >= 0) {
+        if (xTaskGetTickCount() - xStart > pdMS_TO_TICKS(BENCH_PASSTHROUGH_MS + BENCH_RECV_TIMEOUT_MS * 5)) {
+            printf("link %u: loss not detected\n", pLink->m_ulIndex);
+            return 0;
+        }
+    }
+    return 1;
+}
+#else // AVS_CONFIG_WIFI_PASSTHROUGH
+// Any free link of the module, through the sockets of wifi.c
+static int bench_connect(BenchLink* pLink)
+{
+    pLink->m_xSocket = WIFI_SocketConnect(eWiFiSocketTCP, "192.168.1.1", 5000 + pLink->m_ulIndex);
+    return pLink->m_xSocket != WIFI_SOCKET_INVALID;
+}
+
+static int32_t bench_send(BenchLink* pLink, const uint8_t* pucSend, uint32_t ulSize)
+{
+    return WIFI_SocketSend(pLink->m_xSocket, pucSend, ulSize, 0);
+}
+
+static int32_t bench_recv(BenchLink* pLink, uint8_t* pucRecv, uint32_t ulTimeoutMs)
+{
+    return WIFI_SocketRecv(pLink->m_xSocket, pucRecv, BENCH_SEND_MAX, pdMS_TO_TICKS(ulTimeoutMs));
+}
+
+static void bench_close(BenchLink* pLink)
+{
+    WIFI_SocketGetStats(pLink->m_xSocket, &pLink->m_tStats);
+    WIFI_SocketClose(pLink->m_xSocket);
+}
+#endif // AVS_CONFIG_WIFI_PASSTHROUGH
+
+/////////////////////////////////////////////////////////////////////////////////////////////
+// Sends the data of a link and checks what comes back
+/////////////////////////////////////////////////////////////////////////////////////////////
+static void bench_link(BenchLink* pLink)
+{
+    static uint8_t aaucSend[BENCH_LINKS_MAX][BENCH_SEND_MAX];
+    static uint8_t aaucRecv[BENCH_LINKS_MAX][BENCH_SEND_MAX];
+    uint8_t* pucSend = aaucSend[pLink->m_ulIndex];
+    uint8_t* pucRecv = aaucRecv[pLink->m_ulIndex];
+    unsigned int ulSeed = pLink->m_ulIndex + 1;
+    uint32_t ulBytes = g_tOptions.m_ulBytes;
+    TickType_t xStart = xTaskGetTickCount();
+    TickType_t xLastRecv = xStart;
+    uint32_t ulSize = 0;
+    int32_t lRet;
+
+
+    if (!bench_connect(pLink)) {
+        printf("link %u: connect failed\n", pLink->m_ulIndex);
+        pLink->m_lResult = -1;
+        pLink->m_ullEnd = host_time_us();
+        return;
+    }
+
+    while (pLink->m_ulReceived < ulBytes) {
+        if (xTaskGetTickCount() - xStart > pdMS_TO_TICKS(BENCH_TIMEOUT_MS)) {
+            printf("link %u: timed out\n", pLink->m_ulIndex);
+            pLink->m_lResult = -1;
+            break;
+        }
+
+        if (pLink->m_ulSent < ulBytes) {
+            ulSize = BENCH_SEND_SIZE;
+            if (g_tOptions.m_bStress) {
+                ulSize = 1 + rand_r(&ulSeed) % BENCH_SEND_MAX;
+            }
+            if (ulSize > ulBytes - pLink->m_ulSent) {
+                ulSize = ulBytes - pLink->m_ulSent;
+            }
+            // In active mode the ring of a link is the only buffer: like an acknowledged protocol,
+            // no more than it holds is in flight, or the data sent back is dropped by design
+            if (g_tOptions.m_tEmu.m_ucNoPassive && ulSize > AT_PARSER_LINK_SIZE - (pLink->m_ulSent - pLink->m_ulReceived)) {
+                ulSize = AT_PARSER_LINK_SIZE - (pLink->m_ulSent - pLink->m_ulReceived);
+            }
+        }
+        if (pLink->m_ulSent < ulBytes && ulSize) {
+            for (uint32_t i=0; i<ulSize; i++) {
+                pucSend[i] = bench_byte(pLink->m_ulIndex, pLink->m_ulSent + i);
+            }
+            lRet = bench_send(pLink, pucSend, ulSize);
+            if (lRet < 0) {
+                printf("link %u: send failed after %u bytes\n", pLink->m_ulIndex, pLink->m_ulSent);
+                pLink->m_lResult = -1;
+                break;
+            }
+            pLink->m_ulSent += lRet;
+        }
+
+        // The readers of the stress test pause, the first one for longer
+        if (g_tOptions.m_bStress && !(rand_r(&ulSeed) % 32)) {
+            vTaskDelay(pdMS_TO_TICKS(rand_r(&ulSeed) % (pLink->m_ulIndex ? 20 : 200)));
+        }
+
+        lRet = bench_recv(pLink, pucRecv, pLink->m_ulSent < ulBytes ? 0 : BENCH_RECV_TIMEOUT_MS);
+        if (lRet < 0) {
+            printf("link %u: closed after %u bytes\n", pLink->m_ulIndex, pLink->m_ulReceived);
+            pLink->m_lResult = -1;
+            break;
+        }
+        if (lRet > 0) {
+            xLastRecv = xTaskGetTickCount();
+        }
+        else if (pLink->m_ulSent == ulBytes) {
+            // Lost bytes never come: the link ends once nothing more is received
+            if (xTaskGetTickCount() - xLastRecv > pdMS_TO_TICKS(BENCH_RECV_TIMEOUT_MS * 3)) {
+                printf("link %u: %u bytes missing\n", pLink->m_ulIndex, ulBytes - pLink->m_ulReceived);
+                pLink->m_lResult = -1;
+                break;
+            }
+        }
+        else {
+            // The send queue is full and nothing came back yet
+            vTaskDelay(1);
+        }
+
+        if ((uint32_t)lRet > ulBytes - pLink->m_ulReceived) {
+            pLink->m_ulDiffers += lRet - (ulBytes - pLink->m_ulReceived);
+            lRet = ulBytes - pLink->m_ulReceived;
+        }
+        for (int32_t i=0; i<lRet; i++) {
+            if (pucRecv[i] != bench_byte(pLink->m_ulIndex, pLink->m_ulReceived + i)) {
+                pLink->m_ulDiffers++;
+            }
+        }
+        pLink->m_ulReceived += lRet;
+    }
+
+#if AVS_CONFIG_WIFI_PASSTHROUGH
+    if (!pLink->m_lResult && !bench_drop(pLink)) {
+        pLink->m_lResult = -1;
+    }
+#endif
+    if (!pLink->m_lResult) {
+        pLink->m_lResult = 1;
+    }
+    pLink->m_ullEnd = host_time_us();
+    bench_close(pLink);
+}
+
+static void vTaskBenchLink(void *pvParameters)
+{
+    bench_link((BenchLink*)pvParameters);
+    xTaskNotifyGive(g_xBench);
+
+    while (1) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    }
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////
+// Benchmarks
+/////////////////////////////////////////////////////////////////////////////////////////////
+static int bench_turnaround(void)
+{
+    uint32_t* pulTimes = malloc(g_tOptions.m_ulCommands * sizeof(uint32_t));
+    uint64_t ullTotal = 0;
+    uint32_t ulCount = 0;
+
+
+    if (!pulTimes) {
+        return 0;
+    }
+    for (uint32_t i=0; i<g_tOptions.m_ulCommands; i++) {
+        uint64_t ullStart = host_time_us();
+        if (at_at() != AT_OK) {
+            continue;
+        }
+        pulTimes[ulCount] = (uint32_t)(host_time_us() - ullStart);
+        ullTotal += pulTimes[ulCount++];
+    }
+    if (!ulCount) {
+        printf("turnaround: AT failed\n");
+        free(pulTimes);
+        return 0;
+    }
+
+    qsort(pulTimes, ulCount, sizeof(uint32_t), bench_compare);
+    printf("%-12s %8s %8s %8s %8s %8s\n", "turnaround", "commands", "min", "avg", "p99", "max");
+    printf("%-12s %8u %8u %8u %8u %8u us\n", "AT", ulCount, pulTimes[0], (uint32_t)(ullTotal / ulCount),
+        pulTimes[(ulCount - 1) * 99 / 100], pulTimes[ulCount - 1]);
+    free(pulTimes);
+    return ulCount == g_tOptions.m_ulCommands;
+}
+
+static int bench_throughput(void)
+{
+    TEsp32EmuLines* pLines = esp32_emu_lines();
+    uint64_t ullSent = pLines->m_ullSent;
+    uint64_t ullReceived = pLines->m_ullReceived;
+    uint32_t ulUartDropped = uartrb_dropped(UART1);
+    uint64_t ullStart, ullCpu, ullEnd = 0;
+    uint64_t ullBytes = 0;
+    uint32_t ulDropped = 0;
+    uint32_t ulDiffers = 0;
+    int lFailed = 0;
+    double dSeconds, dLine;
+
+
+    memset(g_atLinks, 0, sizeof(g_atLinks));
+    ulTaskNotifyTake(pdTRUE, 0);
+    ullCpu = bench_cpu_us();
+    ullStart = host_time_us();
+    for (uint32_t i=0; i<g_tOptions.m_ulLinks; i++) {
+        g_atLinks[i].m_ulIndex = i;
+        if (xTaskCreate(vTaskBenchLink, "Link", TASK_BENCH_STACK_SIZE, &g_atLinks[i], TASK_BENCH_PRIORITY, NULL) != pdTRUE) {
+            printf("vTaskBenchLink failed\n");
+            return 0;
+        }
+    }
+    for (uint32_t ulDone=0; ulDone<g_tOptions.m_ulLinks; ) {
+        ulDone += ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    }
+    ullCpu = bench_cpu_us() - ullCpu;
+
+    printf("\n%-12s %8s %8s %8s %6s %6s %6s %8s %8s\n", "link", "bytes", "seconds", "KB/s", "sends", "reqs",
+        "errors", "dropped", "differ");
+    for (uint32_t i=0; i<g_tOptions.m_ulLinks; i++) {
+        BenchLink* pLink = &g_atLinks[i];
+        double dLink = (double)(pLink->m_ullEnd - ullStart) / 1000000;
+        char acName[16];
+
+        snprintf(acName, sizeof(acName), "%u%s", i, pLink->m_lResult < 0 ? " failed" : "");
+        printf("%-12s %8u %8.2f %8.1f %6u %6u %6u %8u %8u\n", acName, pLink->m_ulReceived, dLink,
+            pLink->m_ulReceived / 1024.0 / dLink, pLink->m_tStats.ulTxSends, pLink->m_tStats.ulRxRequests,
+            pLink->m_tStats.ulTxErrors, pLink->m_tStats.ulRxDropped, pLink->m_ulDiffers);
+        if (pLink->m_ullEnd > ullEnd) {
+            ullEnd = pLink->m_ullEnd;
+        }
+        ullBytes += pLink->m_ulReceived;
+        ulDropped += pLink->m_tStats.ulRxDropped;
+        ulDiffers += pLink->m_ulDiffers;
+        lFailed |= pLink->m_lResult < 0;
+    }
+
+    // Each way, the data is part of the bytes on the line with the AT commands, headers and responses
+    dSeconds = (double)(ullEnd - ullStart) / 1000000;
+    dLine = at_uart_baud() / 10.0;
+    printf("%-12s %8llu %8.2f %8.1f each way, %.0f%% of the line rate; line use %.0f%% to the module, %.0f%% back\n",
+        "total", (unsigned long long)ullBytes, dSeconds, ullBytes / 1024.0 / dSeconds,
+        100 * ullBytes / dSeconds / dLine, 100 * (pLines->m_ullReceived - ullReceived) / dSeconds / dLine,
+        100 * (pLines->m_ullSent - ullSent) / dSeconds / dLine);
+    printf("%-12s %8.1f us of CPU per KB sent and received (%.2f s, with the UART thread)\n", "cpu",
+        ullBytes ? ullCpu / (2 * ullBytes / 1024.0) : 0, ullCpu / 1000000.0);
+    printf("%-12s uartrb %u, links %u, FIFO %llu; module lost %llu, garbled %llu, held %.0f ms by RTS\n", "dropped",
+        uartrb_dropped(UART1) - ulUartDropped, ulDropped, (unsigned long long)pLines->m_ullOverrun,
+        (unsigned long long)pLines->m_ullDropped, (unsigned long long)pLines->m_ullGarbled,
+        pLines->m_ullStalledUs / 1000.0);
+
+    if (g_tOptions.m_tEmu.m_ulLossPpm) {
+        // The links end, with or without their data, and the commands work again
+        return at_at() == AT_OK;
+    }
+    return !lFailed && !ulDiffers && !ulDropped && uartrb_dropped(UART1) == ulUartDropped && !pLines->m_ullOverrun;
+}
+
+static void vTaskBench(void *pvParameters)
+{
+    int bPassed;
+#if AVS_CONFIG_WIFI_PASSTHROUGH
+    enum at_txmode eMode;
+#endif
+    (void) pvParameters;
+
+
+    if (WIFI_On() != eWiFiSuccess) {
+        printf("WIFI_On failed\n");
+        exit(1);
+    }
+#if AVS_CONFIG_WIFI_PASSTHROUGH
+    // comm_connect enters passthrough; a quiet link is checked after 300 ms rather than 10 s
+    if (!comm_init()) {
+        printf("comm_init failed\n");
+        exit(1);
+    }
+    at_timeout_passthrough(pdMS_TO_TICKS(BENCH_PASSTHROUGH_MS));
+#endif
+    printf("UART %u baud, flow %s; module latency %u us, segment %u%s, loss %u ppm, %s receive%s\n",
+        at_uart_baud(), esp32_emu_lines()->m_ucFlow == 3 ? "RTS/CTS" : "RTS", g_tOptions.m_tEmu.m_ulLatencyUs,
+        g_tOptions.m_tEmu.m_ulSegment, g_tOptions.m_tEmu.m_ucFragment ? " fragmented" : "",
+        g_tOptions.m_tEmu.m_ulLossPpm, g_tOptions.m_tEmu.m_ucNoPassive ? "active" : "passive",
+        AVS_CONFIG_WIFI_PASSTHROUGH ? ", passthrough" : "");
+
+    bPassed = bench_turnaround();
+    bPassed &= bench_throughput();
+#if AVS_CONFIG_WIFI_PASSTHROUGH
+    // comm_connect took passthrough, and "+++" left it for the commands
+    if (at_query_cipmode(&eMode) != AT_OK || eMode != at_txmode_passthrough) {
+        printf("passthrough not used\n");
+        bPassed = 0;
+    }
+#endif
+    if (g_tOptions.m_bStress || g_tOptions.m_tEmu.m_ulLossPpm) {
+        printf("%s\n", bPassed ? "passed" : "FAILED");
+    }
+
+    esp32_emu_stop();
+    exit(bPassed ? 0 : 1);
+}
+
+
+
+static void usage(const char* pcName)
+{
+    printf("usage: %s [options]\n"
+        "  -b baud     highest rate the module takes (AT_UART_BAUD_MAX %u)\n"
+        "  -F flow     flow control of the module after reset, like saved by AT+UART_DEF: 0 none, 3 RTS/CTS (0)\n"
+        "  -n links    links used at once, 1 to %d (%d)\n"
+        "  -k KB       data sent and received back per link (64)\n"
+        "  -c count    AT commands of the turnaround benchmark (200)\n"
+        "  -L us       latency of the module for each response and the data sent back\n"
+        "  -g bytes    largest +IPD (1460)\n"
+        "  -f us       fragmentation: +IPD of random sizes and pauses up to us in the UART data\n"
+        "  -p ppm      bytes lost by the module towards the FT900 per million\n"
+        "  -a          active receive mode, the module refuses AT+CIPRECVMODE=1\n"
+        "  -s          stress test: random sizes and pauses of the readers; fails on any loss\n"
+        "  -v          print the commands received by the module\n",
+        pcName, AT_UART_BAUD_MAX, BENCH_LINKS_MAX, BENCH_LINKS);
+}
+
+int main(int argc, char** argv)
+{
+    TEsp32EmuConfig* pEmu = &g_tOptions.m_tEmu;
+    const char* pcDevice;
+    int lOption;
+
+
+    setvbuf(stdout, NULL, _IOLBF, 0);
+    pEmu->m_ulBaud = AT_UART_BAUD;
+    pEmu->m_ulSegment = 1460;
+    g_tOptions.m_ulLinks = BENCH_LINKS;
+    g_tOptions.m_ulBytes = 64 * 1024;
+    g_tOptions.m_ulCommands = 200;
+
+    while ((lOption = getopt(argc, argv, "b:F:n:k:c:L:g:f:p:asvh")) != -1) {
+        switch (lOption) {
+            case 'b': pEmu->m_ulMaxBaud = atoi(optarg); break;
+            case 'F': pEmu->m_ucFlow = atoi(optarg); break;
+            case 'n': g_tOptions.m_ulLinks = atoi(optarg); break;
+            case 'k': g_tOptions.m_ulBytes = atoi(optarg) * 1024; break;
+            case 'c': g_tOptions.m_ulCommands = atoi(optarg); break;
+            case 'L': pEmu->m_ulLatencyUs = atoi(optarg); break;
+            case 'g': pEmu->m_ulSegment = atoi(optarg); break;
+            case 'f': pEmu->m_ucFragment = 1; pEmu->m_ulGapUs = atoi(optarg); break;
+            case 'p': pEmu->m_ulLossPpm = atoi(optarg); break;
+            case 'a': pEmu->m_ucNoPassive = 1; break;
+            case 's': g_tOptions.m_bStress = 1; break;
+            case 'v': pEmu->m_ucVerbose = 1; break;
+            default: usage(argv[0]); return 1;
+        }
+    }
+    if (!g_tOptions.m_ulLinks || g_tOptions.m_ulLinks > BENCH_LINKS_MAX || !g_tOptions.m_ulBytes ||
+        !g_tOptions.m_ulCommands || !pEmu->m_ulSegment || pEmu->m_ucFlow > 3) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    if (!(pcDevice = esp32_emu_start(pEmu))) {
+        printf("esp32_emu_start failed\n");
+        return 1;
+    }
+    host_uart_set_device(pcDevice);
+
+    if (xTaskCreate(vTaskBench, "Bench", TASK_BENCH_STACK_SIZE, NULL, TASK_BENCH_PRIORITY, &g_xBench) != pdTRUE) {
+        printf("vTaskBench failed\n");
+        return 1;
+    }
+
+    vTaskStartScheduler();
+    return 0;
+}
@@ -0,0 +1,946 @@
+/**
+  @file esp32_emu.c
+  @brief
+  Host build of the ESP32 driver
+  AT firmware stand-in of the ESP32, run in a child process on the master side of a pseudo terminal
+  - Commands: AT, ATE, AT+GMR, AT+RST, AT+RESTORE, AT+UART_CUR/DEF, AT+CWMODE, AT+CWJAP, AT+CWQAP, AT+CIPSTA,
+    AT+CIPMUX, AT+CIPMODE, AT+CIPDINFO, AT+CIPRECVMODE, AT+CIPRECVDATA (2.x format),
+    AT+CIPSTART, AT+CIPCLOSE, AT+CIPSTATUS and AT+CIPSEND
+  - The data of AT+CIPSEND is sent back on its link as +IPD, or held for AT+CIPRECVDATA in passive mode;
+    data ending with "DROP" closes the link instead
+  - Passthrough: with AT+CIPMODE=1, AT+CIPSEND without length sends back the data as is until "+++"
+    arrives alone after 20 ms without data. "DROP" closes the link without telling, like the module
+    reconnecting in the background, so only AT+CIPSTATUS shows it
+  - A writer thread sends the responses at the rate of the module, 16 bytes at a time, and waits while
+    the FT900 de-asserts RTS if the module uses CTS. The FT900 is taken to empty its FIFO in time while
+    its receive interrupt is enabled: the next 16 bytes wait until it has read the previous ones, so the
+    delays of the host scheduler are not seen as overruns. Otherwise the data beyond 128 bytes is lost
+  - Data is garbled in both directions while the rates of the FT900 and of the module are more than
+    2.5% apart, like a real UART
+
+ */
+/*
+ * ============================================================================
+ * History
+ * =======
+ * 2026-10-16 : Created v1
+ *
+ * ============================================================================
+ */
+
+#define _GNU_SOURCE // posix_openpt, ptsname_r
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <termios.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/prctl.h>
+#include <sys/wait.h>
+#include "esp32_emu.h"
+
+
+
+#define EMU_LINKS           5
+#define EMU_CHUNK           16      // bytes written at a time, the receive FIFO of the FT900
+#define EMU_FIFO_MAX        128     // receive FIFO of the FT900 in 16950 mode
+#define EMU_LINE_MAX        512
+#define EMU_SEND_MAX        2048    // largest AT+CIPSEND
+#define EMU_DEFAULT_BAUD    115200
+#define EMU_DEFAULT_FLOW    0
+#define EMU_GUARD_US        20000   // silence before "+++" in passthrough
+
+
+typedef struct _EmuOutput {
+    struct _EmuOutput* m_pNext;
+    uint64_t m_ullDue;          // not written before, in microseconds
+    uint32_t m_ulSize;
+    uint8_t  m_aucData[];
+} EmuOutput;
+
+typedef struct _EmuLink {
+    uint8_t  m_ucOpen;
+    uint16_t m_uwPort;
+    uint8_t* m_pucHeld;         // data kept for AT+CIPRECVDATA in passive mode
+    uint32_t m_ulHeld;
+    uint32_t m_ulAlloc;
+} EmuLink;
+
+typedef struct _Esp32Emu {
+
+    TEsp32EmuConfig m_tConfig;
+    TEsp32EmuLines* m_pLines;
+    int m_lFd;
+    int m_lSlave;               // kept open to see the bytes the FT900 has not read
+    unsigned int m_ulSeed;      // reader thread
+    unsigned int m_ulWriterSeed;
+
+    // Responses not written yet, oldest first
+    pthread_mutex_t m_xMutex;
+    pthread_cond_t m_xCond;
+    EmuOutput* m_pHead;
+    EmuOutput* m_pTail;
+
+    // Settings of the firmware
+    uint8_t  m_ucEcho;
+    uint8_t  m_ucMux;
+    uint8_t  m_ucPassive;
+    uint8_t  m_ucDinfo;
+    uint8_t  m_ucCipmode;
+    uint8_t  m_ucCwmode;
+    uint8_t  m_ucWifi;
+    uint32_t m_ulDefBaud;
+    uint8_t  m_ucDefFlow;
+    EmuLink  m_atLinks[EMU_LINKS];
+
+    // AT+CIPSEND waiting for its data
+    int      m_lSendLink;
+    uint32_t m_ulSendSize;
+    uint32_t m_ulSendLeft;
+    uint8_t  m_aucSend[EMU_SEND_MAX];
+
+    // Passthrough started by AT+CIPSEND with AT+CIPMODE=1
+    uint8_t  m_ucPassthrough;
+    uint32_t m_ulTail;          // last 4 bytes of the data, for "DROP"
+    uint64_t m_ullLastRx;       // end of the last data received, for the guard time of "+++"
+
+} Esp32Emu;
+
+static Esp32Emu g_tEmu;
+static TEsp32EmuLines* g_pLines = NULL;
+static pid_t g_lChild = 0;
+static char g_acSlave[128];
+
+
+
+static uint64_t emu_time_us(void)
+{
+    struct timespec tNow;
+
+    clock_gettime(CLOCK_MONOTONIC, &tNow);
+    return (uint64_t)tNow.tv_sec * 1000000 + tNow.tv_nsec / 1000;
+}
+
+static void emu_sleep_us(uint64_t ullUs)
+{
+    struct timespec tSleep = {(time_t)(ullUs / 1000000), (long)(ullUs % 1000000) * 1000};
+
+    while (nanosleep(&tSleep, &tSleep) && errno == EINTR) {
+    }
+}
+
+// Rates further apart than 2.5% make a UART sample the wrong bits
+static int emu_garbled(const Esp32Emu* pEmu)
+{
+    uint32_t ulHost = pEmu->m_pLines->m_ulHostBaud;
+    uint32_t ulBaud = pEmu->m_pLines->m_ulBaud;
+
+    return ulHost > ulBaud + ulBaud / 40 || ulHost + ulBaud / 40 < ulBaud;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////
+// Writer thread: the UART transmitter of the module
+/////////////////////////////////////////////////////////////////////////////////////////////
+static void emu_write_chunk(Esp32Emu* pEmu, const uint8_t* pucData, uint32_t ulSize)
+{
+    TEsp32EmuLines* pLines = pEmu->m_pLines;
+    uint8_t aucChunk[EMU_CHUNK];
+    uint32_t ulOut = 0;
+
+    for (uint32_t i=0; i<ulSize; i++) {
+        if (pEmu->m_tConfig.m_ulLossPpm &&
+            (uint32_t)(rand_r(&pEmu->m_ulWriterSeed) % 1000000) < pEmu->m_tConfig.m_ulLossPpm) {
+            pLines->m_ullDropped++;
+            continue;
+        }
+        if (emu_garbled(pEmu)) {
+            aucChunk[ulOut++] = (uint8_t)rand_r(&pEmu->m_ulWriterSeed);
+            pLines->m_ullGarbled++;
+            continue;
+        }
+        aucChunk[ulOut++] = pucData[i];
+    }
+
+    for (uint32_t i=0; i<ulOut; ) {
+        ssize_t lRet = write(pEmu->m_lFd, aucChunk + i, ulOut - i);
+        if (lRet <= 0) {
+            if (lRet < 0 && errno != EINTR && errno != EAGAIN) {
+                _exit(0);
+            }
+            continue;
+        }
+        i += lRet;
+    }
+    pLines->m_ullSent += ulOut;
+}
+
+static void emu_write(Esp32Emu* pEmu, const uint8_t* pucData, uint32_t ulSize)
+{
+    TEsp32EmuLines* pLines = pEmu->m_pLines;
+    uint64_t ullNext = emu_time_us();   // end of the chunk on the line
+
+    while (ulSize) {
+        uint32_t ulChunk = EMU_CHUNK;
+        uint64_t ullNow;
+        int lUnread;
+
+        if (pEmu->m_tConfig.m_ucFragment) {
+            ulChunk = 1 + rand_r(&pEmu->m_ulWriterSeed) % EMU_CHUNK;
+        }
+        if (ulChunk > ulSize) {
+            ulChunk = ulSize;
+        }
+
+        // The module holds its data while the FT900 de-asserts RTS
+        if ((pLines->m_ucFlow & 2) && !pLines->m_ucHostRts) {
+            uint64_t ullStall = emu_time_us();
+            while (!pLines->m_ucHostRts) {
+                emu_sleep_us(20);
+            }
+            pLines->m_ullStalledUs += emu_time_us() - ullStall;
+            ullNext = emu_time_us();
+        }
+        while (!ioctl(pEmu->m_lSlave, FIONREAD, &lUnread) && lUnread > 0) {
+            if (!pLines->m_ucHostReading && lUnread + ulChunk > EMU_FIFO_MAX) {
+                break;
+            }
+            emu_sleep_us(10);
+        }
+
+        // 10 bits per byte at the rate of the module: the chunk is written when its last bit arrives.
+        // A late writer catches up, so the rate holds despite the sleeps.
+        ullNow = emu_time_us();
+        ullNext += (uint64_t)ulChunk * 10 * 1000000 / pLines->m_ulBaud;
+        if (pEmu->m_tConfig.m_ucFragment && pEmu->m_tConfig.m_ulGapUs && !(rand_r(&pEmu->m_ulWriterSeed) % 16)) {
+            ullNext += rand_r(&pEmu->m_ulWriterSeed) % pEmu->m_tConfig.m_ulGapUs;
+        }
+        if (ullNext > ullNow) {
+            emu_sleep_us(ullNext - ullNow);
+        }
+
+        if (lUnread > 0 && !pLines->m_ucHostReading && lUnread + ulChunk > EMU_FIFO_MAX) {
+            pLines->m_ullOverrun += ulChunk;
+        }
+        else {
+            emu_write_chunk(pEmu, pucData, ulChunk);
+        }
+        pucData += ulChunk;
+        ulSize -= ulChunk;
+    }
+}
+
+static void* emu_writer(void* pvEmu)
+{
+    Esp32Emu* pEmu = (Esp32Emu*)pvEmu;
+
+    while (1) {
+        EmuOutput* pOutput;
+        uint64_t ullNow;
+
+        pthread_mutex_lock(&pEmu->m_xMutex);
+        while (!pEmu->m_pHead) {
+            pthread_cond_wait(&pEmu->m_xCond, &pEmu->m_xMutex);
+        }
+        pOutput = pEmu->m_pHead;
+        pthread_mutex_unlock(&pEmu->m_xMutex);
+
+        ullNow = emu_time_us();
+        if (pOutput->m_ullDue > ullNow) {
+            emu_sleep_us(pOutput->m_ullDue - ullNow);
+        }
+        emu_write(pEmu, pOutput->m_aucData, pOutput->m_ulSize);
+
+        // Removed once written, so that emu_drain also waits for the last one
+        pthread_mutex_lock(&pEmu->m_xMutex);
+        pEmu->m_pHead = pOutput->m_pNext;
+        if (!pEmu->m_pHead) {
+            pEmu->m_pTail = NULL;
+            pthread_cond_broadcast(&pEmu->m_xCond);
+        }
+        pthread_mutex_unlock(&pEmu->m_xMutex);
+        free(pOutput);
+    }
+    return NULL;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////
+// Responses, queued for the writer thread
+/////////////////////////////////////////////////////////////////////////////////////////////
+static void emu_queue(Esp32Emu* pEmu, uint32_t ulDelayUs, const void* pvHeader, uint32_t ulHeader,
+    const void* pvData, uint32_t ulData)
+{
+    EmuOutput* pOutput = malloc(sizeof(EmuOutput) + ulHeader + ulData);
+
+    if (!pOutput) {
+        return;
+    }
+    pOutput->m_pNext = NULL;
+    pOutput->m_ullDue = emu_time_us() + ulDelayUs;
+    pOutput->m_ulSize = ulHeader + ulData;
+    memcpy(pOutput->m_aucData, pvHeader, ulHeader);
+    if (ulData) {
+        memcpy(pOutput->m_aucData + ulHeader, pvData, ulData);
+    }
+
+    pthread_mutex_lock(&pEmu->m_xMutex);
+    if (pEmu->m_pTail) {
+        pEmu->m_pTail->m_pNext = pOutput;
+    }
+    else {
+        pEmu->m_pHead = pOutput;
+    }
+    pEmu->m_pTail = pOutput;
+    pthread_cond_broadcast(&pEmu->m_xCond);
+    pthread_mutex_unlock(&pEmu->m_xMutex);
+}
+
+// Response after the latency of the module
+static void emu_reply(Esp32Emu* pEmu, const char* pcFormat, ...)
+{
+    char acReply[EMU_LINE_MAX];
+    va_list tArgs;
+    int lSize;
+
+    va_start(tArgs, pcFormat);
+    lSize = vsnprintf(acReply, sizeof(acReply), pcFormat, tArgs);
+    va_end(tArgs);
+    if (lSize >= (int)sizeof(acReply)) {
+        lSize = sizeof(acReply) - 1;
+    }
+    emu_queue(pEmu, pEmu->m_tConfig.m_ulLatencyUs, acReply, lSize, NULL, 0);
+}
+
+// Waits until all the responses have been written
+static void emu_drain(Esp32Emu* pEmu)
+{
+    pthread_mutex_lock(&pEmu->m_xMutex);
+    while (pEmu->m_pHead) {
+        pthread_cond_wait(&pEmu->m_xCond, &pEmu->m_xMutex);
+    }
+    pthread_mutex_unlock(&pEmu->m_xMutex);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////
+// Links
+/////////////////////////////////////////////////////////////////////////////////////////////
+static void emu_link_close(Esp32Emu* pEmu, int lLink, int bReport)
+{
+    EmuLink* pLink = &pEmu->m_atLinks[lLink];
+
+    if (!pLink->m_ucOpen) {
+        return;
+    }
+    pLink->m_ucOpen = 0;
+    pLink->m_ulHeld = 0;
+    if (!bReport) {
+        return;
+    }
+    if (pEmu->m_ucMux) {
+        emu_reply(pEmu, "%d,CLOSED\r\n", lLink);
+    }
+    else {
+        emu_reply(pEmu, "CLOSED\r\n");
+    }
+}
+
+static void emu_link_hold(EmuLink* pLink, const uint8_t* pucData, uint32_t ulSize)
+{
+    if (pLink->m_ulHeld + ulSize > pLink->m_ulAlloc) {
+        uint32_t ulAlloc = (pLink->m_ulHeld + ulSize) * 2;
+        uint8_t* pucHeld = realloc(pLink->m_pucHeld, ulAlloc);
+        if (!pucHeld) {
+            return;
+        }
+        pLink->m_pucHeld = pucHeld;
+        pLink->m_ulAlloc = ulAlloc;
+    }
+    memcpy(pLink->m_pucHeld + pLink->m_ulHeld, pucData, ulSize);
+    pLink->m_ulHeld += ulSize;
+}
+
+// The remote end sends the data of AT+CIPSEND back, in TCP segments
+static void emu_send_done(Esp32Emu* pEmu)
+{
+    int lLink = pEmu->m_lSendLink;
+    EmuLink* pLink = &pEmu->m_atLinks[lLink];
+    uint32_t ulSize = pEmu->m_ulSendSize;
+    uint32_t ulSegment = pEmu->m_tConfig.m_ulSegment;
+    char acHeader[32];
+    int lHeader;
+
+    emu_reply(pEmu, "\r\nRecv %u bytes\r\n\r\nSEND OK\r\n", ulSize);
+
+    if (ulSize >= 4 && !memcmp(pEmu->m_aucSend + ulSize - 4, "DROP", 4)) {
+        emu_link_close(pEmu, lLink, 1);
+        return;
+    }
+
+    for (uint32_t ulOffset=0; ulOffset<ulSize; ) {
+        uint32_t ulLength = ulSegment;
+        if (pEmu->m_tConfig.m_ucFragment) {
+            ulLength = 1 + rand_r(&pEmu->m_ulSeed) % ulSegment;
+        }
+        if (ulLength > ulSize - ulOffset) {
+            ulLength = ulSize - ulOffset;
+        }
+
+        if (pEmu->m_ucPassive) {
+            emu_link_hold(pLink, pEmu->m_aucSend + ulOffset, ulLength);
+            if (pEmu->m_ucMux) {
+                lHeader = snprintf(acHeader, sizeof(acHeader), "\r\n+IPD,%d,%u\r\n", lLink, ulLength);
+            }
+            else {
+                lHeader = snprintf(acHeader, sizeof(acHeader), "\r\n+IPD,%u\r\n", ulLength);
+            }
+            emu_queue(pEmu, pEmu->m_tConfig.m_ulLatencyUs, acHeader, lHeader, NULL, 0);
+        }
+        else {
+            if (pEmu->m_ucMux) {
+                lHeader = snprintf(acHeader, sizeof(acHeader), "\r\n+IPD,%d,%u:", lLink, ulLength);
+            }
+            else {
+                lHeader = snprintf(acHeader, sizeof(acHeader), "\r\n+IPD,%u:", ulLength);
+            }
+            emu_queue(pEmu, pEmu->m_tConfig.m_ulLatencyUs, acHeader, lHeader, pEmu->m_aucSend + ulOffset, ulLength);
+        }
+        ulOffset += ulLength;
+    }
+}
+
+// The remote end sends the data of passthrough back as is, in TCP segments
+static void emu_passthrough(Esp32Emu* pEmu, const uint8_t* pucData, uint32_t ulSize, uint64_t ullGapUs)
+{
+    uint32_t ulSegment = pEmu->m_tConfig.m_ulSegment;
+
+    if (ulSize == 3 && !memcmp(pucData, "+++", 3) && ullGapUs >= EMU_GUARD_US) {
+        pEmu->m_ucPassthrough = 0;
+        return;
+    }
+    if (!pEmu->m_atLinks[0].m_ucOpen) {
+        return;
+    }
+    for (uint32_t i=0; i<ulSize; i++) {
+        pEmu->m_ulTail = (pEmu->m_ulTail << 8) | pucData[i];
+    }
+    if (pEmu->m_ulTail == ((uint32_t)'D' << 24 | (uint32_t)'R' << 16 | (uint32_t)'O' << 8 | 'P')) {
+        emu_link_close(pEmu, 0, 0);
+        return;
+    }
+
+    for (uint32_t ulOffset=0; ulOffset<ulSize; ) {
+        uint32_t ulLength = ulSegment;
+        if (pEmu->m_tConfig.m_ucFragment) {
+            ulLength = 1 + rand_r(&pEmu->m_ulSeed) % ulSegment;
+        }
+        if (ulLength > ulSize - ulOffset) {
+            ulLength = ulSize - ulOffset;
+        }
+        emu_queue(pEmu, pEmu->m_tConfig.m_ulLatencyUs, pucData + ulOffset, ulLength, NULL, 0);
+        ulOffset += ulLength;
+    }
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////
+// Commands
+/////////////////////////////////////////////////////////////////////////////////////////////
+static void emu_reset(Esp32Emu* pEmu)
+{
+    for (int i=0; i<EMU_LINKS; i++) {
+        emu_link_close(pEmu, i, 0);
+    }
+    pEmu->m_ucEcho = 1;
+    pEmu->m_ucMux = 0;
+    pEmu->m_ucPassive = 0;
+    pEmu->m_ucDinfo = 0;
+    pEmu->m_ucCipmode = 0;
+    pEmu->m_ucPassthrough = 0;
+    pEmu->m_ulSendLeft = 0;
+    pEmu->m_pLines->m_ulBaud = pEmu->m_ulDefBaud;
+    pEmu->m_pLines->m_ucFlow = pEmu->m_ucDefFlow;
+}
+
+// Link of the parameters of AT+CIPSTART, AT+CIPCLOSE, AT+CIPSEND and AT+CIPRECVDATA; -1 if not valid
+static int emu_link_param(Esp32Emu* pEmu, const char** ppcParams)
+{
+    char* pcEnd;
+    long lLink;
+
+    if (!pEmu->m_ucMux) {
+        return 0;
+    }
+    lLink = strtol(*ppcParams, &pcEnd, 10);
+    if (pcEnd == *ppcParams || lLink < 0 || lLink >= EMU_LINKS) {
+        return -1;
+    }
+    *ppcParams = (*pcEnd == ',') ? pcEnd + 1 : pcEnd;
+    return (int)lLink;
+}
+
+static void emu_uart(Esp32Emu* pEmu, const char* pcParams, int bDefault)
+{
+    unsigned int ulBaud, ulData, ulStop, ulParity, ulFlow;
+
+    if (sscanf(pcParams, "%u,%u,%u,%u,%u", &ulBaud, &ulData, &ulStop, &ulParity, &ulFlow) != 5 ||
+        ulBaud < 80 || ulBaud > 5000000 || ulFlow > 3 ||
+        (pEmu->m_tConfig.m_ulMaxBaud && ulBaud > pEmu->m_tConfig.m_ulMaxBaud)) {
+        emu_reply(pEmu, "\r\nERROR\r\n");
+        return;
+    }
+
+    // OK goes out at the old rate
+    emu_reply(pEmu, "\r\nOK\r\n");
+    emu_drain(pEmu);
+    emu_sleep_us(2000);
+    pEmu->m_pLines->m_ulBaud = ulBaud;
+    pEmu->m_pLines->m_ucFlow = (uint8_t)ulFlow;
+    if (bDefault) {
+        pEmu->m_ulDefBaud = ulBaud;
+        pEmu->m_ucDefFlow = (uint8_t)ulFlow;
+    }
+}
+
+static void emu_cipstart(Esp32Emu* pEmu, const char* pcParams)
+{
+    int lLink = emu_link_param(pEmu, &pcParams);
+    const char* pcPort;
+
+    if (lLink < 0 || (strncmp(pcParams, "\"TCP\"", 5) && strncmp(pcParams, "\"UDP\"", 5) && strncmp(pcParams, "\"SSL\"", 5))) {
+        emu_reply(pEmu, "\r\nERROR\r\n");
+        return;
+    }
+    if (!pEmu->m_ucWifi) {
+        emu_reply(pEmu, "\r\nno ip\r\n\r\nERROR\r\n");
+        return;
+    }
+    if (pEmu->m_atLinks[lLink].m_ucOpen) {
+        emu_reply(pEmu, "\r\nALREADY CONNECTED\r\n\r\nERROR\r\n");
+        return;
+    }
+    pcPort = strrchr(pcParams, '"');
+    pEmu->m_atLinks[lLink].m_ucOpen = 1;
+    pEmu->m_atLinks[lLink].m_uwPort = (pcPort && pcPort[1] == ',') ? (uint16_t)atoi(pcPort + 2) : 0;
+    pEmu->m_atLinks[lLink].m_ulHeld = 0;
+    if (pEmu->m_ucMux) {
+        emu_reply(pEmu, "%d,CONNECT\r\n\r\nOK\r\n", lLink);
+    }
+    else {
+        emu_reply(pEmu, "CONNECT\r\n\r\nOK\r\n");
+    }
+}
+
+static void emu_cipstatus(Esp32Emu* pEmu)
+{
+    char acReply[EMU_LINE_MAX];
+    int lSize = 0;
+    int lStatus = pEmu->m_ucWifi ? 2 : 5;
+
+    for (int i=0; i<EMU_LINKS; i++) {
+        if (pEmu->m_atLinks[i].m_ucOpen) {
+            lStatus = 3;
+            lSize += snprintf(acReply + lSize, sizeof(acReply) - lSize, "+CIPSTATUS:%d,\"TCP\",\"192.168.1.1\",%u,%u,0\r\n",
+                i, pEmu->m_atLinks[i].m_uwPort, 50000 + i);
+        }
+    }
+    emu_reply(pEmu, "STATUS:%d\r\n%s\r\nOK\r\n", lStatus, lSize ? acReply : "");
+}
+
+static void emu_ciprecvdata(Esp32Emu* pEmu, const char* pcParams)
+{
+    int lLink = emu_link_param(pEmu, &pcParams);
+    EmuLink* pLink;
+    uint32_t ulSize;
+    char acHeader[32];
+    int lHeader;
+
+    if (lLink < 0 || !pEmu->m_ucPassive) {
+        emu_reply(pEmu, "\r\nERROR\r\n");
+        return;
+    }
+    pLink = &pEmu->m_atLinks[lLink];
+    ulSize = (uint32_t)strtoul(pcParams, NULL, 10);
+    if (ulSize > pLink->m_ulHeld) {
+        ulSize = pLink->m_ulHeld;
+    }
+    if (!ulSize) {
+        emu_reply(pEmu, "\r\nERROR\r\n");
+        return;
+    }
+
+    lHeader = snprintf(acHeader, sizeof(acHeader), "+CIPRECVDATA:%u,", ulSize);
+    emu_queue(pEmu, pEmu->m_tConfig.m_ulLatencyUs, acHeader, lHeader, pLink->m_pucHeld, ulSize);
+    emu_queue(pEmu, 0, "\r\nOK\r\n", 6, NULL, 0);
+    memmove(pLink->m_pucHeld, pLink->m_pucHeld + ulSize, pLink->m_ulHeld - ulSize);
+    pLink->m_ulHeld -= ulSize;
+}
+
+static void emu_cipsend(Esp32Emu* pEmu, const char* pcParams)
+{
+    int lLink = emu_link_param(pEmu, &pcParams);
+    unsigned long ulSize = strtoul(pcParams, NULL, 10);
+
+    if (lLink < 0 || !pEmu->m_atLinks[lLink].m_ucOpen) {
+        emu_reply(pEmu, "\r\nlink is not valid\r\n\r\nERROR\r\n");
+        return;
+    }
+    if (!ulSize || ulSize > EMU_SEND_MAX) {
+        emu_reply(pEmu, "\r\nERROR\r\n");
+        return;
+    }
+    pEmu->m_lSendLink = lLink;
+    pEmu->m_ulSendSize = (uint32_t)ulSize;
+    pEmu->m_ulSendLeft = (uint32_t)ulSize;
+    emu_reply(pEmu, "\r\nOK\r\n\r\n>");
+}
+
+// AT+CIPSEND without length: passthrough on the single link of AT+CIPMUX=0
+static void emu_cipsend_passthrough(Esp32Emu* pEmu)
+{
+    if (!pEmu->m_ucCipmode || pEmu->m_ucMux || !pEmu->m_atLinks[0].m_ucOpen) {
+        emu_reply(pEmu, "\r\nERROR\r\n");
+        return;
+    }
+    pEmu->m_ucPassthrough = 1;
+    pEmu->m_ulTail = 0;
+    emu_reply(pEmu, "\r\nOK\r\n\r\n>");
+}
+
+static void emu_command(Esp32Emu* pEmu, const char* pcLine)
+{
+    const char* pcParams;
+
+    if (pEmu->m_tConfig.m_ucVerbose) {
+        fprintf(stderr, "esp32: %s\n", pcLine);
+    }
+    if (!*pcLine) {
+        return;
+    }
+    if (pEmu->m_ucEcho) {
+        emu_queue(pEmu, 0, pcLine, strlen(pcLine), "\r\n", 2);
+    }
+
+#define EMU_IS(c)       (!strcmp(pcLine, c))
+#define EMU_SET(c)      (!strncmp(pcLine, c "=", sizeof(c)) && (pcParams = pcLine + sizeof(c)))
+    if (EMU_IS("AT")) {
+        emu_reply(pEmu, "\r\nOK\r\n");
+    }
+    else if (EMU_IS("ATE0") || EMU_IS("ATE1")) {
+        pEmu->m_ucEcho = pcLine[3] - '0';
+        emu_reply(pEmu, "\r\nOK\r\n");
+    }
+    else if (EMU_IS("AT+GMR")) {
+        emu_reply(pEmu, "AT version:2.1.0.0(host emulator)\r\nSDK version:v4.2\r\n"
+            "compile time(0):Oct 16 2026 00:00:00\r\nBin version:2.1.0(WROOM-32)\r\n\r\nOK\r\n");
+    }
+    else if (EMU_IS("AT+RST") || EMU_IS("AT+RESTORE")) {
+        emu_reply(pEmu, "\r\nOK\r\n");
+        emu_drain(pEmu);
+        emu_sleep_us(50000);
+        if (pcLine[3] == 'R' && pcLine[4] == 'E') {
+            pEmu->m_ulDefBaud = EMU_DEFAULT_BAUD;
+            pEmu->m_ucDefFlow = EMU_DEFAULT_FLOW;
+        }
+        emu_reset(pEmu);
+        emu_queue(pEmu, 0, "\r\nready\r\n", 9, NULL, 0);
+    }
+    else if (EMU_SET("AT+UART_CUR")) {
+        emu_uart(pEmu, pcParams, 0);
+    }
+    else if (EMU_SET("AT+UART_DEF")) {
+        emu_uart(pEmu, pcParams, 1);
+    }
+    else if (EMU_IS("AT+UART_CUR?")) {
+        emu_reply(pEmu, "+UART_CUR:%u,8,1,0,%u\r\n\r\nOK\r\n", pEmu->m_pLines->m_ulBaud, pEmu->m_pLines->m_ucFlow);
+    }
+    else if (EMU_IS("AT+UART_DEF?")) {
+        emu_reply(pEmu, "+UART_DEF:%u,8,1,0,%u\r\n\r\nOK\r\n", pEmu->m_ulDefBaud, pEmu->m_ucDefFlow);
+    }
+    else if (EMU_SET("AT+CWMODE")) {
+        pEmu->m_ucCwmode = (uint8_t)atoi(pcParams);
+        emu_reply(pEmu, "\r\nOK\r\n");
+    }
+    else if (EMU_IS("AT+CWMODE?")) {
+        emu_reply(pEmu, "+CWMODE:%d\r\n\r\nOK\r\n", pEmu->m_ucCwmode);
+    }
+    else if (EMU_SET("AT+CWJAP")) {
+        pEmu->m_ucWifi = 1;
+        emu_reply(pEmu, "WIFI CONNECTED\r\nWIFI GOT IP\r\n\r\nOK\r\n");
+    }
+    else if (EMU_IS("AT+CWJAP?")) {
+        if (pEmu->m_ucWifi) {
+            emu_reply(pEmu, "+CWJAP:\"emulator\",\"02:00:00:00:00:01\",6,-40,0,0,0,0\r\n\r\nOK\r\n");
+        }
+        else {
+            emu_reply(pEmu, "No AP\r\n\r\nOK\r\n");
+        }
+    }
+    else if (EMU_IS("AT+CWQAP")) {
+        emu_reply(pEmu, "\r\nOK\r\n");
+        for (int i=0; i<EMU_LINKS; i++) {
+            emu_link_close(pEmu, i, 1);
+        }
+        if (pEmu->m_ucWifi) {
+            pEmu->m_ucWifi = 0;
+            emu_reply(pEmu, "WIFI DISCONNECT\r\n");
+        }
+    }
+    else if (EMU_IS("AT+CIPSTA?")) {
+        if (pEmu->m_ucWifi) {
+            emu_reply(pEmu, "+CIPSTA:ip:\"192.168.1.2\"\r\n+CIPSTA:gateway:\"192.168.1.1\"\r\n"
+                "+CIPSTA:netmask:\"255.255.255.0\"\r\n\r\nOK\r\n");
+        }
+        else {
+            emu_reply(pEmu, "+CIPSTA:ip:\"0.0.0.0\"\r\n+CIPSTA:gateway:\"0.0.0.0\"\r\n"
+                "+CIPSTA:netmask:\"0.0.0.0\"\r\n\r\nOK\r\n");
+        }
+    }
+    else if (EMU_SET("AT+CIPMUX")) {
+        int bOpen = 0;
+        for (int i=0; i<EMU_LINKS; i++) {
+            bOpen |= pEmu->m_atLinks[i].m_ucOpen;
+        }
+        if (bOpen) {
+            emu_reply(pEmu, "\r\nlink is builded\r\n\r\nERROR\r\n");
+        }
+        else if (pEmu->m_ucCipmode && atoi(pcParams)) {
+            emu_reply(pEmu, "\r\nERROR\r\n");
+        }
+        else {
+            pEmu->m_ucMux = (uint8_t)atoi(pcParams);
+            emu_reply(pEmu, "\r\nOK\r\n");
+        }
+    }
+    else if (EMU_IS("AT+CIPMUX?")) {
+        emu_reply(pEmu, "+CIPMUX:%d\r\n\r\nOK\r\n", pEmu->m_ucMux);
+    }
+    else if (EMU_SET("AT+CIPMODE")) {
+        // Passthrough needs AT+CIPMUX=0
+        int lMode = atoi(pcParams);
+        if (lMode > 1 || (lMode && pEmu->m_ucMux)) {
+            emu_reply(pEmu, "\r\nERROR\r\n");
+        }
+        else {
+            pEmu->m_ucCipmode = (uint8_t)lMode;
+            emu_reply(pEmu, "\r\nOK\r\n");
+        }
+    }
+    else if (EMU_IS("AT+CIPMODE?")) {
+        emu_reply(pEmu, "+CIPMODE:%d\r\n\r\nOK\r\n", pEmu->m_ucCipmode);
+    }
+    else if (EMU_SET("AT+CIPDINFO")) {
+        pEmu->m_ucDinfo = (uint8_t)atoi(pcParams);
+        emu_reply(pEmu, "\r\nOK\r\n");
+    }
+    else if (EMU_IS("AT+CIPDINFO?")) {
+        emu_reply(pEmu, "+CIPDINFO:%s\r\n\r\nOK\r\n", pEmu->m_ucDinfo ? "TRUE" : "FALSE");
+    }
+    else if (EMU_SET("AT+CIPRECVMODE")) {
+        if (pEmu->m_tConfig.m_ucNoPassive) {
+            emu_reply(pEmu, "\r\nERROR\r\n");
+        }
+        else {
+            pEmu->m_ucPassive = (uint8_t)atoi(pcParams);
+            emu_reply(pEmu, "\r\nOK\r\n");
+        }
+    }
+    else if (EMU_IS("AT+CIPRECVMODE?")) {
+        emu_reply(pEmu, "+CIPRECVMODE:%d\r\n\r\nOK\r\n", pEmu->m_ucPassive);
+    }
+    else if (EMU_SET("AT+CIPRECVDATA")) {
+        emu_ciprecvdata(pEmu, pcParams);
+    }
+    else if (EMU_SET("AT+CIPSTART")) {
+        emu_cipstart(pEmu, pcParams);
+    }
+    else if (EMU_SET("AT+CIPCLOSE") || EMU_IS("AT+CIPCLOSE")) {
+        int lLink;
+        pcParams = pcLine[11] ? pcLine + 12 : "";
+        lLink = emu_link_param(pEmu, &pcParams);
+        if (lLink < 0 || !pEmu->m_atLinks[lLink].m_ucOpen) {
+            emu_reply(pEmu, "\r\nERROR\r\n");
+        }
+        else {
+            emu_link_close(pEmu, lLink, 1);
+            emu_reply(pEmu, "\r\nOK\r\n");
+        }
+    }
+    else if (EMU_IS("AT+CIPSTATUS")) {
+        emu_cipstatus(pEmu);
+    }
+    else if (EMU_SET("AT+CIPSEND")) {
+        emu_cipsend(pEmu, pcParams);
+    }
+    else if (EMU_IS("AT+CIPSEND")) {
+        emu_cipsend_passthrough(pEmu);
+    }
+    else {
+        emu_reply(pEmu, "\r\nERROR\r\n");
+    }
+#undef EMU_IS
+#undef EMU_SET
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////
+// Reader: the UART receiver and the command interpreter of the module
+/////////////////////////////////////////////////////////////////////////////////////////////
+static void emu_run(Esp32Emu* pEmu)
+{
+    uint8_t aucBuffer[4096];
+    char acLine[EMU_LINE_MAX];
+    uint32_t ulLine = 0;
+    pthread_t xWriter;
+
+    pthread_mutex_init(&pEmu->m_xMutex, NULL);
+    pthread_cond_init(&pEmu->m_xCond, NULL);
+    pthread_create(&xWriter, NULL, emu_writer, pEmu);
+
+    while (1) {
+        ssize_t lRet = read(pEmu->m_lFd, aucBuffer, sizeof(aucBuffer));
+        if (lRet <= 0) {
+            if (lRet < 0 && errno != EINTR && errno != EAGAIN) {
+                return;
+            }
+            continue;
+        }
+        pEmu->m_pLines->m_ullReceived += lRet;
+
+        // The terminal hands the FIFO over as soon as the FT900 writes it
+        uint64_t ullNow = emu_time_us();
+        uint64_t ullDone = pEmu->m_pLines->m_ullHostTxDone;
+        uint64_t ullGap;
+        if (ullDone > ullNow) {
+            emu_sleep_us(ullDone - ullNow);
+        }
+        ullNow = emu_time_us();
+        ullGap = ullNow - pEmu->m_ullLastRx;
+        pEmu->m_ullLastRx = ullNow;
+        if (emu_garbled(pEmu)) {
+            for (ssize_t i=0; i<lRet; i++) {
+                aucBuffer[i] = (uint8_t)rand_r(&pEmu->m_ulSeed);
+            }
+        }
+
+        // Data of passthrough, all of it: nothing follows "+++" before the module takes commands again
+        if (pEmu->m_ucPassthrough) {
+            emu_passthrough(pEmu, aucBuffer, (uint32_t)lRet, ullGap);
+            continue;
+        }
+
+        for (ssize_t i=0; i<lRet; ) {
+            // Data of AT+CIPSEND
+            if (pEmu->m_ulSendLeft) {
+                uint32_t ulSize = pEmu->m_ulSendLeft;
+                if (ulSize > (uint32_t)(lRet - i)) {
+                    ulSize = (uint32_t)(lRet - i);
+                }
+                memcpy(pEmu->m_aucSend + pEmu->m_ulSendSize - pEmu->m_ulSendLeft, aucBuffer + i, ulSize);
+                pEmu->m_ulSendLeft -= ulSize;
+                i += ulSize;
+                if (!pEmu->m_ulSendLeft) {
+                    emu_send_done(pEmu);
+                }
+                continue;
+            }
+
+            char c = (char)aucBuffer[i++];
+            if (c == '\n') {
+                if (ulLine && acLine[ulLine - 1] == '\r') {
+                    ulLine--;
+                }
+                acLine[ulLine] = '\0';
+                emu_command(pEmu, acLine);
+                ulLine = 0;
+            }
+            else if (ulLine < sizeof(acLine) - 1) {
+                acLine[ulLine++] = c;
+            }
+        }
+    }
+}
+
+
+
+const char* esp32_emu_start(const TEsp32EmuConfig* pConfig)
+{
+    Esp32Emu* pEmu = &g_tEmu;
+    struct termios tTermios;
+    int lMaster, lSlave;
+
+
+    g_pLines = mmap(NULL, sizeof(TEsp32EmuLines), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (g_pLines == MAP_FAILED) {
+        g_pLines = NULL;
+        return NULL;
+    }
+    memset((void*)g_pLines, 0, sizeof(TEsp32EmuLines));
+    g_pLines->m_ulHostBaud = pConfig->m_ulBaud;
+    g_pLines->m_ucHostRts = 1;
+
+    lMaster = posix_openpt(O_RDWR | O_NOCTTY);
+    if (lMaster < 0 || grantpt(lMaster) || unlockpt(lMaster) || ptsname_r(lMaster, g_acSlave, sizeof(g_acSlave))) {
+        return NULL;
+    }
+    // Raw from the start: the module writes before the FT900 opens the terminal
+    lSlave = open(g_acSlave, O_RDWR | O_NOCTTY);
+    if (lSlave < 0) {
+        close(lMaster);
+        return NULL;
+    }
+    tcgetattr(lSlave, &tTermios);
+    cfmakeraw(&tTermios);
+    tcsetattr(lSlave, TCSANOW, &tTermios);
+
+    memset(pEmu, 0, sizeof(Esp32Emu));
+    pEmu->m_tConfig = *pConfig;
+    if (!pEmu->m_tConfig.m_ulSegment) {
+        pEmu->m_tConfig.m_ulSegment = 1460;
+    }
+    pEmu->m_pLines = g_pLines;
+    pEmu->m_lFd = lMaster;
+    pEmu->m_lSlave = lSlave;
+    pEmu->m_ulSeed = 1;
+    pEmu->m_ulWriterSeed = 2;
+    pEmu->m_ucCwmode = 1;
+    pEmu->m_ucWifi = 1;
+    pEmu->m_ulDefBaud = pConfig->m_ulBaud;
+    pEmu->m_ucDefFlow = pConfig->m_ucFlow;
+    emu_reset(pEmu);
+
+    g_lChild = fork();
+    if (g_lChild < 0) {
+        close(lMaster);
+        close(lSlave);
+        return NULL;
+    }
+    if (!g_lChild) {
+        // The slave stays open here, also so that reads of the master do not fail before the FT900 opens it
+        prctl(PR_SET_PDEATHSIG, SIGTERM);
+        emu_run(pEmu);
+        _exit(0);
+    }
+
+    close(lMaster);
+    close(lSlave);
+    return g_acSlave;
+}
+
+void esp32_emu_stop(void)
+{
+    if (g_lChild > 0) {
+        kill(g_lChild, SIGTERM);
+        waitpid(g_lChild, NULL, 0);
+        g_lChild = 0;
+    }
+}
+
+TEsp32EmuLines* esp32_emu_lines(void)
+{
+    return g_pLines;
+}
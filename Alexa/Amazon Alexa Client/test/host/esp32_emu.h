@@ -0,0 +1,60 @@
+/**
+  @file esp32_emu.h
+  @brief
+  Host build of the ESP32 driver
+  AT firmware stand-in of the ESP32 on a pseudo terminal, with line rate, latency, fragmentation and loss
+
+ */
+/*
+ * ============================================================================
+ * History
+ * =======
+ * 2026-10-16 : Created v1
+ *
+ * ============================================================================
+ */
+#ifndef ESP32_EMU_H
+#define ESP32_EMU_H
+#include <stdint.h>
+
+
+typedef struct _TEsp32EmuConfig {
+    uint32_t m_ulBaud;          // rate after reset (AT+UART_DEF)
+    uint8_t  m_ucFlow;          // flow control after reset: 0 none, 1 RTS, 2 CTS, 3 both
+    uint32_t m_ulMaxBaud;       // AT+UART_CUR/DEF above it fail, 0 for no limit
+    uint32_t m_ulLatencyUs;     // delay of each response, of SEND OK and of the data sent back
+    uint32_t m_ulSegment;       // largest +IPD, the TCP segment size
+    uint8_t  m_ucFragment;      // +IPD of random sizes up to m_ulSegment, and pauses in the UART data
+    uint32_t m_ulGapUs;         // longest pause in the UART data with m_ucFragment
+    uint32_t m_ulLossPpm;       // bytes dropped towards the FT900 per million
+    uint8_t  m_ucNoPassive;     // refuse AT+CIPRECVMODE=1 like older firmware
+    uint8_t  m_ucVerbose;       // print the commands
+} TEsp32EmuConfig;
+
+// Modem lines and counters shared between the UART of the FT900 (uart_host.c) and the module
+typedef struct _TEsp32EmuLines {
+    volatile uint32_t m_ulHostBaud;     // rate of the FT900, set by uart_open
+    volatile uint64_t m_ullHostTxDone;  // CLOCK_MONOTONIC microseconds when the last byte written by the FT900 is received
+    volatile uint8_t  m_ucHostRts;      // RTS of the FT900, CTS of the module
+    volatile uint8_t  m_ucHostReading;  // receive interrupt of the FT900 enabled
+    volatile uint32_t m_ulBaud;         // rate of the module
+    volatile uint8_t  m_ucFlow;         // flow control of the module
+    volatile uint64_t m_ullSent;        // bytes written to the FT900
+    volatile uint64_t m_ullReceived;    // bytes read from the FT900
+    volatile uint64_t m_ullDropped;     // bytes dropped by m_ulLossPpm
+    volatile uint64_t m_ullGarbled;     // bytes garbled by a rate mismatch
+    volatile uint64_t m_ullOverrun;     // bytes lost in the full receive FIFO of the FT900
+    volatile uint64_t m_ullStalledUs;   // time waiting for the RTS of the FT900
+} TEsp32EmuLines;
+
+// Starts the module in a child process; returns the name of the terminal of the FT900 side, or NULL
+const char*     esp32_emu_start(const TEsp32EmuConfig* pConfig);
+
+// Stops the child process
+void            esp32_emu_stop(void);
+
+// Lines shared with the child process, NULL before esp32_emu_start
+TEsp32EmuLines* esp32_emu_lines(void);
+
+
+#endif // ESP32_EMU_H
@@ -0,0 +1,360 @@
+/**
+  @file freertos_host.c
+  @brief
+  Host build of libavs
+  FreeRTOS API of the library on POSIX threads
+  - Tasks are threads started by xTaskCreate; priorities are not used
+  - Task notifications are a count with a condition variable per task
+  - The critical section is a recursive mutex; the emulated ISR runs with it held
+  - The tick is 1ms of CLOCK_MONOTONIC
+
+ */
+/*
+ * ============================================================================
+ * History
+ * =======
+ * 2026-10-16 : Created v1
+ *
+ * ============================================================================
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "FreeRTOS.h"
+#include "task.h"
+#include "semphr.h"
+#include "host.h"
+
+
+
+struct tskTaskControlBlock {
+    pthread_t m_xThread;
+    pthread_mutex_t m_xMutex;
+    pthread_cond_t m_xCond;
+    uint32_t m_ulNotify;
+    uint8_t m_bNotified;        // notification pending, for xTaskNotifyWait
+    TaskFunction_t m_fxnTask;
+    void* m_pvParameters;
+    const char* m_pcName;
+};
+
+struct QueueDefinition {
+    pthread_mutex_t m_xMutex;
+};
+
+static __thread TaskHandle_t g_xCurrent = NULL;
+static pthread_mutex_t g_xCritical;
+static pthread_once_t g_xOnce = PTHREAD_ONCE_INIT;
+static struct timespec g_tStart;
+
+
+
+static void host_init(void)
+{
+    pthread_mutexattr_t tAttr;
+
+    pthread_mutexattr_init(&tAttr);
+    pthread_mutexattr_settype(&tAttr, PTHREAD_MUTEX_RECURSIVE);
+    pthread_mutex_init(&g_xCritical, &tAttr);
+    pthread_mutexattr_destroy(&tAttr);
+    clock_gettime(CLOCK_MONOTONIC, &g_tStart);
+}
+
+uint64_t host_time_us(void)
+{
+    struct timespec tNow;
+
+    pthread_once(&g_xOnce, host_init);
+    clock_gettime(CLOCK_MONOTONIC, &tNow);
+    return (uint64_t)(tNow.tv_sec - g_tStart.tv_sec) * 1000000 +
+        (tNow.tv_nsec - g_tStart.tv_nsec) / 1000;
+}
+
+// Absolute CLOCK_MONOTONIC time xTicks from now
+static void host_deadline(struct timespec* ptDeadline, TickType_t xTicks)
+{
+    clock_gettime(CLOCK_MONOTONIC, ptDeadline);
+    ptDeadline->tv_sec += xTicks / 1000;
+    ptDeadline->tv_nsec += (long)(xTicks % 1000) * 1000000;
+    if (ptDeadline->tv_nsec >= 1000000000) {
+        ptDeadline->tv_sec++;
+        ptDeadline->tv_nsec -= 1000000000;
+    }
+}
+
+static TaskHandle_t host_task_new(const char* pcName)
+{
+    TaskHandle_t xTask = calloc(1, sizeof(*xTask));
+    pthread_condattr_t tAttr;
+
+    if (!xTask) {
+        return NULL;
+    }
+    pthread_condattr_init(&tAttr);
+    pthread_condattr_setclock(&tAttr, CLOCK_MONOTONIC);
+    pthread_cond_init(&xTask->m_xCond, &tAttr);
+    pthread_condattr_destroy(&tAttr);
+    pthread_mutex_init(&xTask->m_xMutex, NULL);
+    xTask->m_pcName = pcName;
+    return xTask;
+}
+
+
+
+void* pvPortMalloc(size_t xWantedSize)
+{
+    return malloc(xWantedSize);
+}
+
+void vPortFree(void* pv)
+{
+    free(pv);
+}
+
+void vPortEnterCritical(void)
+{
+    pthread_once(&g_xOnce, host_init);
+    pthread_mutex_lock(&g_xCritical);
+}
+
+void vPortExitCritical(void)
+{
+    pthread_mutex_unlock(&g_xCritical);
+}
+
+
+
+static void* host_task_entry(void* pvTask)
+{
+    TaskHandle_t xTask = (TaskHandle_t)pvTask;
+
+    g_xCurrent = xTask;
+    xTask->m_fxnTask(xTask->m_pvParameters);
+    return NULL;
+}
+
+BaseType_t xTaskCreate(TaskFunction_t pxTaskCode, const char* const pcName, const uint16_t usStackDepth,
+    void* const pvParameters, UBaseType_t uxPriority, TaskHandle_t* const pxCreatedTask)
+{
+    TaskHandle_t xTask;
+    (void) usStackDepth;
+    (void) uxPriority;
+
+
+    pthread_once(&g_xOnce, host_init);
+    if (!(xTask = host_task_new(pcName))) {
+        return pdFAIL;
+    }
+    xTask->m_fxnTask = pxTaskCode;
+    xTask->m_pvParameters = pvParameters;
+
+    // The handle is set before the task runs like with FreeRTOS
+    if (pxCreatedTask) {
+        *pxCreatedTask = xTask;
+    }
+    if (pthread_create(&xTask->m_xThread, NULL, host_task_entry, xTask)) {
+        if (pxCreatedTask) {
+            *pxCreatedTask = NULL;
+        }
+        free(xTask);
+        return pdFAIL;
+    }
+    pthread_detach(xTask->m_xThread);
+    return pdPASS;
+}
+
+// The tasks run on their own threads; the caller only waits for them to exit the process
+void vTaskStartScheduler(void)
+{
+    while (1) {
+        pause();
+    }
+}
+
+void vTaskDelay(const TickType_t xTicksToDelay)
+{
+    struct timespec tDelay;
+
+    tDelay.tv_sec = xTicksToDelay / 1000;
+    tDelay.tv_nsec = (long)(xTicksToDelay % 1000) * 1000000;
+    while (nanosleep(&tDelay, &tDelay) && errno == EINTR);
+}
+
+TickType_t xTaskGetTickCount(void)
+{
+    return (TickType_t)(host_time_us() / 1000);
+}
+
+// Run time stats counter of the port, used by the event trace
+uint32_t ulPortProfilerCounterGet(void)
+{
+    return (uint32_t)host_time_us();
+}
+
+// Threads not created by xTaskCreate get a handle on first use
+TaskHandle_t xTaskGetCurrentTaskHandle(void)
+{
+    if (!g_xCurrent) {
+        pthread_once(&g_xOnce, host_init);
+        g_xCurrent = host_task_new("Host");
+    }
+    return g_xCurrent;
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t xClearCountOnExit, TickType_t xTicksToWait)
+{
+    TaskHandle_t xTask = xTaskGetCurrentTaskHandle();
+    struct timespec tDeadline;
+    uint32_t ulValue;
+
+
+    if (xTicksToWait != portMAX_DELAY) {
+        host_deadline(&tDeadline, xTicksToWait);
+    }
+
+    pthread_mutex_lock(&xTask->m_xMutex);
+    while (!xTask->m_ulNotify && xTicksToWait) {
+        if (xTicksToWait == portMAX_DELAY) {
+            pthread_cond_wait(&xTask->m_xCond, &xTask->m_xMutex);
+        }
+        else if (pthread_cond_timedwait(&xTask->m_xCond, &xTask->m_xMutex, &tDeadline) == ETIMEDOUT) {
+            break;
+        }
+    }
+    ulValue = xTask->m_ulNotify;
+    if (ulValue) {
+        xTask->m_ulNotify = xClearCountOnExit ? 0 : ulValue - 1;
+    }
+    xTask->m_bNotified = 0;
+    pthread_mutex_unlock(&xTask->m_xMutex);
+
+    return ulValue;
+}
+
+BaseType_t xTaskNotifyWait(uint32_t ulBitsToClearOnEntry, uint32_t ulBitsToClearOnExit, uint32_t* pulNotificationValue, TickType_t xTicksToWait)
+{
+    TaskHandle_t xTask = xTaskGetCurrentTaskHandle();
+    struct timespec tDeadline;
+    BaseType_t xRet;
+
+
+    if (xTicksToWait != portMAX_DELAY) {
+        host_deadline(&tDeadline, xTicksToWait);
+    }
+
+    pthread_mutex_lock(&xTask->m_xMutex);
+    if (!xTask->m_bNotified) {
+        xTask->m_ulNotify &= ~ulBitsToClearOnEntry;
+    }
+    while (!xTask->m_bNotified && xTicksToWait) {
+        if (xTicksToWait == portMAX_DELAY) {
+            pthread_cond_wait(&xTask->m_xCond, &xTask->m_xMutex);
+        }
+        else if (pthread_cond_timedwait(&xTask->m_xCond, &xTask->m_xMutex, &tDeadline) == ETIMEDOUT) {
+            break;
+        }
+    }
+    if (pulNotificationValue) {
+        *pulNotificationValue = xTask->m_ulNotify;
+    }
+    xRet = xTask->m_bNotified ? pdTRUE : pdFALSE;
+    if (xRet) {
+        xTask->m_ulNotify &= ~ulBitsToClearOnExit;
+    }
+    xTask->m_bNotified = 0;
+    pthread_mutex_unlock(&xTask->m_xMutex);
+
+    return xRet;
+}
+
+BaseType_t xTaskNotify(TaskHandle_t xTaskToNotify, uint32_t ulValue, eNotifyAction eAction)
+{
+    BaseType_t xRet = pdPASS;
+
+    pthread_mutex_lock(&xTaskToNotify->m_xMutex);
+    switch (eAction) {
+    case eSetBits:
+        xTaskToNotify->m_ulNotify |= ulValue;
+        break;
+    case eIncrement:
+        xTaskToNotify->m_ulNotify++;
+        break;
+    case eSetValueWithoutOverwrite:
+        if (xTaskToNotify->m_bNotified) {
+            xRet = pdFAIL;
+            break;
+        }
+        // fall through
+    case eSetValueWithOverwrite:
+        xTaskToNotify->m_ulNotify = ulValue;
+        break;
+    default:
+        break;
+    }
+    if (xRet == pdPASS) {
+        xTaskToNotify->m_bNotified = 1;
+        pthread_cond_signal(&xTaskToNotify->m_xCond);
+    }
+    pthread_mutex_unlock(&xTaskToNotify->m_xMutex);
+    return xRet;
+}
+
+BaseType_t xTaskNotifyGive(TaskHandle_t xTaskToNotify)
+{
+    return xTaskNotify(xTaskToNotify, 0, eIncrement);
+}
+
+void vTaskNotifyGiveFromISR(TaskHandle_t xTaskToNotify, BaseType_t* pxHigherPriorityTaskWoken)
+{
+    xTaskNotifyGive(xTaskToNotify);
+    if (pxHigherPriorityTaskWoken) {
+        *pxHigherPriorityTaskWoken = pdTRUE;
+    }
+}
+
+
+
+SemaphoreHandle_t xSemaphoreCreateMutex(void)
+{
+    SemaphoreHandle_t xSemaphore = calloc(1, sizeof(*xSemaphore));
+
+    if (xSemaphore) {
+        pthread_mutex_init(&xSemaphore->m_xMutex, NULL);
+    }
+    return xSemaphore;
+}
+
+void vSemaphoreDelete(SemaphoreHandle_t xSemaphore)
+{
+    pthread_mutex_destroy(&xSemaphore->m_xMutex);
+    free(xSemaphore);
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t xSemaphore, TickType_t xBlockTime)
+{
+    struct timespec tDeadline;
+
+    if (xBlockTime == portMAX_DELAY) {
+        return pthread_mutex_lock(&xSemaphore->m_xMutex) ? pdFALSE : pdTRUE;
+    }
+
+    // pthread_mutex_timedlock uses CLOCK_REALTIME
+    clock_gettime(CLOCK_REALTIME, &tDeadline);
+    tDeadline.tv_sec += xBlockTime / 1000;
+    tDeadline.tv_nsec += (long)(xBlockTime % 1000) * 1000000;
+    if (tDeadline.tv_nsec >= 1000000000) {
+        tDeadline.tv_sec++;
+        tDeadline.tv_nsec -= 1000000000;
+    }
+    return pthread_mutex_timedlock(&xSemaphore->m_xMutex, &tDeadline) ? pdFALSE : pdTRUE;
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t xSemaphore)
+{
+    return pthread_mutex_unlock(&xSemaphore->m_xMutex) ? pdFALSE : pdTRUE;
+}
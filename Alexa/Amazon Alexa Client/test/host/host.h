@@ -0,0 +1,67 @@
+/**
+  @file host.h
+  @brief
+  Host build of libavs
+  Emulated peripherals and the counters of the benchmark
+
+ */
+/*
+ * ============================================================================
+ * History
+ * =======
+ * 2026-10-16 : Created v1
+ *
+ * ============================================================================
+ */
+#ifndef HOST_H
+#define HOST_H
+#include <stdint.h>
+
+
+// Microseconds since the start of the process
+uint64_t host_time_us(void);
+
+
+// Microphone and speaker (audio_host.c)
+// The microphone plays a 16-bit mono RAW or WAV file, then silence.
+// The speaker output is written to a 16-bit stereo WAV file if set.
+// The audio clock runs ulSpeed times faster than real time.
+int  host_audio_set_source(const char* pcFileName);
+int  host_audio_source_ended(void);
+int  host_audio_set_sink(const char* pcFileName);
+void host_audio_close_sink(void);
+void host_audio_set_speed(uint32_t ulSpeed);
+
+
+// SD card (sdcard_host.c); files are opened relative to pcRoot
+void host_sdcard_set_root(const char* pcRoot);
+
+
+// Counters of a request, cleared by host_stats_reset
+typedef struct _THostStats {
+
+    // Bytes copied between buffers
+    uint64_t m_ullMemcpy;       // memcpy of the library
+    uint64_t m_ullConvert;      // written by the audio conversions and codecs
+    uint64_t m_ullSocket;       // sent and received through the socket
+    uint64_t m_ullSDCard;       // read and written to the SD card, including its write cache
+    uint64_t m_ullI2S;          // written and read to the I2S FIFOs
+
+    // Time in microseconds (host_time_us), 0 until it happened
+    uint64_t m_ullCaptureStart; // microphone started
+    uint64_t m_ullCaptureEnd;   // microphone source ended or microphone stopped
+    uint64_t m_ullFirstRecv;    // first bytes received
+    uint64_t m_ullPlayStart;    // first samples written to the speaker FIFO
+
+} THostStats;
+
+extern volatile THostStats g_tHostStats;
+void host_stats_reset(void);
+void host_stats_mark(volatile uint64_t* pullMark);
+
+
+// UART1 of the ESP32 driver (uart_host.c), on the terminal of esp32_emu.c
+void host_uart_set_device(const char* pcDevice);
+
+
+#endif // HOST_H
@@ -0,0 +1,93 @@
+/**
+  @file host_hooks.c
+  @brief
+  Host build of libavs
+  Counters of the bytes copied by the library (host_hooks.h) and the marks of the benchmark
+
+ */
+/*
+ * ============================================================================
+ * History
+ * =======
+ * 2026-10-16 : Created v1
+ *
+ * ============================================================================
+ */
+
+#include <stdint.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include "FreeRTOS.h"
+#include "task.h"
+#include "host.h"
+
+
+
+volatile THostStats g_tHostStats = {0};
+
+
+
+void host_stats_reset(void)
+{
+    taskENTER_CRITICAL();
+    memset((void*)&g_tHostStats, 0, sizeof(g_tHostStats));
+    taskEXIT_CRITICAL();
+}
+
+// Sets the mark to the current time unless already set
+void host_stats_mark(volatile uint64_t* pullMark)
+{
+    taskENTER_CRITICAL();
+    if (!*pullMark) {
+        *pullMark = host_time_us();
+    }
+    taskEXIT_CRITICAL();
+}
+
+static void host_count(volatile uint64_t* pullCounter, uint64_t ullBytes)
+{
+    taskENTER_CRITICAL();
+    *pullCounter += ullBytes;
+    taskEXIT_CRITICAL();
+}
+
+
+
+void* host_memcpy(void* pvDst, const void* pvSrc, size_t ulSize)
+{
+    host_count(&g_tHostStats.m_ullMemcpy, ulSize);
+    return memcpy(pvDst, pvSrc, ulSize);
+}
+
+ssize_t host_send(int lSocket, const void* pvBuffer, size_t ulSize, int lFlags)
+{
+    ssize_t lRet = send(lSocket, pvBuffer, ulSize, lFlags);
+
+    if (lRet > 0) {
+        host_count(&g_tHostStats.m_ullSocket, lRet);
+    }
+    return lRet;
+}
+
+ssize_t host_recv(int lSocket, void* pvBuffer, size_t ulSize, int lFlags)
+{
+    ssize_t lRet = recv(lSocket, pvBuffer, ulSize, lFlags);
+
+    if (lRet > 0) {
+        host_stats_mark(&g_tHostStats.m_ullFirstRecv);
+        host_count(&g_tHostStats.m_ullSocket, lRet);
+    }
+    return lRet;
+}
+
+void host_convert(uint32_t ulSize)
+{
+    host_count(&g_tHostStats.m_ullConvert, ulSize);
+}
+
+uint32_t host_converted(uint32_t ulSize)
+{
+    host_count(&g_tHostStats.m_ullConvert, ulSize);
+    return ulSize;
+}
@@ -0,0 +1,40 @@
+/**
+  @file host_hooks.h
+  @brief
+  Host build of libavs
+  Forced include of the library sources (-include) that counts the bytes they copy
+
+ */
+#ifndef HOST_HOOKS_H
+#define HOST_HOOKS_H
+#include <string.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include "audio.h"
+
+
+void*   host_memcpy(void* pvDst, const void* pvSrc, size_t ulSize);
+ssize_t host_send(int lSocket, const void* pvBuffer, size_t ulSize, int lFlags);
+ssize_t host_recv(int lSocket, void* pvBuffer, size_t ulSize, int lFlags);
+void    host_convert(uint32_t ulSize);
+uint32_t host_converted(uint32_t ulSize);
+
+#define memcpy(d, s, n)                         host_memcpy(d, s, n)
+#define send(s, b, n, f)                        host_send(s, b, n, f)
+#define recv(s, b, n, f)                        host_recv(s, b, n, f)
+
+// Output bytes of the conversions
+#define audio_pcm16_to_ulaw(n, s, d)            (host_convert((n)>>1), audio_pcm16_to_ulaw(n, s, d))
+#define audio_ulaw_to_pcm16(n, s, d)            (host_convert((n)<<1), audio_ulaw_to_pcm16(n, s, d))
+#define audio_ulaw_to_pcm16_stereo(n, s, d)     (host_convert((n)<<2), audio_ulaw_to_pcm16_stereo(n, s, d))
+#define audio_pcm16_to_adpcm(n, s, d, p)        (host_convert((n)>>2), audio_pcm16_to_adpcm(n, s, d, p))
+#define audio_adpcm_to_pcm16(n, s, d, p)        (host_convert((n)<<2), audio_adpcm_to_pcm16(n, s, d, p))
+#define audio_adpcm_to_pcm16_stereo(n, s, d, p) (host_convert((n)<<3), audio_adpcm_to_pcm16_stereo(n, s, d, p))
+#define audio_mono_to_stereo(d, s, n)           (host_convert((n)<<1), audio_mono_to_stereo(d, s, n))
+#define audio_stereo_to_mono(d, s, n)           (host_convert(n), audio_stereo_to_mono(d, s, n))
+#define audio_stereo_to_mono_average(d, s, n)   (host_convert(n), audio_stereo_to_mono_average(d, s, n))
+#define audio_resample_up(d, s, n, p)           host_converted(audio_resample_up(d, s, n, p))
+#define audio_resample_down(d, s, n, p)         host_converted(audio_resample_down(d, s, n, p))
+
+
+#endif // HOST_HOOKS_H
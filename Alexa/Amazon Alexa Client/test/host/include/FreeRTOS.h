@@ -0,0 +1,38 @@
+/**
+  @file FreeRTOS.h
+  @brief
+  Host build of libavs
+  Subset of the FreeRTOS API used by the library, implemented with POSIX threads by freertos_host.c
+
+ */
+#ifndef INC_FREERTOS_H
+#define INC_FREERTOS_H
+#include <stdint.h>
+#include <stddef.h>
+
+
+typedef uint32_t TickType_t;
+typedef long BaseType_t;
+typedef unsigned long UBaseType_t;
+
+#define configTICK_RATE_HZ      ((TickType_t)1000)
+#define configCPU_CLOCK_HZ      (1000000UL) // ulPortProfilerCounterGet counts microseconds
+#define portMAX_DELAY           ((TickType_t)0xffffffffUL)
+#define pdMS_TO_TICKS(xTimeInMs) ((TickType_t)(((TickType_t)(xTimeInMs) * (TickType_t)configTICK_RATE_HZ) / (TickType_t)1000))
+
+#define pdFALSE                 ((BaseType_t)0)
+#define pdTRUE                  ((BaseType_t)1)
+#define pdPASS                  (pdTRUE)
+#define pdFAIL                  (pdFALSE)
+
+// The ISR of the emulated peripherals runs in its own thread; there is nothing to yield
+#define portYIELD_FROM_ISR(...)
+
+void* pvPortMalloc(size_t xWantedSize);
+void  vPortFree(void* pv);
+void  vPortEnterCritical(void);
+void  vPortExitCritical(void);
+uint32_t ulPortProfilerCounterGet(void);
+
+
+#endif // INC_FREERTOS_H
@@ -0,0 +1,33 @@
+#ifndef AVS_CONFIG_H
+#define AVS_CONFIG_H
+
+
+
+///////////////////////////////////////////////////////////////////////////////////
+// Host build of libavs (test/host)
+// Settings of avs_config_defaults.h can be changed with make CONFIG="-D..."
+///////////////////////////////////////////////////////////////////////////////////
+#ifndef AVS_CONFIG_DEVICE_ID
+#define AVS_CONFIG_DEVICE_ID            1
+#endif
+
+
+///////////////////////////////////////////////////////////////////////////////////
+// Set your server IP address and port
+// ((a<<24)|(b<<16)|(c<<8)|d); the loopback gateway of avs_bench by default
+///////////////////////////////////////////////////////////////////////////////////
+#ifndef AVS_CONFIG_SERVER_ADDR
+#define AVS_CONFIG_SERVER_ADDR          (0x7F000001)
+#endif
+
+
+///////////////////////////////////////////////////////////////////////////////////
+// Event trace for avs_bench -e and avs_trace
+///////////////////////////////////////////////////////////////////////////////////
+#ifndef AVS_CONFIG_TRACE
+#define AVS_CONFIG_TRACE                1
+#endif
+
+
+#include <avs/avs_config_defaults.h>
+#endif // AVS_CONFIG_H
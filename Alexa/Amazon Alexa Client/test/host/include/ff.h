@@ -0,0 +1,44 @@
+/**
+  @file ff.h
+  @brief
+  Host build of libavs
+  Subset of FatFs used by the library; files of the SD card are host files under a root directory (sdcard_host.c)
+
+ */
+#ifndef FF_DEFINED
+#define FF_DEFINED
+#include <stdio.h>
+#include <stdint.h>
+
+
+typedef unsigned int UINT;
+typedef unsigned char BYTE;
+typedef uint32_t DWORD;
+typedef DWORD FSIZE_t;
+
+typedef enum {
+    FR_OK = 0,
+    FR_DISK_ERR,
+    FR_INT_ERR,
+    FR_NOT_READY,
+    FR_NO_FILE,
+    FR_NO_PATH,
+    FR_INVALID_NAME,
+    FR_DENIED,
+    FR_EXIST,
+    FR_INVALID_OBJECT,
+} FRESULT;
+
+typedef struct {
+    FILE*   fp;
+    FSIZE_t fsize;
+} FIL;
+
+#define f_size(fp)  ((fp)->fsize)
+
+FRESULT f_read(FIL* fp, void* buff, UINT btr, UINT* br);
+FRESULT f_write(FIL* fp, const void* buff, UINT btw, UINT* bw);
+FRESULT f_lseek(FIL* fp, FSIZE_t ofs);
+
+
+#endif // FF_DEFINED
@@ -0,0 +1,73 @@
+/**
+  @file ft900.h
+  @brief
+  Host build of libavs
+  Subset of the FT900 driver used by the library; the I2S peripheral is emulated by audio_host.c
+  and UART1 of the ESP32 driver (COMMUNICATION_IO==2) by uart_host.c
+
+ */
+#ifndef FT900_H
+#define FT900_H
+#include <stdint.h>
+#include <stddef.h>
+
+
+// I2S interrupt enables and pending flags (same bit for both in the emulation)
+#define MASK_I2S_IE_FIFO_TX_EMPTY       (1<<0)
+#define MASK_I2S_IE_FIFO_TX_HALF_FULL   (1<<1)
+#define MASK_I2S_IE_FIFO_RX_FULL        (1<<2)
+#define MASK_I2S_IE_FIFO_RX_HALF_FULL   (1<<3)
+#define MASK_I2S_IE_FIFO_RX_OVER        (1<<4)
+
+#define MASK_I2S_PEND_FIFO_TX_EMPTY     (1<<0)
+#define MASK_I2S_PEND_FIFO_TX_HALF_FULL (1<<1)
+#define MASK_I2S_PEND_FIFO_RX_FULL      (1<<2)
+#define MASK_I2S_PEND_FIFO_RX_HALF_FULL (1<<3)
+#define MASK_I2S_PEND_FIFO_RX_OVER      (1<<4)
+
+typedef struct {
+    volatile uint16_t I2S_IRQ_EN;
+    volatile uint16_t I2S_IRQ_PEND;
+} ft900_i2s_regs_t;
+
+extern ft900_i2s_regs_t* I2S;
+
+void     i2s_start_tx(void);
+void     i2s_stop_tx(void);
+void     i2s_start_rx(void);
+void     i2s_stop_rx(void);
+uint16_t i2s_write(const uint8_t *data, const uint16_t num_bytes);
+uint16_t i2s_read(uint8_t *data, const uint16_t num_bytes);
+uint16_t i2s_get_status(void);
+void     i2s_clear_int_flag(uint16_t mask);
+void     i2s_enable_int(uint16_t mask);
+void     i2s_disable_int(uint16_t mask);
+
+
+#if (COMMUNICATION_IO == 2)
+#include <stdio.h>
+#include "ft900_uart_simple.h"
+#include "FreeRTOS.h"
+
+#define interrupt_uart0         0
+#define interrupt_uart1         1
+
+#define CRITICAL_SECTION_BEGIN  vPortEnterCritical();
+#define CRITICAL_SECTION_END    vPortExitCritical();
+
+#define tfp_printf              printf
+#define tfp_sprintf             sprintf
+#define configPRINTF(x)         printf x
+
+extern ft900_uart_regs_t* UART0;
+extern ft900_uart_regs_t* UART1;
+
+int8_t interrupt_attach(int lInterrupt, uint8_t ucPriority, void (*fxnIsr)(void));
+
+// strlcpy of newlib, not in glibc before 2.38
+size_t host_strlcpy(char* pcDst, const char* pcSrc, size_t ulSize);
+#define strlcpy(d, s, n)        host_strlcpy(d, s, n)
+#endif
+
+
+#endif // FT900_H
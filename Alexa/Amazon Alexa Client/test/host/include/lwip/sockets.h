@@ -0,0 +1,19 @@
+/**
+  @file lwip/sockets.h
+  @brief
+  Host build of the ESP32 driver
+  Subset of the lwIP socket API used by the WiFi part of comm_wrapper.c (inet_ntop of the server address),
+  taken from the POSIX sockets
+
+ */
+#ifndef LWIP_HDR_SOCKETS_H
+#define LWIP_HDR_SOCKETS_H
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+
+typedef struct in_addr ip_addr_t;
+
+
+#endif // LWIP_HDR_SOCKETS_H
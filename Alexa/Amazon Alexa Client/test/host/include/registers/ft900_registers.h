@@ -0,0 +1,12 @@
+/**
+  @file ft900_registers.h
+  @brief
+  Host build of the ESP32 driver
+  The UART registers are the structure of ft900_uart_registers.h, not mapped to hardware
+
+ */
+#ifndef FT900_REGISTERS_H_
+#define FT900_REGISTERS_H_
+
+
+#endif // FT900_REGISTERS_H_
@@ -0,0 +1,20 @@
+/**
+  @file semphr.h
+  @brief
+  Host build of libavs
+
+ */
+#ifndef SEMAPHORE_H
+#define SEMAPHORE_H
+#include "FreeRTOS.h"
+
+
+typedef struct QueueDefinition* SemaphoreHandle_t;
+
+SemaphoreHandle_t xSemaphoreCreateMutex(void);
+void              vSemaphoreDelete(SemaphoreHandle_t xSemaphore);
+BaseType_t        xSemaphoreTake(SemaphoreHandle_t xSemaphore, TickType_t xBlockTime);
+BaseType_t        xSemaphoreGive(SemaphoreHandle_t xSemaphore);
+
+
+#endif // SEMAPHORE_H
@@ -0,0 +1,42 @@
+/**
+  @file task.h
+  @brief
+  Host build of libavs
+  Tasks are POSIX threads; the critical section is a recursive mutex also held by the emulated ISR
+
+ */
+#ifndef INC_TASK_H
+#define INC_TASK_H
+#include "FreeRTOS.h"
+
+
+typedef struct tskTaskControlBlock* TaskHandle_t;
+typedef void (*TaskFunction_t)(void*);
+
+typedef enum {
+    eNoAction = 0,
+    eSetBits,
+    eIncrement,
+    eSetValueWithOverwrite,
+    eSetValueWithoutOverwrite
+} eNotifyAction;
+
+#define taskENTER_CRITICAL()    vPortEnterCritical()
+#define taskEXIT_CRITICAL()     vPortExitCritical()
+
+BaseType_t   xTaskCreate(TaskFunction_t pxTaskCode, const char* const pcName, const uint16_t usStackDepth,
+                 void* const pvParameters, UBaseType_t uxPriority, TaskHandle_t* const pxCreatedTask);
+void         vTaskStartScheduler(void);
+void         vTaskDelay(const TickType_t xTicksToDelay);
+TickType_t   xTaskGetTickCount(void);
+TaskHandle_t xTaskGetCurrentTaskHandle(void);
+
+uint32_t     ulTaskNotifyTake(BaseType_t xClearCountOnExit, TickType_t xTicksToWait);
+BaseType_t   xTaskNotifyGive(TaskHandle_t xTaskToNotify);
+BaseType_t   xTaskNotify(TaskHandle_t xTaskToNotify, uint32_t ulValue, eNotifyAction eAction);
+BaseType_t   xTaskNotifyWait(uint32_t ulBitsToClearOnEntry, uint32_t ulBitsToClearOnExit,
+                 uint32_t* pulNotificationValue, TickType_t xTicksToWait);
+void         vTaskNotifyGiveFromISR(TaskHandle_t xTaskToNotify, BaseType_t* pxHigherPriorityTaskWoken);
+
+
+#endif // INC_TASK_H
@@ -0,0 +1,15 @@
+/**
+  @file tinyprintf.h
+  @brief
+  Host build of libavs
+
+ */
+#ifndef TINYPRINTF_H
+#define TINYPRINTF_H
+#include <stdio.h>
+
+
+#define tfp_printf printf
+
+
+#endif // TINYPRINTF_H
@@ -0,0 +1,378 @@
+/**
+  @file loopback.c
+  @brief
+  Host build of libavs
+  Loopback stand-in of the Alexa gateway
+  - Handshake: TDeviceInfo, then TDeviceCodecs and TDeviceProtocol if the device sends them
+  - Protocol 1: requests of known length or AVS_REQUEST_SIZE_STREAMED, response as length and audio
+  - Protocol 2: AUDIO frames until FLAG_END, response as AUDIO frames of the same stream
+  The codecs preferred by the device are selected so that the request audio can be played back as is.
+
+ */
+/*
+ * ============================================================================
+ * History
+ * =======
+ * 2026-10-16 : Created v1
+ *
+ * ============================================================================
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include "avs/avs.h"
+#include "utils/device_information.h"
+#include "loopback.h"
+
+
+
+typedef struct _LoopbackConnection {
+
+    const TLoopbackConfig* m_pConfig;
+    int m_lSocket;
+    uint16_t m_uwProtocol;
+    uint16_t m_uwSequence;      // frames sent
+    char* m_pcAudio;            // request audio
+    uint32_t m_ulAudioSize;
+    uint32_t m_ulAudioAlloc;
+
+} LoopbackConnection;
+
+typedef struct _LoopbackThread {
+    TLoopbackConfig m_tConfig;
+    int m_lListen;
+} LoopbackThread;
+
+
+
+static int loopback_recv_all(LoopbackConnection* pConn, void* pvBuffer, uint32_t ulSize)
+{
+    char* pcBuffer = (char*)pvBuffer;
+
+    while (ulSize) {
+        ssize_t lRet = recv(pConn->m_lSocket, pcBuffer, ulSize, 0);
+        if (lRet <= 0) {
+            return 0;
+        }
+        pcBuffer += lRet;
+        ulSize -= lRet;
+    }
+    return 1;
+}
+
+static int loopback_send_all(LoopbackConnection* pConn, const void* pvBuffer, uint32_t ulSize)
+{
+    const char* pcBuffer = (const char*)pvBuffer;
+
+    while (ulSize) {
+        ssize_t lRet = send(pConn->m_lSocket, pcBuffer, ulSize, MSG_NOSIGNAL);
+        if (lRet <= 0) {
+            return 0;
+        }
+        pcBuffer += lRet;
+        ulSize -= lRet;
+    }
+    return 1;
+}
+
+// Appends ulSize bytes of the request received from the socket
+static int loopback_recv_audio(LoopbackConnection* pConn, uint32_t ulSize)
+{
+    if (pConn->m_ulAudioSize + ulSize > pConn->m_ulAudioAlloc) {
+        uint32_t ulAlloc = (pConn->m_ulAudioSize + ulSize) * 2;
+        char* pcAudio = realloc(pConn->m_pcAudio, ulAlloc);
+        if (!pcAudio) {
+            return 0;
+        }
+        pConn->m_pcAudio = pcAudio;
+        pConn->m_ulAudioAlloc = ulAlloc;
+    }
+    if (!loopback_recv_all(pConn, pConn->m_pcAudio + pConn->m_ulAudioSize, ulSize)) {
+        return 0;
+    }
+    pConn->m_ulAudioSize += ulSize;
+    return 1;
+}
+
+static void loopback_discard(LoopbackConnection* pConn, uint32_t ulSize)
+{
+    char acDiscard[256];
+
+    while (ulSize) {
+        uint32_t ulChunk = ulSize < sizeof(acDiscard) ? ulSize : sizeof(acDiscard);
+        if (!loopback_recv_all(pConn, acDiscard, ulChunk)) {
+            return;
+        }
+        ulSize -= ulChunk;
+    }
+}
+
+
+
+/////////////////////////////////////////////////////////////////////////////////////////////
+// Receives the handshake; returns the first word of the first request in pulWord
+/////////////////////////////////////////////////////////////////////////////////////////////
+static int loopback_handshake(LoopbackConnection* pConn, uint32_t* pulWord)
+{
+    TDeviceInfo tDeviceInfo;
+    uint32_t ulWord;
+
+
+    if (!loopback_recv_all(pConn, &tDeviceInfo, sizeof(tDeviceInfo)) ||
+        !loopback_recv_all(pConn, &ulWord, sizeof(ulWord))) {
+        return 0;
+    }
+    if (pConn->m_pConfig->m_ucVerbose) {
+        printf("loopback: device %u send %04x recv %04x\n", tDeviceInfo.m_ulDeviceID,
+            tDeviceInfo.m_uwSendCapabilities, tDeviceInfo.m_uwRecvCapabilities);
+    }
+
+    if (ulWord == DEVICE_CODECS_MAGIC) {
+        TDeviceCodecs tDeviceCodecs;
+        tDeviceCodecs.m_ulMagic = ulWord;
+        if (!loopback_recv_all(pConn, (char*)&tDeviceCodecs + sizeof(ulWord), sizeof(tDeviceCodecs) - sizeof(ulWord)) ||
+            !loopback_send_all(pConn, &tDeviceInfo, sizeof(tDeviceInfo)) ||
+            !loopback_recv_all(pConn, &ulWord, sizeof(ulWord))) {
+            return 0;
+        }
+    }
+
+    pConn->m_uwProtocol = DEVICE_PROTOCOL_VERSION_LENGTH;
+    if (ulWord == DEVICE_PROTOCOL_MAGIC) {
+        TDeviceProtocol tDeviceProtocol;
+        tDeviceProtocol.m_ulMagic = ulWord;
+        if (!loopback_recv_all(pConn, (char*)&tDeviceProtocol + sizeof(ulWord), sizeof(tDeviceProtocol) - sizeof(ulWord))) {
+            return 0;
+        }
+
+        // Interrupted uploads are not kept; the device sends them again
+        if (tDeviceProtocol.m_uwVersion > DEVICE_PROTOCOL_VERSION_FRAMED) {
+            tDeviceProtocol.m_uwVersion = DEVICE_PROTOCOL_VERSION_FRAMED;
+        }
+        pConn->m_uwProtocol = tDeviceProtocol.m_uwVersion;
+        tDeviceProtocol.m_uwStream = 0;
+        tDeviceProtocol.m_ulOffset = 0;
+        if (!loopback_send_all(pConn, &tDeviceProtocol, sizeof(tDeviceProtocol))) {
+            return 0;
+        }
+        if (pConn->m_uwProtocol >= DEVICE_PROTOCOL_VERSION_FRAMED) {
+            ulWord = 0;
+        }
+        else if (!loopback_recv_all(pConn, &ulWord, sizeof(ulWord))) {
+            return 0;
+        }
+    }
+
+    *pulWord = ulWord;
+    return 1;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////
+// Protocol 1: receives a request starting with its length ulWord
+/////////////////////////////////////////////////////////////////////////////////////////////
+static int loopback_recv_length(LoopbackConnection* pConn, uint32_t ulWord)
+{
+    uint32_t ulSize;
+
+    if (ulWord != AVS_REQUEST_SIZE_STREAMED) {
+        return loopback_recv_audio(pConn, ulWord);
+    }
+
+    // [4-byte length][payload] until a 0 length
+    while (1) {
+        if (!loopback_recv_all(pConn, &ulSize, sizeof(ulSize))) {
+            return 0;
+        }
+        if (!ulSize) {
+            return 1;
+        }
+        if (!loopback_recv_audio(pConn, ulSize)) {
+            return 0;
+        }
+    }
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////
+// Protocol 2: receives the AUDIO frames of a request until FLAG_END; returns the stream
+/////////////////////////////////////////////////////////////////////////////////////////////
+static int loopback_recv_frames(LoopbackConnection* pConn, uint16_t* puwStream)
+{
+    TDeviceFrame tFrame;
+
+    while (1) {
+        if (!loopback_recv_all(pConn, &tFrame, sizeof(tFrame))) {
+            return 0;
+        }
+        if (tFrame.m_ucType != DEVICE_FRAME_AUDIO) {
+            loopback_discard(pConn, tFrame.m_ulLength);
+            continue;
+        }
+        if (tFrame.m_ulLength && !loopback_recv_audio(pConn, tFrame.m_ulLength)) {
+            return 0;
+        }
+        if (tFrame.m_ucFlags & DEVICE_FRAME_FLAG_END) {
+            *puwStream = tFrame.m_uwStream;
+            return 1;
+        }
+    }
+}
+
+static int loopback_respond(LoopbackConnection* pConn, uint16_t uwStream)
+{
+    if (pConn->m_pConfig->m_ulThinkMs) {
+        usleep(pConn->m_pConfig->m_ulThinkMs * 1000);
+    }
+
+    if (pConn->m_uwProtocol < DEVICE_PROTOCOL_VERSION_FRAMED) {
+        return loopback_send_all(pConn, &pConn->m_ulAudioSize, sizeof(pConn->m_ulAudioSize)) &&
+            loopback_send_all(pConn, pConn->m_pcAudio, pConn->m_ulAudioSize);
+    }
+
+    uint32_t ulOffset = 0;
+    do {
+        TDeviceFrame tFrame = {0};
+        uint32_t ulSize = pConn->m_ulAudioSize - ulOffset;
+        if (ulSize > pConn->m_pConfig->m_ulFrameSize) {
+            ulSize = pConn->m_pConfig->m_ulFrameSize;
+        }
+        tFrame.m_ucType = DEVICE_FRAME_AUDIO;
+        tFrame.m_ucFlags = (ulOffset + ulSize == pConn->m_ulAudioSize) ? DEVICE_FRAME_FLAG_END : 0;
+        tFrame.m_uwStream = uwStream;
+        tFrame.m_uwSequence = pConn->m_uwSequence++;
+        tFrame.m_ulOffset = ulOffset;
+        tFrame.m_ulLength = ulSize;
+        if (!loopback_send_all(pConn, &tFrame, sizeof(tFrame)) ||
+            !loopback_send_all(pConn, pConn->m_pcAudio + ulOffset, ulSize)) {
+            return 0;
+        }
+        ulOffset += ulSize;
+    } while (ulOffset < pConn->m_ulAudioSize);
+
+    return 1;
+}
+
+static void loopback_serve(const TLoopbackConfig* pConfig, int lSocket)
+{
+    LoopbackConnection tConn = {0};
+    uint32_t ulWord = 0;
+    int lOption = 1;
+
+
+    tConn.m_pConfig = pConfig;
+    tConn.m_lSocket = lSocket;
+    setsockopt(lSocket, IPPROTO_TCP, TCP_NODELAY, &lOption, sizeof(lOption));
+
+    if (!loopback_handshake(&tConn, &ulWord)) {
+        return;
+    }
+
+    while (1) {
+        uint16_t uwStream = 0;
+        int lRet;
+
+        tConn.m_ulAudioSize = 0;
+        if (tConn.m_uwProtocol >= DEVICE_PROTOCOL_VERSION_FRAMED) {
+            lRet = loopback_recv_frames(&tConn, &uwStream);
+        }
+        else {
+            lRet = (ulWord || loopback_recv_all(&tConn, &ulWord, sizeof(ulWord))) &&
+                loopback_recv_length(&tConn, ulWord);
+            ulWord = 0;
+        }
+        if (!lRet) {
+            break;
+        }
+        if (pConfig->m_ucVerbose) {
+            printf("loopback: request stream %d %u bytes\n", uwStream, tConn.m_ulAudioSize);
+        }
+        if (!loopback_respond(&tConn, uwStream)) {
+            break;
+        }
+    }
+
+    free(tConn.m_pcAudio);
+}
+
+static int loopback_listen(const TLoopbackConfig* pConfig)
+{
+    struct sockaddr_in tAddr = {0};
+    int lOption = 1;
+    int lSocket = socket(AF_INET, SOCK_STREAM, 0);
+
+
+    if (lSocket < 0) {
+        return -1;
+    }
+    tAddr.sin_family = AF_INET;
+    tAddr.sin_port = htons(pConfig->m_uwPort);
+    tAddr.sin_addr.s_addr = htonl(INADDR_ANY);
+    setsockopt(lSocket, SOL_SOCKET, SO_REUSEADDR, &lOption, sizeof(lOption));
+    if (bind(lSocket, (struct sockaddr*)&tAddr, sizeof(tAddr)) < 0 || listen(lSocket, 1) < 0) {
+        close(lSocket);
+        return -1;
+    }
+    return lSocket;
+}
+
+static void loopback_accept(const TLoopbackConfig* pConfig, int lListen)
+{
+    while (1) {
+        int lSocket = accept(lListen, NULL, NULL);
+        if (lSocket < 0) {
+            continue;
+        }
+        if (pConfig->m_ucVerbose) {
+            printf("loopback: connected\n");
+        }
+        loopback_serve(pConfig, lSocket);
+        close(lSocket);
+        if (pConfig->m_ucVerbose) {
+            printf("loopback: disconnected\n");
+        }
+    }
+}
+
+int loopback_run(const TLoopbackConfig* pConfig)
+{
+    int lListen = loopback_listen(pConfig);
+
+    if (lListen < 0) {
+        return 0;
+    }
+    loopback_accept(pConfig, lListen);
+    return 1;
+}
+
+static void* loopback_thread(void* pvParameters)
+{
+    LoopbackThread* pThread = (LoopbackThread*)pvParameters;
+
+    loopback_accept(&pThread->m_tConfig, pThread->m_lListen);
+    return NULL;
+}
+
+int loopback_start(const TLoopbackConfig* pConfig)
+{
+    static LoopbackThread tThread;
+    pthread_t xThread;
+
+
+    tThread.m_tConfig = *pConfig;
+    tThread.m_lListen = loopback_listen(pConfig);
+    if (tThread.m_lListen < 0) {
+        return 0;
+    }
+    if (pthread_create(&xThread, NULL, loopback_thread, &tThread)) {
+        close(tThread.m_lListen);
+        return 0;
+    }
+    pthread_detach(xThread);
+    return 1;
+}
@@ -0,0 +1,35 @@
+/**
+  @file loopback.h
+  @brief
+  Host build of libavs
+  Loopback stand-in of the Alexa gateway: the audio of each request is sent back as its response
+
+ */
+/*
+ * ============================================================================
+ * History
+ * =======
+ * 2026-10-16 : Created v1
+ *
+ * ============================================================================
+ */
+#ifndef LOOPBACK_H
+#define LOOPBACK_H
+#include <stdint.h>
+
+
+typedef struct _TLoopbackConfig {
+    uint16_t m_uwPort;
+    uint32_t m_ulThinkMs;       // delay between the end of a request and its response
+    uint32_t m_ulFrameSize;     // audio bytes per response frame (framed protocol)
+    uint8_t  m_ucVerbose;
+} TLoopbackConfig;
+
+// Serves the connections one after the other; returns 0 if the port cannot be opened
+int  loopback_run(const TLoopbackConfig* pConfig);
+
+// Runs loopback_run on a thread; returns once the port is listening
+int  loopback_start(const TLoopbackConfig* pConfig);
+
+
+#endif // LOOPBACK_H
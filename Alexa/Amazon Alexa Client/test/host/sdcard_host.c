@@ -0,0 +1,271 @@
+/**
+  @file sdcard_host.c
+  @brief
+  Host build of libavs
+  SD card module on the host file system; file names are relative to the root set by host_sdcard_set_root
+  The write cache of the recording files is kept so that the same bytes are copied as on the board.
+
+ */
+/*
+ * ============================================================================
+ * History
+ * =======
+ * 2026-10-16 : Created v1
+ *
+ * ============================================================================
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <dirent.h>
+#include <unistd.h>
+#include "FreeRTOS.h"
+#include "tinyprintf.h"
+#include "sdcard.h"
+#include "host.h"
+
+
+
+//#define DEBUG
+#ifdef DEBUG
+#define DEBUG_PRINTF(...) do {tfp_printf(__VA_ARGS__);} while (0)
+#else
+#define DEBUG_PRINTF(...)
+#endif
+
+
+
+typedef struct _SDCardCacheContext {
+
+    char* m_pcBuffer;
+    uint32_t m_ulBufferSize;
+    uint32_t m_ulUsed;
+    FIL* m_pFile;
+
+} SDCardCacheContext;
+
+static SDCardCacheContext g_hCache = {0};
+static char g_acRoot[256] = ".";
+
+
+
+void host_sdcard_set_root(const char* pcRoot)
+{
+    snprintf(g_acRoot, sizeof(g_acRoot), "%s", pcRoot);
+}
+
+static void sdcard_path(char* pcPath, size_t ulSize, const char* filename)
+{
+    snprintf(pcPath, ulSize, "%s/%s", g_acRoot, filename);
+}
+
+
+
+FRESULT f_read(FIL* fp, void* buff, UINT btr, UINT* br)
+{
+    *br = fread(buff, 1, btr, fp->fp);
+    g_tHostStats.m_ullSDCard += *br;
+    return ferror(fp->fp) ? FR_DISK_ERR : FR_OK;
+}
+
+FRESULT f_write(FIL* fp, const void* buff, UINT btw, UINT* bw)
+{
+    long lPosition;
+
+    *bw = fwrite(buff, 1, btw, fp->fp);
+    g_tHostStats.m_ullSDCard += *bw;
+    if (*bw != btw) {
+        return FR_DISK_ERR;
+    }
+    lPosition = ftell(fp->fp);
+    if (lPosition > (long)fp->fsize) {
+        fp->fsize = lPosition;
+    }
+    return FR_OK;
+}
+
+FRESULT f_lseek(FIL* fp, FSIZE_t ofs)
+{
+    return fseek(fp->fp, ofs, SEEK_SET) ? FR_DISK_ERR : FR_OK;
+}
+
+
+
+void sdcard_dir(char* path)
+{
+    char acPath[300];
+    struct dirent* pEntry;
+    DIR* pDir;
+
+
+    sdcard_path(acPath, sizeof(acPath), path);
+    if (!(pDir = opendir(acPath))) {
+        return;
+    }
+    while ((pEntry = readdir(pDir)) != NULL) {
+        if (pEntry->d_name[0] != '.') {
+            tfp_printf("%s\r\n", pEntry->d_name);
+        }
+    }
+    closedir(pDir);
+}
+
+void sdcard_setup(void)
+{
+    DEBUG_PRINTF("Mounted %s\r\n", g_acRoot);
+}
+
+int sdcard_open(FIL* f, const char* filename, int bWrite, int bRead)
+{
+    char acPath[300];
+
+    // Like the board, an existing file is replaced when opened for writing
+    sdcard_path(acPath, sizeof(acPath), filename);
+    if (bWrite) {
+        f->fp = fopen(acPath, bRead ? "w+b" : "wb");
+    }
+    else if (bRead) {
+        f->fp = fopen(acPath, "rb");
+    }
+    else {
+        return FR_INVALID_OBJECT;
+    }
+    if (!f->fp) {
+        DEBUG_PRINTF("sdcard_open(): %s failed\r\n", acPath);
+        return bWrite ? FR_DENIED : FR_NO_FILE;
+    }
+
+    f->fsize = 0;
+    if (!bWrite) {
+        fseek(f->fp, 0, SEEK_END);
+        f->fsize = ftell(f->fp);
+        fseek(f->fp, 0, SEEK_SET);
+    }
+    return FR_OK;
+}
+
+
+
+/////////////////////////////////////////////////////////////////////////////////////////////
+// Allocates the recording file write cache of ulBufferSize bytes (multiple of the sector size)
+/////////////////////////////////////////////////////////////////////////////////////////////
+int sdcard_cache_setup(uint32_t ulBufferSize)
+{
+    if (!ulBufferSize || (ulBufferSize % 512)) {
+        DEBUG_PRINTF("sdcard_cache_setup(): invalid size %d\r\n", (int)ulBufferSize);
+        return 0;
+    }
+
+    g_hCache.m_pcBuffer = pvPortMalloc(ulBufferSize);
+    if (!g_hCache.m_pcBuffer) {
+        DEBUG_PRINTF("sdcard_cache_setup(): pvPortMalloc failed\r\n");
+        return 0;
+    }
+    g_hCache.m_ulBufferSize = ulBufferSize;
+
+    return 1;
+}
+
+void sdcard_cache_free(void)
+{
+    if (g_hCache.m_pcBuffer) {
+        vPortFree(g_hCache.m_pcBuffer);
+        g_hCache.m_pcBuffer = NULL;
+    }
+    g_hCache.m_ulBufferSize = 0;
+}
+
+static FRESULT sdcard_cache_flush(void)
+{
+    FRESULT res = FR_OK;
+    UINT written = 0;
+
+    if (g_hCache.m_ulUsed) {
+        res = f_write(g_hCache.m_pFile, g_hCache.m_pcBuffer, g_hCache.m_ulUsed, &written);
+        g_hCache.m_ulUsed = 0;
+    }
+
+    return res;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////
+// Creates a recording file; there is nothing to preallocate on the host
+/////////////////////////////////////////////////////////////////////////////////////////////
+int sdcard_open_record(FIL* f, const char* filename, uint32_t ulSize)
+{
+    FRESULT res = sdcard_open(f, filename, 1, 0);
+    if (FR_OK != res) {
+        return res;
+    }
+
+    if (g_hCache.m_pcBuffer && !g_hCache.m_pFile) {
+        g_hCache.m_pFile = f;
+        g_hCache.m_ulUsed = 0;
+    }
+
+    return res;
+}
+
+FRESULT sdcard_write(FIL* f, const void* buff, UINT btw, UINT* bw)
+{
+    const char* pcSrc = (const char*)buff;
+    FRESULT res = FR_OK;
+
+
+    if (f != g_hCache.m_pFile) {
+        return f_write(f, buff, btw, bw);
+    }
+
+    *bw = 0;
+    while (btw) {
+        uint32_t ulCopy = g_hCache.m_ulBufferSize - g_hCache.m_ulUsed;
+        if (ulCopy > btw) {
+            ulCopy = btw;
+        }
+        memcpy(g_hCache.m_pcBuffer + g_hCache.m_ulUsed, pcSrc, ulCopy);
+        g_tHostStats.m_ullSDCard += ulCopy;
+        g_hCache.m_ulUsed += ulCopy;
+        pcSrc += ulCopy;
+        btw -= ulCopy;
+        *bw += ulCopy;
+
+        if (g_hCache.m_ulUsed == g_hCache.m_ulBufferSize) {
+            res = sdcard_cache_flush();
+            if (FR_OK != res) {
+                break;
+            }
+        }
+    }
+
+    return res;
+}
+
+FRESULT sdcard_rewind(FIL* f)
+{
+    if (f == g_hCache.m_pFile) {
+        g_hCache.m_ulUsed = 0;
+    }
+    fflush(f->fp);
+    if (ftruncate(fileno(f->fp), 0) || fseek(f->fp, 0, SEEK_SET)) {
+        return FR_DISK_ERR;
+    }
+    f->fsize = 0;
+    return FR_OK;
+}
+
+FRESULT sdcard_close(FIL* f)
+{
+    FRESULT res = FR_OK;
+
+    if (f == g_hCache.m_pFile) {
+        res = sdcard_cache_flush();
+        g_hCache.m_pFile = NULL;
+    }
+    if (f->fp) {
+        fclose(f->fp);
+        f->fp = NULL;
+    }
+
+    return res;
+}
@@ -0,0 +1,345 @@
+/**
+  @file uart_host.c
+  @brief
+  Host build of the ESP32 driver
+  UART driver of the FT900 (ft900_uart_simple.h) on the pseudo terminal of esp32_emu.c
+  - The interrupt handler attached by uartrb.c runs on its own thread with the critical section held
+  - The transmitter takes 10 bits per byte at the rate set by uart_open, so writes are paced like on the board,
+    and the module only handles a FIFO once its last byte would have been received
+  - Each receive interrupt reads at most one FIFO (16 bytes, 128 in 16950 mode)
+  - RTS is passed to the module through the lines shared with esp32_emu.c; with automatic flow control
+    it follows the receive interrupt, which uartrb.c disables while its ring buffer is full
+
+ */
+/*
+ * ============================================================================
+ * History
+ * =======
+ * 2026-10-16 : Created v1
+ *
+ * ============================================================================
+ */
+
+#define _GNU_SOURCE // ppoll
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <termios.h>
+#include "ft900.h"
+#include "FreeRTOS.h"
+#include "host.h"
+#include "esp32_emu.h"
+
+
+
+#define UART_HOST_FIFO_16550    16
+#define UART_HOST_FIFO_16950    128
+#define UART_HOST_IDLE_NS       1000000 // wait for data or a transmit interrupt
+
+
+static ft900_uart_regs_t g_tUart0;
+static ft900_uart_regs_t g_tUart1;
+ft900_uart_regs_t* UART0 = &g_tUart0;
+ft900_uart_regs_t* UART1 = &g_tUart1;
+
+static const char* g_pcDevice = NULL;
+static int g_lFd = -1;
+static void (*g_fxnIsr)(void) = NULL;
+static pthread_t g_xIsrThread;
+static uint32_t g_ulClock = 25000000;       // peripheral clock divided by the samples per bit
+static uint32_t g_ulBaud = 115200;
+static uint8_t g_ucMode = uart_mode_16550;
+static uint8_t g_bAutoFlow = 0;             // 16950 automatic RTS/CTS
+static uint8_t g_bRts = 1;
+static uint8_t g_bRxEnabled = 0;
+static uint8_t g_bTxEnabled = 0;
+static uint8_t g_bGlobalEnabled = 0;
+static size_t g_ulRxLeft = 0;               // bytes the current receive interrupt reads
+static uint64_t g_ullTxDone = 0;            // end of the transmission of the FIFO, in microseconds
+static uint8_t g_bTxPending = 0;            // transmit interrupt at g_ullTxDone
+static uint8_t g_ucInterrupt = uart_interrupt_none;
+
+
+
+static void uart_host_lines(void)
+{
+    TEsp32EmuLines* pLines = esp32_emu_lines();
+
+    if (pLines) {
+        pLines->m_ucHostRts = g_bAutoFlow ? g_bRxEnabled : g_bRts;
+        pLines->m_ucHostReading = g_bRxEnabled && g_bGlobalEnabled;
+        pLines->m_ulHostBaud = g_ulBaud;
+    }
+}
+
+static int uart_host_readable(void)
+{
+    struct pollfd tPoll = {g_lFd, POLLIN, 0};
+
+    return poll(&tPoll, 1, 0) > 0 && (tPoll.revents & POLLIN);
+}
+
+static void* uart_host_isr(void* pvParameters)
+{
+    (void) pvParameters;
+
+    while (1) {
+        struct pollfd tPoll = {g_lFd, g_bRxEnabled ? POLLIN : 0, 0};
+        struct timespec tTimeout = {0, UART_HOST_IDLE_NS};
+
+        if (g_bTxPending) {
+            uint64_t ullNow = host_time_us();
+            tTimeout.tv_nsec = g_ullTxDone > ullNow ? (long)(g_ullTxDone - ullNow) * 1000 : 0;
+            if (tTimeout.tv_nsec > UART_HOST_IDLE_NS) {
+                tTimeout.tv_nsec = UART_HOST_IDLE_NS;
+            }
+        }
+        ppoll(&tPoll, 1, &tTimeout, NULL);
+
+        // Like the interrupt line, the handler is called until nothing is pending
+        vPortEnterCritical();
+        if (g_bGlobalEnabled) {
+            do {
+                g_fxnIsr();
+            } while (g_ucInterrupt != uart_interrupt_none);
+        }
+        vPortExitCritical();
+    }
+    return NULL;
+}
+
+
+
+size_t host_strlcpy(char* pcDst, const char* pcSrc, size_t ulSize)
+{
+    size_t ulLength = strlen(pcSrc);
+
+    if (ulSize) {
+        size_t ulCopy = ulLength < ulSize - 1 ? ulLength : ulSize - 1;
+        memcpy(pcDst, pcSrc, ulCopy);
+        pcDst[ulCopy] = '\0';
+    }
+    return ulLength;
+}
+
+void host_uart_set_device(const char* pcDevice)
+{
+    g_pcDevice = pcDevice;
+}
+
+int8_t interrupt_attach(int lInterrupt, uint8_t ucPriority, void (*fxnIsr)(void))
+{
+    (void) lInterrupt;
+    (void) ucPriority;
+    g_fxnIsr = fxnIsr;
+    return 0;
+}
+
+int32_t uart_calculate_baud(uint32_t target_baud, uint8_t samples, uint32_t f_perif, uint16_t *divisor, uint8_t *prescaler)
+{
+    g_ulClock = f_perif / samples;
+    *divisor = (uint16_t)((g_ulClock + target_baud / 2) / target_baud);
+    if (prescaler) {
+        *prescaler = 1;
+    }
+    return (int32_t)(g_ulClock / *divisor);
+}
+
+int8_t uart_open(ft900_uart_regs_t *dev, uint8_t prescaler, uint32_t divisor, uart_data_bits_t databits,
+    uart_parity_t parity, uart_stop_bits_t stop)
+{
+    (void) databits;
+    (void) parity;
+    (void) stop;
+
+    if (dev != UART1 || !divisor || !prescaler) {
+        return -1;
+    }
+    if (g_lFd < 0) {
+        struct termios tTermios;
+        if (!g_pcDevice || (g_lFd = open(g_pcDevice, O_RDWR | O_NOCTTY | O_NONBLOCK)) < 0) {
+            perror(g_pcDevice ? g_pcDevice : "uart_open");
+            exit(1);
+        }
+        tcgetattr(g_lFd, &tTermios);
+        cfmakeraw(&tTermios);
+        tcsetattr(g_lFd, TCSANOW, &tTermios);
+    }
+
+    vPortEnterCritical();
+    g_ulBaud = g_ulClock / (divisor * prescaler);
+    g_bTxPending = 0;
+    g_ullTxDone = 0;
+    uart_host_lines();
+    vPortExitCritical();
+    return 0;
+}
+
+int8_t uart_mode(ft900_uart_regs_t *dev, uart_mode_t mode)
+{
+    (void) dev;
+    g_ucMode = mode;
+    g_bAutoFlow = 0;
+    uart_host_lines();
+    return 0;
+}
+
+int8_t uart_set_flow_control(ft900_uart_regs_t *dev, uart_flow_t flow)
+{
+    (void) dev;
+    if (flow != uart_flow_none && g_ucMode < uart_mode_16650) {
+        return -1;
+    }
+    g_bAutoFlow = (flow == uart_flow_rts_cts);
+    uart_host_lines();
+    return 0;
+}
+
+int8_t uart_enable_interrupt(ft900_uart_regs_t *dev, uart_interrupt_t interrupt)
+{
+    (void) dev;
+    if (interrupt == uart_interrupt_rx) {
+        g_bRxEnabled = 1;
+        uart_host_lines();
+    }
+    else if (interrupt == uart_interrupt_tx) {
+        g_bTxEnabled = 1;
+    }
+    return 0;
+}
+
+int8_t uart_disable_interrupt(ft900_uart_regs_t *dev, uart_interrupt_t interrupt)
+{
+    (void) dev;
+    if (interrupt == uart_interrupt_rx) {
+        g_bRxEnabled = 0;
+        uart_host_lines();
+    }
+    else if (interrupt == uart_interrupt_tx) {
+        g_bTxEnabled = 0;
+    }
+    return 0;
+}
+
+int8_t uart_enable_interrupts_globally(ft900_uart_regs_t *dev)
+{
+    (void) dev;
+    if (!g_bGlobalEnabled && !g_xIsrThread && g_fxnIsr && g_lFd >= 0) {
+        pthread_create(&g_xIsrThread, NULL, uart_host_isr, NULL);
+    }
+    g_bGlobalEnabled = 1;
+    uart_host_lines();
+    return 0;
+}
+
+int8_t uart_disable_interrupts_globally(ft900_uart_regs_t *dev)
+{
+    (void) dev;
+    g_bGlobalEnabled = 0;
+    uart_host_lines();
+    return 0;
+}
+
+// Receive data first, like the priorities of the 16550
+uint8_t uart_get_interrupt(ft900_uart_regs_t *dev)
+{
+    (void) dev;
+    g_ucInterrupt = uart_interrupt_none;
+    if (g_bRxEnabled && uart_host_readable()) {
+        g_ulRxLeft = (g_ucMode >= uart_mode_16650) ? UART_HOST_FIFO_16950 : UART_HOST_FIFO_16550;
+        g_ucInterrupt = uart_interrupt_rx;
+    }
+    else if (g_bTxPending && host_time_us() >= g_ullTxDone) {
+        g_bTxPending = 0;
+        if (g_bTxEnabled) {
+            g_ucInterrupt = uart_interrupt_tx;
+        }
+    }
+    return g_ucInterrupt;
+}
+
+size_t uart_read_fifo(ft900_uart_regs_t *dev, uint8_t *buffer, size_t len)
+{
+    ssize_t lRet;
+
+    (void) dev;
+    if (len > g_ulRxLeft) {
+        len = g_ulRxLeft;
+    }
+    if (!len) {
+        return 0;
+    }
+    lRet = read(g_lFd, buffer, len);
+    if (lRet <= 0) {
+        return 0;
+    }
+    g_ulRxLeft -= lRet;
+    return (size_t)lRet;
+}
+
+// Nothing is written while the transmitter is busy with the previous FIFO
+size_t uart_write_fifo(ft900_uart_regs_t *dev, uint8_t *buffer, size_t len)
+{
+    uint64_t ullNow = host_time_us();
+    size_t ulFifo = (g_ucMode >= uart_mode_16650) ? UART_HOST_FIFO_16950 : UART_HOST_FIFO_16550;
+    TEsp32EmuLines* pLines;
+    uint64_t ullLine;
+    ssize_t lRet;
+
+    (void) dev;
+    if (g_bTxPending || g_ullTxDone > ullNow) {
+        return 0;
+    }
+    if (len > ulFifo) {
+        len = ulFifo;
+    }
+    lRet = write(g_lFd, buffer, len);
+    if (lRet <= 0) {
+        // The module is not reading: try again after a byte time
+        lRet = 0;
+    }
+    ullLine = ((uint64_t)(lRet ? lRet : 1) * 10 * 1000000 + g_ulBaud - 1) / g_ulBaud;
+    g_ullTxDone = ullNow + ullLine;
+    g_bTxPending = 1;
+    if (lRet && (pLines = esp32_emu_lines())) {
+        // The write is immediate on the terminal, the module waits until the last bit is on the line
+        struct timespec tNow;
+        clock_gettime(CLOCK_MONOTONIC, &tNow);
+        pLines->m_ullHostTxDone = (uint64_t)tNow.tv_sec * 1000000 + tNow.tv_nsec / 1000 + ullLine;
+    }
+    return (size_t)lRet;
+}
+
+int8_t uart_rts(ft900_uart_regs_t *dev, int active)
+{
+    (void) dev;
+    g_bRts = active ? 1 : 0;
+    uart_host_lines();
+    return 0;
+}
+
+int8_t uart_dtr(ft900_uart_regs_t *dev, int active)
+{
+    (void) dev;
+    (void) active;
+    return 0;
+}
+
+// The module never holds off the FT900
+int8_t uart_cts(ft900_uart_regs_t *dev)
+{
+    (void) dev;
+    return 1;
+}
+
+int8_t uart_dsr(ft900_uart_regs_t *dev)
+{
+    (void) dev;
+    return 1;
+}
@@ -0,0 +1,177 @@
+############################################################################################
+# This is the throughput bench of the RS485 serial bridge
+# Runs rs485_bridge.py in master mode and in device mode on a pair of pseudo terminals
+# joined back to back, then echoes data from a TCP client of the device to a local server
+# through the bus, for each set of polled addresses (only the device address 1 is on the bus)
+############################################################################################
+import sys
+import os
+import pty
+import tty
+import socket
+import select
+import subprocess
+import threading
+import time
+import argparse
+
+
+
+
+
+############################################################################################
+# Configurations that can be set using application parameter
+############################################################################################
+CONF_BYTES_DEFAULT                   = 262144              # --bytes, sent and echoed per run
+CONF_DEVICES_DEFAULT                 = '1;1-4;1-16'        # --devices, polled addresses of each run
+CONF_SERVER_PORT                     = 11300               # echo server (gateway side)
+CONF_LISTEN_PORT                     = 11301               # device mode TCP client (simulator side)
+CONF_CHUNK_SIZE                      = 4096
+CONF_TIMEOUT                         = 60.0
+
+
+
+############################################################################################
+# pty_pair
+# Two pseudo terminals whose master sides are copied to each other like a cable
+############################################################################################
+def pty_open():
+
+    master, slave = pty.openpty()
+    tty.setraw(slave)
+    return master, slave, os.ttyname(slave)
+
+def pty_pair():
+
+    a = pty_open()
+    b = pty_open()
+
+    def copy():
+        while True:
+            readable, writable, failed = select.select([a[0], b[0]], [], [])
+            for fd in readable:
+                try:
+                    data = os.read(fd, 65536)
+                except OSError:
+                    return
+                os.write(b[0] if fd == a[0] else a[0], data)
+
+    threading.Thread(target=copy, daemon=True).start()
+    return a[2], b[2]
+
+############################################################################################
+# echo_server
+# Gateway side: sends back all the data of each connection
+############################################################################################
+def echo_server(port):
+
+    server = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
+    server.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEADDR, 1)
+    server.bind(('127.0.0.1', port))
+    server.listen(4)
+
+    def serve(sock):
+        with sock:
+            while True:
+                data = sock.recv(CONF_CHUNK_SIZE)
+                if not data:
+                    return
+                sock.sendall(data)
+
+    def accept():
+        while True:
+            sock, peer = server.accept()
+            threading.Thread(target=serve, args=(sock,), daemon=True).start()
+
+    threading.Thread(target=accept, daemon=True).start()
+
+############################################################################################
+# bench_run
+# Returns the seconds to echo size bytes through the bus, or 0 on timeout
+############################################################################################
+def bench_run(size):
+
+    deadline = time.monotonic() + CONF_TIMEOUT
+    while True:
+        try:
+            sock = socket.create_connection(('127.0.0.1', CONF_LISTEN_PORT), timeout=1)
+            break
+        except OSError:
+            if time.monotonic() > deadline:
+                return 0
+            time.sleep(0.1)
+
+    payload = bytes(i & 0xFF for i in range(CONF_CHUNK_SIZE))
+    sent = 0
+    received = 0
+    start = time.monotonic()
+    sock.setblocking(False)
+    while received < size:
+        if time.monotonic() > deadline:
+            sock.close()
+            return 0
+        writers = [sock] if sent < size else []
+        readable, writable, failed = select.select([sock], writers, [], 0.1)
+        if writable:
+            try:
+                sent += sock.send(payload[:min(CONF_CHUNK_SIZE, size - sent)])
+            except BlockingIOError:
+                pass
+        if readable:
+            data = sock.recv(65536)
+            if not data:
+                break
+            received += len(data)
+    elapsed = time.monotonic() - start
+    sock.close()
+    return elapsed if received == size else 0
+
+
+def main(args):
+
+    bridge = os.path.join(os.path.dirname(os.path.abspath(__file__)), 'rs485_bridge.py')
+    size = int(args.bytes)
+    output = None if args.verbose else subprocess.DEVNULL
+    echo_server(CONF_SERVER_PORT)
+
+    print("{:<12} {:>10} {:>8} {:>8}".format("devices", "bytes", "seconds", "KB/s"))
+    failed = False
+    for devices in args.devices.split(';'):
+        master_port, device_port = pty_pair()
+        processes = [
+            subprocess.Popen([sys.executable, bridge, '--port', master_port, '--devices', devices,
+                '--serverport', str(CONF_SERVER_PORT)], stdout=output),
+            subprocess.Popen([sys.executable, bridge, '--mode', 'device', '--port', device_port, '--address', '1',
+                '--listenport', str(CONF_LISTEN_PORT)], stdout=output),
+        ]
+        try:
+            # let the master find the device and the absent addresses back off
+            time.sleep(float(args.settle))
+            elapsed = bench_run(size)
+        finally:
+            for process in processes:
+                process.kill()
+                process.wait()
+        if elapsed:
+            print("{:<12} {:>10} {:>8.2f} {:>8.1f}".format(devices, size, elapsed, size * 2 / elapsed / 1024))
+        else:
+            print("{:<12} {:>10} timedout".format(devices, size))
+            failed = True
+    return 1 if failed else 0
+
+
+def parse_arguments(argv):
+    parser = argparse.ArgumentParser()
+    parser.add_argument('--bytes', required=False, default=CONF_BYTES_DEFAULT,
+        help='Bytes sent by the client and echoed back by the server in each run.')
+    parser.add_argument('--devices', required=False, default=CONF_DEVICES_DEFAULT,
+        help='Polled addresses of each run, separated by ;')
+    parser.add_argument('--settle', required=False, default=1.0,
+        help='Seconds before the run, while the bridge probes the addresses.')
+    parser.add_argument('--verbose', required=False, action='store_true',
+        help='Show the output of the bridges.')
+    return parser.parse_args(argv)
+
+
+if __name__ == '__main__':
+    sys.exit(main(parse_arguments(sys.argv[1:])))
@@ -0,0 +1,545 @@
+############################################################################################
+# This is the RS485 serial bridge of the RPI Alexa Gateway
+# It connects FT900 Alexa Clients built with COMMUNICATION_IO=3 (RS485) to the gateway
+# Master mode: polls the devices on the bus and connects each of them to the gateway
+# Device mode: forwards one TCP client (ex. FT900 Alexa Simulator) over the bus like an
+#              FT900 device, so the simulator and the gateway can run over RS485
+############################################################################################
+import sys
+import socket
+import select
+import errno
+import time
+import argparse
+import serial
+
+
+
+
+
+############################################################################################
+# Configurations that can be set using application parameter
+############################################################################################
+CONF_SERIAL_PORT_DEFAULT             = '/dev/ttyUSB0'      # --port (or a pyserial URL)
+CONF_SERIAL_BAUD_DEFAULT             = 2000000             # --baud, AVS_CONFIG_RS485_BAUD
+CONF_SERVER_ADDR_DEFAULT             = '127.0.0.1'         # --serveraddr, when the device sends 0
+CONF_SERVER_PORT_DEFAULT             = 0                   # --serverport, 0 uses the port sent by the device
+CONF_DEVICES_DEFAULT                 = '1'                 # --devices, AVS_CONFIG_RS485_ADDRESS of the devices
+CONF_LISTEN_PORT_DEFAULT             = 11234               # --listenport (device mode)
+CONF_DEVICE_ADDRESS_DEFAULT          = 1                   # --address (device mode)
+
+############################################################################################
+# Bus timings
+############################################################################################
+CONF_TURN_TIMEOUT                    = 0.05   # time for a device to end its turn
+CONF_ABSENT_TURNS                    = 40     # missed turns before the connection of a device is dropped
+CONF_PROBE_INTERVAL_MIN              = 1.0    # polling interval of a device that just went absent
+CONF_PROBE_INTERVAL_MAX              = 16.0   # the interval doubles after each unanswered poll up to this
+CONF_IDLE_INTERVAL                   = 0.002  # pause after a round without data
+CONF_SOCKET_BUFFER                   = 8192   # TCP data buffered per direction and device
+
+############################################################################################
+# Link protocol (lib/rs485/rs485.c)
+############################################################################################
+RS485_FLAG                           = 0x7E
+RS485_ESCAPE                         = 0x7D
+RS485_ESCAPE_XOR                     = 0x20
+RS485_ADDRESS_DEVICE                 = 0x80
+RS485_FRAME_DATA                     = 0
+RS485_FRAME_CONNECT                  = 1
+RS485_FRAME_DISCONNECT               = 2
+RS485_FRAME_POLL                     = 3
+RS485_FRAME_FINAL                    = 0x80
+RS485_HEADER_SIZE                    = 5
+RS485_PAYLOAD_SIZE                   = 240
+RS485_WINDOW                         = 4
+
+STATE_IDLE                           = 0
+STATE_CONNECTING                     = 1
+STATE_CONNECTED                      = 2
+STATE_CLOSING                        = 3
+
+############################################################################################
+# Global variables
+############################################################################################
+g_serveraddr = CONF_SERVER_ADDR_DEFAULT
+g_serverport = CONF_SERVER_PORT_DEFAULT
+g_crctable = []
+g_errors = 0
+
+
+
+############################################################################################
+# crc16 (CRC-16/CCITT-FALSE)
+############################################################################################
+def crc16(data, crc=0xFFFF):
+
+    global g_crctable
+
+    if not g_crctable:
+        for i in range(256):
+            c = i << 8
+            for j in range(8):
+                c = ((c << 1) ^ 0x1021) if (c & 0x8000) else (c << 1)
+            g_crctable.append(c & 0xFFFF)
+
+    for b in data:
+        crc = ((crc << 8) & 0xFFFF) ^ g_crctable[(crc >> 8) ^ b]
+    return crc
+
+############################################################################################
+# frame_encode
+############################################################################################
+def frame_encode(address, type, seq, ack, credit, payload=b''):
+
+    body = bytes([address, type, seq, ack, credit]) + payload
+    crc = crc16(body)
+    body += bytes([crc >> 8, crc & 0xFF])
+    body = body.replace(b'\x7d', b'\x7d\x5d').replace(b'\x7e', b'\x7d\x5e')
+    return b'\x7e' + body + b'\x7e'
+
+############################################################################################
+# frame_decoder
+# Returns the frames with a valid CRC as (address, type, seq, ack, credit, payload)
+############################################################################################
+class frame_decoder():
+
+    def __init__(self):
+        self.buffer = b''
+
+    def feed(self, data):
+        global g_errors
+        frames = []
+        parts = (self.buffer + data).split(b'\x7e')
+        self.buffer = parts.pop()
+        for part in parts:
+            if len(part) < RS485_HEADER_SIZE + 2:
+                continue
+            body = part.replace(b'\x7d\x5e', b'\x7e').replace(b'\x7d\x5d', b'\x7d')
+            if crc16(body) != 0:
+                g_errors += 1
+                continue
+            frames.append((body[0], body[1], body[2], body[3], body[4], body[RS485_HEADER_SIZE:-2]))
+        return frames
+
+############################################################################################
+# link
+# Window of one direction pair: sent DATA frames are kept until acknowledged
+# and sent again on each turn (go-back-N)
+############################################################################################
+class link():
+
+    def __init__(self):
+        self.reset()
+
+    def reset(self):
+        self.tx_acked = 0
+        self.tx_queued = 0
+        self.tx_window = {}
+        self.tx_pending = bytearray()
+        self.tx_credit = 0
+        self.rx_expected = 0
+        self.rx_data = bytearray()
+
+    def credit(self):
+        free = CONF_SOCKET_BUFFER - len(self.rx_data)
+        return max(0, min(RS485_WINDOW, free // RS485_PAYLOAD_SIZE))
+
+    def idle(self):
+        return self.tx_acked == self.tx_queued and not self.tx_pending
+
+    # DATA frames of this turn as (seq, payload)
+    def data_frames(self):
+        while (self.tx_queued - self.tx_acked) & 0xFF < RS485_WINDOW and self.tx_pending:
+            self.tx_window[self.tx_queued] = bytes(self.tx_pending[:RS485_PAYLOAD_SIZE])
+            del self.tx_pending[:RS485_PAYLOAD_SIZE]
+            self.tx_queued = (self.tx_queued + 1) & 0xFF
+        frames = []
+        seq = self.tx_acked
+        while seq != self.tx_queued and (seq - self.tx_acked) & 0xFF < self.tx_credit:
+            frames.append((seq, self.tx_window[seq]))
+            seq = (seq + 1) & 0xFF
+        return frames
+
+    def receive(self, type, seq, ack, credit, payload):
+        if type == RS485_FRAME_DATA and seq == self.rx_expected:
+            if len(payload) <= CONF_SOCKET_BUFFER - len(self.rx_data):
+                self.rx_data += payload
+                self.rx_expected = (self.rx_expected + 1) & 0xFF
+        if (ack - self.tx_acked) & 0xFF <= (self.tx_queued - self.tx_acked) & 0xFF:
+            while self.tx_acked != ack:
+                del self.tx_window[self.tx_acked]
+                self.tx_acked = (self.tx_acked + 1) & 0xFF
+        self.tx_credit = min(credit, RS485_WINDOW)
+
+############################################################################################
+# connection
+# TCP side of a device; the link carries the data of the socket
+############################################################################################
+class connection():
+
+    def __init__(self):
+        self.state = STATE_IDLE
+        self.session = 0
+        self.sock = None
+        self.link = link()
+        self.answer_connect = False
+        self.answer_disconnect = False
+        self.closed = False
+
+    def close(self):
+        if self.sock:
+            self.sock.close()
+            self.sock = None
+
+    # exchanges data between the socket and the link; returns True if data moved
+    def pump(self):
+        moved = False
+        if self.sock is None or self.state != STATE_CONNECTED:
+            return moved
+        try:
+            while self.link.rx_data:
+                sent = self.sock.send(self.link.rx_data)
+                del self.link.rx_data[:sent]
+                moved = True
+        except (BlockingIOError, InterruptedError):
+            pass
+        except OSError:
+            self.closed = True
+        try:
+            while not self.closed and len(self.link.tx_pending) < CONF_SOCKET_BUFFER:
+                data = self.sock.recv(CONF_SOCKET_BUFFER - len(self.link.tx_pending))
+                if not data:
+                    self.closed = True
+                    break
+                self.link.tx_pending += data
+                moved = True
+        except (BlockingIOError, InterruptedError):
+            pass
+        except OSError:
+            self.closed = True
+        return moved
+
+    # frames of this turn as (type, seq, payload), ending with the poll
+    def turn(self, final):
+        frames = []
+        if self.answer_disconnect:
+            frames.append((RS485_FRAME_DISCONNECT, self.session, b''))
+            self.answer_disconnect = False
+        if self.answer_connect:
+            frames.append((RS485_FRAME_CONNECT, self.session, b''))
+            self.answer_connect = False
+        if self.state == STATE_CLOSING:
+            frames.append((RS485_FRAME_DISCONNECT, self.session, b''))
+        elif self.state == STATE_CONNECTED:
+            for seq, payload in self.link.data_frames():
+                frames.append((RS485_FRAME_DATA, seq, payload))
+        frames.append((RS485_FRAME_POLL | final, 0, b''))
+        return frames
+
+    # the socket closed after its data was delivered, or the connection failed
+    def disconnect(self):
+        self.close()
+        self.closed = False
+        self.link.reset()
+        self.state = STATE_CLOSING
+
+    def receive_disconnect(self, seq):
+        if seq != self.session:
+            return
+        if self.state != STATE_CLOSING:
+            self.answer_disconnect = True
+        self.close()
+        self.link.reset()
+        self.state = STATE_IDLE
+
+    def receive(self, type, seq, ack, credit, payload):
+        if type == RS485_FRAME_DATA or type == RS485_FRAME_POLL:
+            if self.state == STATE_CONNECTED:
+                self.link.receive(type, seq, ack, credit, payload)
+
+############################################################################################
+# device
+# Bus master side of a device
+############################################################################################
+class device(connection):
+
+    def __init__(self, address):
+        connection.__init__(self)
+        self.address = address
+        self.present = False
+        self.missed = 0
+        self.probe = 0
+        self.backoff = CONF_PROBE_INTERVAL_MIN
+
+    def connect(self, session, payload):
+        global g_serveraddr
+        global g_serverport
+
+        self.close()
+        self.link.reset()
+        self.session = session
+        addr = g_serveraddr
+        port = g_serverport
+        if len(payload) >= 6:
+            if payload[0:4] != b'\x00\x00\x00\x00':
+                addr = socket.inet_ntoa(payload[0:4])
+            if not port:
+                port = (payload[4] << 8) | payload[5]
+        print("[{}] connecting to {}:{} session {}".format(self.address, addr, port, session))
+        self.sock = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
+        self.sock.setblocking(False)
+        self.sock.setsockopt(socket.IPPROTO_TCP, socket.TCP_NODELAY, 1)
+        err = self.sock.connect_ex((addr, port))
+        if err not in (0, errno.EINPROGRESS, errno.EWOULDBLOCK):
+            print("[{}] connect failed {}".format(self.address, err))
+            self.disconnect()
+            return
+        self.state = STATE_CONNECTING
+
+    # completes the non-blocking connect
+    def check_connect(self):
+        if self.state != STATE_CONNECTING:
+            return
+        readable, writable, failed = select.select([], [self.sock], [self.sock], 0)
+        if not writable and not failed:
+            return
+        err = self.sock.getsockopt(socket.SOL_SOCKET, socket.SO_ERROR)
+        if err:
+            print("[{}] connect failed {}".format(self.address, err))
+            self.disconnect()
+            return
+        print("[{}] connected".format(self.address))
+        self.state = STATE_CONNECTED
+        self.answer_connect = True
+
+    def receive(self, type, seq, ack, credit, payload):
+        if type == RS485_FRAME_CONNECT:
+            if seq == self.session and self.state in (STATE_CONNECTING, STATE_CONNECTED):
+                # answer again, the previous answer was lost
+                self.answer_connect = (self.state == STATE_CONNECTED)
+            else:
+                self.connect(seq, payload)
+        elif type == RS485_FRAME_DISCONNECT:
+            if seq == self.session and self.state != STATE_IDLE:
+                print("[{}] disconnected by the device".format(self.address))
+            self.receive_disconnect(seq)
+        else:
+            connection.receive(self, type, seq, ack, credit, payload)
+
+    def absent(self):
+        if self.present:
+            print("[{}] not responding".format(self.address))
+        self.present = False
+        self.close()
+        self.link.reset()
+        self.state = STATE_IDLE
+
+############################################################################################
+# serial_read_frames
+# Reads the frames of one turn until the final frame of the address or the timeout
+############################################################################################
+def serial_read_frames(port, decoder, address, timeout):
+
+    frames = []
+    deadline = time.monotonic() + timeout
+    while True:
+        left = deadline - time.monotonic()
+        if left <= 0:
+            return frames, False
+        port.timeout = left
+        data = port.read(max(1, port.in_waiting))
+        for frame in decoder.feed(data):
+            if frame[0] != address:
+                continue
+            frames.append(frame)
+            if frame[1] & RS485_FRAME_FINAL:
+                return frames, True
+
+############################################################################################
+# run_master
+############################################################################################
+def run_master(port, addresses):
+
+    decoder = frame_decoder()
+    devices = [device(address) for address in addresses]
+    stats_time = time.monotonic()
+    stats_bytes = 0
+
+    print("Polling devices {} on {} at {} baud".format(addresses, port.port, port.baudrate))
+    while True:
+        now = time.monotonic()
+        active = False
+        for dev in devices:
+            if not dev.present and now < dev.probe:
+                continue
+
+            # exchange data with the gateway
+            dev.check_connect()
+            if dev.pump():
+                active = True
+            if dev.closed and dev.link.idle():
+                print("[{}] disconnected by the server".format(dev.address))
+                dev.disconnect()
+
+            # send the turn of the bridge, then give the turn to the device
+            buf = bytearray()
+            for type, seq, payload in dev.turn(RS485_FRAME_FINAL):
+                buf += frame_encode(dev.address, type, seq, dev.link.rx_expected, dev.link.credit(), payload)
+            port.write(buf)
+            stats_bytes += len(buf)
+
+            frames, final = serial_read_frames(port, decoder, dev.address | RS485_ADDRESS_DEVICE, CONF_TURN_TIMEOUT)
+            for address, type, seq, ack, credit, payload in frames:
+                dev.receive(type & ~RS485_FRAME_FINAL, seq, ack, credit, payload)
+                if type == RS485_FRAME_DATA:
+                    active = True
+                    stats_bytes += len(payload)
+            if final:
+                if not dev.present:
+                    print("[{}] present".format(dev.address))
+                dev.present = True
+                dev.missed = 0
+                dev.backoff = CONF_PROBE_INTERVAL_MIN
+            elif dev.present:
+                dev.missed += 1
+                if dev.missed >= CONF_ABSENT_TURNS:
+                    dev.absent()
+            # each poll of an absent device costs a turn timeout to the others
+            if not dev.present:
+                dev.probe = time.monotonic() + dev.backoff
+                dev.backoff = min(dev.backoff * 2, CONF_PROBE_INTERVAL_MAX)
+            if dev.pump():
+                active = True
+
+        if not active:
+            if not any(dev.present for dev in devices):
+                time.sleep(min(CONF_PROBE_INTERVAL_MAX, max(0, min(dev.probe for dev in devices) - time.monotonic())))
+            else:
+                time.sleep(CONF_IDLE_INTERVAL)
+
+        if time.monotonic() - stats_time >= 10:
+            print("bus {} bytes/s, {} errors, {} absent".format(int(stats_bytes / (time.monotonic() - stats_time)), g_errors,
+                sum(1 for dev in devices if not dev.present)))
+            stats_time = time.monotonic()
+            stats_bytes = 0
+
+############################################################################################
+# run_device
+############################################################################################
+def run_device(port, address, listenport):
+
+    decoder = frame_decoder()
+    conn = connection()
+    server = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
+    server.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEADDR, 1)
+    server.bind(('0.0.0.0', listenport))
+    server.listen(1)
+    server.setblocking(False)
+    serverport = 0
+    print("Device {} on {} at {} baud, listening on port {}".format(address, port.port, port.baudrate, listenport))
+
+    port.timeout = 0.01
+    while True:
+        # accept a client when not connected, and connect it over the bus
+        if conn.sock is None and conn.state == STATE_IDLE:
+            try:
+                sock, peer = server.accept()
+                sock.setblocking(False)
+                sock.setsockopt(socket.IPPROTO_TCP, socket.TCP_NODELAY, 1)
+                conn.sock = sock
+                conn.link.reset()
+                conn.session = (conn.session + 1) & 0xFF
+                conn.state = STATE_CONNECTING
+                print("client {} connecting session {}".format(peer, conn.session))
+            except (BlockingIOError, InterruptedError):
+                pass
+
+        conn.pump()
+        if conn.closed and conn.state == STATE_CONNECTED:
+            print("client disconnected")
+            conn.disconnect()
+
+        data = port.read(max(1, port.in_waiting))
+        for frame_address, type, seq, ack, credit, payload in decoder.feed(data):
+            if frame_address != address:
+                continue
+            final = type & RS485_FRAME_FINAL
+            type &= ~RS485_FRAME_FINAL
+            if type == RS485_FRAME_CONNECT:
+                if conn.state == STATE_CONNECTING and seq == conn.session:
+                    conn.link.reset()
+                    conn.state = STATE_CONNECTED
+                    print("connected")
+            elif type == RS485_FRAME_DISCONNECT:
+                if seq == conn.session and conn.state != STATE_IDLE:
+                    print("disconnected by the bridge")
+                conn.receive_disconnect(seq)
+            conn.receive(type, seq, ack, credit, payload)
+            if not final:
+                continue
+
+            # turn of the device
+            conn.pump()
+            frames = []
+            if conn.state == STATE_CONNECTING:
+                frames.append((RS485_FRAME_CONNECT, conn.session, bytes(4) + bytes([serverport >> 8, serverport & 0xFF])))
+            frames += conn.turn(RS485_FRAME_FINAL)
+            buf = bytearray()
+            for type, seq, payload in frames:
+                buf += frame_encode(address | RS485_ADDRESS_DEVICE, type, seq, conn.link.rx_expected, conn.link.credit(), payload)
+            port.write(buf)
+
+        # the bridge answered the DISCONNECT of the device
+        if conn.state == STATE_IDLE and conn.sock is not None and not conn.answer_disconnect:
+            conn.close()
+
+        serverport = g_serverport
+
+
+def main(args):
+
+    global g_serveraddr
+    global g_serverport
+
+    g_serveraddr = args.serveraddr
+    g_serverport = int(args.serverport)
+
+    port = serial.serial_for_url(args.port, baudrate=int(args.baud), timeout=CONF_TURN_TIMEOUT)
+    if args.mode == 'device':
+        run_device(port, int(args.address), int(args.listenport))
+        return
+
+    addresses = []
+    for item in args.devices.split(','):
+        if '-' in item:
+            first, last = item.split('-')
+            addresses += range(int(first), int(last) + 1)
+        else:
+            addresses.append(int(item))
+    run_master(port, addresses)
+
+
+def parse_arguments(argv):
+    parser = argparse.ArgumentParser()
+    parser.add_argument('--mode', required=False, default='master', choices=['master', 'device'],
+        help='master: bridge of the gateway, device: forwards a TCP client like an FT900 device.')
+    parser.add_argument('--port', required=False, default=CONF_SERIAL_PORT_DEFAULT,
+        help='Serial port or pyserial URL of the RS485 adapter.')
+    parser.add_argument('--baud', required=False, default=CONF_SERIAL_BAUD_DEFAULT,
+        help='Baud rate, same as AVS_CONFIG_RS485_BAUD.')
+    parser.add_argument('--serveraddr', required=False, default=CONF_SERVER_ADDR_DEFAULT,
+        help='Server IP address used when the device does not set one.')
+    parser.add_argument('--serverport', required=False, default=CONF_SERVER_PORT_DEFAULT,
+        help='Server port; 0 uses the port of the device (master), sent to the bridge (device).')
+    parser.add_argument('--devices', required=False, default=CONF_DEVICES_DEFAULT,
+        help='Addresses of the devices to poll, ex. 1-3,7; only the devices on the bus, as absent ones cost bus time.')
+    parser.add_argument('--address', required=False, default=CONF_DEVICE_ADDRESS_DEFAULT,
+        help='Address of the device (device mode).')
+    parser.add_argument('--listenport', required=False, default=CONF_LISTEN_PORT_DEFAULT,
+        help='Port the TCP client connects to (device mode).')
+    return parser.parse_args(argv)
+
+
+if __name__ == '__main__':
+    main(parse_arguments(sys.argv[1:]))